@@ -0,0 +1,51 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include "common.h"
+#include "grid.h"
+#include "contact.h"
+
+// Continuous collision for balls too fast for their substep. A swept ball
+// moves along its velocity to the first time it would touch another ball or
+// the border circle, bounces there and carries on with the rest of the
+// substep. After CCD_MAX_IMPACTS bounces it stops at the next impact, so it
+// cannot pass through anything however few substeps are used. Other balls
+// count as standing still at their current positions for the sweep.
+
+#define CCD_MAX_IMPACTS 4   // per ball and substep; the next one ends the ball's substep
+
+// Balls swept in the last integrateSwept, and every ball swept since
+// beginSweptStep. Those can be any distance from where the step's grid put
+// them, so they are also kept in lists per grid cell by where they are now.
+typedef struct {
+    int *balls;
+    int count;
+    int *displaced;
+    int displacedCount;
+    unsigned char *isDisplaced; // per ball
+    int *next;                  // per ball: next displaced ball in the same cell, -1 at the end
+    int *ballCell;              // per ball: the cell list it is in, -1 for none
+    int capacity;
+    int *cellHead;              // per grid cell: first displaced ball in it, -1 for none
+    int cellCapacity;
+} ccdWorkspace;
+
+void initCcdWorkspace(ccdWorkspace *w);
+
+void freeCcdWorkspace(ccdWorkspace *w);
+
+// Forgets the displaced balls; call once per step after the grid is built.
+void beginSweptStep(ccdWorkspace *w);
+
+// Moves ball i through a substep of length h. Candidates come from grid as
+// built at the start of the step, with one cell of slack for how far balls
+// that were never swept have moved since, plus work's displaced balls from
+// their cell lists. Returns the number of impacts resolved.
+int sweepBall(pointArray *a, const spatialGrid *grid, const ccdWorkspace *work, int i, float radius, float borderRadius, double restitution, double h);
+
+// integratePosition and clampToBorder for every ball, except that balls
+// faster than maxSpeed are swept (in index order, after the others moved).
+// Returns how many were swept.
+int integrateSwept(pointArray *a, const spatialGrid *grid, ccdWorkspace *work, float radius, float borderRadius, double restitution, double maxSpeed, double h);
+
+#endif // ccd.h
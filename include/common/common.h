@@ -15,8 +15,16 @@ typedef struct {
     centerPoint *points;
     int size;
     int capacity;
+    unsigned int revision; // bumped whenever points are added or moved
+    int borrowed;          // points belong to someone else (a mapped snapshot): never freed, copied on growth
 } pointArray;
 
+typedef struct spatialGrid spatialGrid;
+typedef struct contactList contactList;
+
+// Downward pull on every ball, units per second squared
+#define GRAVITY 9.81
+
 extern unsigned int VBO;
 extern float radius;
 
@@ -27,15 +35,33 @@ void freePointArray(pointArray *a);
 
 void addPoint(pointArray *a, double x, double y, double vx, double vy);
 
+// Appends count balls with one growth and one revision bump, without the
+// per-ball log lines. Returns the index of the first, or -1 on failure.
+int addPoints(pointArray *a, const centerPoint *points, int count);
+
 void circleGen(centerPoint *p, float radius, int numSegments, float *vertices);
 
 void drawHollow(centerPoint *p, float radius, int numSegments, unsigned int VBO);
 
 void verlet(centerPoint *p, double dt, int subSteps);
 
+// verlet split in two halves (semi-implicit Euler), for contact solvers that
+// correct velocities before they move anything
+void integrateVelocity(centerPoint *p, double dt);
+
+void integratePosition(centerPoint *p, double dt);
+
 int borderCollision(centerPoint *p, float radius);
 
-void collisionDetection(pointArray *a, float radius);
+// Wall for the solver modes, which solve the border as a contact: a ball
+// that still got past borderRadius (it was not near the wall when the
+// contacts were found) is put back on it and loses its outward speed.
+// Returns 1 if it had to.
+int clampToBorder(centerPoint *p, float radius, float borderRadius);
+
+// Resolves overlaps in place. Resolved pairs are appended to contacts
+// (sorted by pair) unless it is NULL.
+void collisionDetection(pointArray *a, spatialGrid *grid, contactList *contacts, float radius);
 
 void updateVertexData(pointArray *a, unsigned int VBO, float radius);
 
@@ -0,0 +1,81 @@
+#ifndef CONSTRAINT_H
+#define CONSTRAINT_H
+
+#include "common.h"
+
+// Links between balls, solved with XPBD after every substep's move: each
+// constraint corrects positions along its gradient and the correction over
+// the substep length goes into the velocities. Compliance is inverse
+// stiffness (0 is rigid); the lambdas restart every substep.
+//
+// Every kind lives in its own batch of parallel arrays. A batch is greedily
+// colored so no two constraints of one color share a ball, then reordered so
+// each color is a contiguous range that can be solved in parallel without
+// races; constraints that find no free color form a last range solved
+// serially. Coloring is redone on the first solve after an add.
+
+#define MAX_CONSTRAINT_COLORS 64
+
+typedef enum {
+    CONSTRAINT_DISTANCE,    // |p0 - p1| = rest
+    CONSTRAINT_BENDING,     // |p0 - p2| = rest, straightening the chain p0 p1 p2
+    CONSTRAINT_AREA,        // signed area of triangle p0 p1 p2 = rest
+    CONSTRAINT_PIN,         // p0 at (anchorX, anchorY)
+    CONSTRAINT_KINDS
+} constraintKind;
+
+typedef struct {
+    int *p0, *p1, *p2;      // unused ones are -1
+    double *rest;
+    double *compliance;
+    double *lambda;
+    double *anchorX, *anchorY;
+    int count;
+    int capacity;
+    int colorStart[MAX_CONSTRAINT_COLORS + 2]; // the last range is the serial spill
+    int numColors;
+} constraintBatch;
+
+typedef struct {
+    constraintBatch batches[CONSTRAINT_KINDS];
+    int iterations;         // passes over all batches per substep
+    int colored;            // cleared by the adds
+    int numBalls;           // highest ball referenced + 1, found when coloring
+    unsigned long long *usedColors; // per ball, coloring scratch
+    int usedCapacity;
+} constraintSet;
+
+void initConstraintSet(constraintSet *c);
+
+void freeConstraintSet(constraintSet *c);
+
+// The adds return the constraint's index in its batch before coloring, or -1
+// on failure. A negative rest (NAN for areas, whose sign is the winding)
+// takes the current value from a.
+int addDistanceConstraint(constraintSet *c, const pointArray *a, int i, int j, double rest, double compliance);
+
+int addBendingConstraint(constraintSet *c, const pointArray *a, int i, int j, int k, double rest, double compliance);
+
+int addAreaConstraint(constraintSet *c, const pointArray *a, int i, int j, int k, double rest, double compliance);
+
+int addPinConstraint(constraintSet *c, int i, vector2 anchor, double compliance);
+
+int constraintCount(const constraintSet *c);
+
+// Builders over balls that are already placed; all return 0 or -1.
+// A rope through balls first .. first + count - 1.
+int addRope(constraintSet *c, const pointArray *a, int first, int count, double compliance, double bendCompliance);
+
+// A sheet of cols x rows balls stored row by row from first: structural
+// links along rows and columns, bending across every two.
+int addSheet(constraintSet *c, const pointArray *a, int first, int cols, int rows, double compliance, double bendCompliance);
+
+// A blob: a closed ring of count balls from first around the ball centre,
+// with spokes to it and the area of every ring triangle kept.
+int addBlob(constraintSet *c, const pointArray *a, int centre, int first, int count, double compliance, double areaCompliance);
+
+// Projects every constraint onto the positions in a over substep h and
+// adds the corrections divided by h to the velocities.
+void solveConstraints(constraintSet *c, pointArray *a, double h);
+
+#endif // constraint.h
@@ -0,0 +1,145 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include <string.h>
+#include "common.h"
+#include "grid.h"
+
+// One touching pair found by the narrowphase. Lists are kept sorted by
+// (a, b) so consecutive steps can be matched with a linear merge walk
+// instead of a hash lookup per contact.
+typedef struct {
+    int a, b;           // point indices, a < b; b is BORDER_CONTACT for the wall
+    vector2 normal;     // unit vector from b towards a
+    double depth;       // overlap at detection time, negative if not touching yet
+    double impulse;     // normal impulse on a along normal, positive pushing apart:
+                        // the solver's accumulated impulse, or in the legacy and
+                        // fixed-point modes the one the velocity exchange applied
+    double tangentImpulse;
+    double bounce;      // target separating speed from restitution
+    int color;          // batch for the colored solver, -1 until assigned
+    int touched;        // overlapping, or pushed apart by the solver, at some point this step
+    vector2 shift;      // added to b's position: the periodic image of b that a touches
+} contact;
+
+struct contactList {
+    contact *items;
+    int count;
+    int capacity;
+};
+
+typedef enum {
+    CONTACT_BEGIN,
+    CONTACT_PERSIST,
+    CONTACT_END
+} contactEventType;
+
+typedef struct {
+    int a, b;
+    contactEventType type;
+    vector2 normal;
+    double impulse;     // the contact's impulse; zero for CONTACT_END
+} contactEvent;
+
+// Receives events in batches straight out of the preallocated buffer; the
+// pointer is only valid for the duration of the call.
+typedef void (*contactCallback)(const contactEvent *events, int count, void *userData);
+
+typedef struct {
+    contactEvent *events;
+    int count;
+    int capacity;
+    int dropped;        // events lost because the buffer was full and no callback was set
+    int reportPersist;  // piles persist thousands of contacts; set to 0 to skip them
+    contactCallback callback;
+    void *userData;
+} contactEvents;
+
+#define BORDER_CONTACT -1
+
+// Orders exactly like comparing (a, b) as ints, border contacts first
+static inline unsigned long long contactKey(int a, int b) {
+    return ((unsigned long long)(unsigned int)a << 32) | (unsigned int)(b + 1);
+}
+
+// The list helpers below serve contact and world3d's contact3d alike: both
+// records open with int a, b, and the helpers take the record size.
+
+static inline unsigned long long recordKey(const void *record) {
+    int pair[2];
+    memcpy(pair, record, sizeof(pair));
+    return contactKey(pair[0], pair[1]);
+}
+
+// Grows a list of records to hold at least count, doubling from 64. Returns
+// the new items with *capacity updated, or NULL (items untouched) on failure.
+void *growContactItems(void *items, int *capacity, int count, size_t size);
+
+// Stores record at index count of a list sorted by (a, b). Only the run
+// sharing its a can be out of order, and it is a handful long. The list
+// must have room for it.
+static inline void insertSortedContact(void *items, int count, const void *record, size_t size) {
+    char *base = (char *)items;
+    unsigned long long key = recordKey(record);
+    int pos = count;
+    while (pos > 0) {
+        unsigned long long before = recordKey(base + (pos - 1) * size);
+        if (before >> 32 != key >> 32 || before <= key) {
+            break;
+        }
+        memcpy(base + pos * size, base + (pos - 1) * size, size);
+        pos--;
+    }
+    memcpy(base + pos * size, record, size);
+}
+
+// One step of the merge walk over two lists sorted by (a, b): moves *i and
+// *j to the next pair present in both and returns 1, or returns 0 once
+// either list runs out. Step both past the match before calling again.
+static inline int nextCommonContact(const void *previous, int previousCount, const void *current, int currentCount,
+                                    size_t size, int *i, int *j) {
+    while (*i < previousCount && *j < currentCount) {
+        unsigned long long prevKey = recordKey((const char *)previous + *i * size);
+        unsigned long long curKey = recordKey((const char *)current + *j * size);
+        if (prevKey < curKey) {
+            (*i)++;
+        } else if (curKey < prevKey) {
+            (*j)++;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void initContactList(contactList *c, int capacity);
+
+void freeContactList(contactList *c);
+
+void clearContactList(contactList *c);
+
+// Appends a pair, keeping the list sorted as long as a never decreases
+// between calls (the order collisionDetection produces).
+void addContact(contactList *c, int a, int b, vector2 normal, double depth, double impulse);
+
+// Narrowphase only: appends every pair within margin of touching, plus balls
+// within margin of the border circle, sorted and with zero impulses. Does
+// not move anything. Large worlds are searched in parallel; the list is the
+// same for any thread count. On a periodic grid there is no border and
+// pairs across an edge are found through the wrapped cells, each contact
+// carrying the shift of its image.
+void findContacts(pointArray *a, spatialGrid *grid, contactList *contacts, float radius, float borderRadius, double margin);
+
+void initContactEvents(contactEvents *e, int capacity);
+
+void freeContactEvents(contactEvents *e);
+
+void setContactCallback(contactEvents *e, contactCallback callback, void *userData);
+
+// Diffs last step's contacts against this step's. Only touched contacts
+// count, so margin contacts that never close raise no events. Without a callback the events stay in e->events until
+// the next call; with one they are delivered in batches of at most
+// e->capacity and the buffer is left empty.
+void emitContactEvents(contactEvents *e, const contactList *previous, const contactList *current);
+
+#endif // contact.h
@@ -0,0 +1,78 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include "world.h"
+#include "transport.h"
+
+// One world split across ranks in vertical slabs: rank r owns the balls
+// with cuts[r] <= x < cuts[r + 1]. Each rank steps its own physicsWorld
+// with its balls first and, during the step, copies (ghosts) of the
+// neighbouring slabs' balls within halo of its edges appended after them.
+// Ghosts collide like any ball and are dropped after the step; each side
+// of a pair across a cut solves it on its own copy. Balls that crossed a
+// cut move to their new owner at the start of the next step, hopping one
+// slab per round until all have arrived. Since gravity piles the balls at
+// the bottom of the circle, the cuts are moved every so often to the
+// quantiles of the balls' x coordinates once the largest slab holds too
+// many more than the mean. Free balls only: bodies, constraints, the
+// fluid, long-range forces and periodic boxes are per rank.
+
+#define DOMAIN_BINS 4096
+
+typedef struct {
+    long long id;           // stable across migrations
+    centerPoint point;
+} domainBall;
+
+typedef struct {
+    int migrated;           // balls this rank sent away in the last step
+    int ghosts;             // ghosts it held
+    int rounds;             // migration rounds until every ball had arrived
+    double imbalance;       // largest slab over the mean, at the last check
+    int rebalanced;         // cuts moved in the last step
+} domainStats;
+
+typedef struct {
+    transport *net;
+    physicsWorld *world;    // owned balls first; ghosts after them during a step
+    double *cuts;           // net->size + 1 slab edges, the same on every rank
+    long long *ids;         // per local ball, ghosts included
+    int idCapacity;
+    int owned;
+    double halo;            // ghost reach past each cut
+    int rebalanceInterval;  // steps between load checks, 0 for never
+    double rebalanceThreshold; // largest slab over the mean that triggers a move
+    domainBall *outLeft, *outRight; // packing buffers
+    int outLeftCapacity, outRightCapacity;
+    void *in;               // receive buffer
+    unsigned long long inCapacity;
+    centerPoint *unpacked;  // received balls without their ids, for addPoints
+    int unpackedCapacity;
+    int *remap;             // old to new local index during migration
+    int remapCapacity;
+    domainStats stats;
+} domain;
+
+// Equal-width slabs over the border; the world must be empty and in a
+// substepped solver mode. Returns 0, or -1 on allocation failure.
+int initDomain(domain *d, transport *net, physicsWorld *w);
+
+void freeDomain(domain *d);
+
+// Every rank passes the same balls; each keeps the ones in its slab, with
+// ids first .. first + count. Returns 0, or -1 on failure.
+int scatterToDomain(domain *d, const centerPoint *balls, int count, long long first);
+
+// Migration, halo exchange, stepWorld and the ghosts dropped again. Every
+// rank must call it with the same arguments. Returns 0, or -1 if the
+// transport failed.
+int stepDomain(domain *d, double dt, int subSteps);
+
+// Sum of every rank's owned balls, known to all ranks.
+long long domainBallCount(domain *d);
+
+// Collects every ball on rank 0 into out (count of them, indexed by id);
+// other ranks pass out NULL. Returns 0, or -1 on failure.
+int gatherDomain(domain *d, centerPoint *out, long long count);
+
+#endif // domain.h
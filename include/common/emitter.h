@@ -0,0 +1,57 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include "common.h"
+#include "sph.h"
+
+// Spawners that add balls at a steady rate. A step's new balls from every
+// emitter are generated into one buffer and appended with addPoints, so a
+// burst of thousands costs one growth instead of thousands of addPoint
+// calls. Each emitter draws from its own seeded stream, so a run replays
+// exactly.
+
+typedef enum {
+    EMITTER_POINT,  // at position
+    EMITTER_LINE,   // uniform along position .. position + extent
+    EMITTER_DISC    // uniform over the disc of radius extent.x around position
+} emitterShape;
+
+typedef struct {
+    emitterShape shape;
+    vector2 position;
+    vector2 extent;
+    double rate;            // balls per second
+    vector2 velocity;       // mean launch velocity
+    double speedSpread;     // launch speed uniform within +- this
+    double angleSpread;     // launch direction uniform within +- this, radians
+    int remaining;          // balls left to emit, < 0 for no limit
+    int fluid;              // emitted balls are marked fluid
+    double owed;            // fraction of a ball carried to the next step
+    unsigned long long state;
+} emitter;
+
+typedef struct {
+    emitter *emitters;
+    int count;
+    int capacity;
+    centerPoint *scratch;   // the step's new balls
+    int scratchCapacity;
+    unsigned char *fluid;   // whether each scratch ball is fluid
+} emitterSet;
+
+void initEmitterSet(emitterSet *s);
+
+void freeEmitterSet(emitterSet *s);
+
+// Copies e, seeding its stream. Returns the emitter's index, or -1 on
+// allocation failure.
+int addEmitter(emitterSet *s, const emitter *e, unsigned long long seed);
+
+void removeEmitter(emitterSet *s, int index);
+
+// Emits dt worth of balls into a, marking fluid ones in f (which may be
+// NULL). Returns the index of the first new ball, or -1 on failure or if
+// nothing was emitted.
+int runEmitters(emitterSet *s, pointArray *a, sphSet *f, double dt);
+
+#endif // emitter.h
@@ -0,0 +1,68 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include "common.h"
+
+// Force fields added to gravity() at runtime: a uniform pull, radial
+// attractors and repulsors, vortices, drag and vector fields sampled on a
+// grid. Balls are copied into blocks of positions and velocities and every
+// field runs one loop over the block, so the per-ball work has no branches
+// and vectorizes; the only dispatch is per field and block.
+
+#define FIELD_BLOCK 64
+
+typedef enum {
+    FIELD_UNIFORM,  // acceleration everywhere
+    FIELD_RADIAL,   // strength / distance^2 towards centre; negative repels
+    FIELD_VORTEX,   // strength / distance around centre, counter-clockwise when positive
+    FIELD_DRAG,     // -(linear + quadratic * speed) * velocity
+    FIELD_GRID      // bilinear samples, clamped at the edges
+} forceFieldKind;
+
+typedef struct {
+    forceFieldKind kind;
+    vector2 vector;         // uniform: the acceleration; radial, vortex: the centre
+    double strength;        // radial, vortex; drag: the linear rate
+    double softening;       // radial, vortex: keeps the centre finite; drag: the quadratic rate
+    double range;           // radial, vortex: no effect past this distance, 0 for none
+    double minX, minY;      // grid: where the samples start
+    double cellSize;
+    int cols, rows;
+    float *samplesX, *samplesY; // grid: cols * rows accelerations, row after row
+} forceField;
+
+typedef struct {
+    forceField *fields;
+    int count;
+    int capacity;
+} forceFieldSet;
+
+void initForceFieldSet(forceFieldSet *s);
+
+void freeForceFieldSet(forceFieldSet *s);
+
+// Builders append one field and return its index, or -1 on allocation
+// failure. Fields can be changed in place between steps.
+int addUniformField(forceFieldSet *s, double ax, double ay);
+
+int addRadialField(forceFieldSet *s, double cx, double cy, double strength, double softening, double range);
+
+int addVortexField(forceFieldSet *s, double cx, double cy, double strength, double softening, double range);
+
+int addDragField(forceFieldSet *s, double linear, double quadratic);
+
+// Copies cols * rows samples (x and y components) spaced cellSize apart.
+int addGridField(forceFieldSet *s, double minX, double minY, double cellSize, int cols, int rows,
+                 const float *samplesX, const float *samplesY);
+
+// Later fields move down one index.
+void removeForceField(forceFieldSet *s, int field);
+
+// Adds every field's acceleration at count balls to ax, ay.
+void evaluateForceFields(const forceFieldSet *s, const double *x, const double *y, const double *vx, const double *vy,
+                         int count, double *ax, double *ay);
+
+// Kicks every ball's velocity by h times the fields at its state.
+void applyForceFields(const forceFieldSet *s, pointArray *a, double h);
+
+#endif // field.h
@@ -0,0 +1,104 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "common.h"
+#include "grid.h"
+#include "contact.h"
+
+// Integer backend for lockstep runs. Positions and velocities are Q8.24
+// (range +-128, resolution 6e-8); products go through 64 bits and square
+// roots are exact integer floors, so every build on every platform computes
+// exactly the same bits. Compile with -DPHYSICS_FIXED_POINT to make stepWorld use
+// it. The fixed state is then authoritative and the doubles in the point
+// array are only a copy for rendering, queries and events, until something
+// else changes the array (a domain migrating, a drag): the next import then
+// reloads it whole. Doubles exported from Q8.24 convert back exactly, so
+// that costs nothing in determinism.
+//
+// Shifts only ever apply to non-negative values (or go through
+// fixedShiftDown), since C leaves shifting negative ones undefined (<<) or
+// implementation-defined (>>).
+
+typedef int32_t fixed;
+
+#define FIXED_SHIFT 24
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+// Structure of arrays, so the integration loops vectorize
+typedef struct {
+    fixed *x, *y;
+    fixed *vx, *vy;
+    int count;
+    int capacity;
+    unsigned int revision; // of the point array as exportFixedPoints left it
+    fixed radius;
+    fixed borderRadius;
+    fixed gravity;
+    fixed slop;
+    fixed damping;      // velocity kept after a ball-ball collision
+} fixedState;
+
+// Exact for doubles on the Q8.24 grid; everything else rounds to nearest.
+static inline fixed fixedFromDouble(double v) {
+    return (fixed)floor(v * FIXED_ONE + 0.5);
+}
+
+static inline double fixedToDouble(fixed v) {
+    return v / (double)FIXED_ONE;
+}
+
+// v / 2^FIXED_SHIFT rounded towards minus infinity, what an arithmetic
+// right shift gives, spelled out so negative v does not depend on the compiler
+static inline int64_t fixedShiftDown(int64_t v) {
+    return v >= 0 ? v >> FIXED_SHIFT : -((-v - 1) >> FIXED_SHIFT) - 1;
+}
+
+static inline fixed fixedMul(fixed a, fixed b) {
+    return (fixed)fixedShiftDown((int64_t)a * b);
+}
+
+static inline fixed fixedDiv(fixed a, fixed b) {
+    return (fixed)((int64_t)a * FIXED_ONE / b);
+}
+
+// Floor of the square root of a 64-bit integer.
+uint64_t isqrt64(uint64_t v);
+
+static inline fixed fixedSqrt(fixed a) {
+    return a > 0 ? (fixed)isqrt64((uint64_t)a << FIXED_SHIFT) : 0;
+}
+
+// The integer backend steps plain balls only. Whatever else would change the
+// simulation calls this first and fails when it returns 1, so a fixed-point
+// build refuses it instead of silently leaving it out.
+static inline int fixedPointRefuses(const char *feature) {
+#ifdef PHYSICS_FIXED_POINT
+    fprintf(stderr, "%s: not supported by the fixed-point backend\n", feature);
+    return 1;
+#else
+    (void)feature;
+    return 0;
+#endif
+}
+
+void initFixedState(fixedState *f, float radius, float borderRadius);
+
+void freeFixedState(fixedState *f);
+
+// Converts the points the fixed state does not have yet: only new spawns
+// while the array is as the last export left it, otherwise all of them.
+void importFixedPoints(fixedState *f, const pointArray *a);
+
+void exportFixedPoints(fixedState *f, pointArray *a);
+
+// The legacy step in integers: integration and border every substep, then
+// one damped collision pass. grid only lends its storage and is left marked
+// as not built; resolved pairs are appended to contacts unless it is NULL.
+void stepFixed(fixedState *f, spatialGrid *grid, contactList *contacts, double dt, int subSteps);
+
+unsigned long long hashFixedState(const fixedState *f);
+
+#endif // fixed.h
@@ -0,0 +1,50 @@
+#ifndef FMM_H
+#define FMM_H
+
+#include <complex.h>
+#include "common.h"
+
+// 2D fast multipole method for the long-range kernel of longrange.h. Points
+// are complex numbers z and the field of unit masses is the derivative of
+// the log potential sum_j log(z - z_j), so
+//
+//   a_i = -strength * conj(sum_j 1 / (z_i - z_j))
+//
+// A uniform quadtree, deep enough for at most boxSize balls per leaf box on
+// average, carries truncated multipole expansions up the levels and local
+// (Taylor) expansions down them, every box of a level in parallel. Leaves
+// sum their own and their eight neighbours' balls directly, softened;
+// well-separated boxes use the plain kernel, so softening should stay well
+// below the leaf box size.
+
+#define FMM_MAX_ORDER 40
+
+// Balls sorted along the Morton curve: 16 bits per axis, interleaved.
+typedef struct {
+    const unsigned int *codes;
+    const int *order;       // original index of each sorted ball
+    const double *x, *y;
+    int count;
+    double minX, minY;      // where the code grid starts
+    double scale;           // grid cells per unit length
+} mortonSet;
+
+typedef struct {
+    double complex *multipoles;  // order + 1 per box, level after level
+    double complex *locals;
+    int boxCapacity;
+    int *leafStart;              // first sorted ball of each leaf box, and the end
+    int leafCapacity;
+    int levels;                  // depth of the leaves
+} fmmWorkspace;
+
+void initFmmWorkspace(fmmWorkspace *f);
+
+void freeFmmWorkspace(fmmWorkspace *f);
+
+// Writes every ball's acceleration to out (indexed like the point array)
+// using expansions of order terms. Returns 0, or -1 on allocation failure.
+int evaluateFmm(fmmWorkspace *f, const mortonSet *m, int order, int boxSize, double strength, double softening,
+                vector2 *out);
+
+#endif // fmm.h
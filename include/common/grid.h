@@ -0,0 +1,74 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "common.h"
+
+// Uniform grid broadphase over a fixed rectangle. Points are bucketed by a
+// counting sort so every cell is a contiguous run of point indices, in
+// ascending index order. Points outside the rectangle are clamped into the
+// edge cells, which keeps every query correct (just slower out there).
+// A periodic grid tiles the plane with its rectangle: the cells past one
+// edge are those along the opposite edge, seen shifted by the period.
+// world3d buckets spheres into the same grid with a third axis of layers;
+// every 2D grid has a single layer.
+struct spatialGrid {
+    double minX, minY, minZ;
+    double cellSize;
+    int cols, rows, layers;
+    int *cellStart;        // cols * rows * layers + 1 offsets into cellPoints
+    int *cellPoints;       // point indices grouped by cell
+    int *pointCell;        // cell of every point at build time
+    int pointCapacity;
+    unsigned int revision; // pointArray revision the grid was built from
+    int built;
+    const int *pointGroup; // optional, per point: points sharing a group >= 0 never collide
+    int groupCount;        // points covered by pointGroup; the rest have no group
+    int periodic;          // cells wrap around; the period is cols (rows) cells
+};
+
+void initGrid(spatialGrid *g, double minX, double minY, double maxX, double maxY, double cellSize);
+
+// Periodic grid over the rectangle: cells grow a little so a whole number
+// of them spans each side. Returns 0, or -1 if a side would have fewer
+// than three cells (a pair could then be found through two images).
+int initPeriodicGrid(spatialGrid *g, double minX, double minY, double maxX, double maxY, double cellSize);
+
+// Cube of side cells over [min, max] on all three axes, for world3d.
+void initGrid3d(spatialGrid *g, double min, double max, double cellSize);
+
+void freeGrid(spatialGrid *g);
+
+void buildGrid(spatialGrid *g, const pointArray *a);
+
+// The two halves of buildGrid, for builders that compute cells their own way
+// (fixed-point positions, a third axis): reserve room for count points, fill
+// pointCell[0..count-1], then sort. Reserving returns 0 on allocation failure.
+int reserveGridPoints(spatialGrid *g, int count);
+
+void sortGridPoints(spatialGrid *g, int count);
+
+// Rebuilds only if the points changed since the last build.
+void ensureGrid(spatialGrid *g, const pointArray *a);
+
+// The same-body filter the narrowphases apply to every pair
+static inline int gridSameGroup(const spatialGrid *g, int i, int j) {
+    return g->pointGroup != NULL && i < g->groupCount && j < g->groupCount
+        && g->pointGroup[i] >= 0 && g->pointGroup[i] == g->pointGroup[j];
+}
+
+static inline int gridClampCol(const spatialGrid *g, double x) {
+    int c = (int)((x - g->minX) / g->cellSize);
+    return c < 0 ? 0 : (c >= g->cols ? g->cols - 1 : c);
+}
+
+static inline int gridClampRow(const spatialGrid *g, double y) {
+    int r = (int)((y - g->minY) / g->cellSize);
+    return r < 0 ? 0 : (r >= g->rows ? g->rows - 1 : r);
+}
+
+static inline int gridClampLayer(const spatialGrid *g, double z) {
+    int l = (int)((z - g->minZ) / g->cellSize);
+    return l < 0 ? 0 : (l >= g->layers ? g->layers - 1 : l);
+}
+
+#endif // grid.h
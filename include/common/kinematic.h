@@ -0,0 +1,84 @@
+#ifndef KINEMATIC_H
+#define KINEMATIC_H
+
+#include "common.h"
+#include "grid.h"
+
+// Kinematic colliders: capsules (paddles, pistons, mixer blades) that move
+// along a given path and push balls without being pushed back. Each step a
+// body goes from its last pose to its target, linearly in position and
+// angle; balls it touches are moved out and take on the body's surface
+// velocity along the contact normal.
+//
+// Once per step, every body's swept bounds are looked up in the ball grid
+// and the candidate pairs are grouped by ball, so the per-substep pass runs
+// over balls in parallel and a ball touched by several bodies handles them
+// in body order.
+
+typedef enum {
+    KINEMATIC_MANUAL,       // target set with setKinematicTarget
+    KINEMATIC_SPIN,         // turns about origin at spin rad/s
+    KINEMATIC_OSCILLATE     // origin + amplitude * sin(frequency * 2 pi t + phase)
+} kinematicScript;
+
+typedef struct {
+    vector2 a, b;           // capsule ends in the body frame
+    double thickness;       // capsule radius
+    kinematicScript script;
+    vector2 origin;
+    vector2 amplitude;
+    double spin;
+    double frequency;
+    double phase;
+    vector2 position;       // pose at the start of the step
+    double angle;
+    vector2 target;         // pose at the end of the step
+    double targetAngle;
+    vector2 velocity;       // over the current step
+    double angularVelocity;
+} kinematicBody;
+
+typedef struct {
+    kinematicBody *bodies;
+    int count;
+    int capacity;
+    double time;            // scripts are evaluated at the end of each step
+    double stepLength;
+    vector2 *worldA, *worldB; // capsule ends at the pose of the last collideKinematic
+    // Candidate pairs of the current step, grouped by ball
+    int *ballStart;         // numPoints + 1 offsets into pairBodies
+    int *pairBodies;
+    int *pairBalls;         // body-major while gathering
+    int *bodyStart;
+    int *activeBalls;       // balls with at least one pair
+    int activeCount;
+    int numPoints;
+    int pointCapacity;
+    int pairCount;
+    int pairCapacity;
+} kinematicSet;
+
+void initKinematicSet(kinematicSet *k);
+
+void freeKinematicSet(kinematicSet *k);
+
+// Adds a capsule from a to b (body frame) at the given pose and returns its
+// index, or -1 on allocation failure.
+int addKinematicBody(kinematicSet *k, vector2 a, vector2 b, double thickness, vector2 position, double angle);
+
+// Pose the body should reach by the end of the next step.
+void setKinematicTarget(kinematicSet *k, int body, vector2 position, double angle);
+
+// Runs the scripts for a step of length dt, derives velocities and gathers
+// the balls each body can reach (the grid must be current). reach is how far
+// a ball's centre may be from a capsule surface and still count.
+void beginKinematicStep(kinematicSet *k, spatialGrid *grid, const pointArray *a, double dt, double reach);
+
+// Resolves the balls (all candidates if balls is NULL) against the bodies at
+// fraction t of the step. Returns the number of pushes.
+int collideKinematic(kinematicSet *k, pointArray *a, const int *balls, int count, double t, float radius, double restitution);
+
+// The targets become the start poses of the next step.
+void endKinematicStep(kinematicSet *k);
+
+#endif // kinematic.h
@@ -0,0 +1,83 @@
+#ifndef LONGRANGE_H
+#define LONGRANGE_H
+
+#include "common.h"
+#include "fmm.h"
+
+// Pairwise long-range forces between all balls, on top of (or instead of)
+// the constant gravity() pull. Every ball has unit mass (or charge) and
+// feels the softened 2D Laplace field of all the others,
+//
+//   a_i = -strength * sum_j (x_i - x_j) / (|x_i - x_j|^2 + softening^2)
+//
+// so a positive strength attracts like gravity and a negative one repels
+// like charges of one sign. Barnes-Hut sorts the balls along a Morton curve,
+// builds a quadtree over the sorted order and lets each ball treat any node
+// smaller than theta times its distance as one mass at its centre. The fast
+// multipole method (fmm.h) trades that error control for expansions of a
+// set order, which converge geometrically.
+
+typedef enum {
+    LONG_RANGE_NONE,
+    LONG_RANGE_DIRECT,      // all pairs, the O(n^2) reference
+    LONG_RANGE_BARNES_HUT,
+    LONG_RANGE_FMM
+} longRangeMode;
+
+typedef struct {
+    longRangeMode mode;
+    double strength;
+    double softening;
+    double theta;           // opening angle: 0 is exact, larger is faster and rougher
+    int leafSize;           // balls a node may hold before it is split
+    int order;              // FMM expansion terms, up to FMM_MAX_ORDER
+    int boxSize;            // FMM leaf boxes hold at most this many balls on average
+    int uniformGravity;     // keep gravity()'s constant pull as well
+} longRangeSettings;
+
+typedef struct {
+    double comX, comY;      // centre of mass
+    double mass;
+    double minX, minY, maxX, maxY;  // bounding box of its balls
+    double size;            // longest side of that box
+    int first, count;       // range of the Morton-sorted order
+    int child[4];           // -1 where empty; all -1 in a leaf
+} quadNode;
+
+typedef struct {
+    vector2 *acceleration;  // per ball, from the last computeLongRangeForces
+    unsigned int *codes;
+    int *order;             // balls in Morton order
+    unsigned int *codeScratch;
+    int *orderScratch;
+    double *sortedX, *sortedY;
+    int capacity;
+    quadNode *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    double minX, minY;      // code grid of the last sort
+    double scale;
+    fmmWorkspace fmm;
+} longRangeWorkspace;
+
+void defaultLongRangeSettings(longRangeSettings *s);
+
+void initLongRangeWorkspace(longRangeWorkspace *w);
+
+void freeLongRangeWorkspace(longRangeWorkspace *w);
+
+// Fills w->acceleration for every ball with the configured method. Returns 0,
+// or -1 on allocation failure (accelerations are then zero).
+int computeLongRangeForces(longRangeWorkspace *w, const longRangeSettings *s, const pointArray *a);
+
+// Exact acceleration of ball i, summed over every other ball.
+vector2 directForce(const longRangeSettings *s, const pointArray *a, int i);
+
+// Sorts and builds the tree; barnesHutForce then evaluates any point against
+// it. Returns 0, or -1 on allocation failure.
+int buildBarnesHut(longRangeWorkspace *w, const longRangeSettings *s, const pointArray *a);
+
+// A ball at (x, y) may be in the tree: its own term is zero.
+vector2 barnesHutForce(const longRangeWorkspace *w, const longRangeSettings *s, double x, double y);
+
+#endif // longrange.h
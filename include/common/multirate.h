@@ -0,0 +1,53 @@
+#ifndef MULTIRATE_H
+#define MULTIRATE_H
+
+#include "common.h"
+#include "contact.h"
+#include "solver.h"
+
+// Local time stepping for the iterative solver. Every ball gets a level L
+// from its own speed and takes 2^L substeps per step; balls connected
+// through contacts share the highest level among them, so both balls of a
+// contact are always solved at the same rate. The levels run interleaved on
+// the finest substep grid and all of them end together at the step
+// boundary.
+
+#define MAX_RATE_LEVELS 8   // up to 128 substeps
+
+typedef struct {
+    int *level;         // per ball, this step
+    int *previousLevel; // per ball, last step, to rescale warm-start impulses
+    int *parent;        // union-find over the contact graph
+    int *ballOrder;     // balls grouped by level
+    int levelStart[MAX_RATE_LEVELS + 1];
+    contactList levelContacts[MAX_RATE_LEVELS];
+    int numLevels;      // finest level + 1
+    int numPoints;      // balls with a valid previousLevel
+    int capacity;
+    long long ballSubSteps; // substeps summed over balls, last solve
+} multiRateWorkspace;
+
+// Called after each level moves its balls, with just those balls and the
+// fraction t of the step they have completed, for collisions with static
+// and kinematic geometry.
+typedef void (*rateBallCallback)(pointArray *a, const int *balls, int count, double t, void *userData);
+
+void initMultiRateWorkspace(multiRateWorkspace *m);
+
+void freeMultiRateWorkspace(multiRateWorkspace *m);
+
+// Picks each ball's level so it moves at most maxTravel per substep (speed
+// plus gravity over the step, as in adaptive substepping), within
+// [minSubSteps, maxSubSteps] rounded to powers of two, then promotes
+// contact-connected balls to their group's maximum. Call after findContacts.
+// Returns the substep count of the finest level.
+int assignRateLevels(multiRateWorkspace *m, const pointArray *a, const contactList *contacts, double dt, double maxTravel, int minSubSteps, int maxSubSteps);
+
+// The iterative step (integrateVelocity, solveContacts, integratePosition
+// and the border) with each level on its own substep length. Contacts must
+// be prepared; their impulses are returned in place and in order. moved may
+// be NULL.
+void solveMultiRate(multiRateWorkspace *m, pointArray *a, contactList *contacts, const solverSettings *s, float radius, float borderRadius, double dt,
+                    rateBallCallback moved, void *userData);
+
+#endif // multirate.h
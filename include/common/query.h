@@ -0,0 +1,45 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "common.h"
+#include "grid.h"
+
+// Spatial queries answered from the broadphase grid. Every query calls
+// ensureGrid first, so asking repeatedly between steps never rebuilds.
+
+typedef struct {
+    vector2 center;
+    double radius;
+} radiusQuery;
+
+typedef struct {
+    vector2 origin;
+    vector2 dir;
+    double maxDist;
+} rayQuery;
+
+// Indices of balls whose centre lies within r of center. Writes at most maxOut
+// indices and returns the total number found.
+int queryRadius(spatialGrid *g, const pointArray *a, vector2 center, double r, int *out, int maxOut);
+
+// The k balls closest to p, nearest first, with their squared distances.
+// Returns how many were found (less than k only if there are fewer balls).
+int queryNearest(spatialGrid *g, const pointArray *a, vector2 p, int k, int *outIndices, double *outDistSq);
+
+// First ball of the given radius hit by the ray, or -1. dir need not be
+// normalized; *outT is the distance along the ray to the hit.
+int queryRaycast(spatialGrid *g, const pointArray *a, vector2 origin, vector2 dir, double maxDist, float radius, double *outT);
+
+// Balls of the given radius overlapping the box [lo, hi]. Same output
+// convention as queryRadius.
+int queryAABB(spatialGrid *g, const pointArray *a, vector2 lo, vector2 hi, float radius, int *out, int maxOut);
+
+// Batched forms run the queries in parallel. Query q writes its results to
+// out + q * maxPerQuery (or + q * k) and its count to outCounts[q].
+void queryRadiusBatch(spatialGrid *g, const pointArray *a, const radiusQuery *queries, int count, int maxPerQuery, int *out, int *outCounts);
+
+void queryNearestBatch(spatialGrid *g, const pointArray *a, const vector2 *points, int count, int k, int *outIndices, double *outDistSq, int *outCounts);
+
+void queryRaycastBatch(spatialGrid *g, const pointArray *a, const rayQuery *rays, int count, float radius, int *outHits, double *outT);
+
+#endif // query.h
@@ -0,0 +1,102 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "world.h"
+
+// Everything that changes a run from outside, keyed by the step it happened
+// before, plus hashes of the state every hashInterval steps. Replaying the
+// inputs from the same starting world reproduces the run bit for bit, and
+// the hashes show where it stops doing so.
+//
+// Saved as text, one record per line, doubles printed with 17 digits so
+// they read back exactly:
+//
+//   physics-input 1
+//   world <capacity> <radius> <borderRadius> <solverMode>
+//   run <timeStep> <subSteps> <hashInterval>
+//   snapshot <path>                 optional starting state (saveSnapshot)
+//   <step> spawn <x> <y> <vx> <vy>
+//   <step> param <name> <value>
+//   <step> hash <hex>               after <step> completed steps
+//   end <steps>
+
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_PATH_MAX 260
+
+typedef enum {
+    INPUT_SPAWN,
+    INPUT_PARAMETER
+} inputType;
+
+typedef enum {
+    PARAM_TIME_STEP,
+    PARAM_SUB_STEPS,
+    PARAM_SOLVER_MODE,
+    PARAM_ITERATIONS,
+    PARAM_RESTITUTION,
+    PARAM_FRICTION,
+    PARAM_ADAPTIVE_SUB_STEPS,
+    PARAM_COUNT
+} inputParameter;
+
+typedef struct {
+    unsigned long long step;
+    inputType type;
+    inputParameter parameter;   // INPUT_PARAMETER only
+    double values[4];           // spawn: x, y, vx, vy; parameter: new value
+} inputEvent;
+
+typedef struct {
+    unsigned long long step;
+    unsigned long long hash;
+} stateHash;
+
+typedef struct {
+    // The world at step 0
+    int capacity;
+    float radius;
+    float borderRadius;
+    solverMode mode;
+    char snapshot[INPUT_LOG_PATH_MAX]; // empty unless the run started from a snapshot
+    double timeStep;
+    int subSteps;
+    int hashInterval;
+    unsigned long long steps;
+    inputEvent *events;
+    int eventCount;
+    int eventCapacity;
+    stateHash *hashes;
+    int hashCount;
+    int hashCapacity;
+} inputLog;
+
+// Hash of everything the next step depends on: the balls and the impulses
+// warm starting carries over.
+unsigned long long hashWorld(const physicsWorld *w);
+
+void initInputLog(inputLog *log, const physicsWorld *w, double timeStep, int subSteps, int hashInterval);
+
+void freeInputLog(inputLog *log);
+
+// addPoint, logged at the current step when log is not NULL.
+void spawnBall(physicsWorld *w, inputLog *log, double x, double y, double vx, double vy);
+
+// Changes a world or run parameter, logged when log is not NULL. Returns 0,
+// or -1 for the solver mode, iterations, restitution and friction in
+// fixed-point builds, which do not use them.
+int setParameter(physicsWorld *w, inputLog *log, double *timeStep, int *subSteps, inputParameter p, double value);
+
+// Call after every stepWorld of a recorded run.
+void recordStep(inputLog *log, const physicsWorld *w);
+
+// Both return 0 on success and -1 on failure, with the reason on stderr.
+int saveInputLog(const inputLog *log, const char *path);
+
+int loadInputLog(inputLog *log, const char *path);
+
+// Re-runs the log into w (which must not be initialized yet; free it after)
+// without rendering. Returns 0 if every recorded hash matched, -1 otherwise,
+// reporting the first divergence on stderr.
+int replayInputLog(const inputLog *log, physicsWorld *w);
+
+#endif // replay.h
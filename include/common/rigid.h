@@ -0,0 +1,87 @@
+#ifndef RIGID_H
+#define RIGID_H
+
+#include "common.h"
+#include "contact.h"
+#include "solver.h"
+
+// Balls glued into rigid composite bodies. The members stay ordinary balls,
+// so the narrowphases (findContacts, collisionDetection, static geometry)
+// find their contacts like any other ball's and any shape made of balls
+// collides for free. Contacts that touch a member are split off and solved
+// against the bodies instead: an impulse at a member changes its body's
+// velocity and spin (unit-mass balls), so a body pushes back with its whole
+// mass. Each substep the bodies move as one and the members are placed
+// back at their local offsets. Members of one body never collide with each
+// other; the world points its grid's pointGroup at ballBody for that.
+
+typedef struct {
+    vector2 position;       // centre of mass
+    vector2 velocity;
+    double angle;
+    double angularVelocity;
+    double inertia;         // about the centre, of the member centres
+    double inverseMass;     // 1 / count
+    double inverseInertia;  // 0 for a single ball
+    int first, count;       // members[first .. first + count)
+} rigidBody;
+
+// Per split contact, refreshed every substep.
+typedef struct {
+    vector2 armA, armB;     // from each side's body centre to its member; zero for free balls
+    double normalMass;
+    double tangentMass;
+} rigidContactPoint;
+
+// Position corrections to a body during a solve, applied at the end.
+typedef struct {
+    vector2 shift;
+    double turn;
+} rigidPush;
+
+typedef struct {
+    rigidBody *bodies;
+    rigidPush *pushes;      // per body
+    int count;
+    int capacity;
+    int *members;           // ball indices, body after body
+    vector2 *offsets;       // member positions in body space
+    int memberCount;
+    int memberCapacity;
+    int *ballBody;          // per ball, -1 if free
+    int *ballSlot;          // per ball, its index into members and offsets
+    int numBalls;           // entries of ballBody and ballSlot
+    int ballCapacity;
+    contactList contacts;   // the split-off contacts, in list order
+    contactList scratch;
+    rigidContactPoint *points;
+    int pointCapacity;
+} rigidSet;
+
+void initRigidSet(rigidSet *r);
+
+void freeRigidSet(rigidSet *r);
+
+// Glues balls[0 .. count) as they are now, taking the body's velocity and
+// spin from their momentum. Returns the body's index, or -1 if a ball does
+// not exist or is already in a body.
+int addRigidBody(rigidSet *r, const pointArray *a, const int *balls, int count);
+
+// Moves the contacts with a member into r->contacts, keeping the rest of
+// the list in order. Call after prepareContacts.
+void splitRigidContacts(rigidSet *r, contactList *contacts);
+
+// After the ball solver each substep: takes the bodies' momentum from their
+// members, solves the split contacts against bodies and free balls with the
+// same settings, and places the members at the corrected poses.
+void solveRigidContacts(rigidSet *r, pointArray *a, const solverSettings *s, float radius, float borderRadius, double h);
+
+// Puts the split contacts back, so the list is whole and sorted again.
+void mergeRigidContacts(rigidSet *r, contactList *contacts);
+
+// Once the balls have moved: collects the members' momentum and the pose
+// that best matches where they went into their bodies, and places the
+// members there.
+void stepRigidBodies(rigidSet *r, pointArray *a, double h);
+
+#endif // rigid.h
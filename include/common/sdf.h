@@ -0,0 +1,96 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include "common.h"
+
+// Static boundaries as signed distance fields: negative inside solid,
+// positive in free space. A field is a postfix program of primitives and
+// CSG operators, e.g. a box with a round hole in it
+//
+//   sdfBox(p, 0, 0, 0.3, 0.1); sdfCircle(p, 0, 0, 0.05); sdfCombine(p, SDF_SUBTRACT);
+//
+// Programs are evaluated an instruction at a time over blocks of balls, so
+// the inner loops run across balls and vectorize. For level geometry with
+// many primitives, bake the program into an sdfGrid once; sampling it is a
+// bilinear lookup per ball whatever the program was.
+
+#define SDF_MAX_STACK 16
+#define SDF_BLOCK 64
+
+typedef enum {
+    SDF_CIRCLE,     // centre, radius
+    SDF_BOX,        // centre, half extents
+    SDF_CAPSULE,    // two end points, radius
+    SDF_POLYGON,    // vertices[first .. first + count), either winding
+    SDF_UNION,      // pops b, a; pushes a or b
+    SDF_INTERSECT,  // a and b
+    SDF_SUBTRACT,   // a without b
+    SDF_INVERT      // pops a; solid becomes free space, e.g. a container
+} sdfOp;
+
+typedef struct {
+    sdfOp op;
+    double params[5];
+    int first, count;
+} sdfInstruction;
+
+typedef struct {
+    sdfInstruction *code;
+    int count;
+    int capacity;
+    vector2 *vertices;
+    int vertexCount;
+    int vertexCapacity;
+    int depth;          // stack depth after the last instruction; 1 when complete
+} sdfProgram;
+
+// Distances sampled at cell corners over a rectangle.
+typedef struct {
+    double minX, minY;
+    double cellSize;
+    int cols, rows;     // samples per row and column
+    float *values;
+} sdfGrid;
+
+void initSdfProgram(sdfProgram *p);
+
+void freeSdfProgram(sdfProgram *p);
+
+// Builders append one instruction and return 0, or -1 (with the reason on
+// stderr) if it would overflow or underflow the stack.
+int sdfCircle(sdfProgram *p, double cx, double cy, double r);
+
+int sdfBox(sdfProgram *p, double cx, double cy, double halfWidth, double halfHeight);
+
+int sdfCapsule(sdfProgram *p, double ax, double ay, double bx, double by, double r);
+
+int sdfPolygon(sdfProgram *p, const vector2 *vertices, int count);
+
+int sdfCombine(sdfProgram *p, sdfOp op);
+
+// An incomplete program (depth other than 1) is free space everywhere.
+double evaluateSdf(const sdfProgram *p, vector2 point);
+
+// out[i] = distance at (x[i], y[i]).
+void evaluateSdfBatch(const sdfProgram *p, const double *x, const double *y, int count, double *out);
+
+void initSdfGrid(sdfGrid *g);
+
+void freeSdfGrid(sdfGrid *g);
+
+// Samples the program over [minX, maxX] x [minY, maxY]. Returns 0 or -1.
+int bakeSdf(sdfGrid *g, const sdfProgram *p, double minX, double minY, double maxX, double maxY, double cellSize);
+
+// Bilinear distance, and the normalized gradient of the bilinear patch
+// (pointing into free space) if normal is not NULL. Outside the baked area
+// the nearest edge sample is used.
+double sampleSdfGrid(const sdfGrid *g, vector2 point, vector2 *normal);
+
+// Keeps balls at least radius clear of solid: overlapping ones are pushed
+// out along the normal and lose their approaching velocity, bouncing back
+// with the given restitution. Uses g if it is baked, p otherwise. balls
+// selects which balls to test (NULL for the first count). Returns how many
+// were pushed.
+int collideSdf(pointArray *a, const int *balls, int count, const sdfProgram *p, const sdfGrid *g, float radius, double restitution);
+
+#endif // sdf.h
@@ -0,0 +1,50 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "common.h"
+
+// Static line segments (terrain, pegboards, funnels) in their own uniform
+// grid, built once when the set is first used after a change. Each cell
+// lists every segment that comes within pad of it, so a ball of radius up
+// to pad only has to look in the one cell its centre is in, however many
+// segments the set has.
+
+typedef struct {
+    vector2 a, b;
+} segment;
+
+typedef struct {
+    segment *segments;
+    int count;
+    int capacity;
+    double minX, minY;
+    double cellSize;
+    double pad;
+    int cols, rows;
+    int *cellStart;     // cols * rows + 1 offsets into cellSegments
+    int *cellSegments;
+    int cellSegmentCount;
+    int built;          // cleared by addSegment
+} segmentSet;
+
+void initSegmentSet(segmentSet *s);
+
+void freeSegmentSet(segmentSet *s);
+
+// Both return 0, or -1 on allocation failure.
+int addSegment(segmentSet *s, vector2 a, vector2 b);
+
+// count - 1 segments through the points, plus one back to the start if closed.
+int addPolyline(segmentSet *s, const vector2 *points, int count, int closed);
+
+// Buckets the segments over [minX, maxX] x [minY, maxY]. Balls outside it
+// use the nearest edge cell. Returns 0 or -1.
+int buildSegmentGrid(segmentSet *s, double minX, double minY, double maxX, double maxY, double cellSize, double pad);
+
+// Pushes balls (all of the first count if balls is NULL) out of segments
+// closer than radius, removing approaching velocity with the given
+// restitution. The grid must be built with pad >= radius. Returns how many
+// pushes were made.
+int collideSegments(pointArray *a, const int *balls, int count, const segmentSet *s, float radius, double restitution);
+
+#endif // segment.h
@@ -0,0 +1,92 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "world.h"
+
+// Binary checkpoint of a world. Layout (all little endian, native doubles):
+//
+//   snapshotHeader                  parameters, offsets and checksums
+//   padding to SNAPSHOT_ALIGN
+//   pointCount * centerPoint        the points array exactly as in memory
+//   padding to SNAPSHOT_ALIGN
+//   contactCount * contact          last step's contacts, for warm starting
+//
+// Because the points are stored in their in-memory layout on a page
+// boundary, mapSnapshot can hand the mapped pages straight to the world.
+//
+// Only plain balls are stored: the header holds the solver and substep
+// settings, and everything else a world can hold is left out. saveSnapshot
+// fails on a world using any of it rather than write one that restores as
+// a different simulation.
+
+#define SNAPSHOT_MAGIC "PHYSNAP"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_ALIGN 4096
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int headerSize;        // readers skip fields newer than they know
+    unsigned int pointSize;         // sizeof(centerPoint) of the writer
+    unsigned int contactSize;       // sizeof(contact) of the writer
+    unsigned long long headerChecksum; // over headerSize bytes with this field zeroed; fixed offset in every version
+    unsigned long long step;
+    double radius;
+    double borderRadius;
+    int solverMode;
+    int iterations;
+    int positionIterations;
+    int warmStart;
+    double restitution;
+    double friction;
+    double restitutionThreshold;
+    double positionCorrection;
+    double slop;
+    double contactMargin;
+    double warmStartFactor;
+    double relaxation;
+    unsigned long long pointCount;
+    unsigned long long pointOffset;
+    unsigned long long contactCount;
+    unsigned long long contactOffset;
+    unsigned long long payloadChecksum; // over points then contacts
+    int periodic;                   // version 2; older snapshots load with the border circle
+    int adaptive;                   // version 3: substepSettings; older snapshots keep initWorld's
+    int minSubSteps;
+    double maxTravel;
+    double maxOverlap;
+    int ccd;
+    double ccdThreshold;
+    double overlapSubSteps;         // the adaptive overlap feedback, see stepStats
+    double overlap;
+} snapshotHeader;
+
+// Keeps a mapped snapshot alive. The world's points live inside it until
+// the array grows (addPoint copies it out) or the world is freed.
+typedef struct {
+    void *base;
+    unsigned long long size;
+    void *fileHandle;   // Windows only
+    void *mapHandle;    // Windows only
+} snapshotMapping;
+
+unsigned long long snapshotChecksum(const void *data, unsigned long long size, unsigned long long seed);
+
+// All return 0 on success and -1 on failure, with the reason on stderr.
+
+// Fails without writing while w has rigid bodies, constraints, fluid, force
+// fields, emitters, segments, kinematic bodies, an SDF boundary (program or
+// baked), long-range forces or multi-rate substeps.
+int saveSnapshot(const physicsWorld *w, const char *path);
+
+// Reads a snapshot into w, which must not be initialized yet.
+int loadSnapshot(physicsWorld *w, const char *path);
+
+// Like loadSnapshot, but the points stay in a private copy-on-write mapping
+// of the file instead of being read. Checksumming touches every page, so it
+// is optional here. Free the world before unmapSnapshot.
+int mapSnapshot(physicsWorld *w, const char *path, int verify, snapshotMapping *m);
+
+void unmapSnapshot(snapshotMapping *m);
+
+#endif // snapshot.h
@@ -0,0 +1,125 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "common.h"
+#include "contact.h"
+
+typedef enum {
+    SOLVER_LEGACY,      // collisionDetection: one damped pass in index order
+    SOLVER_ITERATIVE,   // sequential impulses with warm starting
+    SOLVER_JACOBI,      // same impulses from a snapshot, applied in a second pass
+    SOLVER_COLORED      // Gauss-Seidel over batches of contacts that share no ball
+} solverMode;
+
+#define MAX_CONTACT_COLORS 64
+
+typedef struct {
+    solverMode mode;
+    int iterations;             // velocity iterations per substep
+    int positionIterations;     // overlap projection passes per substep
+    double restitution;
+    double friction;            // Coulomb coefficient
+    double restitutionThreshold; // approach speeds below this do not bounce
+    double positionCorrection;  // fraction of the overlap removed per pass
+    double slop;                // overlap left alone to keep contacts alive
+    double contactMargin;       // pairs this close (in radii) are solved before they touch
+    int warmStart;
+    double warmStartFactor;     // scale applied to last step's impulses
+    double relaxation;          // Jacobi only: fraction of each correction applied
+    int deterministic;          // Jacobi only: 0 adds corrections with atomics in whatever order threads get there
+} solverSettings;
+
+// Scratch for the parallel solvers. Jacobi: contacts grouped by ball (each
+// contact is listed under both of its balls) and one correction per
+// contact. Colored: contact indices bucketed by color.
+typedef struct {
+    int *adjStart;      // numPoints + 1 offsets into adjContacts
+    int *adjContacts;
+    vector2 *delta;
+    unsigned long long *usedColors; // per ball, one bit per color
+    int *colorOrder;
+    int colorStart[MAX_CONTACT_COLORS + 2];
+    int numColors;
+    int numPoints;
+    int pointCapacity;
+    int contactCapacity;
+} solverWorkspace;
+
+void defaultSolverSettings(solverSettings *s);
+
+// The contact rules every solver here applies, in 2D and in world3d alike;
+// the callers differ only in how they project velocities and apply the
+// impulses along their axes.
+
+// Unit masses: 1/2 between two balls, 1 against the immovable wall
+static inline double contactMass(int b) {
+    return b == BORDER_CONTACT ? 1.0 : 0.5;
+}
+
+// Separating speed a new contact should end with
+static inline double bounceSpeed(const solverSettings *s, double vn) {
+    return vn < -s->restitutionThreshold ? -s->restitution * vn : 0.0;
+}
+
+// Not touching yet: allow approach up to closing the gap this substep.
+// Touching: push apart at least at the restitution speed.
+static inline double contactTarget(double depth, double bounce, double h) {
+    return depth < 0.0 ? depth / h : bounce;
+}
+
+// Accumulated normal impulse after one update at normal speed vn; never pulls
+static inline double solveNormalImpulse(double impulse, double vn, double target, double effectiveMass) {
+    double jn = impulse - (vn - target) * effectiveMass;
+    return jn > 0.0 ? jn : 0.0;
+}
+
+// Friction is bounded by the cone of the accumulated normal impulse
+static inline double frictionLimit(const solverSettings *s, double impulse) {
+    return s->friction * impulse;
+}
+
+// Total separation the position pass applies to an overlap of depth; the
+// pair splits it by contactMass
+static inline double positionPush(const solverSettings *s, double depth) {
+    return depth > s->slop ? s->positionCorrection * (depth - s->slop) : 0.0;
+}
+
+// Copies accumulated impulses from matching pairs of the previous step
+// (both lists sorted by pair, matched by a merge walk).
+void warmStartContacts(contactList *current, const contactList *previous, double factor);
+
+// Once per step, before the substeps: computes restitution targets and
+// clears impulses if warm starting is off.
+void prepareContacts(pointArray *a, contactList *contacts, const solverSettings *s);
+
+// Solves the contacts found by findContacts after a substep of length h.
+// Accumulated impulses carry over between substeps and steps. All balls
+// have unit mass and the border is immovable.
+void solveContacts(pointArray *a, contactList *contacts, const solverSettings *s, float radius, float borderRadius, double h);
+
+void initSolverWorkspace(solverWorkspace *w);
+
+void freeSolverWorkspace(solverWorkspace *w);
+
+// Call once per step after findContacts; the list must not change before
+// the Jacobi solves that use it. Not needed when deterministic is off.
+void buildContactAdjacency(solverWorkspace *w, const contactList *contacts, int numPoints);
+
+// Jacobi variant of solveContacts. Every pass first computes all contact
+// corrections from the current (read-only) state, then each ball gathers its
+// own in adjacency order, so both halves run in parallel without atomics and
+// the sums do not depend on the thread count. With deterministic off the
+// corrections are instead scattered with atomic adds and no adjacency is
+// needed, which is cheaper but rounds differently from run to run.
+void solveContactsJacobi(pointArray *a, contactList *contacts, const solverSettings *s, solverWorkspace *work, float radius, float borderRadius, double h);
+
+// Colors the contact graph so no two contacts of a color share a ball.
+// Persisting contacts (color copied by warmStartContacts) keep their color
+// when they can. Call once per step after warm starting.
+void colorContacts(solverWorkspace *w, contactList *contacts, int numPoints);
+
+// Gauss-Seidel with the color batches of colorContacts run in parallel.
+// Results do not depend on the thread count.
+void solveContactsColored(pointArray *a, contactList *contacts, const solverSettings *s, solverWorkspace *work, float radius, float borderRadius, double h);
+
+#endif // solver.h
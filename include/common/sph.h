@@ -0,0 +1,78 @@
+#ifndef SPH_H
+#define SPH_H
+
+#include "common.h"
+#include "grid.h"
+
+// Smoothed-particle hydrodynamics on balls flagged as fluid. Fluid balls
+// still hit solid balls, bodies, the border and static geometry like any
+// other ball; with each other they only interact through density, pressure
+// and viscosity. A neighbour list per fluid ball is gathered from the
+// world's collision grid, reaching skin radii past the kernel, and kept
+// until some ball has moved half the skin. Each substep refreshes the
+// offsets along the lists and sums the 2D kernels (poly6 for density, spiky
+// for pressure in its symmetric form, the viscosity Laplacian) over them as
+// flat arrays. Every ball has unit mass.
+
+typedef struct {
+    double support;         // kernel radius, in ball radii
+    double restDensity;     // <= 0: that of touching balls packed hexagonally
+    double stiffness;       // pressure per unit of density excess: the squared sound speed
+    double viscosity;       // kinematic
+    double skin;            // extra list reach, in ball radii
+} sphSettings;
+
+typedef struct {
+    unsigned char *fluid;   // per ball; balls past numBalls are solid
+    int numBalls;
+    int ballCapacity;
+    int count;              // fluid balls
+    int *particles;         // their indices in grid order, as of the last build
+    int listed;             // entries of particles with neighbour lists
+    int listedCount;        // count and point array size the lists were built for
+    int listedSize;
+    vector2 *reference;     // per listed ball, its position when the lists were built
+    int particleCapacity;
+    double *density;        // per ball, fluid entries only
+    double *pressure;
+    double *thrust;         // pressure / density^2, the symmetric pressure term
+    double *inverseDensity;
+    vector2 *acceleration;  // per ball, from the last computeFluidForces
+    int *neighbourCount;    // per listed ball
+    int *neighbours;        // fluid balls within reach, the ball itself included: stride slots per listed ball
+    int stride;
+    double *dx, *dy, *r2;   // offsets along the lists, refreshed every substep
+    int neighbourCapacity;
+    int *groups;            // collision groups for the grid, see fluidGroups
+    int groupCapacity;
+    double restDensity;     // resolved from the settings on the last build
+} sphSet;
+
+void defaultSphSettings(sphSettings *s);
+
+void initSphSet(sphSet *f);
+
+void freeSphSet(sphSet *f);
+
+// Marks a ball as fluid (or solid again). Returns 0, or -1 on failure.
+int setFluid(sphSet *f, int ball, int fluid);
+
+static inline int isFluid(const sphSet *f, int ball) {
+    return ball < f->numBalls && f->fluid[ball];
+}
+
+// Collision groups that keep fluid balls from colliding with each other,
+// on top of a rigid set's ballBody (bodies 0 .. bodies - 1). Returns
+// ballBody itself while there is no fluid.
+const int *fluidGroups(sphSet *f, const int *ballBody, int numBodyBalls, int bodies, int n);
+
+// Gathers every fluid ball's neighbours from a grid built on the current
+// positions. Returns 0, or -1 on allocation failure (the fluid then feels
+// nothing).
+int buildFluidNeighbours(sphSet *f, const sphSettings *s, const pointArray *a, const spatialGrid *g, float radius);
+
+// Every substep: rebuilds the grid and the lists if they went stale, then
+// density, pressure and the fluid accelerations.
+void computeFluidForces(sphSet *f, const sphSettings *s, const pointArray *a, spatialGrid *g, float radius);
+
+#endif // sph.h
@@ -0,0 +1,129 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdio.h>
+#include "common.h"
+
+// Compressed recording of ball positions over a run. Layout:
+//
+//   trajectoryFileHeader
+//   chunks: trajectoryChunkHeader + payload, keyframeInterval frames each
+//   trajectoryIndexEntry per chunk, then trajectoryTrailer
+//
+// A frame is its step and ball count followed by every position quantized
+// to a multiple of precision. The first frame of a chunk stores the values
+// themselves, later ones the difference to the frame before, as zigzag
+// varints with runs of zeros (resting balls) collapsed to two bytes. The
+// chunk is then optionally squeezed again with LZ4 or zstd, compiled in
+// with -DHAVE_LZ4 / -DHAVE_ZSTD. Every chunk can be decoded on its own,
+// so the index gives random access.
+
+#define TRAJECTORY_MAGIC "PHYTRAJ"
+#define TRAJECTORY_VERSION 1
+
+typedef enum {
+    TRAJECTORY_DROP,        // a frame that finds the buffer full is lost
+    TRAJECTORY_DECIMATE     // and from then on only every 2nd, 4th, ... frame is offered until the writer catches up
+} trajectoryPolicy;
+
+typedef enum {
+    TRAJECTORY_CODEC_BUILTIN,
+    TRAJECTORY_CODEC_LZ4,
+    TRAJECTORY_CODEC_ZSTD
+} trajectoryCodec;
+
+typedef struct {
+    double precision;       // quantization step in world units
+    int keyframeInterval;   // frames per chunk
+    int bufferFrames;       // frames the simulation can run ahead of the writer
+    trajectoryPolicy policy;
+    trajectoryCodec codec;  // falls back to the built-in codec if not compiled in
+} trajectorySettings;
+
+typedef struct {
+    unsigned long long framesOffered;
+    unsigned long long framesRecorded;
+    unsigned long long framesDropped;   // buffer was full
+    unsigned long long framesDecimated; // skipped by TRAJECTORY_DECIMATE
+    unsigned long long bytesRaw;        // positions as doubles
+    unsigned long long bytesWritten;
+} trajectoryStats;
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int keyframeInterval;
+    double precision;
+} trajectoryFileHeader;
+
+typedef struct {
+    unsigned long long firstStep;
+    unsigned int frameCount;
+    unsigned int codec;
+    unsigned long long rawSize;
+    unsigned long long storedSize;
+} trajectoryChunkHeader;
+
+typedef struct {
+    unsigned long long firstStep;
+    unsigned long long firstFrame;
+    unsigned long long offset;  // of the chunk header
+} trajectoryIndexEntry;
+
+typedef struct {
+    unsigned long long indexOffset;
+    unsigned long long chunkCount;
+    unsigned long long frameCount;
+    char magic[8];
+} trajectoryTrailer;
+
+// Owns the background thread, so it is only handled through a pointer.
+typedef struct trajectoryWriter trajectoryWriter;
+
+typedef struct {
+    FILE *file;
+    trajectoryFileHeader header;
+    trajectoryIndexEntry *index;
+    unsigned long long chunkCount;
+    unsigned long long frameCount;
+    // Decoder state for the chunk that is loaded
+    unsigned char *raw;
+    unsigned long long rawSize;
+    unsigned long long rawCapacity;
+    unsigned long long cursor;
+    long long chunk;            // -1 when none is loaded
+    long long frame;            // index of the frame in positions, -1 before the first read
+    long long *quantized;
+    int quantizedCapacity;
+    // The current frame
+    vector2 *positions;
+    int count;
+    unsigned long long step;
+} trajectoryReader;
+
+void defaultTrajectorySettings(trajectorySettings *s);
+
+// Returns NULL (reason on stderr) if the file cannot be created.
+trajectoryWriter *openTrajectoryWriter(const char *path, const trajectorySettings *s);
+
+// Called by the simulation after a step. Only copies the positions into a
+// free buffer slot; never waits for the writer thread.
+void recordFrame(trajectoryWriter *t, const pointArray *a, unsigned long long step);
+
+void getTrajectoryStats(trajectoryWriter *t, trajectoryStats *stats);
+
+// Writes everything still buffered, the index and the trailer, and frees t.
+// Returns 0 on success or -1 if any write failed.
+int closeTrajectoryWriter(trajectoryWriter *t, trajectoryStats *stats);
+
+// Returns 0 on success or -1. A file without a trailer (the writer never
+// closed it) is indexed by walking its chunks.
+int openTrajectory(trajectoryReader *r, const char *path);
+
+// Decodes frame index into r->positions / r->count / r->step. Reading
+// forward within a chunk only decodes the new frames.
+int readTrajectoryFrame(trajectoryReader *r, unsigned long long index);
+
+void closeTrajectory(trajectoryReader *r);
+
+#endif // trajectory.h
@@ -0,0 +1,40 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+// Byte pipes between the ranks of a distributed run. Every pair of ranks
+// has an ordered, reliable channel each way; send and receive block until
+// all bytes went through. A channel only buffers so much, so two ranks
+// that both send large messages to each other before receiving can stall:
+// callers order their exchanges (see domain.c).
+
+typedef struct transport transport;
+
+struct transport {
+    int rank;
+    int size;
+    int (*send)(transport *t, int to, const void *data, unsigned long long bytes);
+    int (*receive)(transport *t, int from, void *data, unsigned long long bytes);
+    void (*close)(transport *t);
+    void *state;
+};
+
+// Ranks as threads of one process, over shared ring buffers. Fills
+// ranks[0 .. size), one for each thread. Returns 0, or -1 on failure.
+int openMemoryTransports(transport *ranks, int size);
+
+// One rank per process (or thread) over stream sockets: TCP on
+// 127.0.0.1, rank r listening on port + r, or Unix domain sockets when
+// address is "unix:<path>", rank r listening on <path>.<r> (not on
+// Windows). Blocks until every rank is connected or timeout seconds pass.
+// Returns 0, or -1 on failure.
+int openSocketTransport(transport *t, const char *address, int port, int rank, int size, double timeout);
+
+void closeTransport(transport *t);
+
+// Length-prefixed messages on top of the raw channel. receiveMessage grows
+// *data as needed and stores the length in *bytes. Both return 0 or -1.
+int sendMessage(transport *t, int to, const void *data, unsigned long long bytes);
+
+int receiveMessage(transport *t, int from, void **data, unsigned long long *capacity, unsigned long long *bytes);
+
+#endif // transport.h
@@ -0,0 +1,115 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "common.h"
+#include "grid.h"
+#include "contact.h"
+#include "solver.h"
+#include "fixed.h"
+#include "multirate.h"
+#include "ccd.h"
+#include "sdf.h"
+#include "segment.h"
+#include "kinematic.h"
+#include "constraint.h"
+#include "rigid.h"
+#include "longrange.h"
+#include "sph.h"
+#include "field.h"
+#include "emitter.h"
+
+// With adaptive on, stepWorld's subSteps is only the upper bound: each step
+// uses enough substeps that the fastest ball travels at most maxTravel
+// radii per substep, and at least minSubSteps unless that is above the
+// bound. Speed says nothing about a pile settling under its own weight, so
+// the count also follows the deepest ball overlap the last step left,
+// projected a few steps ahead while it is rising: it grows while that is
+// over maxOverlap diameters, falls while it is under three quarters of it
+// and holds in between. The first step runs at the bound; 0 turns this
+// off. With multiRate on (iterative solver only) the speed rule is applied
+// per ball instead, see multirate.h. With ccd on, balls
+// moving more than ccdThreshold radii per step are swept (ccd.h). Contacts
+// are only found once per step, so without it a ball that fast can pass
+// through others whatever the substep count. Multi-rate steps ignore
+// ccd; their fast balls already get fine levels. Constraints and rigid
+// bodies tie balls together across levels, so while there are any every
+// ball takes the uniform substeps instead, and so does every ball while
+// long-range forces or fluid are on. Fixed-point builds follow adaptive but
+// skip multiRate and ccd.
+typedef struct {
+    int adaptive;
+    int minSubSteps;
+    double maxTravel;
+    double maxOverlap;
+    int multiRate;
+    int ccd;
+    double ccdThreshold;
+} substepSettings;
+
+// Instrumentation of the last stepWorld call.
+typedef struct {
+    int subSteps;           // of the finest level when multi-rate
+    double maxSpeed;
+    int contacts;
+    long long ballSubSteps; // substeps summed over balls, the integration work done
+    int swept;              // ball substeps that needed a sweep
+    double overlapSubSteps; // count the overlap feedback asks for, 0 until the first adaptive step
+    double overlap;         // deepest ball overlap the previous step left, in diameters; adaptive only
+} stepStats;
+
+// Everything one simulation needs between frames: the balls, the
+// broadphase built over them and the contacts of the last two steps.
+typedef struct {
+    pointArray points;
+    spatialGrid grid;
+    contactList contacts;
+    contactList previousContacts;
+    contactEvents events;    // disabled until initContactEvents is called on it
+    solverSettings solver;   // unused by fixed-point builds, which keep one damped pass
+    substepSettings substeps;
+    stepStats stats;
+    solverWorkspace solverWork;
+    multiRateWorkspace rates;
+    ccdWorkspace ccd;
+    // Everything from here to emitters is refused by fixed-point builds (see
+    // fixedPointRefuses) or, for plain settings, skipped by them
+    sdfProgram boundary;     // static geometry inside the border, empty by default
+    sdfGrid bakedBoundary;   // used instead of boundary once baked
+    segmentSet segments;     // static segments; bucketed on the first step after they change
+    kinematicSet kinematics; // moving colliders, none by default
+    constraintSet constraints; // ropes, sheets and blobs; solved by the substepped modes
+    rigidSet rigid;          // composite bodies
+    longRangeSettings longRange; // pairwise forces, off by default; substepped modes only
+    longRangeWorkspace longRangeWork;
+    sphSettings sph;
+    sphSet fluid;            // balls marked by setFluid; the legacy mode keeps them solid
+    forceFieldSet fields;    // on top of gravity
+    emitterSet emitters;     // run at the start of every step; only solid ones in fixed-point builds
+    fixedState fixed;        // authoritative state when built with PHYSICS_FIXED_POINT
+    float radius;
+    float borderRadius;
+    int periodic;            // see setPeriodic
+    unsigned long long step; // completed calls to stepWorld
+} physicsWorld;
+
+void initWorld(physicsWorld *w, int capacity, float radius, float borderRadius);
+
+void freeWorld(physicsWorld *w);
+
+// Bakes w->boundary over the border's square at the given sample spacing,
+// so collisions with it cost one bilinear lookup per ball. Returns 0 or -1.
+int bakeBoundary(physicsWorld *w, double cellSize);
+
+// Swaps the border circle for a periodic box: the square the circle is
+// inscribed in tiles the plane, balls leaving through one side come back
+// through the other and collide with the images of balls across the
+// edges. Bodies wrap as a whole by their centre. Only the substepped
+// solver modes wrap; CCD and multi-rate substepping are skipped, and
+// constraints, the fluid and long-range forces do not see the images.
+// Returns 0, or -1 if the box is under three grid cells wide or in a
+// fixed-point build.
+int setPeriodic(physicsWorld *w, int periodic);
+
+void stepWorld(physicsWorld *w, double dt, int subSteps);
+
+#endif // world.h
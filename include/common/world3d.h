@@ -0,0 +1,84 @@
+#ifndef WORLD3D_H
+#define WORLD3D_H
+
+#include "contact.h"
+#include "solver.h"
+
+// Spheres inside a spherical border, stepped like world.h's SOLVER_ITERATIVE
+// path: narrowphase with a contact margin, warm start, then Gauss-Seidel
+// impulses and the position pass every substep. It runs on the 2D engine's
+// shared pieces: the spatialGrid (with a third axis of layers) and its
+// counting sort, the sorted contact list helpers and merge walk of
+// contact.h, and the contact rules of solver.h (mass, target, normal
+// impulse, bounce, friction limit, position push). What stays 3D's own is
+// the vector algebra around them: the 27-cell search, relative velocities
+// and impulses on three axes, and friction as a vector clamped to the cone's
+// circle. Only SOLVER_ITERATIVE is supported; there are no Jacobi or colored
+// solvers, adaptive substeps, CCD, fields, rigid bodies, constraints,
+// periodic boxes, snapshots or fixed point. Gravity points down y, as in 2D.
+
+typedef struct {
+    double x, y, z;
+} vector3;
+
+typedef struct {
+    vector3 position;
+    vector3 velocity;
+} sphere;
+
+typedef struct {
+    sphere *spheres;
+    int size;
+    int capacity;
+    unsigned int revision; // bumped whenever spheres are added or moved
+} sphereArray;
+
+// Opens with a, b like contact, so contact.h's list helpers apply
+typedef struct {
+    int a, b;              // sphere indices, a < b; b is BORDER_CONTACT for the wall
+    vector3 normal;        // unit vector from b towards a
+    double depth;
+    double impulse;
+    vector3 tangentImpulse; // friction, in the contact plane
+    double bounce;
+} contact3d;
+
+typedef struct {
+    contact3d *items;
+    int count;
+    int capacity;
+} contactList3d;
+
+typedef struct {
+    sphereArray spheres;
+    spatialGrid grid;      // initGrid3d over the border's cube
+    contactList3d contacts;
+    contactList3d previousContacts;
+    solverSettings solver;
+    int contactsFound;     // of the last step
+    float radius;
+    float borderRadius;
+    unsigned long long step;
+} world3d;
+
+// Starts from defaultSolverSettings with the mode set to SOLVER_ITERATIVE.
+void initWorld3d(world3d *w, int capacity, float radius, float borderRadius);
+
+void freeWorld3d(world3d *w);
+
+// Appends count spheres with one growth. Returns the index of the first, or
+// -1 on allocation failure.
+int addSpheres(world3d *w, const sphere *spheres, int count);
+
+// The spherical analog of clampToBorder: a sphere past the wall loses its
+// outward velocity and goes back onto it. Returns 1 if it was clamped.
+int clampToBorder3d(sphere *s, float radius, float borderRadius);
+
+// Every pair within margin of touching and every sphere within margin of
+// the border, sorted by (a, b) like findContacts.
+void findContacts3d(world3d *w, double margin);
+
+// Returns -1 without stepping if solver.mode is not SOLVER_ITERATIVE.
+int stepWorld3d(world3d *w, double dt, int subSteps);
+
+#endif // world3d.h
@@ -0,0 +1,1638 @@
+// Headless benchmarks. Usage: bench <suite> [balls] [steps]
+// Rows that check a result end in ok or WRONG; any WRONG exits with 1.
+//
+//   solvers   Gauss-Seidel, Jacobi and graph-colored Gauss-Seidel contact
+//             solvers: throughput and residual overlap for a settled pile at
+//             several thread counts
+//   determinism state hashes after the same run at 1, 2, 7 and 32 threads
+//             for every parallel solver, and what the order-free Jacobi
+//             variant saves over the deterministic one
+//   events    two balls passing within the contact margin, glancing and
+//             meeting head on in every substepped solver mode: begin and
+//             end events, none at all for the near miss
+//   fixed     float legacy pipeline against the Q8.24 integer backend; the
+//             fixed hash must be the same on every build and machine
+//   substeps  adaptive substepping against the fixed bound and against the
+//             largest fixed count that costs no more than its mean, from
+//             the same settled pile and from that pile after an explosion;
+//             adaptive's deepest overlap, averaged over the steps, must be
+//             no worse than that count's
+//   multirate uniform, adaptive and per-ball multi-rate substepping for a
+//             settled pile with a few fast balls flying over it
+//   ccd       balls fired into a settled pile at several substep counts with
+//             and without swept collisions, counting tunnelling events;
+//             with them there must be none
+//   sdf       per-ball cost of the border circle, an analytic SDF boundary
+//             as it grows more complex, and the same boundary baked
+//   segments  per-ball cost of static segment collisions from a hundred to
+//             tens of thousands of segments, and the one-off build time
+//   kinematic a settled pile stirred by tens to hundreds of spinning blades:
+//             step time, candidate pairs and the share the blades cost
+//   constraints a hundredth, a tenth and all of the balls in 32x32 cloth
+//             sheets of XPBD constraints hanging from their top row: solve
+//             time per substep, colors and the worst stretch left in the
+//             links
+//   rigid     composites of four balls (squares and rods) dropped into a
+//             pile against the same balls left loose: step time and the
+//             overlap left
+//   longrange pairwise forces over a disc of balls: Barnes-Hut at several
+//             opening angles and the FMM at several expansion orders, time
+//             and error against direct summation on sampled balls, and what
+//             the direct sum would take for all of them
+//   sph       a dam break of fluid balls with solid ones mixed in: step
+//             time, the fluid's share, neighbours per ball and how far the
+//             density strays from rest as the column collapses
+//   fields    per-ball cost of each force field kind and all of them at
+//             once, and of spawning balls through an emitter
+//   periodic  a gas of balls in a periodic box with gravity cancelled by a
+//             field: step time, contacts through the box edges, overlap,
+//             kinetic energy and balls found outside the box
+//   3d        the same number of balls settled as a 2D pile and as a 3D
+//             pile of spheres: time per ball substep, contacts per ball
+//             and the overlap left
+//   distributed a pile split over four ranks running as threads, over the
+//             memory, TCP and Unix socket transports, with and without
+//             rebalancing: step time, slab imbalance, ghosts, migrations
+//             and whether every ball is still there
+//   snapshots save, load and map times for a settled pile, then the same
+//             snapshot rewritten as other writers would have left it (a
+//             version 1 or 2 header, a longer header from a newer build, a
+//             different contact layout) loaded both ways: the points and
+//             substep settings must come back and only the mismatched
+//             contacts may be dropped. Saving a world with segments, fields,
+//             constraints or multi-rate substeps must fail.
+//   trajectory  cost of recording every step, compressed size per frame and
+//             the worst position error after reading the file back
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "common/common.h"
+#include "common/world.h"
+#include "common/world3d.h"
+#include "common/domain.h"
+#include "common/snapshot.h"
+#include "common/trajectory.h"
+#include "common/replay.h"
+
+#define BENCH_BORDER 0.9f
+
+static double now(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void setThreads(int threads) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#else
+    (void)threads;
+#endif
+}
+
+static int benchFailures = 0;
+
+static const char *verdict(int ok) {
+    benchFailures += !ok;
+    return ok ? "ok" : "WRONG";
+}
+
+static int maxThreads(void) {
+#ifdef _OPENMP
+    return omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
+
+// Radius that fills about 40% of the border circle with n balls
+static float pileRadius(int n) {
+    return (float)(BENCH_BORDER * sqrt(0.4 / n));
+}
+
+// Scatters n balls uniformly over the disc with a fixed seed, replacing
+// any already there. One addPoints call, so a million balls do not each
+// print a line from addPoint.
+static void scatterBalls(physicsWorld *w, int n, unsigned int seed) {
+    centerPoint *points = (centerPoint *)malloc(n * sizeof(centerPoint));
+    srand(seed);
+    double reach = BENCH_BORDER - w->radius;
+    for (int i = 0; i < n; i++) {
+        double r = reach * sqrt(rand() / (double)RAND_MAX);
+        double t = 2.0 * 3.14159265358979323846 * rand() / (double)RAND_MAX;
+        points[i].position = (vector2){r * cos(t), r * sin(t)};
+        points[i].velocity = (vector2){0.0, 0.0};
+        points[i].acceleration = (vector2){0.0, 0.0};
+    }
+    w->points.size = 0;
+    addPoints(&w->points, points, n);
+    free(points);
+}
+
+static void overlapStats(const physicsWorld *w, double *maxOverlap, double *meanOverlap) {
+    double worst = 0.0, sum = 0.0;
+    int touching = 0;
+    for (int k = 0; k < w->contacts.count; k++) {
+        const contact *c = &w->contacts.items[k];
+        if (c->b == BORDER_CONTACT) {
+            continue;
+        }
+        vector2 p = w->points.points[c->a].position, q = w->points.points[c->b].position;
+        q.x += c->shift.x;
+        q.y += c->shift.y;
+        double depth = 2.0 * w->radius - sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y));
+        if (depth > 0.0) {
+            worst = depth > worst ? depth : worst;
+            sum += depth;
+            touching++;
+        }
+    }
+    *maxOverlap = worst / (2.0 * w->radius);
+    *meanOverlap = touching > 0 ? sum / touching / (2.0 * w->radius) : 0.0;
+}
+
+static void benchSolvers(int balls, int steps) {
+    const int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    const solverMode modes[] = {SOLVER_ITERATIVE, SOLVER_JACOBI, SOLVER_COLORED};
+    const char *names[] = {"gauss-seidel", "jacobi", "colored"};
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+
+    printf("%d balls, radius %g, %d steps of %d substeps after settling\n", balls, radius, steps, subSteps);
+    printf("%-13s %7s %10s %12s %12s %12s\n", "solver", "threads", "steps/s", "Mcontacts/s", "max overlap", "mean overlap");
+
+    for (int m = 0; m < 3; m++) {
+        for (int t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); t++) {
+            int threads = threadCounts[t];
+            if (threads > maxThreads()) {
+                break;
+            }
+            // Gauss-Seidel is serial; one row is enough
+            if (modes[m] == SOLVER_ITERATIVE && threads > 1) {
+                break;
+            }
+            setThreads(threads);
+
+            physicsWorld w;
+            initWorld(&w, balls, radius, BENCH_BORDER);
+            w.solver.mode = modes[m];
+            scatterBalls(&w, balls, 12345);
+            for (int s = 0; s < 100; s++) {
+                stepWorld(&w, 0.01, subSteps);
+            }
+
+            long long contacts = 0;
+            double start = now();
+            for (int s = 0; s < steps; s++) {
+                stepWorld(&w, 0.01, subSteps);
+                contacts += w.contacts.count;
+            }
+            double elapsed = now() - start;
+
+            double maxOverlap, meanOverlap;
+            overlapStats(&w, &maxOverlap, &meanOverlap);
+            printf("%-13s %7d %10.1f %12.2f %11.2f%% %11.3f%%\n", names[m], threads, steps / elapsed,
+                   contacts * subSteps / elapsed / 1e6, 100.0 * maxOverlap, 100.0 * meanOverlap);
+            freeWorld(&w);
+        }
+    }
+}
+
+static void benchDeterminism(int balls, int steps) {
+    const int threadCounts[] = {1, 2, 7, 32};
+    const solverMode modes[] = {SOLVER_ITERATIVE, SOLVER_JACOBI, SOLVER_COLORED, SOLVER_JACOBI};
+    const int deterministic[] = {1, 1, 1, 0};
+    const char *names[] = {"gauss-seidel", "jacobi", "colored", "jacobi-atomic"};
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+
+    printf("%d balls, %d steps of %d substeps from the same scatter\n", balls, steps, subSteps);
+    printf("%-14s %7s %10s %18s %10s\n", "solver", "threads", "steps/s", "hash", "vs 1 thread");
+
+    for (int m = 0; m < 4; m++) {
+        unsigned long long reference = 0;
+        // Oversubscribing a small machine is fine: only the results are compared
+        for (int t = 0; t < 4; t++) {
+            setThreads(threadCounts[t]);
+            physicsWorld w;
+            initWorld(&w, balls, radius, BENCH_BORDER);
+            w.solver.mode = modes[m];
+            w.solver.deterministic = deterministic[m];
+            scatterBalls(&w, balls, 12345);
+
+            double start = now();
+            for (int s = 0; s < steps; s++) {
+                stepWorld(&w, 0.01, subSteps);
+            }
+            double elapsed = now() - start;
+
+            unsigned long long hash = hashWorld(&w);
+            if (t == 0) {
+                reference = hash;
+            }
+            printf("%-14s %7d %10.1f   %016llx %10s\n", names[m], threadCounts[t], steps / elapsed, hash,
+                   hash == reference ? "same" : "DIFFERS");
+            freeWorld(&w);
+        }
+    }
+    setThreads(maxThreads());
+}
+
+// A ball fired past a resting one; offset is how far apart their paths are
+static void benchEvents(int steps) {
+    const solverMode modes[] = {SOLVER_ITERATIVE, SOLVER_JACOBI, SOLVER_COLORED};
+    const char *modeNames[] = {"iterative", "jacobi", "colored"};
+    const float radius = 0.05f;
+    const char *cases[] = {"near miss", "glancing", "head on"};
+    // Inside the contact margin but never touching, then overlapping paths
+    const double offsets[] = {(2.0 + 0.5 * 0.25) * radius, 1.5 * radius, 0.0};
+    const int expected[] = {0, 1, 1};
+    steps = steps > 60 ? steps : 60;
+    printf("two balls of radius %.2f, the moving one at 1 per second, %d steps of 4 substeps\n", radius, steps);
+    printf("%-10s %-10s %8s %8s %8s\n", "mode", "case", "begins", "ends", "result");
+
+    for (int m = 0; m < 3; m++) {
+        for (int c = 0; c < 3; c++) {
+            physicsWorld w;
+            initWorld(&w, 2, radius, BENCH_BORDER);
+            w.solver.mode = modes[m];
+            w.solver.contactMargin = 0.25;
+            initContactEvents(&w.events, 16);
+            if (addUniformField(&w.fields, 0.0, GRAVITY) < 0) {
+                freeWorld(&w);
+                return;
+            }
+            w.points.points[0] = (centerPoint){{-0.4, 0.0}, {1.0, 0.0}, {0.0, 0.0}};
+            w.points.points[1] = (centerPoint){{0.0, offsets[c]}, {0.0, 0.0}, {0.0, 0.0}};
+            w.points.size = 2;
+            w.points.revision++;
+            int begins = 0, ends = 0;
+            for (int s = 0; s < steps; s++) {
+                stepWorld(&w, 0.01, 4);
+                for (int k = 0; k < w.events.count; k++) {
+                    begins += w.events.events[k].type == CONTACT_BEGIN;
+                    ends += w.events.events[k].type == CONTACT_END;
+                }
+            }
+            printf("%-10s %-10s %8d %8d %8s\n", modeNames[m], cases[c], begins, ends,
+                   verdict(begins == expected[c] && ends == expected[c]));
+            freeWorld(&w);
+        }
+    }
+}
+
+static void benchFixed(int balls, int steps) {
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+    printf("%d balls, %d steps of %d substeps from the same scatter\n", balls, steps, subSteps);
+    printf("%-8s %10s %14s %18s\n", "backend", "steps/s", "Mballsteps/s", "hash");
+
+    physicsWorld w;
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    double start = now();
+    for (int s = 0; s < steps; s++) {
+        stepWorld(&w, 0.01, subSteps);
+    }
+    double elapsed = now() - start;
+#ifdef PHYSICS_FIXED_POINT
+    const char *floatName = "fixed*";
+#else
+    const char *floatName = "float";
+#endif
+    printf("%-8s %10.1f %14.2f %18s\n", floatName, steps / elapsed, (double)balls * steps * subSteps / elapsed / 1e6, "-");
+    freeWorld(&w);
+
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    fixedState f;
+    initFixedState(&f, radius, BENCH_BORDER);
+    importFixedPoints(&f, &w.points);
+    start = now();
+    for (int s = 0; s < steps; s++) {
+        stepFixed(&f, &w.grid, NULL, 0.01, subSteps);
+    }
+    elapsed = now() - start;
+    printf("%-8s %10.1f %14.2f   %016llx\n", "fixed", steps / elapsed, (double)balls * steps * subSteps / elapsed / 1e6, hashFixedState(&f));
+    freeFixedState(&f);
+    freeWorld(&w);
+}
+
+typedef struct {
+    double rate;            // steps per second
+    double meanSubSteps;
+    int most;
+    double worstOverlap;    // deepest overlap over every step, in diameters
+    double meanOverlap;     // deepest overlap of each step, averaged over the steps
+} subStepRun;
+
+// Restarts from the settled balls, blown outwards at up to 5 units/s when
+// explode is set, and runs at fixed substeps, or adaptively up to
+// maxSubSteps when fixed is 0
+static void runSubSteps(const pointArray *settled, int steps, int maxSubSteps, int explode, int fixed, subStepRun *out) {
+    physicsWorld w;
+    initWorld(&w, settled->size, pileRadius(settled->size), BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    w.substeps.adaptive = fixed == 0;
+    addPoints(&w.points, settled->points, settled->size);
+    if (explode) {
+        for (int i = 0; i < w.points.size; i++) {
+            vector2 p = w.points.points[i].position;
+            w.points.points[i].velocity = (vector2){5.0 * p.x / BENCH_BORDER, 5.0 * p.y / BENCH_BORDER};
+        }
+    }
+    long long total = 0;
+    double elapsed = 0.0, worst = 0.0, sum = 0.0;
+    out->most = 0;
+    for (int s = 0; s < steps; s++) {
+        double start = now();
+        stepWorld(&w, 0.01, fixed > 0 ? fixed : maxSubSteps);
+        elapsed += now() - start;
+        total += w.stats.subSteps;
+        out->most = w.stats.subSteps > out->most ? w.stats.subSteps : out->most;
+        double maxOverlap, meanOverlap;
+        overlapStats(&w, &maxOverlap, &meanOverlap);
+        worst = maxOverlap > worst ? maxOverlap : worst;
+        sum += maxOverlap;
+    }
+    out->rate = steps / elapsed;
+    out->meanSubSteps = (double)total / steps;
+    out->worstOverlap = worst;
+    out->meanOverlap = sum / steps;
+    freeWorld(&w);
+}
+
+static void benchSubSteps(int balls, int steps) {
+    const int maxSubSteps = 10;
+    const char *phases[2] = {"settled", "explosion"};
+    printf("%d balls, %d steps of a settled pile and of the same pile after an explosion, at most %d substeps\n", balls,
+           steps, maxSubSteps);
+    printf("%-9s %-9s %10s %14s %9s %14s %14s %8s\n", "substeps", "phase", "steps/s", "mean substeps", "max",
+           "mean overlap", "worst overlap", "result");
+
+    // Every run starts from the same settled pile
+    physicsWorld w;
+    initWorld(&w, balls, pileRadius(balls), BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    scatterBalls(&w, balls, 12345);
+    for (int s = 0; s < 300; s++) {
+        stepWorld(&w, 0.01, maxSubSteps);
+    }
+
+    for (int phase = 0; phase < 2; phase++) {
+        subStepRun adaptive, bound, matched;
+        runSubSteps(&w.points, steps, maxSubSteps, phase, 0, &adaptive);
+        runSubSteps(&w.points, steps, maxSubSteps, phase, maxSubSteps, &bound);
+        // The most fixed substeps that cost no more than adaptive's mean
+        int count = (int)floor(adaptive.meanSubSteps + 1e-9);
+        runSubSteps(&w.points, steps, maxSubSteps, phase, count > 0 ? count : 1, &matched);
+
+        const char *names[3] = {"fixed", "matched", "adaptive"};
+        const subStepRun *runs[3] = {&bound, &matched, &adaptive};
+        for (int r = 0; r < 3; r++) {
+            printf("%-9s %-9s %10.1f %14.2f %9d %13.2f%% %13.2f%% %8s\n", names[r], phases[phase], runs[r]->rate,
+                   runs[r]->meanSubSteps, runs[r]->most, 100.0 * runs[r]->meanOverlap, 100.0 * runs[r]->worstOverlap,
+                   r < 2 ? "-" : verdict(adaptive.meanOverlap <= matched.meanOverlap));
+        }
+    }
+    freeWorld(&w);
+}
+
+static void benchMultiRate(int balls, int steps) {
+    const int maxSubSteps = 16;
+    const int fast = balls / 100 > 1 ? balls / 100 : 1;
+    const char *names[3] = {"fixed", "adaptive", "multirate"};
+    float radius = pileRadius(balls);
+    printf("%d settled balls plus %d fast ones, %d steps, at most %d substeps\n", balls, fast, steps, maxSubSteps);
+    printf("%-10s %10s %16s %9s %12s\n", "substeps", "steps/s", "ball substeps", "finest", "max overlap");
+
+    for (int config = 0; config < 3; config++) {
+        physicsWorld w;
+        initWorld(&w, balls + fast, radius, BENCH_BORDER);
+        w.solver.mode = SOLVER_ITERATIVE;
+        w.substeps.adaptive = config == 1;
+        w.substeps.multiRate = config == 2;
+        scatterBalls(&w, balls, 12345);
+        // Long enough for the whole pile to come to rest at one level
+        for (int s = 0; s < 300; s++) {
+            stepWorld(&w, 0.01, maxSubSteps);
+        }
+        // Thrown sideways across the empty top half at 6 units/s
+        for (int k = 0; k < fast; k++) {
+            double x = BENCH_BORDER * (0.8 * k / fast - 0.4);
+            double y = BENCH_BORDER * (0.5 + 0.3 * (k % 3) / 3.0);
+            pointArray *a = &w.points;
+            a->points[a->size++] = (centerPoint){{x, y}, {k % 2 ? 6.0 : -6.0, 1.0}, {0.0, 0.0}};
+        }
+        w.points.revision++;
+
+        long long work = 0;
+        int finest = 0;
+        double start = now();
+        for (int s = 0; s < steps; s++) {
+            stepWorld(&w, 0.01, maxSubSteps);
+            work += w.stats.ballSubSteps;
+            finest = w.stats.subSteps > finest ? w.stats.subSteps : finest;
+        }
+        double elapsed = now() - start;
+        double maxOverlap, meanOverlap;
+        overlapStats(&w, &maxOverlap, &meanOverlap);
+        printf("%-10s %10.1f %16.0f %9d %11.2f%%\n", names[config], steps / elapsed, (double)work / steps, finest, 100.0 * maxOverlap);
+        freeWorld(&w);
+    }
+}
+
+// Tunnelling: over one step, a projectile's path passed within one radius
+// of the centre of a ball that stayed put, which contacts never allow
+static int countTunnels(const physicsWorld *w, const vector2 *before, int first) {
+    const pointArray *a = &w->points;
+    double r2 = (double)w->radius * w->radius;
+    int tunnels = 0;
+    for (int i = first; i < a->size; i++) {
+        vector2 p = before[i], q = a->points[i].position;
+        double dx = q.x - p.x, dy = q.y - p.y;
+        double length2 = dx * dx + dy * dy;
+        if (length2 < 4.0 * r2) {
+            continue;
+        }
+        for (int j = 0; j < a->size; j++) {
+            vector2 c = a->points[j].position;
+            double mx = c.x - before[j].x, my = c.y - before[j].y;
+            if (j == i || mx * mx + my * my > 0.25 * r2) {
+                continue;
+            }
+            double t = ((c.x - p.x) * dx + (c.y - p.y) * dy) / length2;
+            double ex = p.x + t * dx - c.x, ey = p.y + t * dy - c.y;
+            if (t > 0.0 && t < 1.0 && ex * ex + ey * ey < r2) {
+                tunnels++;
+                break;
+            }
+        }
+    }
+    return tunnels;
+}
+
+static void benchCcd(int balls, int steps) {
+    // Fixed-point builds step with ccd set but never sweep, so every row would tunnel
+    if (fixedPointRefuses("Swept collisions")) {
+        return;
+    }
+    const int fast = 20;
+    const double speed = 10.0;
+    float radius = pileRadius(balls);
+    vector2 *before = (vector2 *)malloc((balls + fast) * sizeof(vector2));
+    printf("%d settled balls, %d fired down into them at %g units/s (%.1f radii per step), %d steps\n",
+           balls, fast, speed, speed * 0.01 / radius, steps);
+    printf("%-9s %-5s %10s %9s %12s %12s %8s\n", "substeps", "ccd", "steps/s", "tunnels", "swept/step", "max overlap",
+           "result");
+
+    for (int subSteps = 1; subSteps <= 16; subSteps *= 2) {
+        for (int ccd = 0; ccd < 2; ccd++) {
+            physicsWorld w;
+            initWorld(&w, balls + fast, radius, BENCH_BORDER);
+            w.solver.mode = SOLVER_ITERATIVE;
+            scatterBalls(&w, balls, 12345);
+            for (int s = 0; s < 300; s++) {
+                stepWorld(&w, 0.01, 16);
+            }
+            w.substeps.ccd = ccd;
+            pointArray *a = &w.points;
+            for (int k = 0; k < fast; k++) {
+                double x = BENCH_BORDER * (0.8 * k / fast - 0.4);
+                a->points[a->size++] = (centerPoint){{x, 0.5 * BENCH_BORDER}, {0.0, -speed}, {0.0, 0.0}};
+            }
+            a->revision++;
+
+            int tunnels = 0;
+            long long swept = 0;
+            double elapsed = 0.0;
+            for (int s = 0; s < steps; s++) {
+                for (int i = 0; i < a->size; i++) {
+                    before[i] = a->points[i].position;
+                }
+                double t0 = now();
+                stepWorld(&w, 0.01, subSteps);
+                elapsed += now() - t0;
+                swept += w.stats.swept;
+                tunnels += countTunnels(&w, before, balls);
+            }
+            double maxOverlap, meanOverlap;
+            overlapStats(&w, &maxOverlap, &meanOverlap);
+            // Swept balls must never tunnel
+            printf("%-9d %-5s %10.1f %9d %12.1f %11.2f%% %8s\n", subSteps, ccd ? "on" : "off", steps / elapsed, tunnels,
+                   (double)swept / steps, 100.0 * maxOverlap, ccd ? verdict(tunnels == 0) : "-");
+            freeWorld(&w);
+        }
+    }
+    free(before);
+}
+
+// A pegboard: the border as a program, then rows of round pegs and a few
+// slanted walls, everything unioned
+static void buildPegboard(sdfProgram *p, int pegs) {
+    sdfCircle(p, 0.0, 0.0, BENCH_BORDER);
+    sdfCombine(p, SDF_INVERT);
+    int perRow = (int)ceil(sqrt((double)pegs));
+    for (int k = 0; k < pegs; k++) {
+        double x = -0.6 + 1.2 * (k % perRow + 0.5 * ((k / perRow) % 2)) / perRow;
+        double y = 0.5 - 0.8 * (k / perRow) / perRow;
+        sdfCircle(p, x, y, 0.004);
+        sdfCombine(p, SDF_UNION);
+    }
+    for (int k = 0; k < 4; k++) {
+        sdfCapsule(p, -0.7 + 0.4 * k, -0.4, -0.6 + 0.4 * k, -0.55, 0.01);
+        sdfCombine(p, SDF_UNION);
+    }
+}
+
+static void benchSdf(int balls, int steps) {
+    physicsWorld w;
+    float radius = pileRadius(balls);
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    printf("%d balls, %d passes each; ns per ball\n", balls, steps);
+    printf("%-22s %12s %12s\n", "boundary", "analytic", "baked");
+
+    double start = now();
+    for (int s = 0; s < steps; s++) {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < w.points.size; i++) {
+            clampToBorder(&w.points.points[i], w.radius, w.borderRadius);
+        }
+    }
+    printf("%-22s %12.1f %12s\n", "clampToBorder", 1e9 * (now() - start) / steps / balls, "-");
+
+    int pegCounts[4] = {0, 10, 100, 1000};
+    for (int c = 0; c < 4; c++) {
+        sdfProgram p;
+        sdfGrid g;
+        initSdfProgram(&p);
+        initSdfGrid(&g);
+        buildPegboard(&p, pegCounts[c]);
+        start = now();
+        for (int s = 0; s < steps; s++) {
+            collideSdf(&w.points, NULL, w.points.size, &p, NULL, w.radius, 0.3);
+        }
+        double analytic = now() - start;
+        bakeSdf(&g, &p, -BENCH_BORDER, -BENCH_BORDER, BENCH_BORDER, BENCH_BORDER, 2.0 * radius);
+        start = now();
+        for (int s = 0; s < steps; s++) {
+            collideSdf(&w.points, NULL, w.points.size, NULL, &g, w.radius, 0.3);
+        }
+        double baked = now() - start;
+        char name[32];
+        snprintf(name, sizeof(name), "4 walls + %d pegs", pegCounts[c]);
+        printf("%-22s %12.1f %12.1f\n", name, 1e9 * analytic / steps / balls, 1e9 * baked / steps / balls);
+        freeSdfGrid(&g);
+        freeSdfProgram(&p);
+    }
+    freeWorld(&w);
+}
+
+// Wavy terrain lines across the band [y0, y1], each segment about a ball
+// wide, 500 to a line
+static void buildTerrain(segmentSet *set, int count, double y0, double y1) {
+    const int perLine = 500;
+    int lines = (count + perLine - 1) / perLine;
+    vector2 *points = (vector2 *)malloc((perLine + 1) * sizeof(vector2));
+    for (int l = 0; l < lines; l++) {
+        double y = y0 + (y1 - y0) * (l + 0.5) / lines;
+        int n = count - l * perLine < perLine ? count - l * perLine : perLine;
+        for (int k = 0; k <= n; k++) {
+            double x = -0.6 + 1.2 * k / perLine;
+            points[k] = (vector2){x, y + 0.01 * sin(40.0 * x + l)};
+        }
+        addPolyline(set, points, n + 1, 0);
+    }
+    free(points);
+}
+
+static void benchSegments(int balls, int steps) {
+    const int local = 2000;
+    physicsWorld w;
+    float radius = pileRadius(balls);
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    // Balls stay in the bottom band with the same terrain around them; the
+    // level grows above them, where a good structure never looks
+    int kept = 0;
+    for (int i = 0; i < w.points.size; i++) {
+        if (w.points.points[i].position.y < -0.2) {
+            w.points.points[kept++] = w.points.points[i];
+        }
+    }
+    w.points.size = kept;
+    balls = kept;
+    printf("%d balls among %d local segments, %d passes each\n", balls, local, steps);
+    printf("%-10s %12s %14s %12s\n", "segments", "build ms", "ns per ball", "pushes");
+
+    int counts[5] = {0, 1000, 10000, 30000, 60000};
+    centerPoint *saved = (centerPoint *)malloc(balls * sizeof(centerPoint));
+    memcpy(saved, w.points.points, balls * sizeof(centerPoint));
+    for (int c = 0; c < 5; c++) {
+        segmentSet set;
+        initSegmentSet(&set);
+        buildTerrain(&set, local, -0.7, -0.2);
+        buildTerrain(&set, counts[c], 0.0, 0.8);
+        double start = now();
+        buildSegmentGrid(&set, -BENCH_BORDER, -BENCH_BORDER, BENCH_BORDER, BENCH_BORDER, w.grid.cellSize, w.radius);
+        double build = now() - start;
+
+        // Every pass from the same positions, so each sees the same overlaps
+        long long pushes = 0;
+        double elapsed = 0.0;
+        for (int s = 0; s < steps; s++) {
+            memcpy(w.points.points, saved, balls * sizeof(centerPoint));
+            start = now();
+            pushes += collideSegments(&w.points, NULL, w.points.size, &set, w.radius, 0.3);
+            elapsed += now() - start;
+        }
+        printf("%-10d %12.2f %14.1f %12lld\n", set.count, 1e3 * build, 1e9 * elapsed / steps / balls, pushes / steps);
+        freeSegmentSet(&set);
+    }
+    free(saved);
+    freeWorld(&w);
+}
+
+static void benchKinematic(int balls, int steps) {
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+    printf("%d balls, %d steps of %d substeps, blades spinning at 10 rad/s\n", balls, steps, subSteps);
+    printf("%-8s %12s %14s %12s %12s\n", "blades", "ms/step", "blade ms/step", "pairs", "balls hit");
+
+    int bladeCounts[4] = {0, 30, 100, 300};
+    for (int c = 0; c < 4; c++) {
+        physicsWorld w;
+        initWorld(&w, balls, radius, BENCH_BORDER);
+        w.solver.mode = SOLVER_ITERATIVE;
+        scatterBalls(&w, balls, 12345);
+        for (int s = 0; s < 100; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        // Rows of blades 20 across, through the bottom half where the pile is
+        int blades = bladeCounts[c];
+        for (int k = 0; k < blades; k++) {
+            double x = -0.6 + 1.2 * (k % 20) / 19.0;
+            double y = -0.7 + 0.5 * (k / 20) / (blades / 20 + 1.0);
+            int b = addKinematicBody(&w.kinematics, (vector2){-0.03, 0.0}, (vector2){0.03, 0.0}, 0.005, (vector2){x, y}, 0.3 * k);
+            if (b < 0) {
+                freeWorld(&w);
+                return;
+            }
+            w.kinematics.bodies[b].script = KINEMATIC_SPIN;
+            w.kinematics.bodies[b].spin = k % 2 ? 10.0 : -10.0;
+        }
+
+        double start = now();
+        for (int s = 0; s < steps; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        double elapsed = now() - start;
+
+        // The blade work alone, replayed on the final state
+        double bladeTime = 0.0;
+        if (blades > 0) {
+            double reach = w.radius + (w.stats.maxSpeed + GRAVITY * 0.01) * 0.01;
+            start = now();
+            for (int s = 0; s < steps; s++) {
+                beginKinematicStep(&w.kinematics, &w.grid, &w.points, 0.01, reach);
+                for (int q = 0; q < subSteps; q++) {
+                    collideKinematic(&w.kinematics, &w.points, NULL, 0, (q + 1.0) / subSteps, w.radius, w.solver.restitution);
+                }
+                endKinematicStep(&w.kinematics);
+            }
+            bladeTime = now() - start;
+        }
+        printf("%-8d %12.2f %14.2f %12d %12d\n", blades, 1e3 * elapsed / steps, 1e3 * bladeTime / steps,
+               w.kinematics.pairCount, w.kinematics.activeCount);
+        freeWorld(&w);
+    }
+}
+
+// Mean and largest relative stretch over the distance links
+static void stretchStats(const physicsWorld *w, double *mean, double *worst) {
+    const constraintBatch *b = &w->constraints.batches[CONSTRAINT_DISTANCE];
+    double sum = 0.0, largest = 0.0;
+    for (int n = 0; n < b->count; n++) {
+        vector2 p = w->points.points[b->p0[n]].position, q = w->points.points[b->p1[n]].position;
+        double length = sqrt((p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y));
+        double stretch = fabs(length - b->rest[n]) / b->rest[n];
+        sum += stretch;
+        largest = stretch > largest ? stretch : largest;
+    }
+    *mean = b->count > 0 ? sum / b->count : 0.0;
+    *worst = largest;
+}
+
+static void benchConstraints(int balls, int steps) {
+    // Gauss-Seidel carries a correction only so many links per pass, so a
+    // single sheet hundreds of balls tall never settles at a few passes; the
+    // bench scales the number of sheets instead of their size
+    const int subSteps = 4, iterations = 4, side = 32;
+    printf("%d steps of %d substeps at %d constraint passes, up to %d balls in sheets of %dx%d pinned along the top row\n",
+           steps, subSteps, iterations, balls, side, side);
+    printf("%-10s %10s %8s %8s %12s %14s %10s %10s %10s\n", "links", "balls", "sheets", "colors", "ms/step", "solve ms/sub",
+           "ns/link", "stretch", "worst");
+
+    // A hundredth, a tenth and all of the balls
+    int counts[3] = {balls / 100 / (side * side), balls / 10 / (side * side), balls / (side * side)};
+    int previous = 0;
+    for (int c = 0; c < 3; c++) {
+        int sheets = counts[c] > 1 ? counts[c] : 1;
+        if (sheets == previous) {
+            continue;
+        }
+        previous = sheets;
+        // Every sheet the same size, so each settles alike; the border grows
+        // to hold the tiles, a fifth of each tile left as gap
+        int across = (int)ceil(sqrt((double)sheets));
+        double pitch = 1.2;
+        float radius = (float)(0.4 * pitch / side);
+        int n = sheets * side * side;
+        physicsWorld w;
+        initWorld(&w, n, radius, (float)(BENCH_BORDER * across));
+        w.solver.mode = SOLVER_COLORED;
+        pointArray *a = &w.points;
+        for (int t = 0; t < sheets; t++) {
+            double left = -0.6 * across + (t % across) * pitch, top = 0.6 * across - (t / across) * pitch;
+            for (int k = 0; k < side * side; k++) {
+                centerPoint *p = &a->points[t * side * side + k];
+                p->position = (vector2){left + (2 * (k % side) + 1) * radius, top - 2 * (k / side) * radius};
+                p->velocity = (vector2){0.0, 0.0};
+                p->acceleration = (vector2){0.0, 0.0};
+            }
+        }
+        a->size = n;
+        a->revision++;
+        for (int t = 0; t < sheets; t++) {
+            addSheet(&w.constraints, a, t * side * side, side, side, 0.0, 1e-6);
+            for (int q = 0; q < side; q++) {
+                addPinConstraint(&w.constraints, t * side * side + q, a->points[t * side * side + q].position, 0.0);
+            }
+        }
+        w.constraints.iterations = iterations;
+
+        double start = now();
+        for (int s = 0; s < steps; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        double elapsed = now() - start;
+
+        // The constraint work alone, on the final state
+        int repeats = 20;
+        start = now();
+        for (int s = 0; s < repeats; s++) {
+            solveConstraints(&w.constraints, a, 0.01 / subSteps);
+        }
+        double solve = (now() - start) / repeats;
+        int links = constraintCount(&w.constraints);
+        int colors = 0;
+        for (int k = 0; k < CONSTRAINT_KINDS; k++) {
+            colors += w.constraints.batches[k].numColors;
+        }
+        double mean, worst;
+        stretchStats(&w, &mean, &worst);
+        printf("%-10d %10d %8d %8d %12.2f %14.3f %10.2f %9.2f%% %9.2f%%\n", links, a->size, sheets, colors,
+               1e3 * elapsed / steps, 1e3 * solve, 1e9 * solve / (links * iterations), 100.0 * mean, 100.0 * worst);
+        freeWorld(&w);
+    }
+}
+
+// Lays out bodies of four balls on a lattice inside the border, squares and
+// rods in turn; glues them unless loose. Returns how many balls were placed.
+static int buildComposites(physicsWorld *w, int balls, int loose) {
+    pointArray *a = &w->points;
+    double r = w->radius, pitch = 9.0 * r, reach = BENCH_BORDER - 5.0 * r;
+    int n = 0, body = 0;
+    for (double y = -reach; y <= reach && n + 4 <= balls; y += pitch) {
+        for (double x = -reach; x <= reach && n + 4 <= balls; x += pitch) {
+            if (x * x + y * y > reach * reach) {
+                continue;
+            }
+            int members[4];
+            for (int k = 0; k < 4; k++) {
+                vector2 offset = body % 2 ? (vector2){(k % 2 - 0.5) * 2.0 * r, (k / 2 - 0.5) * 2.0 * r}
+                                          : (vector2){(k - 1.5) * 2.0 * r, 0.0};
+                a->points[n] = (centerPoint){{x + offset.x, y + offset.y}, {0.0, 0.0}, {0.0, 0.0}};
+                members[k] = n++;
+            }
+            a->size = n;
+            if (!loose) {
+                addRigidBody(&w->rigid, a, members, 4);
+            }
+            body++;
+        }
+    }
+    a->revision++;
+    return n;
+}
+
+static void benchRigid(int balls, int steps) {
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+    printf("up to %d balls in bodies of 4, %d steps of %d substeps after 200 to settle\n", balls, steps, subSteps);
+    printf("%-8s %10s %10s %12s %12s %12s\n", "layout", "balls", "bodies", "ms/step", "mean ovl", "max ovl");
+
+    for (int loose = 1; loose >= 0; loose--) {
+        physicsWorld w;
+        initWorld(&w, balls, radius, BENCH_BORDER);
+        w.solver.mode = SOLVER_ITERATIVE;
+        w.substeps.ccd = 1;
+        int placed = buildComposites(&w, balls, loose);
+        for (int s = 0; s < 200; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+
+        double start = now();
+        for (int s = 0; s < steps; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        double elapsed = now() - start;
+
+        double maxOverlap, meanOverlap;
+        overlapStats(&w, &maxOverlap, &meanOverlap);
+        printf("%-8s %10d %10d %12.2f %11.2f%% %11.2f%%\n", loose ? "loose" : "bodies", placed, w.rigid.count,
+               1e3 * elapsed / steps, 100.0 * meanOverlap, 100.0 * maxOverlap);
+        freeWorld(&w);
+    }
+}
+
+// Relative rms and largest error of the last computeLongRangeForces over the
+// sampled balls
+static void forceErrors(const physicsWorld *w, const vector2 *exact, int samples, double *rms, double *worst) {
+    double squared = 0.0, reference = 0.0, largest = 0.0;
+    for (int k = 0; k < samples; k++) {
+        vector2 f = w->longRangeWork.acceleration[(int)((long long)k * w->points.size / samples)];
+        double ex = f.x - exact[k].x, ey = f.y - exact[k].y;
+        double e = sqrt(ex * ex + ey * ey), m = sqrt(exact[k].x * exact[k].x + exact[k].y * exact[k].y);
+        squared += e * e;
+        reference += m * m;
+        largest = m > 0.0 && e / m > largest ? e / m : largest;
+    }
+    *rms = reference > 0.0 ? sqrt(squared / reference) : 0.0;
+    *worst = largest;
+}
+
+static double timeLongRange(physicsWorld *w, const longRangeSettings *s, int steps) {
+    double start = now();
+    for (int r = 0; r < steps; r++) {
+        computeLongRangeForces(&w->longRangeWork, s, &w->points);
+    }
+    return (now() - start) / steps;
+}
+
+static void benchLongRange(int balls, int steps) {
+    const double thetas[] = {0.3, 0.5, 0.7, 1.0};
+    const int orders[] = {4, 8, 12, 16, 24, 32};
+    const int samples = balls < 1000 ? balls : 1000;
+    physicsWorld w;
+    initWorld(&w, balls, pileRadius(balls), BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    pointArray *a = &w.points;
+    // Unsoftened, the kernel the FMM's far field uses, so every method is
+    // measured against the same sum
+    longRangeSettings s = w.longRange;
+    s.softening = 0.0;
+
+    // The reference on an evenly spread sample, timed to extrapolate
+    vector2 *exact = (vector2 *)malloc(samples * sizeof(vector2));
+    double start = now();
+    for (int k = 0; k < samples; k++) {
+        exact[k] = directForce(&s, a, (int)((long long)k * balls / samples));
+    }
+    double direct = (now() - start) * balls / samples;
+    printf("%d balls, %d steps per setting (threads %d), errors over %d sampled balls\n", balls, steps, maxThreads(),
+           samples);
+    printf("direct sum: %.1f ms (extrapolated)\n", 1e3 * direct);
+    printf("%-12s %8s %12s %12s %12s %12s %10s\n", "method", "setting", "build ms", "force ms", "rms error",
+           "max error", "speedup");
+
+    s.mode = LONG_RANGE_BARNES_HUT;
+    for (int t = 0; t < (int)(sizeof(thetas) / sizeof(thetas[0])); t++) {
+        s.theta = thetas[t];
+        start = now();
+        for (int r = 0; r < steps; r++) {
+            buildBarnesHut(&w.longRangeWork, &s, a);
+        }
+        double build = (now() - start) / steps;
+        // computeLongRangeForces rebuilds the tree, so its time covers both
+        double total = timeLongRange(&w, &s, steps);
+        double rms, worst;
+        forceErrors(&w, exact, samples, &rms, &worst);
+        printf("%-12s %8.2f %12.2f %12.2f %12.2e %12.2e %9.0fx\n", "barnes-hut", thetas[t], 1e3 * build,
+               1e3 * (total - build), rms, worst, direct / total);
+    }
+
+    // The accuracy against time curve: the tree is fixed by boxSize, only
+    // the expansions grow
+    s.mode = LONG_RANGE_FMM;
+    for (int p = 0; p < (int)(sizeof(orders) / sizeof(orders[0])); p++) {
+        s.order = orders[p];
+        double total = timeLongRange(&w, &s, steps);
+        double rms, worst;
+        forceErrors(&w, exact, samples, &rms, &worst);
+        printf("%-12s %8d %12s %12.2f %12.2e %12.2e %9.0fx\n", "fmm", orders[p], "-", 1e3 * total, rms, worst,
+               direct / total);
+    }
+    free(exact);
+    freeWorld(&w);
+}
+
+// Hexagonally packed column of touching balls filling the left of the
+// border, every solidEvery-th one left solid
+static int buildDamBreak(physicsWorld *w, int balls, int solidEvery) {
+    pointArray *a = &w->points;
+    double r = w->radius, reach = BENCH_BORDER - 2.0 * r, rowHeight = sqrt(3.0) * r;
+    int n = 0;
+    for (int row = 0; n < balls; row++) {
+        double y = -reach + row * rowHeight;
+        if (y > reach) {
+            break;
+        }
+        for (double x = -reach + (row % 2) * r; x <= 0.0 && n < balls; x += 2.0 * r) {
+            if (x * x + y * y > reach * reach) {
+                continue;
+            }
+            a->points[n] = (centerPoint){{x, y}, {0.0, 0.0}, {0.0, 0.0}};
+            if (n % solidEvery != 0) {
+                setFluid(&w->fluid, n, 1);
+            }
+            n++;
+        }
+    }
+    a->size = n;
+    a->revision++;
+    return n;
+}
+
+static void benchSph(int balls, int steps) {
+    const int subSteps = 10;
+    // Half the pile's usual radius so the column is tall enough to flow
+    float radius = 0.5f * pileRadius(balls);
+    physicsWorld w;
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    int placed = buildDamBreak(&w, balls, 16);
+    printf("dam break of %d balls (%d fluid), %d steps of %d substeps (threads %d)\n", placed, w.fluid.count, steps,
+           subSteps, maxThreads());
+    printf("%-8s %12s %14s %12s %12s %12s %12s\n", "steps", "ms/step", "fluid ms/sub", "neighbours", "density",
+           "max density", "solid ovl");
+
+    for (int done = 0; done < steps;) {
+        int chunk = steps / 4 > 0 ? steps / 4 : 1;
+        double start = now();
+        for (int s = 0; s < chunk; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        double elapsed = (now() - start) / chunk;
+        done += chunk;
+
+        // The fluid work alone, on the current lists
+        start = now();
+        for (int s = 0; s < 10; s++) {
+            computeFluidForces(&w.fluid, &w.sph, &w.points, &w.grid, w.radius);
+        }
+        double fluid = (now() - start) / 10;
+        double sum = 0.0, densest = 0.0, neighbours = 0.0;
+        for (int p = 0; p < w.fluid.listed; p++) {
+            neighbours += w.fluid.neighbourCount[p];
+            double ratio = w.fluid.density[w.fluid.particles[p]] / w.fluid.restDensity;
+            sum += ratio;
+            densest = ratio > densest ? ratio : densest;
+        }
+        double maxOverlap, meanOverlap;
+        overlapStats(&w, &maxOverlap, &meanOverlap);
+        int listed = w.fluid.listed > 0 ? w.fluid.listed : 1;
+        printf("%-8d %12.2f %14.3f %12.1f %12.3f %12.3f %11.2f%%\n", done, 1e3 * elapsed, 1e3 * fluid,
+               neighbours / listed, sum / listed, densest, 100.0 * meanOverlap);
+    }
+    freeWorld(&w);
+}
+
+// One of each kind; the grid swirls over the whole border square
+static int addFieldOfKind(forceFieldSet *s, forceFieldKind kind) {
+    switch (kind) {
+    case FIELD_UNIFORM:
+        return addUniformField(s, 0.5, 0.0);
+    case FIELD_RADIAL:
+        return addRadialField(s, 0.2, 0.3, 0.05, 0.05, 0.5);
+    case FIELD_VORTEX:
+        return addVortexField(s, -0.2, 0.0, 0.5, 0.05, 0.0);
+    case FIELD_DRAG:
+        return addDragField(s, 0.1, 0.5);
+    default: {
+        enum { SIDE = 64 };
+        static float gx[SIDE * SIDE], gy[SIDE * SIDE];
+        for (int r = 0; r < SIDE; r++) {
+            for (int c = 0; c < SIDE; c++) {
+                gx[r * SIDE + c] = (float)sin(0.2 * r);
+                gy[r * SIDE + c] = (float)cos(0.2 * c);
+            }
+        }
+        return addGridField(s, -BENCH_BORDER, -BENCH_BORDER, 2.0 * BENCH_BORDER / (SIDE - 1), SIDE, SIDE, gx, gy);
+    }
+    }
+}
+
+static void benchFields(int balls, int steps) {
+    const char *names[5] = {"uniform", "radial", "vortex", "drag", "grid"};
+    physicsWorld w;
+    initWorld(&w, balls, pileRadius(balls), BENCH_BORDER);
+    scatterBalls(&w, balls, 12345);
+    printf("%d balls, %d passes each (threads %d)\n", balls, steps, maxThreads());
+    printf("%-12s %12s\n", "field", "ns/ball");
+
+    for (int k = 0; k <= 5; k++) {
+        forceFieldSet set;
+        initForceFieldSet(&set);
+        for (int f = 0; f < 5; f++) {
+            if (f == k || k == 5) {
+                addFieldOfKind(&set, (forceFieldKind)f);
+            }
+        }
+        double start = now();
+        for (int s = 0; s < steps; s++) {
+            applyForceFields(&set, &w.points, 1e-6);
+        }
+        printf("%-12s %12.2f\n", k < 5 ? names[k] : "all five", 1e9 * (now() - start) / steps / balls);
+        freeForceFieldSet(&set);
+    }
+
+    // A disc emitter spawning as many balls in ten bursts
+    emitterSet emitters;
+    initEmitterSet(&emitters);
+    emitter e = {EMITTER_DISC, {0.0, 0.0}, {0.5, 0.0}, 100.0 * balls, {0.0, 1.0}, 0.2, 0.5, balls, 0, 0.0, 0};
+    addEmitter(&emitters, &e, 42);
+    pointArray a;
+    initPointArray(&a, 16);
+    double start = now();
+    while (runEmitters(&emitters, &a, NULL, 0.001) >= 0) {
+    }
+    printf("%-12s %12.2f\n", "emitter", 1e9 * (now() - start) / balls);
+    freePointArray(&a);
+    freeEmitterSet(&emitters);
+    freeWorld(&w);
+}
+
+// Balls on a jittered square lattice filling the box, half its area
+// covered, with random velocities; returns the ball count
+static int buildGas(physicsWorld *w, int balls, unsigned int seed) {
+    int side = (int)ceil(sqrt((double)balls));
+    double spacing = 2.0 * BENCH_BORDER / side;
+    centerPoint *points = (centerPoint *)malloc(side * side * sizeof(centerPoint));
+    srand(seed);
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            double jx = (rand() / (double)RAND_MAX - 0.5) * 0.1 * spacing;
+            double jy = (rand() / (double)RAND_MAX - 0.5) * 0.1 * spacing;
+            double t = 2.0 * 3.14159265358979323846 * rand() / (double)RAND_MAX;
+            double speed = 20.0 * w->radius;
+            points[r * side + c] = (centerPoint){{-BENCH_BORDER + (c + 0.5) * spacing + jx, -BENCH_BORDER + (r + 0.5) * spacing + jy},
+                                                 {speed * cos(t), speed * sin(t)}, {0.0, 0.0}};
+        }
+    }
+    w->points.size = 0;
+    addPoints(&w->points, points, side * side);
+    free(points);
+    return side * side;
+}
+
+static double kineticEnergy(const pointArray *a) {
+    double sum = 0.0;
+    for (int i = 0; i < a->size; i++) {
+        sum += 0.5 * (a->points[i].velocity.x * a->points[i].velocity.x + a->points[i].velocity.y * a->points[i].velocity.y);
+    }
+    return sum;
+}
+
+static void benchPeriodic(int balls, int steps) {
+    const int subSteps = 4;
+    int side = (int)ceil(sqrt((double)balls));
+    // Half the area covered: pi r^2 = spacing^2 / 2
+    float radius = (float)(2.0 * BENCH_BORDER / side * sqrt(0.5 / 3.14159265358979323846));
+    physicsWorld w;
+    initWorld(&w, side * side, radius, BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    w.solver.restitution = 1.0;
+    w.solver.friction = 0.0;
+    if (setPeriodic(&w, 1) != 0) {
+        freeWorld(&w);
+        return;
+    }
+    addUniformField(&w.fields, 0.0, GRAVITY);
+    int placed = buildGas(&w, balls, 12345);
+    double start = kineticEnergy(&w.points);
+    printf("%d balls in a periodic box, %d x %d cells, %d steps of %d substeps (threads %d)\n", placed, w.grid.cols,
+           w.grid.rows, steps, subSteps, maxThreads());
+    printf("%-8s %12s %12s %12s %12s %12s %10s\n", "steps", "ms/step", "contacts", "across edge", "mean ovl",
+           "energy", "outside");
+
+    for (int done = 0; done < steps;) {
+        int chunk = steps / 4 > 0 ? steps / 4 : 1;
+        double t0 = now();
+        for (int s = 0; s < chunk; s++) {
+            stepWorld(&w, 0.01, subSteps);
+        }
+        double elapsed = (now() - t0) / chunk;
+        done += chunk;
+
+        int across = 0;
+        for (int k = 0; k < w.contacts.count; k++) {
+            across += w.contacts.items[k].shift.x != 0.0 || w.contacts.items[k].shift.y != 0.0;
+        }
+        // Balls drift out by at most a step's travel before the next wrap
+        int outside = 0;
+        double limit = BENCH_BORDER + 0.5 * w.grid.cellSize;
+        for (int i = 0; i < w.points.size; i++) {
+            outside += fabs(w.points.points[i].position.x) > limit || fabs(w.points.points[i].position.y) > limit;
+        }
+        double maxOverlap, meanOverlap;
+        overlapStats(&w, &maxOverlap, &meanOverlap);
+        printf("%-8d %12.2f %12d %12d %11.2f%% %12.3f %10d\n", done, 1e3 * elapsed, w.contacts.count, across,
+               100.0 * meanOverlap, kineticEnergy(&w.points) / start, outside);
+    }
+    freeWorld(&w);
+}
+
+// Scatters n spheres uniformly over the ball the border encloses
+static void scatterSpheres(world3d *w, int n, unsigned int seed) {
+    sphere *spheres = (sphere *)malloc(n * sizeof(sphere));
+    srand(seed);
+    double reach = BENCH_BORDER - w->radius;
+    for (int i = 0; i < n;) {
+        double x = 2.0 * rand() / (double)RAND_MAX - 1.0;
+        double y = 2.0 * rand() / (double)RAND_MAX - 1.0;
+        double z = 2.0 * rand() / (double)RAND_MAX - 1.0;
+        if (x * x + y * y + z * z > 1.0) {
+            continue;
+        }
+        spheres[i++] = (sphere){{reach * x, reach * y, reach * z}, {0.0, 0.0, 0.0}};
+    }
+    w->spheres.size = 0;
+    addSpheres(w, spheres, n);
+    free(spheres);
+}
+
+static void bench3d(int balls, int steps) {
+    const int subSteps = 4;
+    printf("%d balls, %d steps of %d substeps after settling (threads %d)\n", balls, steps, subSteps, maxThreads());
+    printf("%-6s %12s %14s %14s %12s\n", "space", "ms/step", "ns/ball-sub", "contacts/ball", "mean ovl");
+
+    physicsWorld w;
+    initWorld(&w, balls, pileRadius(balls), BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    scatterBalls(&w, balls, 12345);
+    for (int s = 0; s < 100; s++) {
+        stepWorld(&w, 0.01, subSteps);
+    }
+    long long contacts = 0;
+    double start = now();
+    for (int s = 0; s < steps; s++) {
+        stepWorld(&w, 0.01, subSteps);
+        contacts += w.contacts.count;
+    }
+    double elapsed = now() - start;
+    double maxOverlap, meanOverlap;
+    overlapStats(&w, &maxOverlap, &meanOverlap);
+    printf("%-6s %12.2f %14.1f %14.2f %11.2f%%\n", "2d", 1e3 * elapsed / steps, 1e9 * elapsed / steps / subSteps / balls,
+           (double)contacts / steps / balls, 100.0 * meanOverlap);
+    freeWorld(&w);
+
+    // The same fraction of the ball's volume as pileRadius fills of the disc
+    world3d v;
+    initWorld3d(&v, balls, (float)(BENCH_BORDER * cbrt(0.4 / balls)), BENCH_BORDER);
+    scatterSpheres(&v, balls, 12345);
+    for (int s = 0; s < 100; s++) {
+        stepWorld3d(&v, 0.01, subSteps);
+    }
+    contacts = 0;
+    start = now();
+    for (int s = 0; s < steps; s++) {
+        stepWorld3d(&v, 0.01, subSteps);
+        contacts += v.contactsFound;
+    }
+    elapsed = now() - start;
+    double sum = 0.0;
+    int touching = 0;
+    for (int k = 0; k < v.contacts.count; k++) {
+        const contact3d *c = &v.contacts.items[k];
+        if (c->b != BORDER_CONTACT && c->depth > 0.0) {
+            sum += c->depth / (2.0 * v.radius);
+            touching++;
+        }
+    }
+    printf("%-6s %12.2f %14.1f %14.2f %11.2f%%\n", "3d", 1e3 * elapsed / steps, 1e9 * elapsed / steps / subSteps / balls,
+           (double)contacts / steps / balls, touching > 0 ? 100.0 * sum / touching : 0.0);
+    freeWorld3d(&v);
+}
+
+// Runs one decomposed pile; address NULL means the memory transport.
+// Returns 0, or -1 if the transport could not be set up.
+static int runDomain(int balls, int steps, int ranks, const char *address, int port, int rebalance) {
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+    transport *nets = (transport *)malloc(ranks * sizeof(transport));
+    if (address == NULL && openMemoryTransports(nets, ranks) != 0) {
+        free(nets);
+        return -1;
+    }
+    physicsWorld seed;
+    initWorld(&seed, balls, radius, BENCH_BORDER);
+    scatterBalls(&seed, balls, 12345);
+    int failed = 0, ghosts = 0, migrated = 0, rebalances = 0;
+    long long kept = 0;
+    double elapsed = 0.0, imbalance = 0.0;
+
+    #pragma omp parallel num_threads(ranks) reduction(+:failed, ghosts, migrated)
+    {
+#ifdef _OPENMP
+        int rank = omp_get_thread_num();
+#else
+        int rank = 0;
+#endif
+        if (address != NULL) {
+            failed += openSocketTransport(&nets[rank], address, port, rank, ranks, 10.0) != 0;
+        }
+        #pragma omp barrier
+        // One failed rank leaves the others without a peer, so all stop
+        int ready = 1;
+        #pragma omp critical
+        ready = failed == 0;
+        #pragma omp barrier
+        if (ready) {
+            physicsWorld w;
+            domain d;
+            initWorld(&w, balls / ranks, radius, BENCH_BORDER);
+            w.solver.mode = SOLVER_ITERATIVE;
+            initDomain(&d, &nets[rank], &w);
+            // Fixed cuts still measure the imbalance, they just never move
+            if (!rebalance) {
+                d.rebalanceThreshold = HUGE_VAL;
+            }
+            scatterToDomain(&d, seed.points.points, seed.points.size, 0);
+            double start = now();
+            for (int s = 0; s < steps && failed == 0; s++) {
+                failed += stepDomain(&d, 0.01, subSteps) != 0;
+                ghosts += d.stats.ghosts;
+                migrated += d.stats.migrated;
+                if (rank == 0) {
+                    rebalances += d.stats.rebalanced;
+                }
+            }
+            long long count = domainBallCount(&d);
+            if (rank == 0) {
+                elapsed = now() - start;
+                imbalance = d.stats.imbalance;
+                kept = count;
+            }
+            freeDomain(&d);
+            freeWorld(&w);
+        }
+        closeTransport(&nets[rank]);
+    }
+    freeWorld(&seed);
+    free(nets);
+    if (failed > 0) {
+        return -1;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%s%s", address == NULL ? "memory" : (strncmp(address, "unix:", 5) == 0 ? "unix" : "tcp"),
+             rebalance ? "" : ", fixed");
+    printf("%-16s %6d %10.2f %10.3f %10d %10.1f %10.1f %10s\n", name, ranks, 1e3 * elapsed / steps, imbalance,
+           rebalances, (double)ghosts / steps, (double)migrated / steps, kept == balls ? "yes" : "NO");
+    return 0;
+}
+
+static void benchDistributed(int balls, int steps) {
+    const int ranks = 4;
+    printf("%d balls, %d steps over %d ranks as threads (%d cores)\n", balls, steps, ranks, maxThreads());
+    printf("%-16s %6s %10s %10s %10s %10s %10s %10s\n", "transport", "ranks", "ms/step", "imbalance", "rebalances",
+           "ghosts", "migrated", "all there");
+    runDomain(balls, steps, 1, NULL, 0, 0);
+    runDomain(balls, steps, ranks, NULL, 0, 0);
+    runDomain(balls, steps, ranks, NULL, 0, 1);
+    if (runDomain(balls, steps, ranks, "127.0.0.1", 47310, 1) != 0) {
+        printf("%-16s (no loopback sockets here)\n", "tcp");
+    }
+#ifndef _WIN32
+    if (runDomain(balls, steps, ranks, "unix:/tmp/bench-domain", 0, 1) != 0) {
+        printf("%-16s (no Unix sockets here)\n", "unix");
+    }
+#endif
+}
+
+// Rewrites the snapshot at from as another writer would have left it: a
+// header of headerSize bytes claiming version (bytes past this build's
+// header filled with junk) and the contacts stored contactSize bytes apart.
+// The checksums are recomputed the way snapshot.c does. Returns 0 or -1.
+static int rewriteSnapshot(const char *from, const char *to, unsigned int version, unsigned int headerSize, unsigned int contactSize) {
+    FILE *f = fopen(from, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *in = (unsigned char *)malloc(size);
+    int failed = in == NULL || fread(in, size, 1, f) != 1;
+    fclose(f);
+    if (failed) {
+        free(in);
+        return -1;
+    }
+
+    snapshotHeader h;
+    memcpy(&h, in, sizeof(h));
+    unsigned long long pointBytes = h.pointCount * sizeof(centerPoint);
+    unsigned long long contactBytes = h.contactCount * contactSize;
+    unsigned long long outSize = h.contactOffset + contactBytes;
+    unsigned char *out = (unsigned char *)calloc(outSize, 1);
+    if (out == NULL) {
+        free(in);
+        return -1;
+    }
+    memcpy(out + h.pointOffset, in + h.pointOffset, pointBytes);
+    for (unsigned long long k = 0; k < h.contactCount; k++) {
+        memcpy(out + h.contactOffset + k * contactSize, in + h.contactOffset + k * sizeof(contact),
+               contactSize < sizeof(contact) ? contactSize : sizeof(contact));
+    }
+    h.version = version;
+    h.headerSize = headerSize;
+    h.contactSize = contactSize;
+    h.payloadChecksum = snapshotChecksum(out + h.contactOffset, contactBytes, snapshotChecksum(out + h.pointOffset, pointBytes, 0));
+    h.headerChecksum = 0;
+    memcpy(out, &h, headerSize < sizeof(h) ? headerSize : sizeof(h));
+    for (unsigned int k = sizeof(h); k < headerSize; k++) {
+        out[k] = (unsigned char)(0xa5 ^ k);
+    }
+    unsigned long long checksum = snapshotChecksum(out, headerSize, 1);
+    memcpy(out + offsetof(snapshotHeader, headerChecksum), &checksum, sizeof(checksum));
+
+    f = fopen(to, "wb");
+    failed = f == NULL || fwrite(out, outSize, 1, f) != 1;
+    if (f != NULL && fclose(f) != 0) {
+        failed = 1;
+    }
+    free(in);
+    free(out);
+    return failed ? -1 : 0;
+}
+
+// How a loaded world compares with the one that was saved: -1 if the
+// points differ, otherwise the number of contacts it came back with
+// Writers before version 3 leave the substep settings at initWorld's
+static int compareRestored(const physicsWorld *saved, const physicsWorld *loaded, int substeps) {
+    const substepSettings *expected = substeps ? &saved->substeps : &(substepSettings){0};
+    if (loaded->points.size != saved->points.size
+        || memcmp(loaded->points.points, saved->points.points, saved->points.size * sizeof(centerPoint)) != 0
+        || loaded->step != saved->step || loaded->periodic != saved->periodic
+        || loaded->substeps.adaptive != expected->adaptive || loaded->substeps.ccd != expected->ccd
+        || (substeps && loaded->stats.overlapSubSteps != saved->stats.overlapSubSteps)) {
+        return -1;
+    }
+    return loaded->contacts.count;
+}
+
+static void benchSnapshots(int balls, int steps) {
+    const char *path = "bench_snapshot.snap";
+    const char *rewritten = "bench_snapshot_old.snap";
+    float radius = pileRadius(balls);
+    physicsWorld w;
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    w.substeps.adaptive = 1;
+    w.substeps.ccd = 1;
+    scatterBalls(&w, balls, 12345);
+    for (int s = 0; s < steps; s++) {
+        stepWorld(&w, 0.01, 4);
+    }
+
+    printf("%d balls, %d contacts after %d steps\n", balls, w.contacts.count, steps);
+    printf("%-16s %10s\n", "operation", "ms");
+    double start = now();
+    int saved = saveSnapshot(&w, path);
+    printf("%-16s %10.2f\n", "save", 1e3 * (now() - start));
+    if (saved != 0) {
+        freeWorld(&w);
+        return;
+    }
+    physicsWorld l;
+    start = now();
+    if (loadSnapshot(&l, path) == 0) {
+        printf("%-16s %10.2f\n", "load", 1e3 * (now() - start));
+        freeWorld(&l);
+    }
+    for (int verify = 0; verify < 2; verify++) {
+        snapshotMapping m;
+        start = now();
+        if (mapSnapshot(&l, path, verify, &m) == 0) {
+            printf("%-16s %10.2f\n", verify ? "map + verify" : "map", 1e3 * (now() - start));
+            freeWorld(&l);
+            unmapSnapshot(&m);
+        }
+    }
+
+    // Versions, header sizes and contact layouts other writers leave
+    const char *names[] = {"current", "version 2", "version 1", "newer header", "contact layout"};
+    unsigned int versions[] = {SNAPSHOT_VERSION, 2, 1, SNAPSHOT_VERSION, SNAPSHOT_VERSION};
+    unsigned int headerSizes[] = {sizeof(snapshotHeader), offsetof(snapshotHeader, adaptive), offsetof(snapshotHeader, periodic),
+                                  sizeof(snapshotHeader) + 64, sizeof(snapshotHeader)};
+    unsigned int contactSizes[] = {sizeof(contact), sizeof(contact), sizeof(contact), sizeof(contact), sizeof(contact) + 8};
+    printf("\n%-16s %9s %11s %11s %8s\n", "writer", "expected", "load", "map", "result");
+    for (int c = 0; c < 5; c++) {
+        int expected = contactSizes[c] == sizeof(contact) ? w.contacts.count : 0;
+        int got[2] = {-2, -2};
+        if (rewriteSnapshot(path, rewritten, versions[c], headerSizes[c], contactSizes[c]) == 0) {
+            if (loadSnapshot(&l, rewritten) == 0) {
+                got[0] = compareRestored(&w, &l, versions[c] >= 3);
+                freeWorld(&l);
+            }
+            snapshotMapping m;
+            if (mapSnapshot(&l, rewritten, 1, &m) == 0) {
+                got[1] = compareRestored(&w, &l, versions[c] >= 3);
+                freeWorld(&l);
+                unmapSnapshot(&m);
+            }
+        }
+        char text[2][32];
+        for (int k = 0; k < 2; k++) {
+            if (got[k] == -2) {
+                snprintf(text[k], sizeof(text[k]), "failed");
+            } else if (got[k] == -1) {
+                snprintf(text[k], sizeof(text[k]), "points differ");
+            } else {
+                snprintf(text[k], sizeof(text[k]), "%d", got[k]);
+            }
+        }
+        printf("%-16s %9d %11s %11s %8s\n", names[c], expected, text[0], text[1],
+               verdict(got[0] == expected && got[1] == expected));
+    }
+
+    // State snapshots have no section for must stop the save
+    const char *held[] = {"segment", "force field", "constraint", "multi-rate"};
+    printf("\n%-16s %9s %8s\n", "holding", "save", "result");
+    for (int k = 0; k < 4; k++) {
+        physicsWorld u;
+        initWorld(&u, 2, radius, BENCH_BORDER);
+        const centerPoint pair[2] = {{{0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}}, {{2.0 * radius, 0.0}, {0.0, 0.0}, {0.0, 0.0}}};
+        addPoints(&u.points, pair, 2);
+        int added = 0;
+        if (k == 0) {
+            added = addSegment(&u.segments, (vector2){-0.5, -0.5}, (vector2){0.5, -0.5});
+        } else if (k == 1) {
+            added = addUniformField(&u.fields, 1.0, 0.0);
+        } else if (k == 2) {
+            added = addDistanceConstraint(&u.constraints, &u.points, 0, 1, 2.0 * radius, 0.0);
+        } else {
+            u.substeps.multiRate = 1;
+        }
+        // Fixed-point builds already refuse the add
+        int refused = added < 0 || saveSnapshot(&u, path) != 0;
+        printf("%-16s %9s %8s\n", held[k], refused ? "refused" : "written", verdict(refused));
+        freeWorld(&u);
+    }
+    remove(path);
+    remove(rewritten);
+    freeWorld(&w);
+}
+
+static void benchTrajectory(int balls, int steps) {
+    const trajectoryCodec codecs[] = {TRAJECTORY_CODEC_BUILTIN, TRAJECTORY_CODEC_LZ4, TRAJECTORY_CODEC_ZSTD};
+    const char *names[] = {"builtin", "lz4", "zstd"};
+    int available[] = {1, 0, 0};
+#ifdef HAVE_LZ4
+    available[1] = 1;
+#endif
+#ifdef HAVE_ZSTD
+    available[2] = 1;
+#endif
+    const char *path = "bench_trajectory.bin";
+    const int subSteps = 4;
+    float radius = pileRadius(balls);
+
+    physicsWorld w;
+    initWorld(&w, balls, radius, BENCH_BORDER);
+    w.solver.mode = SOLVER_ITERATIVE;
+    scatterBalls(&w, balls, 12345);
+    for (int s = 0; s < 100; s++) {
+        stepWorld(&w, 0.01, subSteps);
+    }
+    // Every codec records the same stretch of simulation
+    centerPoint *settled = (centerPoint *)malloc(balls * sizeof(centerPoint));
+    memcpy(settled, w.points.points, balls * sizeof(centerPoint));
+
+    double start = now();
+    for (int s = 0; s < steps; s++) {
+        stepWorld(&w, 0.01, subSteps);
+    }
+    double plain = (now() - start) / steps;
+
+    printf("%d balls, %d steps, %.3f ms per step without recording\n", balls, steps, 1e3 * plain);
+    printf("%-8s %10s %12s %12s %9s %9s %9s %12s\n", "codec", "precision", "overhead", "bytes/frame", "ratio", "dropped", "decimated", "max error");
+
+    const double precisions[] = {1e-4, 1e-6};
+    for (int c = 0; c < 3; c++) {
+        for (int q = 0; q < 2 && available[c]; q++) {
+            trajectorySettings settings;
+            defaultTrajectorySettings(&settings);
+            settings.codec = codecs[c];
+            settings.precision = precisions[q];
+            trajectoryWriter *t = openTrajectoryWriter(path, &settings);
+            if (t == NULL) {
+                return;
+            }
+            memcpy(w.points.points, settled, balls * sizeof(centerPoint));
+            w.points.revision++;
+
+            start = now();
+            for (int s = 0; s < steps; s++) {
+                stepWorld(&w, 0.01, subSteps);
+                recordFrame(t, &w.points, w.step);
+            }
+            double recorded = (now() - start) / steps;
+            trajectoryStats stats;
+            closeTrajectoryWriter(t, &stats);
+
+            // Compare the last recorded frame with the state it came from
+            double maxError = -1.0;
+            trajectoryReader r;
+            if (stats.framesRecorded == (unsigned long long)steps && openTrajectory(&r, path) == 0) {
+                if (readTrajectoryFrame(&r, r.frameCount - 1) == 0) {
+                    maxError = 0.0;
+                    for (int i = 0; i < r.count; i++) {
+                        maxError = fmax(maxError, fabs(r.positions[i].x - w.points.points[i].position.x));
+                        maxError = fmax(maxError, fabs(r.positions[i].y - w.points.points[i].position.y));
+                    }
+                }
+                closeTrajectory(&r);
+            }
+            unsigned long long frames = stats.framesRecorded > 0 ? stats.framesRecorded : 1;
+            printf("%-8s %10g %11.1f%% %12.0f %8.1fx %9llu %9llu %12.2e\n", names[c], precisions[q], 100.0 * (recorded / plain - 1.0),
+                   (double)stats.bytesWritten / frames, (double)stats.bytesRaw / stats.bytesWritten, stats.framesDropped, stats.framesDecimated, maxError);
+        }
+    }
+    remove(path);
+    free(settled);
+    freeWorld(&w);
+}
+
+int main(int argc, char **argv) {
+    const char *suite = argc > 1 ? argv[1] : "solvers";
+    int balls = argc > 2 ? atoi(argv[2]) : 20000;
+    int steps = argc > 3 ? atoi(argv[3]) : 100;
+
+    if (strcmp(suite, "solvers") == 0) {
+        benchSolvers(balls, steps);
+    } else if (strcmp(suite, "determinism") == 0) {
+        benchDeterminism(balls, steps);
+    } else if (strcmp(suite, "events") == 0) {
+        benchEvents(steps);
+    } else if (strcmp(suite, "fixed") == 0) {
+        benchFixed(balls, steps);
+    } else if (strcmp(suite, "substeps") == 0) {
+        benchSubSteps(balls, steps);
+    } else if (strcmp(suite, "multirate") == 0) {
+        benchMultiRate(balls, steps);
+    } else if (strcmp(suite, "ccd") == 0) {
+        benchCcd(balls, steps);
+    } else if (strcmp(suite, "sdf") == 0) {
+        benchSdf(balls, steps);
+    } else if (strcmp(suite, "segments") == 0) {
+        benchSegments(balls, steps);
+    } else if (strcmp(suite, "kinematic") == 0) {
+        benchKinematic(balls, steps);
+    } else if (strcmp(suite, "constraints") == 0) {
+        benchConstraints(balls, steps);
+    } else if (strcmp(suite, "rigid") == 0) {
+        benchRigid(balls, steps);
+    } else if (strcmp(suite, "longrange") == 0) {
+        benchLongRange(balls, steps);
+    } else if (strcmp(suite, "sph") == 0) {
+        benchSph(balls, steps);
+    } else if (strcmp(suite, "fields") == 0) {
+        benchFields(balls, steps);
+    } else if (strcmp(suite, "periodic") == 0) {
+        benchPeriodic(balls, steps);
+    } else if (strcmp(suite, "3d") == 0) {
+        bench3d(balls, steps);
+    } else if (strcmp(suite, "distributed") == 0) {
+        benchDistributed(balls, steps);
+    } else if (strcmp(suite, "snapshots") == 0) {
+        benchSnapshots(balls, steps);
+    } else if (strcmp(suite, "trajectory") == 0) {
+        benchTrajectory(balls, steps);
+    } else {
+        fprintf(stderr, "Unknown suite %s\n", suite);
+        return 1;
+    }
+    return benchFailures > 0;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common/ccd.h"
+
+void initCcdWorkspace(ccdWorkspace *w) {
+    w->balls = NULL;
+    w->count = 0;
+    w->displaced = NULL;
+    w->displacedCount = 0;
+    w->isDisplaced = NULL;
+    w->next = NULL;
+    w->ballCell = NULL;
+    w->capacity = 0;
+    w->cellHead = NULL;
+    w->cellCapacity = 0;
+}
+
+void freeCcdWorkspace(ccdWorkspace *w) {
+    free(w->balls);
+    free(w->displaced);
+    free(w->isDisplaced);
+    free(w->next);
+    free(w->ballCell);
+    free(w->cellHead);
+    initCcdWorkspace(w);
+}
+
+static void unlinkDisplaced(ccdWorkspace *w, int j) {
+    if (w->ballCell[j] < 0) {
+        return;
+    }
+    int *link = &w->cellHead[w->ballCell[j]];
+    while (*link != j) {
+        link = &w->next[*link];
+    }
+    *link = w->next[j];
+    w->ballCell[j] = -1;
+}
+
+static void linkDisplaced(ccdWorkspace *w, const spatialGrid *grid, const pointArray *a, int j) {
+    vector2 p = a->points[j].position;
+    int cell = gridClampRow(grid, p.y) * grid->cols + gridClampCol(grid, p.x);
+    w->next[j] = w->cellHead[cell];
+    w->cellHead[cell] = j;
+    w->ballCell[j] = cell;
+}
+
+void beginSweptStep(ccdWorkspace *w) {
+    for (int k = 0; k < w->displacedCount; k++) {
+        int j = w->displaced[k];
+        if (w->ballCell[j] >= 0) {
+            w->cellHead[w->ballCell[j]] = -1;
+            w->ballCell[j] = -1;
+        }
+        w->isDisplaced[j] = 0;
+    }
+    w->displacedCount = 0;
+}
+
+// Room for a->size balls and the grid's cells; new entries start empty.
+// Returns 0, or -1 on allocation failure.
+static int reserveCcd(ccdWorkspace *w, const pointArray *a, const spatialGrid *grid) {
+    if (a->size > w->capacity) {
+        int capacity = a->size * 2;
+        int *balls = (int *)realloc(w->balls, capacity * sizeof(int));
+        w->balls = balls != NULL ? balls : w->balls;
+        int *displaced = (int *)realloc(w->displaced, capacity * sizeof(int));
+        w->displaced = displaced != NULL ? displaced : w->displaced;
+        unsigned char *isDisplaced = (unsigned char *)realloc(w->isDisplaced, capacity);
+        w->isDisplaced = isDisplaced != NULL ? isDisplaced : w->isDisplaced;
+        int *next = (int *)realloc(w->next, capacity * sizeof(int));
+        w->next = next != NULL ? next : w->next;
+        int *ballCell = (int *)realloc(w->ballCell, capacity * sizeof(int));
+        w->ballCell = ballCell != NULL ? ballCell : w->ballCell;
+        if (balls == NULL || displaced == NULL || isDisplaced == NULL || next == NULL || ballCell == NULL) {
+            fprintf(stderr, "CCD workspace realloc failure\n");
+            return -1;
+        }
+        for (int j = w->capacity; j < capacity; j++) {
+            isDisplaced[j] = 0;
+            ballCell[j] = -1;
+        }
+        w->capacity = capacity;
+    }
+    int cells = grid->rows * grid->cols;
+    if (cells > w->cellCapacity) {
+        int *cellHead = (int *)realloc(w->cellHead, cells * sizeof(int));
+        if (cellHead == NULL) {
+            fprintf(stderr, "CCD workspace realloc failure\n");
+            return -1;
+        }
+        for (int cell = w->cellCapacity; cell < cells; cell++) {
+            cellHead[cell] = -1;
+        }
+        w->cellHead = cellHead;
+        w->cellCapacity = cells;
+    }
+    return 0;
+}
+
+// Earliest t in [0, limit] at which a ball at p moving with v touches a
+// ball at q (centres 2r apart), or limit + 1 if it does not. A pair that
+// already overlaps and is still closing hits at once; the contact list may
+// not have it, and nothing else would stop the ball going through.
+static double ballImpactTime(vector2 p, vector2 v, vector2 q, double diameter, double limit) {
+    double dx = p.x - q.x, dy = p.y - q.y;
+    double c = dx * dx + dy * dy - diameter * diameter;
+    double b = dx * v.x + dy * v.y;
+    if (b >= 0.0) {
+        return limit + 1.0;
+    }
+    if (c <= 0.0) {
+        return 0.0;
+    }
+    double aa = v.x * v.x + v.y * v.y;
+    double disc = b * b - aa * c;
+    if (disc < 0.0) {
+        return limit + 1.0;
+    }
+    // Smaller root of aa t^2 + 2 b t + c, written so it does not cancel
+    double t = c / (-b + sqrt(disc));
+    return t <= limit ? t : limit + 1.0;
+}
+
+// When a ball inside the circle of radius reach reaches it, or limit + 1
+static double borderImpactTime(vector2 p, vector2 v, double reach, double limit) {
+    double aa = v.x * v.x + v.y * v.y;
+    double c = p.x * p.x + p.y * p.y - reach * reach;
+    if (aa == 0.0 || c >= 0.0) {
+        return limit + 1.0;
+    }
+    double b = p.x * v.x + p.y * v.y;
+    // Larger root; c < 0 means there is exactly one positive one
+    double t = (-b + sqrt(b * b - aa * c)) / aa;
+    return t <= limit ? t : limit + 1.0;
+}
+
+// Keeps first (and hit) as the earliest impact of the ball at from moving
+// with v against ball j; ties go to the lower index, so the result does not
+// depend on the order candidates are visited in
+static void testBall(const pointArray *a, const spatialGrid *grid, int i, int j, vector2 from, vector2 v, double diameter,
+                     double remaining, double *first, int *hit) {
+    if (j == i || j >= a->size || gridSameGroup(grid, i, j)) {
+        return;
+    }
+    double t = ballImpactTime(from, v, a->points[j].position, diameter, remaining);
+    if (t < *first || (t == *first && *hit >= 0 && j < *hit)) {
+        *first = t;
+        *hit = j;
+    }
+}
+
+int sweepBall(pointArray *a, const spatialGrid *grid, const ccdWorkspace *work, int i, float radius, float borderRadius, double restitution, double h) {
+    centerPoint *p = &a->points[i];
+    double diameter = 2.0 * radius;
+    double reach = borderRadius - radius;
+    double remaining = h;
+    int impacts = 0;
+
+    while (remaining > 0.0) {
+        vector2 from = p->position, v = p->velocity;
+        vector2 to = {from.x + v.x * remaining, from.y + v.y * remaining};
+        double slack = diameter + grid->cellSize;
+        int x0 = gridClampCol(grid, fmin(from.x, to.x) - slack), x1 = gridClampCol(grid, fmax(from.x, to.x) + slack);
+        int y0 = gridClampRow(grid, fmin(from.y, to.y) - slack), y1 = gridClampRow(grid, fmax(from.y, to.y) + slack);
+
+        double first = borderImpactTime(from, v, reach, remaining);
+        int hit = first <= remaining ? BORDER_CONTACT : -2;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int cell = y * grid->cols + x;
+                for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+                    testBall(a, grid, i, grid->cellPoints[k], from, v, diameter, remaining, &first, &hit);
+                }
+                for (int j = work->cellHead[cell]; j >= 0; j = work->next[j]) {
+                    testBall(a, grid, i, j, from, v, diameter, remaining, &first, &hit);
+                }
+            }
+        }
+        if (hit == -2) {
+            break;
+        }
+
+        p->position = (vector2){from.x + v.x * first, from.y + v.y * first};
+        remaining -= first;
+        // Out of impacts the ball stays where this one happens for the rest
+        // of the substep; moving on unswept could pass through anything
+        if (impacts++ == CCD_MAX_IMPACTS) {
+            remaining = 0.0;
+        }
+        if (hit == BORDER_CONTACT) {
+            // Bounce off the wall with the contacts' restitution
+            double distance = sqrt(p->position.x * p->position.x + p->position.y * p->position.y);
+            double nx = p->position.x / distance, ny = p->position.y / distance;
+            double outward = v.x * nx + v.y * ny;
+            p->velocity.x -= (1.0 + restitution) * outward * nx;
+            p->velocity.y -= (1.0 + restitution) * outward * ny;
+            continue;
+        }
+        centerPoint *q = &a->points[hit];
+        double dx = p->position.x - q->position.x, dy = p->position.y - q->position.y;
+        double distance = sqrt(dx * dx + dy * dy);
+        double nx = distance > 0.0 ? dx / distance : 0.0, ny = distance > 0.0 ? dy / distance : 1.0;
+        double vn = (p->velocity.x - q->velocity.x) * nx + (p->velocity.y - q->velocity.y) * ny;
+        if (vn < 0.0) {
+            // Unit masses share the normal impulse
+            double j = -(1.0 + restitution) * vn * 0.5;
+            p->velocity.x += j * nx;
+            p->velocity.y += j * ny;
+            q->velocity.x -= j * nx;
+            q->velocity.y -= j * ny;
+        }
+    }
+    integratePosition(p, remaining);
+    clampToBorder(p, radius, borderRadius);
+    return impacts;
+}
+
+int integrateSwept(pointArray *a, const spatialGrid *grid, ccdWorkspace *work, float radius, float borderRadius, double restitution, double maxSpeed, double h) {
+    if (reserveCcd(work, a, grid) != 0) {
+        return 0;
+    }
+
+    // Decided before anything moves: an impact can make a slow ball fast,
+    // and it must still move only once
+    double limit2 = maxSpeed * maxSpeed;
+    work->count = 0;
+    for (int i = 0; i < a->size; i++) {
+        vector2 v = a->points[i].velocity;
+        if (v.x * v.x + v.y * v.y > limit2) {
+            work->balls[work->count++] = i;
+            if (!work->isDisplaced[i]) {
+                work->isDisplaced[i] = 1;
+                work->displaced[work->displacedCount++] = i;
+            }
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a->size; i++) {
+        vector2 v = a->points[i].velocity;
+        if (v.x * v.x + v.y * v.y <= limit2) {
+            integratePosition(&a->points[i], h);
+            clampToBorder(&a->points[i], radius, borderRadius);
+        }
+    }
+    // Displaced balls that were stepped plainly have moved; put every one
+    // in the list of the cell it is in now
+    for (int k = 0; k < work->displacedCount; k++) {
+        unlinkDisplaced(work, work->displaced[k]);
+        linkDisplaced(work, grid, a, work->displaced[k]);
+    }
+    // Impacts change other balls' velocities, so the sweeps run in order
+    for (int k = 0; k < work->count; k++) {
+        int i = work->balls[k];
+        sweepBall(a, grid, work, i, radius, borderRadius, restitution, h);
+        unlinkDisplaced(work, i);
+        linkDisplaced(work, grid, a, i);
+    }
+    a->revision++;
+    return work->count;
+}
@@ -3,16 +3,19 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <windows.h>
 #include <stdbool.h>
 #include "common/common.h"
+#include "common/grid.h"
+#include "common/contact.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 #define NUM_SEGMENTS 10
-#define borderRadius 0.9f
+#define BORDER_RADIUS 0.9f
 #define SLOP 0.0001
 
 // Define these variables in common.c
@@ -24,16 +27,34 @@ void initPointArray(pointArray *a, int initialSize) {
     a->points = (centerPoint *)malloc(initialSize * sizeof(centerPoint));
     a->size = 0;
     a->capacity = initialSize;
+    a->revision = 0;
+    a->borrowed = 0;
 }
 
 void freePointArray(pointArray *a) {
-    free(a->points);
+    if (!a->borrowed) {
+        free(a->points);
+    }
+    a->borrowed = 0;
     a->points = NULL;
     a->size = 0;
     a->capacity = 0;
 }
 
 void addPoint(pointArray *a, double x, double y, double vx, double vy) {
+    if (a->size >= a->capacity && a->borrowed) {
+        // Move off borrowed memory into our own allocation first
+        int capacity = a->capacity > 8 ? a->capacity * 2 : 16;
+        centerPoint *points = (centerPoint *)malloc(capacity * sizeof(centerPoint));
+        if (points == NULL) {
+            fprintf(stderr, "Epic malloc failure\n");
+            return;
+        }
+        memcpy(points, a->points, a->size * sizeof(centerPoint));
+        a->points = points;
+        a->capacity = capacity;
+        a->borrowed = 0;
+    }
     if (a->size >= a->capacity) {
         a->capacity *= 2;
         a->points = (centerPoint *)realloc(a->points, a->capacity * sizeof(centerPoint));
@@ -49,6 +70,36 @@ void addPoint(pointArray *a, double x, double y, double vx, double vy) {
     p->position = (vector2){x, y};
     p->velocity = (vector2){vx, vy};
     p->acceleration = (vector2){0.0, 0.0};
+    a->revision++;
+}
+
+int addPoints(pointArray *a, const centerPoint *points, int count) {
+    if (count <= 0) {
+        return a->size;
+    }
+    if (a->size + count > a->capacity) {
+        int capacity = a->capacity > 8 ? a->capacity : 16;
+        while (capacity < a->size + count) {
+            capacity *= 2;
+        }
+        centerPoint *grown = a->borrowed ? (centerPoint *)malloc(capacity * sizeof(centerPoint))
+                                         : (centerPoint *)realloc(a->points, capacity * sizeof(centerPoint));
+        if (grown == NULL) {
+            fprintf(stderr, "Epic realloc failure\n");
+            return -1;
+        }
+        if (a->borrowed) {
+            memcpy(grown, a->points, a->size * sizeof(centerPoint));
+            a->borrowed = 0;
+        }
+        a->points = grown;
+        a->capacity = capacity;
+    }
+    int first = a->size;
+    memcpy(a->points + first, points, count * sizeof(centerPoint));
+    a->size += count;
+    a->revision++;
+    return first;
 }
 
 void circleGen(centerPoint *p, float radius, int numSegments, float *vertices) {
@@ -80,7 +131,7 @@ void drawHollow(centerPoint *p, float radius, int numSegments, unsigned int VBO)
 
 int borderCollision(centerPoint *p, float radius) {
     float distance = sqrt(p->position.x * p->position.x + p->position.y * p->position.y);
-    if (distance >= borderRadius - radius) {
+    if (distance >= BORDER_RADIUS - radius) {
         // Calculate the normal direction (outward from the center)
         float nx = p->position.x / distance;
         float ny = p->position.y / distance;
@@ -91,17 +142,34 @@ int borderCollision(centerPoint *p, float radius) {
         p->velocity.y -= 2 * dotProduct * ny;
         
         // Reposition the ball just inside the boundary
-        p->position.x = (borderRadius - radius) * nx;
-        p->position.y = (borderRadius - radius) * ny;
+        p->position.x = (BORDER_RADIUS - radius) * nx;
+        p->position.y = (BORDER_RADIUS - radius) * ny;
         
         return 1;
     }
     return 0;
 }
 
+int clampToBorder(centerPoint *p, float radius, float borderRadius) {
+    double reach = borderRadius - radius;
+    double distance = sqrt(p->position.x * p->position.x + p->position.y * p->position.y);
+    if (distance <= reach) {
+        return 0;
+    }
+    double nx = p->position.x / distance;
+    double ny = p->position.y / distance;
+    double outward = p->velocity.x * nx + p->velocity.y * ny;
+    if (outward > 0.0) {
+        p->velocity.x -= outward * nx;
+        p->velocity.y -= outward * ny;
+    }
+    p->position.x = reach * nx;
+    p->position.y = reach * ny;
+    return 1;
+}
+
 void gravity(centerPoint *p) {
-    const double G = -9.81;
-    p->acceleration = (vector2){0.0, G};
+    p->acceleration = (vector2){0.0, -GRAVITY};
 }
 
 void verlet(centerPoint *p, double dt, int subSteps) {
@@ -128,6 +196,17 @@ void verlet(centerPoint *p, double dt, int subSteps) {
     }
 }
 
+void integrateVelocity(centerPoint *p, double dt) {
+    gravity(p);
+    p->velocity.x += p->acceleration.x * dt;
+    p->velocity.y += p->acceleration.y * dt;
+}
+
+void integratePosition(centerPoint *p, double dt) {
+    p->position.x += p->velocity.x * dt;
+    p->position.y += p->velocity.y * dt;
+}
+
 void updateVertexData(pointArray *a, unsigned int VBO, float radius) {
     int totalSize = a->size * (NUM_SEGMENTS + 2) * 2 * sizeof(float);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -146,37 +225,60 @@ void updateVertexData(pointArray *a, unsigned int VBO, float radius) {
 }
 
 
-void collisionDetection(pointArray *a, float radius) {
+void collisionDetection(pointArray *a, spatialGrid *grid, contactList *contacts, float radius) {
     const double damping = 0.9; // Damping factor to reduce jittering
     const double slop = SLOP; // Small threshold for allowable overlap
 
+    ensureGrid(grid, a);
+
     for (int i = 0; i < a->size; i++) {
-        for (int j = i + 1; j < a->size; j++) {
-            double dx = a->points[i].position.x - a->points[j].position.x;
-            double dy = a->points[i].position.y - a->points[j].position.y;
-            double distance = sqrt(dx * dx + dy * dy);
-            double overlap = 2 * radius - distance;
-
-            if (overlap > slop) {
-                // Separate the balls
-                double nx = dx / distance;
-                double ny = dy / distance;
-                a->points[i].position.x += nx * (overlap - slop) / 2;
-                a->points[i].position.y += ny * (overlap - slop) / 2;
-                a->points[j].position.x -= nx * (overlap - slop) / 2;
-                a->points[j].position.y -= ny * (overlap - slop) / 2;
-
-                // Calculate new velocities
-                double vx = a->points[i].velocity.x - a->points[j].velocity.x;
-                double vy = a->points[i].velocity.y - a->points[j].velocity.y;
-                double dotProduct = vx * nx + vy * ny;
-
-                // Apply the collision response with damping
-                a->points[i].velocity.x = (a->points[i].velocity.x - dotProduct * nx) * damping;
-                a->points[i].velocity.y = (a->points[i].velocity.y - dotProduct * ny) * damping;
-                a->points[j].velocity.x = (a->points[j].velocity.x + dotProduct * nx) * damping;
-                a->points[j].velocity.y = (a->points[j].velocity.y + dotProduct * ny) * damping;
+        // Only the 3x3 block of cells around i can hold overlapping balls
+        int cx = grid->pointCell[i] % grid->cols;
+        int cy = grid->pointCell[i] / grid->cols;
+        int x0 = cx > 0 ? cx - 1 : 0, x1 = cx < grid->cols - 1 ? cx + 1 : cx;
+        int y0 = cy > 0 ? cy - 1 : 0, y1 = cy < grid->rows - 1 ? cy + 1 : cy;
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int cell = y * grid->cols + x;
+                for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+                    int j = grid->cellPoints[k];
+                    if (j <= i || gridSameGroup(grid, i, j)) {
+                        continue;
+                    }
+                    double dx = a->points[i].position.x - a->points[j].position.x;
+                    double dy = a->points[i].position.y - a->points[j].position.y;
+                    double distance = sqrt(dx * dx + dy * dy);
+                    double overlap = 2 * radius - distance;
+
+                    if (overlap > slop) {
+                        // Separate the balls
+                        double nx = dx / distance;
+                        double ny = dy / distance;
+                        a->points[i].position.x += nx * (overlap - slop) / 2;
+                        a->points[i].position.y += ny * (overlap - slop) / 2;
+                        a->points[j].position.x -= nx * (overlap - slop) / 2;
+                        a->points[j].position.y -= ny * (overlap - slop) / 2;
+
+                        // Calculate new velocities
+                        double vx = a->points[i].velocity.x - a->points[j].velocity.x;
+                        double vy = a->points[i].velocity.y - a->points[j].velocity.y;
+                        double dotProduct = vx * nx + vy * ny;
+
+                        // Apply the collision response with damping
+                        a->points[i].velocity.x = (a->points[i].velocity.x - dotProduct * nx) * damping;
+                        a->points[i].velocity.y = (a->points[i].velocity.y - dotProduct * ny) * damping;
+                        a->points[j].velocity.x = (a->points[j].velocity.x + dotProduct * nx) * damping;
+                        a->points[j].velocity.y = (a->points[j].velocity.y + dotProduct * ny) * damping;
+
+                        if (contacts != NULL) {
+                            // The exchange gives a (unit mass) -dotProduct along the normal
+                            addContact(contacts, i, j, (vector2){nx, ny}, overlap, -dotProduct);
+                        }
+                    }
+                }
             }
         }
     }
+    a->revision++;
 }
\ No newline at end of file
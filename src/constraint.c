@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/constraint.h"
+#include "common/fixed.h"
+
+static void initBatch(constraintBatch *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+static void freeBatch(constraintBatch *b) {
+    free(b->p0);
+    free(b->p1);
+    free(b->p2);
+    free(b->rest);
+    free(b->compliance);
+    free(b->lambda);
+    free(b->anchorX);
+    free(b->anchorY);
+    initBatch(b);
+}
+
+void initConstraintSet(constraintSet *c) {
+    for (int k = 0; k < CONSTRAINT_KINDS; k++) {
+        initBatch(&c->batches[k]);
+    }
+    c->iterations = 1;
+    c->colored = 1;
+    c->numBalls = 0;
+    c->usedColors = NULL;
+    c->usedCapacity = 0;
+}
+
+void freeConstraintSet(constraintSet *c) {
+    for (int k = 0; k < CONSTRAINT_KINDS; k++) {
+        freeBatch(&c->batches[k]);
+    }
+    free(c->usedColors);
+    initConstraintSet(c);
+}
+
+static int reserveBatch(constraintBatch *b, int count) {
+    if (count <= b->capacity) {
+        return 1;
+    }
+    int capacity = b->capacity > 0 ? b->capacity * 2 : 256;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int **indices[3] = {&b->p0, &b->p1, &b->p2};
+    for (int c = 0; c < 3; c++) {
+        int *column = (int *)realloc(*indices[c], capacity * sizeof(int));
+        if (column == NULL) {
+            fprintf(stderr, "Constraint batch realloc failure\n");
+            return 0;
+        }
+        *indices[c] = column;
+    }
+    double **values[5] = {&b->rest, &b->compliance, &b->lambda, &b->anchorX, &b->anchorY};
+    for (int c = 0; c < 5; c++) {
+        double *column = (double *)realloc(*values[c], capacity * sizeof(double));
+        if (column == NULL) {
+            fprintf(stderr, "Constraint batch realloc failure\n");
+            return 0;
+        }
+        *values[c] = column;
+    }
+    b->capacity = capacity;
+    return 1;
+}
+
+static int appendConstraint(constraintSet *c, constraintKind kind, int i, int j, int k, double rest, double compliance, vector2 anchor) {
+    constraintBatch *b = &c->batches[kind];
+    if (fixedPointRefuses("Constraints") || !reserveBatch(b, b->count + 1)) {
+        return -1;
+    }
+    int n = b->count++;
+    b->p0[n] = i;
+    b->p1[n] = j;
+    b->p2[n] = k;
+    b->rest[n] = rest;
+    b->compliance[n] = compliance;
+    b->lambda[n] = 0.0;
+    b->anchorX[n] = anchor.x;
+    b->anchorY[n] = anchor.y;
+    c->colored = 0;
+    return n;
+}
+
+static int validBalls(const pointArray *a, int i, int j, int k) {
+    int ok = i >= 0 && i < a->size && j >= 0 && j < a->size && (k < 0 || k < a->size);
+    if (!ok) {
+        fprintf(stderr, "Constraint references a ball that does not exist\n");
+    }
+    return ok;
+}
+
+static double distance(const pointArray *a, int i, int j) {
+    double dx = a->points[i].position.x - a->points[j].position.x;
+    double dy = a->points[i].position.y - a->points[j].position.y;
+    return sqrt(dx * dx + dy * dy);
+}
+
+static double triangleArea(const pointArray *a, int i, int j, int k) {
+    vector2 p0 = a->points[i].position, p1 = a->points[j].position, p2 = a->points[k].position;
+    return 0.5 * ((p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y));
+}
+
+int addDistanceConstraint(constraintSet *c, const pointArray *a, int i, int j, double rest, double compliance) {
+    if (!validBalls(a, i, j, -1)) {
+        return -1;
+    }
+    rest = rest < 0.0 ? distance(a, i, j) : rest;
+    return appendConstraint(c, CONSTRAINT_DISTANCE, i, j, -1, rest, compliance, (vector2){0.0, 0.0});
+}
+
+int addBendingConstraint(constraintSet *c, const pointArray *a, int i, int j, int k, double rest, double compliance) {
+    if (!validBalls(a, i, j, k)) {
+        return -1;
+    }
+    rest = rest < 0.0 ? distance(a, i, k) : rest;
+    return appendConstraint(c, CONSTRAINT_BENDING, i, j, k, rest, compliance, (vector2){0.0, 0.0});
+}
+
+int addAreaConstraint(constraintSet *c, const pointArray *a, int i, int j, int k, double rest, double compliance) {
+    if (!validBalls(a, i, j, k)) {
+        return -1;
+    }
+    rest = isnan(rest) ? triangleArea(a, i, j, k) : rest;
+    return appendConstraint(c, CONSTRAINT_AREA, i, j, k, rest, compliance, (vector2){0.0, 0.0});
+}
+
+int addPinConstraint(constraintSet *c, int i, vector2 anchor, double compliance) {
+    if (i < 0) {
+        fprintf(stderr, "Constraint references a ball that does not exist\n");
+        return -1;
+    }
+    return appendConstraint(c, CONSTRAINT_PIN, i, -1, -1, 0.0, compliance, anchor);
+}
+
+int constraintCount(const constraintSet *c) {
+    int count = 0;
+    for (int k = 0; k < CONSTRAINT_KINDS; k++) {
+        count += c->batches[k].count;
+    }
+    return count;
+}
+
+int addRope(constraintSet *c, const pointArray *a, int first, int count, double compliance, double bendCompliance) {
+    for (int i = first; i + 1 < first + count; i++) {
+        if (addDistanceConstraint(c, a, i, i + 1, -1.0, compliance) < 0) {
+            return -1;
+        }
+    }
+    for (int i = first; i + 2 < first + count; i++) {
+        if (addBendingConstraint(c, a, i, i + 1, i + 2, -1.0, bendCompliance) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int addSheet(constraintSet *c, const pointArray *a, int first, int cols, int rows, double compliance, double bendCompliance) {
+    for (int r = 0; r < rows; r++) {
+        for (int q = 0; q < cols; q++) {
+            int i = first + r * cols + q;
+            if (q + 1 < cols && addDistanceConstraint(c, a, i, i + 1, -1.0, compliance) < 0) {
+                return -1;
+            }
+            if (r + 1 < rows && addDistanceConstraint(c, a, i, i + cols, -1.0, compliance) < 0) {
+                return -1;
+            }
+            if (q + 2 < cols && addBendingConstraint(c, a, i, i + 1, i + 2, -1.0, bendCompliance) < 0) {
+                return -1;
+            }
+            if (r + 2 < rows && addBendingConstraint(c, a, i, i + cols, i + 2 * cols, -1.0, bendCompliance) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int addBlob(constraintSet *c, const pointArray *a, int centre, int first, int count, double compliance, double areaCompliance) {
+    for (int k = 0; k < count; k++) {
+        int i = first + k, j = first + (k + 1) % count;
+        if (addDistanceConstraint(c, a, i, j, -1.0, compliance) < 0
+            || addDistanceConstraint(c, a, centre, i, -1.0, compliance) < 0
+            || addAreaConstraint(c, a, centre, i, j, NAN, areaCompliance) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The balls a constraint moves; a bending constraint leaves its middle alone
+static int movedBalls(const constraintBatch *b, constraintKind kind, int n, int *balls) {
+    switch (kind) {
+    case CONSTRAINT_DISTANCE:
+        balls[0] = b->p0[n];
+        balls[1] = b->p1[n];
+        return 2;
+    case CONSTRAINT_BENDING:
+        balls[0] = b->p0[n];
+        balls[1] = b->p2[n];
+        return 2;
+    case CONSTRAINT_AREA:
+        balls[0] = b->p0[n];
+        balls[1] = b->p1[n];
+        balls[2] = b->p2[n];
+        return 3;
+    default:
+        balls[0] = b->p0[n];
+        return 1;
+    }
+}
+
+static void permuteInts(int *column, const int *order, int *scratch, int count) {
+    for (int n = 0; n < count; n++) {
+        scratch[n] = column[order[n]];
+    }
+    memcpy(column, scratch, count * sizeof(int));
+}
+
+static void permuteDoubles(double *column, const int *order, double *scratch, int count) {
+    for (int n = 0; n < count; n++) {
+        scratch[n] = column[order[n]];
+    }
+    memcpy(column, scratch, count * sizeof(double));
+}
+
+static int colorBatch(constraintSet *c, constraintKind kind, int numBalls) {
+    constraintBatch *b = &c->batches[kind];
+    int *start = b->colorStart;
+    memset(start, 0, sizeof(b->colorStart));
+    b->numColors = 0;
+    if (b->count == 0) {
+        return 1;
+    }
+    unsigned long long *used = c->usedColors;
+    memset(used, 0, numBalls * sizeof(unsigned long long));
+    int *color = (int *)malloc(b->count * 2 * sizeof(int));
+    double *scratch = (double *)malloc(b->count * sizeof(double));
+    if (color == NULL || scratch == NULL) {
+        fprintf(stderr, "Constraint coloring malloc failure\n");
+        free(color);
+        free(scratch);
+        return 0;
+    }
+    int *order = color + b->count;
+
+    // Greedy lowest free color in insertion order, spilling past the last
+    for (int n = 0; n < b->count; n++) {
+        int balls[3];
+        int m = movedBalls(b, kind, n, balls);
+        unsigned long long taken = 0;
+        for (int k = 0; k < m; k++) {
+            taken |= used[balls[k]];
+        }
+        int cl = MAX_CONSTRAINT_COLORS;
+        if (taken != ~0ULL) {
+            cl = 0;
+            while (taken & (1ULL << cl)) {
+                cl++;
+            }
+            for (int k = 0; k < m; k++) {
+                used[balls[k]] |= 1ULL << cl;
+            }
+        }
+        color[n] = cl;
+        start[cl + 1]++;
+    }
+    for (int cl = 0; cl <= MAX_CONSTRAINT_COLORS; cl++) {
+        if (cl < MAX_CONSTRAINT_COLORS && start[cl + 1] > 0) {
+            b->numColors = cl + 1;
+        }
+        start[cl + 1] += start[cl];
+    }
+
+    // Stable counting sort into color ranges, applied to every column
+    int fill[MAX_CONSTRAINT_COLORS + 1];
+    memcpy(fill, start, sizeof(fill));
+    for (int n = 0; n < b->count; n++) {
+        order[fill[color[n]]++] = n;
+    }
+    int *intScratch = color;
+    int *columns[3] = {b->p0, b->p1, b->p2};
+    for (int k = 0; k < 3; k++) {
+        permuteInts(columns[k], order, intScratch, b->count);
+    }
+    double *values[5] = {b->rest, b->compliance, b->lambda, b->anchorX, b->anchorY};
+    for (int k = 0; k < 5; k++) {
+        permuteDoubles(values[k], order, scratch, b->count);
+    }
+    free(color);
+    free(scratch);
+    return 1;
+}
+
+static int colorConstraints(constraintSet *c) {
+    int numBalls = 0;
+    for (int kind = 0; kind < CONSTRAINT_KINDS; kind++) {
+        const constraintBatch *b = &c->batches[kind];
+        for (int n = 0; n < b->count; n++) {
+            int m = b->p0[n] > b->p1[n] ? b->p0[n] : b->p1[n];
+            m = b->p2[n] > m ? b->p2[n] : m;
+            numBalls = m + 1 > numBalls ? m + 1 : numBalls;
+        }
+    }
+    if (numBalls > c->usedCapacity) {
+        unsigned long long *used = (unsigned long long *)realloc(c->usedColors, numBalls * sizeof(unsigned long long));
+        if (used == NULL) {
+            fprintf(stderr, "Constraint coloring realloc failure\n");
+            return 0;
+        }
+        c->usedColors = used;
+        c->usedCapacity = numBalls;
+    }
+    for (int kind = 0; kind < CONSTRAINT_KINDS; kind++) {
+        if (!colorBatch(c, (constraintKind)kind, numBalls)) {
+            return 0;
+        }
+    }
+    c->numBalls = numBalls;
+    c->colored = 1;
+    return 1;
+}
+
+// Moves a ball by (dx, dy) and carries the move into its velocity
+static inline void correct(centerPoint *p, double dx, double dy, double inverseH) {
+    p->position.x += dx;
+    p->position.y += dy;
+    p->velocity.x += dx * inverseH;
+    p->velocity.y += dy * inverseH;
+}
+
+// Both distance and bending: keep p0 and q = p1 or p2 at rest apart
+static void solveDistanceRange(constraintBatch *b, const int *q, centerPoint *points, int first, int last, double h, int parallel) {
+#ifndef _OPENMP
+    (void)parallel;
+#endif
+    double inverseH = 1.0 / h, inverseH2 = inverseH * inverseH;
+    const int *p0 = b->p0;
+    const double *rest = b->rest, *compliance = b->compliance;
+    double *lambda = b->lambda;
+    #pragma omp parallel for schedule(static) if(parallel)
+    for (int n = first; n < last; n++) {
+        centerPoint *pa = &points[p0[n]], *pb = &points[q[n]];
+        double dx = pa->position.x - pb->position.x, dy = pa->position.y - pb->position.y;
+        double length = sqrt(dx * dx + dy * dy);
+        if (length < 1e-12) {
+            continue;
+        }
+        double alpha = compliance[n] * inverseH2;
+        double dl = (rest[n] - length - alpha * lambda[n]) / (2.0 + alpha);
+        lambda[n] += dl;
+        double nx = dx / length * dl, ny = dy / length * dl;
+        correct(pa, nx, ny, inverseH);
+        correct(pb, -nx, -ny, inverseH);
+    }
+}
+
+static void solveAreaRange(constraintBatch *b, centerPoint *points, int first, int last, double h, int parallel) {
+#ifndef _OPENMP
+    (void)parallel;
+#endif
+    double inverseH = 1.0 / h, inverseH2 = inverseH * inverseH;
+    #pragma omp parallel for schedule(static) if(parallel)
+    for (int n = first; n < last; n++) {
+        centerPoint *a0 = &points[b->p0[n]], *a1 = &points[b->p1[n]], *a2 = &points[b->p2[n]];
+        vector2 x0 = a0->position, x1 = a1->position, x2 = a2->position;
+        double area = 0.5 * ((x1.x - x0.x) * (x2.y - x0.y) - (x2.x - x0.x) * (x1.y - x0.y));
+        // Gradient of the area with respect to each corner
+        double g0x = 0.5 * (x1.y - x2.y), g0y = 0.5 * (x2.x - x1.x);
+        double g1x = 0.5 * (x2.y - x0.y), g1y = 0.5 * (x0.x - x2.x);
+        double g2x = 0.5 * (x0.y - x1.y), g2y = 0.5 * (x1.x - x0.x);
+        double weight = g0x * g0x + g0y * g0y + g1x * g1x + g1y * g1y + g2x * g2x + g2y * g2y;
+        double alpha = b->compliance[n] * inverseH2;
+        if (weight + alpha < 1e-24) {
+            continue;
+        }
+        double dl = (b->rest[n] - area - alpha * b->lambda[n]) / (weight + alpha);
+        b->lambda[n] += dl;
+        correct(a0, g0x * dl, g0y * dl, inverseH);
+        correct(a1, g1x * dl, g1y * dl, inverseH);
+        correct(a2, g2x * dl, g2y * dl, inverseH);
+    }
+}
+
+static void solvePinRange(constraintBatch *b, centerPoint *points, int first, int last, double h, int parallel) {
+#ifndef _OPENMP
+    (void)parallel;
+#endif
+    double inverseH = 1.0 / h, inverseH2 = inverseH * inverseH;
+    #pragma omp parallel for schedule(static) if(parallel)
+    for (int n = first; n < last; n++) {
+        centerPoint *p = &points[b->p0[n]];
+        double dx = p->position.x - b->anchorX[n], dy = p->position.y - b->anchorY[n];
+        double length = sqrt(dx * dx + dy * dy);
+        if (length < 1e-12) {
+            continue;
+        }
+        double alpha = b->compliance[n] * inverseH2;
+        double dl = (-length - alpha * b->lambda[n]) / (1.0 + alpha);
+        b->lambda[n] += dl;
+        correct(p, dx / length * dl, dy / length * dl, inverseH);
+    }
+}
+
+static void solveRange(constraintBatch *b, constraintKind kind, centerPoint *points, int first, int last, double h, int parallel) {
+    switch (kind) {
+    case CONSTRAINT_DISTANCE:
+        solveDistanceRange(b, b->p1, points, first, last, h, parallel);
+        break;
+    case CONSTRAINT_BENDING:
+        solveDistanceRange(b, b->p2, points, first, last, h, parallel);
+        break;
+    case CONSTRAINT_AREA:
+        solveAreaRange(b, points, first, last, h, parallel);
+        break;
+    default:
+        solvePinRange(b, points, first, last, h, parallel);
+        break;
+    }
+}
+
+void solveConstraints(constraintSet *c, pointArray *a, double h) {
+    if (constraintCount(c) == 0 || h <= 0.0) {
+        return;
+    }
+    if (!c->colored && !colorConstraints(c)) {
+        return;
+    }
+    if (c->numBalls > a->size) {
+        fprintf(stderr, "Constraints reference ball %d of %d\n", c->numBalls - 1, a->size);
+        return;
+    }
+    for (int kind = 0; kind < CONSTRAINT_KINDS; kind++) {
+        constraintBatch *b = &c->batches[kind];
+        for (int n = 0; n < b->count; n++) {
+            b->lambda[n] = 0.0;
+        }
+    }
+
+    // Colors in order and each one's constraints touch distinct balls, so the
+    // result is the same for any thread count
+    int iterations = c->iterations > 0 ? c->iterations : 1;
+    for (int it = 0; it < iterations; it++) {
+        for (int kind = 0; kind < CONSTRAINT_KINDS; kind++) {
+            constraintBatch *b = &c->batches[kind];
+            for (int cl = 0; cl < b->numColors; cl++) {
+                solveRange(b, (constraintKind)kind, a->points, b->colorStart[cl], b->colorStart[cl + 1], h, 1);
+            }
+            solveRange(b, (constraintKind)kind, a->points, b->colorStart[MAX_CONSTRAINT_COLORS], b->count, h, 0);
+        }
+    }
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "common/contact.h"
+
+// Below this many balls the threads cost more than they save
+#define PARALLEL_CONTACT_MIN 2048
+
+void initContactList(contactList *c, int capacity) {
+    c->items = (contact *)malloc(capacity * sizeof(contact));
+    c->count = 0;
+    c->capacity = capacity;
+}
+
+void freeContactList(contactList *c) {
+    free(c->items);
+    c->items = NULL;
+    c->count = 0;
+    c->capacity = 0;
+}
+
+void clearContactList(contactList *c) {
+    c->count = 0;
+}
+
+void *growContactItems(void *items, int *capacity, int count, size_t size) {
+    int grown = *capacity > 0 ? *capacity : 64;
+    while (grown < count) {
+        grown *= 2;
+    }
+    void *resized = realloc(items, grown * size);
+    if (resized == NULL) {
+        fprintf(stderr, "Contact list realloc failure\n");
+        return NULL;
+    }
+    *capacity = grown;
+    return resized;
+}
+
+static void insertContact(contactList *c, const contact *item) {
+    if (c->count >= c->capacity) {
+        contact *items = (contact *)growContactItems(c->items, &c->capacity, c->count + 1, sizeof(contact));
+        if (items == NULL) {
+            return;
+        }
+        c->items = items;
+    }
+    insertSortedContact(c->items, c->count++, item, sizeof(contact));
+}
+
+void addContact(contactList *c, int a, int b, vector2 normal, double depth, double impulse) {
+    contact item = {a, b, normal, depth, impulse, 0.0, 0.0, -1, depth > 0.0, {0.0, 0.0}};
+    insertContact(c, &item);
+}
+
+// Contacts of balls first..last-1, appended in (a, b) order
+static void findContactsRange(const pointArray *a, const spatialGrid *grid, contactList *contacts, int first, int last, float radius, float borderRadius, double margin) {
+    // Pairs further apart than a cell could be missed by the 3x3 search
+    double reach = 2.0 * radius + margin;
+    reach = reach < grid->cellSize ? reach : grid->cellSize;
+    // No wall around a periodic grid; every ball tests against it all the same
+    double wall = grid->periodic ? HUGE_VAL : borderRadius - radius - margin;
+    int cols = grid->cols, rows = grid->rows;
+    double width = cols * grid->cellSize, height = rows * grid->cellSize;
+
+    for (int i = first; i < last; i++) {
+        double px = a->points[i].position.x, py = a->points[i].position.y;
+        double r2 = px * px + py * py;
+        if (r2 > wall * wall) {
+            double distance = sqrt(r2);
+            addContact(contacts, i, BORDER_CONTACT, (vector2){-px / distance, -py / distance}, distance - (borderRadius - radius), 0.0);
+        }
+
+        int cx = grid->pointCell[i] % cols;
+        int cy = grid->pointCell[i] / cols;
+        for (int oy = -1; oy <= 1; oy++) {
+            int y = cy + oy;
+            double sy = 0.0;
+            if (grid->periodic) {
+                // The shift is per cell, so the pair test below stays the same
+                sy = y < 0 ? -height : (y >= rows ? height : 0.0);
+                y = (y + rows) % rows;
+            } else if (y < 0 || y >= rows) {
+                continue;
+            }
+            for (int ox = -1; ox <= 1; ox++) {
+                int x = cx + ox;
+                double sx = 0.0;
+                if (grid->periodic) {
+                    sx = x < 0 ? -width : (x >= cols ? width : 0.0);
+                    x = (x + cols) % cols;
+                } else if (x < 0 || x >= cols) {
+                    continue;
+                }
+                int cell = y * cols + x;
+                for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+                    int j = grid->cellPoints[k];
+                    if (j <= i || gridSameGroup(grid, i, j)) {
+                        continue;
+                    }
+                    double dx = px - (a->points[j].position.x + sx);
+                    double dy = py - (a->points[j].position.y + sy);
+                    double d2 = dx * dx + dy * dy;
+                    if (d2 >= reach * reach) {
+                        continue;
+                    }
+                    double distance = sqrt(d2);
+                    // Coincident centres (spawning on top of each other) get an arbitrary normal
+                    vector2 normal = distance > 0.0 ? (vector2){dx / distance, dy / distance} : (vector2){0.0, 1.0};
+                    contact item = {i, j, normal, 2.0 * radius - distance, 0.0, 0.0, 0.0, -1, distance < 2.0 * radius, {sx, sy}};
+                    insertContact(contacts, &item);
+                }
+            }
+        }
+    }
+}
+
+void findContacts(pointArray *a, spatialGrid *grid, contactList *contacts, float radius, float borderRadius, double margin) {
+    ensureGrid(grid, a);
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+    if (threads == 1 || a->size < PARALLEL_CONTACT_MIN) {
+        findContactsRange(a, grid, contacts, 0, a->size, radius, borderRadius, margin);
+        return;
+    }
+
+    // Each thread searches one contiguous range of balls into its own list and
+    // the lists are joined in range order, so the result is the serial one
+    // whatever the thread count
+    contactList *parts = (contactList *)malloc(threads * sizeof(contactList));
+    if (parts == NULL) {
+        fprintf(stderr, "Contact list malloc failure\n");
+        return;
+    }
+    int base = contacts->count, total = 0;
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        int t = omp_get_thread_num(), n = omp_get_num_threads();
+#else
+        int t = 0, n = 1;
+#endif
+        int first = (int)((long long)a->size * t / n);
+        int last = (int)((long long)a->size * (t + 1) / n);
+        initContactList(&parts[t], contacts->capacity / n + 64);
+        findContactsRange(a, grid, &parts[t], first, last, radius, borderRadius, margin);
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            for (int k = 0; k < n; k++) {
+                total += parts[k].count;
+            }
+            if (base + total > contacts->capacity) {
+                contact *items = (contact *)growContactItems(contacts->items, &contacts->capacity, base + total, sizeof(contact));
+                if (items != NULL) {
+                    contacts->items = items;
+                } else {
+                    total = 0;
+                }
+            }
+        }
+
+        if (total > 0) {
+            int offset = base;
+            for (int k = 0; k < t; k++) {
+                offset += parts[k].count;
+            }
+            memcpy(contacts->items + offset, parts[t].items, parts[t].count * sizeof(contact));
+        }
+        // Other threads still read this part's count for their offsets
+        #pragma omp barrier
+        freeContactList(&parts[t]);
+    }
+    contacts->count = base + total;
+    free(parts);
+}
+
+void initContactEvents(contactEvents *e, int capacity) {
+    e->events = (contactEvent *)malloc(capacity * sizeof(contactEvent));
+    e->count = 0;
+    e->capacity = e->events != NULL ? capacity : 0;
+    e->dropped = 0;
+    e->reportPersist = 1;
+    e->callback = NULL;
+    e->userData = NULL;
+}
+
+void freeContactEvents(contactEvents *e) {
+    free(e->events);
+    e->events = NULL;
+    e->count = 0;
+    e->capacity = 0;
+}
+
+void setContactCallback(contactEvents *e, contactCallback callback, void *userData) {
+    e->callback = callback;
+    e->userData = userData;
+}
+
+static void pushEvent(contactEvents *e, const contact *c, contactEventType type) {
+    if (e->count >= e->capacity) {
+        if (e->callback == NULL) {
+            e->dropped++;
+            return;
+        }
+        e->callback(e->events, e->count, e->userData);
+        e->count = 0;
+    }
+    contactEvent *ev = &e->events[e->count++];
+    ev->a = c->a;
+    ev->b = c->b;
+    ev->type = type;
+    ev->normal = c->normal;
+    ev->impulse = type == CONTACT_END ? 0.0 : c->impulse;
+}
+
+void emitContactEvents(contactEvents *e, const contactList *previous, const contactList *current) {
+    e->count = 0;
+    if (e->capacity == 0) {
+        return;
+    }
+
+    // Margin contacts the solver never had to push are near, not touching.
+    // Depth alone cannot tell: a speculative contact stops the balls at
+    // zero depth, and they may have separated again by the end of the step.
+    int i = 0, j = 0;
+    for (;;) {
+        while (i < previous->count && !previous->items[i].touched) {
+            i++;
+        }
+        while (j < current->count && !current->items[j].touched) {
+            j++;
+        }
+        if (i >= previous->count && j >= current->count) {
+            break;
+        }
+        unsigned long long prevKey = i < previous->count ? contactKey(previous->items[i].a, previous->items[i].b) : ~0ULL;
+        unsigned long long curKey = j < current->count ? contactKey(current->items[j].a, current->items[j].b) : ~0ULL;
+
+        if (curKey < prevKey) {
+            pushEvent(e, &current->items[j++], CONTACT_BEGIN);
+        } else if (prevKey < curKey) {
+            pushEvent(e, &previous->items[i++], CONTACT_END);
+        } else {
+            if (e->reportPersist) {
+                pushEvent(e, &current->items[j], CONTACT_PERSIST);
+            }
+            i++;
+            j++;
+        }
+    }
+
+    if (e->callback != NULL && e->count > 0) {
+        e->callback(e->events, e->count, e->userData);
+        e->count = 0;
+    }
+}
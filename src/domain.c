@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/domain.h"
+
+int initDomain(domain *d, transport *net, physicsWorld *w) {
+    int size = net->size;
+    d->net = net;
+    d->world = w;
+    d->cuts = (double *)malloc((size + 1) * sizeof(double));
+    d->ids = NULL;
+    d->idCapacity = 0;
+    d->owned = 0;
+    // Contact reach plus what a ball travels in a step, with room to spare
+    d->halo = 2.0 * w->grid.cellSize;
+    d->rebalanceInterval = 20;
+    d->rebalanceThreshold = 1.1;
+    d->outLeft = NULL;
+    d->outRight = NULL;
+    d->outLeftCapacity = 0;
+    d->outRightCapacity = 0;
+    d->in = NULL;
+    d->inCapacity = 0;
+    d->unpacked = NULL;
+    d->unpackedCapacity = 0;
+    d->remap = NULL;
+    d->remapCapacity = 0;
+    d->stats = (domainStats){0, 0, 0, 1.0, 0};
+    if (d->cuts == NULL) {
+        fprintf(stderr, "Domain malloc failure\n");
+        return -1;
+    }
+    // The outer edges are open, so nothing ever leaves the first or last slab outwards
+    double r = w->borderRadius;
+    for (int k = 0; k <= size; k++) {
+        d->cuts[k] = -r + 2.0 * r * k / size;
+    }
+    d->cuts[0] = -HUGE_VAL;
+    d->cuts[size] = HUGE_VAL;
+    return 0;
+}
+
+void freeDomain(domain *d) {
+    free(d->cuts);
+    free(d->ids);
+    free(d->outLeft);
+    free(d->outRight);
+    free(d->in);
+    free(d->unpacked);
+    free(d->remap);
+    d->cuts = NULL;
+    d->ids = NULL;
+    d->outLeft = NULL;
+    d->outRight = NULL;
+    d->in = NULL;
+    d->unpacked = NULL;
+    d->remap = NULL;
+    d->idCapacity = 0;
+    d->outLeftCapacity = 0;
+    d->outRightCapacity = 0;
+    d->inCapacity = 0;
+    d->unpackedCapacity = 0;
+    d->remapCapacity = 0;
+}
+
+static int pushBall(domainBall **buffer, int *capacity, int count, long long id, const centerPoint *p) {
+    if (count >= *capacity) {
+        int grown = *capacity > 0 ? *capacity * 2 : 256;
+        domainBall *balls = (domainBall *)realloc(*buffer, grown * sizeof(domainBall));
+        if (balls == NULL) {
+            fprintf(stderr, "Domain buffer realloc failure\n");
+            return -1;
+        }
+        *buffer = balls;
+        *capacity = grown;
+    }
+    (*buffer)[count] = (domainBall){id, *p};
+    return 0;
+}
+
+// Appends received balls after the local ones, as owned or as ghosts
+static int appendBalls(domain *d, const domainBall *balls, int count, int owned) {
+    pointArray *a = &d->world->points;
+    if (a->size + count > d->idCapacity) {
+        int capacity = d->idCapacity > 0 ? d->idCapacity : 256;
+        while (capacity < a->size + count) {
+            capacity *= 2;
+        }
+        long long *ids = (long long *)realloc(d->ids, capacity * sizeof(long long));
+        if (ids == NULL) {
+            fprintf(stderr, "Domain id realloc failure\n");
+            return -1;
+        }
+        d->ids = ids;
+        d->idCapacity = capacity;
+    }
+    if (count > d->unpackedCapacity) {
+        int capacity = d->unpackedCapacity > 0 ? d->unpackedCapacity : 256;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        centerPoint *unpacked = (centerPoint *)realloc(d->unpacked, capacity * sizeof(centerPoint));
+        if (unpacked == NULL) {
+            fprintf(stderr, "Domain buffer realloc failure\n");
+            return -1;
+        }
+        d->unpacked = unpacked;
+        d->unpackedCapacity = capacity;
+    }
+    // One addPoints, so the array grows and its revision moves once
+    for (int k = 0; k < count; k++) {
+        d->unpacked[k] = balls[k].point;
+    }
+    int first = addPoints(a, d->unpacked, count);
+    if (first < 0) {
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        d->ids[first + k] = balls[k].id;
+    }
+    if (owned) {
+        d->owned += count;
+    }
+    return 0;
+}
+
+static int receiveBalls(domain *d, int from, int owned) {
+    unsigned long long bytes;
+    if (receiveMessage(d->net, from, &d->in, &d->inCapacity, &bytes) != 0) {
+        return -1;
+    }
+    return appendBalls(d, (const domainBall *)d->in, (int)(bytes / sizeof(domainBall)), owned);
+}
+
+// Sends outLeft to the left neighbour and outRight to the right one and
+// appends what they send back. Each direction is one phase in which even
+// ranks send before they receive and odd ranks the other way round, so no
+// two neighbours ever both wait on a full channel.
+static int exchangeNeighbours(domain *d, int leftCount, int rightCount, int owned) {
+    transport *net = d->net;
+    int rank = net->rank, even = rank % 2 == 0;
+    int left = rank > 0, right = rank < net->size - 1;
+    int failed = 0;
+    for (int phase = 0; phase < 2 && !failed; phase++) {
+        // Phase 0 flows rightwards, phase 1 leftwards
+        int to = phase == 0 ? rank + 1 : rank - 1, from = phase == 0 ? rank - 1 : rank + 1;
+        int canSend = phase == 0 ? right : left, canReceive = phase == 0 ? left : right;
+        const domainBall *out = phase == 0 ? d->outRight : d->outLeft;
+        unsigned long long bytes = (unsigned long long)(phase == 0 ? rightCount : leftCount) * sizeof(domainBall);
+        if (even && canSend) {
+            failed = sendMessage(net, to, out, bytes) != 0;
+        }
+        if (!failed && canReceive) {
+            failed = receiveBalls(d, from, owned) != 0;
+        }
+        if (!failed && !even && canSend) {
+            failed = sendMessage(net, to, out, bytes) != 0;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+// Sums values over all ranks through rank 0, so every rank ends up with
+// the same bits
+static int allReduceSum(domain *d, double *values, int n) {
+    transport *net = d->net;
+    unsigned long long bytes = (unsigned long long)n * sizeof(double);
+    if (net->rank != 0) {
+        if (net->send(net, 0, values, bytes) != 0 || net->receive(net, 0, values, bytes) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+    double *part = (double *)malloc(bytes > 0 ? bytes : 1);
+    if (part == NULL) {
+        fprintf(stderr, "Domain malloc failure\n");
+        return -1;
+    }
+    int failed = 0;
+    for (int r = 1; r < net->size && !failed; r++) {
+        failed = net->receive(net, r, part, bytes) != 0;
+        for (int k = 0; k < n && !failed; k++) {
+            values[k] += part[k];
+        }
+    }
+    for (int r = 1; r < net->size && !failed; r++) {
+        failed = net->send(net, r, values, bytes) != 0;
+    }
+    free(part);
+    return failed ? -1 : 0;
+}
+
+long long domainBallCount(domain *d) {
+    double count = d->owned;
+    if (allReduceSum(d, &count, 1) != 0) {
+        return -1;
+    }
+    return (long long)count;
+}
+
+int scatterToDomain(domain *d, const centerPoint *balls, int count, long long first) {
+    double lo = d->cuts[d->net->rank], hi = d->cuts[d->net->rank + 1];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        double x = balls[i].position.x;
+        if (x >= lo && x < hi && pushBall(&d->outLeft, &d->outLeftCapacity, n++, first + i, &balls[i]) != 0) {
+            return -1;
+        }
+    }
+    return appendBalls(d, d->outLeft, n, 1);
+}
+
+// Renumbers the contacts kept for warm starting after the owned balls were
+// compacted; contacts of balls that left go. The renumbering keeps the
+// order, so the list stays sorted.
+static void remapContacts(contactList *c, const int *remap) {
+    int kept = 0;
+    for (int k = 0; k < c->count; k++) {
+        contact item = c->items[k];
+        item.a = remap[item.a];
+        item.b = item.b == BORDER_CONTACT ? BORDER_CONTACT : remap[item.b];
+        if (item.a >= 0 && (c->items[k].b == BORDER_CONTACT || item.b >= 0)) {
+            c->items[kept++] = item;
+        }
+    }
+    c->count = kept;
+}
+
+// Sends every ball that left the slab one slab towards its owner, in
+// rounds until none is left travelling
+static int migrate(domain *d) {
+    transport *net = d->net;
+    pointArray *a = &d->world->points;
+    int rank = net->rank;
+    double lo = d->cuts[rank], hi = d->cuts[rank + 1];
+    d->stats.migrated = 0;
+    d->stats.rounds = 0;
+    while (1) {
+        if (d->owned > d->remapCapacity) {
+            int *remap = (int *)realloc(d->remap, d->owned * 2 * sizeof(int));
+            if (remap == NULL) {
+                fprintf(stderr, "Domain remap realloc failure\n");
+                return -1;
+            }
+            d->remap = remap;
+            d->remapCapacity = d->owned * 2;
+        }
+        int leftCount = 0, rightCount = 0, kept = 0;
+        for (int i = 0; i < d->owned; i++) {
+            const centerPoint *p = &a->points[i];
+            if (p->position.x < lo) {
+                if (pushBall(&d->outLeft, &d->outLeftCapacity, leftCount++, d->ids[i], p) != 0) {
+                    return -1;
+                }
+                d->remap[i] = -1;
+            } else if (p->position.x >= hi) {
+                if (pushBall(&d->outRight, &d->outRightCapacity, rightCount++, d->ids[i], p) != 0) {
+                    return -1;
+                }
+                d->remap[i] = -1;
+            } else {
+                d->remap[i] = kept;
+                a->points[kept] = *p;
+                d->ids[kept++] = d->ids[i];
+            }
+        }
+        if (kept < d->owned) {
+            remapContacts(&d->world->contacts, d->remap);
+            d->owned = kept;
+            a->size = kept;
+            a->revision++;
+        }
+        if (exchangeNeighbours(d, leftCount, rightCount, 1) != 0) {
+            return -1;
+        }
+        d->stats.migrated += leftCount + rightCount;
+        d->stats.rounds++;
+        double moved = leftCount + rightCount;
+        if (allReduceSum(d, &moved, 1) != 0) {
+            return -1;
+        }
+        if (moved == 0.0) {
+            return 0;
+        }
+    }
+}
+
+static int exchangeHalo(domain *d) {
+    const pointArray *a = &d->world->points;
+    int rank = d->net->rank;
+    double lo = rank > 0 ? d->cuts[rank] + d->halo : -HUGE_VAL;
+    double hi = rank < d->net->size - 1 ? d->cuts[rank + 1] - d->halo : HUGE_VAL;
+    int leftCount = 0, rightCount = 0;
+    for (int i = 0; i < d->owned; i++) {
+        const centerPoint *p = &a->points[i];
+        if (p->position.x < lo && pushBall(&d->outLeft, &d->outLeftCapacity, leftCount++, d->ids[i], p) != 0) {
+            return -1;
+        }
+        if (p->position.x >= hi && pushBall(&d->outRight, &d->outRightCapacity, rightCount++, d->ids[i], p) != 0) {
+            return -1;
+        }
+    }
+    if (exchangeNeighbours(d, leftCount, rightCount, 0) != 0) {
+        return -1;
+    }
+    d->stats.ghosts = a->size - d->owned;
+    return 0;
+}
+
+// Contacts with a ghost go with it; the rest stay for warm starting
+static void dropGhosts(domain *d) {
+    contactList *c = &d->world->contacts;
+    int kept = 0;
+    for (int k = 0; k < c->count; k++) {
+        if (c->items[k].a < d->owned && c->items[k].b < d->owned) {
+            c->items[kept++] = c->items[k];
+        }
+    }
+    c->count = kept;
+    d->world->points.size = d->owned;
+    d->world->points.revision++;
+}
+
+// Moves the cuts to the quantiles of the balls' x coordinates, from a
+// histogram summed over all ranks. Every rank computes the same cuts.
+static int rebalance(domain *d) {
+    int size = d->net->size;
+    const pointArray *a = &d->world->points;
+    double *bins = (double *)calloc(DOMAIN_BINS > size ? DOMAIN_BINS : size, sizeof(double));
+    if (bins == NULL) {
+        fprintf(stderr, "Domain malloc failure\n");
+        return -1;
+    }
+    bins[d->net->rank] = d->owned;
+    if (allReduceSum(d, bins, size) != 0) {
+        free(bins);
+        return -1;
+    }
+    double total = 0.0, largest = 0.0;
+    for (int r = 0; r < size; r++) {
+        total += bins[r];
+        largest = bins[r] > largest ? bins[r] : largest;
+    }
+    d->stats.imbalance = total > 0.0 ? largest * size / total : 1.0;
+    if (d->stats.imbalance <= d->rebalanceThreshold) {
+        free(bins);
+        return 0;
+    }
+
+    double r = d->world->borderRadius, width = 2.0 * r / DOMAIN_BINS;
+    memset(bins, 0, DOMAIN_BINS * sizeof(double));
+    for (int i = 0; i < d->owned; i++) {
+        int bin = (int)((a->points[i].position.x + r) / width);
+        bins[bin < 0 ? 0 : (bin >= DOMAIN_BINS ? DOMAIN_BINS - 1 : bin)] += 1.0;
+    }
+    if (allReduceSum(d, bins, DOMAIN_BINS) != 0) {
+        free(bins);
+        return -1;
+    }
+    // Interpolated inside the bin where the running count crosses each
+    // share; slabs stay at least a halo wide so ghosts only come from
+    // neighbours
+    double below = 0.0, previous = -r;
+    int bin = 0;
+    for (int k = 1; k < size; k++) {
+        double share = total * k / size;
+        while (bin < DOMAIN_BINS - 1 && below + bins[bin] < share) {
+            below += bins[bin++];
+        }
+        double t = bins[bin] > 0.0 ? (share - below) / bins[bin] : 0.5;
+        double cut = -r + (bin + t) * width;
+        double least = previous + d->halo;
+        d->cuts[k] = cut > least ? cut : least;
+        previous = d->cuts[k];
+    }
+    d->stats.rebalanced = 1;
+    free(bins);
+    return 0;
+}
+
+int stepDomain(domain *d, double dt, int subSteps) {
+    d->stats.rebalanced = 0;
+    if (d->rebalanceInterval > 0 && d->world->step % d->rebalanceInterval == 0 && rebalance(d) != 0) {
+        return -1;
+    }
+    if (migrate(d) != 0 || exchangeHalo(d) != 0) {
+        return -1;
+    }
+    stepWorld(d->world, dt, subSteps);
+    dropGhosts(d);
+    return 0;
+}
+
+int gatherDomain(domain *d, centerPoint *out, long long count) {
+    transport *net = d->net;
+    const pointArray *a = &d->world->points;
+    if (net->rank != 0) {
+        for (int i = 0; i < d->owned; i++) {
+            if (pushBall(&d->outLeft, &d->outLeftCapacity, i, d->ids[i], &a->points[i]) != 0) {
+                return -1;
+            }
+        }
+        return sendMessage(net, 0, d->outLeft, (unsigned long long)d->owned * sizeof(domainBall));
+    }
+    for (int i = 0; i < d->owned; i++) {
+        if (d->ids[i] >= 0 && d->ids[i] < count) {
+            out[d->ids[i]] = a->points[i];
+        }
+    }
+    for (int r = 1; r < net->size; r++) {
+        unsigned long long bytes;
+        if (receiveMessage(net, r, &d->in, &d->inCapacity, &bytes) != 0) {
+            return -1;
+        }
+        const domainBall *balls = (const domainBall *)d->in;
+        for (unsigned long long k = 0; k < bytes / sizeof(domainBall); k++) {
+            if (balls[k].id >= 0 && balls[k].id < count) {
+                out[balls[k].id] = balls[k].point;
+            }
+        }
+    }
+    return 0;
+}
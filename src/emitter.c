@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/emitter.h"
+#include "common/fixed.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void initEmitterSet(emitterSet *s) {
+    s->emitters = NULL;
+    s->count = 0;
+    s->capacity = 0;
+    s->scratch = NULL;
+    s->scratchCapacity = 0;
+    s->fluid = NULL;
+}
+
+void freeEmitterSet(emitterSet *s) {
+    free(s->emitters);
+    free(s->scratch);
+    free(s->fluid);
+    initEmitterSet(s);
+}
+
+// splitmix64
+static unsigned long long nextRandom(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [-1, 1)
+static double signedUnit(unsigned long long *state) {
+    return (double)(nextRandom(state) >> 11) * 0x1.0p-52 - 1.0;
+}
+
+int addEmitter(emitterSet *s, const emitter *e, unsigned long long seed) {
+    if (e->fluid && fixedPointRefuses("Fluid emitters")) {
+        return -1;
+    }
+    if (s->count >= s->capacity) {
+        int capacity = s->capacity > 0 ? s->capacity * 2 : 4;
+        emitter *emitters = (emitter *)realloc(s->emitters, capacity * sizeof(emitter));
+        if (emitters == NULL) {
+            fprintf(stderr, "Emitter realloc failure\n");
+            return -1;
+        }
+        s->emitters = emitters;
+        s->capacity = capacity;
+    }
+    emitter *added = &s->emitters[s->count];
+    *added = *e;
+    added->owed = 0.0;
+    added->state = seed;
+    return s->count++;
+}
+
+void removeEmitter(emitterSet *s, int index) {
+    if (index < 0 || index >= s->count) {
+        return;
+    }
+    memmove(s->emitters + index, s->emitters + index + 1, (s->count - index - 1) * sizeof(emitter));
+    s->count--;
+}
+
+static void spawnOne(emitter *e, centerPoint *p) {
+    vector2 at = e->position;
+    if (e->shape == EMITTER_LINE) {
+        double t = 0.5 * (signedUnit(&e->state) + 1.0);
+        at.x += t * e->extent.x;
+        at.y += t * e->extent.y;
+    } else if (e->shape == EMITTER_DISC) {
+        // Rejection keeps the disc uniform
+        double u, v;
+        do {
+            u = signedUnit(&e->state);
+            v = signedUnit(&e->state);
+        } while (u * u + v * v > 1.0);
+        at.x += u * e->extent.x;
+        at.y += v * e->extent.x;
+    }
+    double speed = sqrt(e->velocity.x * e->velocity.x + e->velocity.y * e->velocity.y);
+    double angle = atan2(e->velocity.y, e->velocity.x) + e->angleSpread * signedUnit(&e->state);
+    speed += e->speedSpread * signedUnit(&e->state);
+    p->position = at;
+    p->velocity = (vector2){speed * cos(angle), speed * sin(angle)};
+    p->acceleration = (vector2){0.0, 0.0};
+}
+
+int runEmitters(emitterSet *s, pointArray *a, sphSet *f, double dt) {
+    int total = 0;
+    for (int k = 0; k < s->count; k++) {
+        emitter *e = &s->emitters[k];
+        e->owed += e->rate * dt;
+        int n = (int)e->owed;
+        if (e->remaining >= 0 && n >= e->remaining) {
+            // Spent: nothing carries over
+            n = e->remaining;
+            e->owed = n;
+        }
+        if (n <= 0) {
+            continue;
+        }
+        if (total + n > s->scratchCapacity) {
+            int capacity = s->scratchCapacity > 0 ? s->scratchCapacity : 256;
+            while (capacity < total + n) {
+                capacity *= 2;
+            }
+            centerPoint *scratch = (centerPoint *)realloc(s->scratch, capacity * sizeof(centerPoint));
+            unsigned char *fluid = (unsigned char *)realloc(s->fluid, capacity);
+            if (scratch != NULL) {
+                s->scratch = scratch;
+            }
+            if (fluid != NULL) {
+                s->fluid = fluid;
+            }
+            if (scratch == NULL || fluid == NULL) {
+                fprintf(stderr, "Emitter realloc failure\n");
+                return -1;
+            }
+            s->scratchCapacity = capacity;
+        }
+        for (int i = 0; i < n; i++) {
+            spawnOne(e, &s->scratch[total + i]);
+        }
+        memset(s->fluid + total, e->fluid != 0, n);
+        e->owed -= n;
+        if (e->remaining >= 0) {
+            e->remaining -= n;
+        }
+        total += n;
+    }
+    if (total == 0) {
+        return -1;
+    }
+    int first = addPoints(a, s->scratch, total);
+    if (first < 0 || f == NULL) {
+        return first;
+    }
+    for (int i = 0; i < total; i++) {
+        if (s->fluid[i] && setFluid(f, first + i, 1) != 0) {
+            return -1;
+        }
+    }
+    return first;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/field.h"
+#include "common/fixed.h"
+
+void initForceFieldSet(forceFieldSet *s) {
+    s->fields = NULL;
+    s->count = 0;
+    s->capacity = 0;
+}
+
+void freeForceFieldSet(forceFieldSet *s) {
+    for (int k = 0; k < s->count; k++) {
+        free(s->fields[k].samplesX);
+        free(s->fields[k].samplesY);
+    }
+    free(s->fields);
+    initForceFieldSet(s);
+}
+
+static int appendField(forceFieldSet *s, const forceField *f) {
+    if (fixedPointRefuses("Force fields")) {
+        return -1;
+    }
+    if (s->count >= s->capacity) {
+        int capacity = s->capacity > 0 ? s->capacity * 2 : 8;
+        forceField *fields = (forceField *)realloc(s->fields, capacity * sizeof(forceField));
+        if (fields == NULL) {
+            fprintf(stderr, "Force field realloc failure\n");
+            return -1;
+        }
+        s->fields = fields;
+        s->capacity = capacity;
+    }
+    s->fields[s->count] = *f;
+    return s->count++;
+}
+
+int addUniformField(forceFieldSet *s, double ax, double ay) {
+    forceField f = {0};
+    f.kind = FIELD_UNIFORM;
+    f.vector = (vector2){ax, ay};
+    return appendField(s, &f);
+}
+
+int addRadialField(forceFieldSet *s, double cx, double cy, double strength, double softening, double range) {
+    forceField f = {0};
+    f.kind = FIELD_RADIAL;
+    f.vector = (vector2){cx, cy};
+    f.strength = strength;
+    f.softening = softening;
+    f.range = range;
+    return appendField(s, &f);
+}
+
+int addVortexField(forceFieldSet *s, double cx, double cy, double strength, double softening, double range) {
+    int field = addRadialField(s, cx, cy, strength, softening, range);
+    if (field >= 0) {
+        s->fields[field].kind = FIELD_VORTEX;
+    }
+    return field;
+}
+
+int addDragField(forceFieldSet *s, double linear, double quadratic) {
+    forceField f = {0};
+    f.kind = FIELD_DRAG;
+    f.strength = linear;
+    f.softening = quadratic;
+    return appendField(s, &f);
+}
+
+int addGridField(forceFieldSet *s, double minX, double minY, double cellSize, int cols, int rows,
+                 const float *samplesX, const float *samplesY) {
+    if (cols < 1 || rows < 1 || cellSize <= 0.0) {
+        fprintf(stderr, "Grid field: empty grid\n");
+        return -1;
+    }
+    forceField f = {0};
+    f.kind = FIELD_GRID;
+    f.minX = minX;
+    f.minY = minY;
+    f.cellSize = cellSize;
+    f.cols = cols;
+    f.rows = rows;
+    f.samplesX = (float *)malloc(cols * rows * sizeof(float));
+    f.samplesY = (float *)malloc(cols * rows * sizeof(float));
+    if (f.samplesX == NULL || f.samplesY == NULL) {
+        fprintf(stderr, "Grid field malloc failure\n");
+        free(f.samplesX);
+        free(f.samplesY);
+        return -1;
+    }
+    memcpy(f.samplesX, samplesX, cols * rows * sizeof(float));
+    memcpy(f.samplesY, samplesY, cols * rows * sizeof(float));
+    int field = appendField(s, &f);
+    if (field < 0) {
+        free(f.samplesX);
+        free(f.samplesY);
+    }
+    return field;
+}
+
+void removeForceField(forceFieldSet *s, int field) {
+    if (field < 0 || field >= s->count) {
+        return;
+    }
+    free(s->fields[field].samplesX);
+    free(s->fields[field].samplesY);
+    memmove(s->fields + field, s->fields + field + 1, (s->count - field - 1) * sizeof(forceField));
+    s->count--;
+}
+
+// One field over one block; out-of-range balls are masked, not skipped
+static void evaluateField(const forceField *f, const double *x, const double *y, const double *vx, const double *vy,
+                          int n, double *ax, double *ay) {
+    double cx = f->vector.x, cy = f->vector.y, strength = f->strength;
+    double softening2 = f->softening * f->softening;
+    double range2 = f->range > 0.0 ? f->range * f->range : HUGE_VAL;
+    switch (f->kind) {
+    case FIELD_UNIFORM:
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            ax[i] += cx;
+            ay[i] += cy;
+        }
+        break;
+    case FIELD_RADIAL:
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            double dx = cx - x[i], dy = cy - y[i];
+            double r2 = dx * dx + dy * dy, d2 = r2 + softening2;
+            double scale = r2 < range2 && d2 > 0.0 ? strength / (d2 * sqrt(d2)) : 0.0;
+            ax[i] += scale * dx;
+            ay[i] += scale * dy;
+        }
+        break;
+    case FIELD_VORTEX:
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            double dx = x[i] - cx, dy = y[i] - cy;
+            double r2 = dx * dx + dy * dy, d2 = r2 + softening2;
+            double scale = r2 < range2 && d2 > 0.0 ? strength / d2 : 0.0;
+            ax[i] -= scale * dy;
+            ay[i] += scale * dx;
+        }
+        break;
+    case FIELD_DRAG: {
+        double quadratic = f->softening;
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            double rate = strength + quadratic * sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+            ax[i] -= rate * vx[i];
+            ay[i] -= rate * vy[i];
+        }
+        break;
+    }
+    case FIELD_GRID: {
+        const float *sx = f->samplesX, *sy = f->samplesY;
+        int cols = f->cols;
+        double lastCol = f->cols - 1, lastRow = f->rows - 1, inverse = 1.0 / f->cellSize;
+        #pragma omp simd
+        for (int i = 0; i < n; i++) {
+            double u = (x[i] - f->minX) * inverse, v = (y[i] - f->minY) * inverse;
+            u = u < 0.0 ? 0.0 : (u > lastCol ? lastCol : u);
+            v = v < 0.0 ? 0.0 : (v > lastRow ? lastRow : v);
+            // The far corner repeats the last sample at the upper edges
+            int c = (int)u, r = (int)v;
+            int c1 = c + 1 < f->cols ? c + 1 : c, r1 = r + 1 < f->rows ? r + 1 : r;
+            double tu = u - c, tv = v - r;
+            double w00 = (1.0 - tu) * (1.0 - tv), w10 = tu * (1.0 - tv), w01 = (1.0 - tu) * tv, w11 = tu * tv;
+            ax[i] += w00 * sx[r * cols + c] + w10 * sx[r * cols + c1] + w01 * sx[r1 * cols + c] + w11 * sx[r1 * cols + c1];
+            ay[i] += w00 * sy[r * cols + c] + w10 * sy[r * cols + c1] + w01 * sy[r1 * cols + c] + w11 * sy[r1 * cols + c1];
+        }
+        break;
+    }
+    }
+}
+
+void evaluateForceFields(const forceFieldSet *s, const double *x, const double *y, const double *vx, const double *vy,
+                         int count, double *ax, double *ay) {
+    int blocks = (count + FIELD_BLOCK - 1) / FIELD_BLOCK;
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++) {
+        int first = b * FIELD_BLOCK;
+        int n = count - first < FIELD_BLOCK ? count - first : FIELD_BLOCK;
+        for (int k = 0; k < s->count; k++) {
+            evaluateField(&s->fields[k], x + first, y + first, vx + first, vy + first, n, ax + first, ay + first);
+        }
+    }
+}
+
+void applyForceFields(const forceFieldSet *s, pointArray *a, double h) {
+    if (s->count == 0) {
+        return;
+    }
+    int blocks = (a->size + FIELD_BLOCK - 1) / FIELD_BLOCK;
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++) {
+        double x[FIELD_BLOCK], y[FIELD_BLOCK], vx[FIELD_BLOCK], vy[FIELD_BLOCK], ax[FIELD_BLOCK], ay[FIELD_BLOCK];
+        centerPoint *p = a->points + b * FIELD_BLOCK;
+        int n = a->size - b * FIELD_BLOCK < FIELD_BLOCK ? a->size - b * FIELD_BLOCK : FIELD_BLOCK;
+        for (int i = 0; i < n; i++) {
+            x[i] = p[i].position.x;
+            y[i] = p[i].position.y;
+            vx[i] = p[i].velocity.x;
+            vy[i] = p[i].velocity.y;
+            ax[i] = 0.0;
+            ay[i] = 0.0;
+        }
+        for (int k = 0; k < s->count; k++) {
+            evaluateField(&s->fields[k], x, y, vx, vy, n, ax, ay);
+        }
+        for (int i = 0; i < n; i++) {
+            p[i].velocity.x += ax[i] * h;
+            p[i].velocity.y += ay[i] * h;
+        }
+    }
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/fixed.h"
+
+uint64_t isqrt64(uint64_t v) {
+    // The double estimate is within one of the answer for any input; the
+    // integer correction makes the result exact, so it cannot depend on how
+    // the platform rounds
+    uint64_t r = (uint64_t)sqrt((double)v);
+    while (r > 0 && (r > 0xffffffffULL || r * r > v)) {
+        r--;
+    }
+    while (r < 0xffffffffULL && (r + 1) * (r + 1) <= v) {
+        r++;
+    }
+    return r;
+}
+
+void initFixedState(fixedState *f, float radius, float borderRadius) {
+    memset(f, 0, sizeof(*f));
+    f->radius = fixedFromDouble(radius);
+    f->borderRadius = fixedFromDouble(borderRadius);
+    f->gravity = fixedFromDouble(-GRAVITY);
+    f->slop = fixedFromDouble(0.0001);
+    f->damping = fixedFromDouble(0.9);
+}
+
+void freeFixedState(fixedState *f) {
+    free(f->x);
+    free(f->y);
+    free(f->vx);
+    free(f->vy);
+    f->x = f->y = f->vx = f->vy = NULL;
+    f->count = 0;
+    f->capacity = 0;
+}
+
+static int reserveFixed(fixedState *f, int count) {
+    if (count <= f->capacity) {
+        return 1;
+    }
+    int capacity = f->capacity > 0 ? f->capacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    fixed **columns[4] = {&f->x, &f->y, &f->vx, &f->vy};
+    for (int c = 0; c < 4; c++) {
+        fixed *column = (fixed *)realloc(*columns[c], capacity * sizeof(fixed));
+        if (column == NULL) {
+            fprintf(stderr, "Fixed state realloc failure\n");
+            return 0;
+        }
+        *columns[c] = column;
+    }
+    f->capacity = capacity;
+    return 1;
+}
+
+void importFixedPoints(fixedState *f, const pointArray *a) {
+    if (a->revision != f->revision) {
+        // Compacted, appended to or moved since the export: stale from the first ball
+        f->count = 0;
+    }
+    if (a->size <= f->count || !reserveFixed(f, a->size)) {
+        return;
+    }
+    for (int i = f->count; i < a->size; i++) {
+        f->x[i] = fixedFromDouble(a->points[i].position.x);
+        f->y[i] = fixedFromDouble(a->points[i].position.y);
+        f->vx[i] = fixedFromDouble(a->points[i].velocity.x);
+        f->vy[i] = fixedFromDouble(a->points[i].velocity.y);
+    }
+    f->count = a->size;
+}
+
+void exportFixedPoints(fixedState *f, pointArray *a) {
+    double g = fixedToDouble(f->gravity);
+    for (int i = 0; i < f->count && i < a->size; i++) {
+        a->points[i].position = (vector2){fixedToDouble(f->x[i]), fixedToDouble(f->y[i])};
+        a->points[i].velocity = (vector2){fixedToDouble(f->vx[i]), fixedToDouble(f->vy[i])};
+        a->points[i].acceleration = (vector2){0.0, g};
+    }
+    a->revision++;
+    f->revision = a->revision;
+}
+
+// buildGrid with the cell computed in integers
+static int bucketFixed(spatialGrid *g, const fixedState *f) {
+    if (!reserveGridPoints(g, f->count)) {
+        return 0;
+    }
+
+    fixed minX = fixedFromDouble(g->minX), minY = fixedFromDouble(g->minY);
+    fixed cellSize = fixedFromDouble(g->cellSize);
+    for (int i = 0; i < f->count; i++) {
+        int col = (int)(((int64_t)f->x[i] - minX) / cellSize);
+        int row = (int)(((int64_t)f->y[i] - minY) / cellSize);
+        col = col < 0 ? 0 : (col >= g->cols ? g->cols - 1 : col);
+        row = row < 0 ? 0 : (row >= g->rows ? g->rows - 1 : row);
+        g->pointCell[i] = row * g->cols + col;
+    }
+    sortGridPoints(g, f->count);
+    return 1;
+}
+
+static void integrateFixed(fixedState *f, fixed h) {
+    fixed dv = fixedMul(f->gravity, h);
+    fixed *x = f->x, *y = f->y, *vx = f->vx, *vy = f->vy;
+    #pragma omp simd
+    for (int i = 0; i < f->count; i++) {
+        vy[i] += dv;
+        x[i] += (fixed)fixedShiftDown((int64_t)vx[i] * h);
+        y[i] += (fixed)fixedShiftDown((int64_t)vy[i] * h);
+    }
+}
+
+static void borderFixed(fixedState *f) {
+    fixed limit = f->borderRadius - f->radius;
+    int64_t limit2 = (int64_t)limit * limit;
+    for (int i = 0; i < f->count; i++) {
+        int64_t r2 = (int64_t)f->x[i] * f->x[i] + (int64_t)f->y[i] * f->y[i];
+        if (r2 < limit2) {
+            continue;
+        }
+        // sqrt of a Q16.48 square is already Q8.24
+        fixed distance = (fixed)isqrt64((uint64_t)r2);
+        fixed nx = fixedDiv(f->x[i], distance), ny = fixedDiv(f->y[i], distance);
+        fixed outward = fixedMul(f->vx[i], nx) + fixedMul(f->vy[i], ny);
+        if (outward > 0) {
+            f->vx[i] -= 2 * fixedMul(outward, nx);
+            f->vy[i] -= 2 * fixedMul(outward, ny);
+        }
+        f->x[i] = fixedMul(limit, nx);
+        f->y[i] = fixedMul(limit, ny);
+    }
+}
+
+// collisionDetection in integers: one damped pass in index order
+static void collideFixed(fixedState *f, const spatialGrid *g, contactList *contacts) {
+    fixed diameter = 2 * f->radius;
+    int64_t diameter2 = (int64_t)diameter * diameter;
+    for (int i = 0; i < f->count; i++) {
+        int cx = g->pointCell[i] % g->cols;
+        int cy = g->pointCell[i] / g->cols;
+        int x0 = cx > 0 ? cx - 1 : 0, x1 = cx < g->cols - 1 ? cx + 1 : cx;
+        int y0 = cy > 0 ? cy - 1 : 0, y1 = cy < g->rows - 1 ? cy + 1 : cy;
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int cell = y * g->cols + x;
+                for (int k = g->cellStart[cell]; k < g->cellStart[cell + 1]; k++) {
+                    int j = g->cellPoints[k];
+                    if (j <= i) {
+                        continue;
+                    }
+                    fixed dx = f->x[i] - f->x[j], dy = f->y[i] - f->y[j];
+                    int64_t d2 = (int64_t)dx * dx + (int64_t)dy * dy;
+                    if (d2 >= diameter2) {
+                        continue;
+                    }
+                    fixed distance = (fixed)isqrt64((uint64_t)d2);
+                    fixed overlap = diameter - distance;
+                    if (overlap <= f->slop) {
+                        continue;
+                    }
+                    fixed nx = 0, ny = FIXED_ONE;
+                    if (distance > 0) {
+                        nx = fixedDiv(dx, distance);
+                        ny = fixedDiv(dy, distance);
+                    }
+                    fixed half = (overlap - f->slop) / 2;
+                    f->x[i] += fixedMul(nx, half);
+                    f->y[i] += fixedMul(ny, half);
+                    f->x[j] -= fixedMul(nx, half);
+                    f->y[j] -= fixedMul(ny, half);
+
+                    fixed dot = fixedMul(f->vx[i] - f->vx[j], nx) + fixedMul(f->vy[i] - f->vy[j], ny);
+                    f->vx[i] = fixedMul(f->vx[i] - fixedMul(dot, nx), f->damping);
+                    f->vy[i] = fixedMul(f->vy[i] - fixedMul(dot, ny), f->damping);
+                    f->vx[j] = fixedMul(f->vx[j] + fixedMul(dot, nx), f->damping);
+                    f->vy[j] = fixedMul(f->vy[j] + fixedMul(dot, ny), f->damping);
+
+                    if (contacts != NULL) {
+                        addContact(contacts, i, j, (vector2){fixedToDouble(nx), fixedToDouble(ny)}, fixedToDouble(overlap), -fixedToDouble(dot));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void stepFixed(fixedState *f, spatialGrid *grid, contactList *contacts, double dt, int subSteps) {
+    // Same shape as the legacy float step: substepped motion, then one
+    // collision pass
+    fixed h = fixedFromDouble(dt / subSteps);
+    for (int s = 0; s < subSteps; s++) {
+        integrateFixed(f, h);
+        borderFixed(f);
+    }
+    if (bucketFixed(grid, f)) {
+        collideFixed(f, grid, contacts);
+    }
+    // The buckets came from the fixed positions; queries rebuild from the doubles
+    grid->built = 0;
+}
+
+unsigned long long hashFixedState(const fixedState *f) {
+    unsigned long long h = 0xcbf29ce484222325ULL ^ (unsigned long long)f->count;
+    const fixed *columns[4] = {f->x, f->y, f->vx, f->vy};
+    for (int c = 0; c < 4; c++) {
+        for (int i = 0; i < f->count; i++) {
+            h = (h ^ (uint32_t)columns[c][i]) * 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
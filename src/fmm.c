@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/fmm.h"
+
+#define FMM_MAX_LEVELS 11   // 4^11 leaf boxes; the expansions outgrow memory past that
+
+void initFmmWorkspace(fmmWorkspace *f) {
+    memset(f, 0, sizeof(*f));
+}
+
+void freeFmmWorkspace(fmmWorkspace *f) {
+    free(f->multipoles);
+    free(f->locals);
+    free(f->leafStart);
+    initFmmWorkspace(f);
+}
+
+static unsigned int spreadBits(unsigned int v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static unsigned int compactBits(unsigned int v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return v;
+}
+
+// Boxes of all coarser levels come first
+static long long levelOffset(int level) {
+    return ((1LL << (2 * level)) - 1) / 3;
+}
+
+static double complex boxCentre(const mortonSet *m, int level, unsigned int box) {
+    double side = 65536.0 / m->scale / (double)(1 << level);
+    double ix = compactBits(box), iy = compactBits(box >> 1);
+    return (m->minX + (ix + 0.5) * side) + (m->minY + (iy + 0.5) * side) * I;
+}
+
+static int lowerBound(const unsigned int *codes, int n, unsigned int key) {
+    int first = 0, last = n;
+    while (first < last) {
+        int mid = first + (last - first) / 2;
+        if (codes[mid] < key) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+static int reserveFmm(fmmWorkspace *f, long long boxes, int order, long long leaves) {
+    long long terms = boxes * (order + 1);
+    if (terms > f->boxCapacity) {
+        double complex *multipoles = (double complex *)realloc(f->multipoles, terms * sizeof(double complex));
+        if (multipoles != NULL) {
+            f->multipoles = multipoles;
+        }
+        double complex *locals = (double complex *)realloc(f->locals, terms * sizeof(double complex));
+        if (locals != NULL) {
+            f->locals = locals;
+        }
+        if (multipoles == NULL || locals == NULL) {
+            fprintf(stderr, "FMM expansion realloc failure\n");
+            return 0;
+        }
+        f->boxCapacity = (int)terms;
+    }
+    if (leaves + 1 > f->leafCapacity) {
+        int *leafStart = (int *)realloc(f->leafStart, (leaves + 1) * sizeof(int));
+        if (leafStart == NULL) {
+            fprintf(stderr, "FMM leaf realloc failure\n");
+            return 0;
+        }
+        f->leafStart = leafStart;
+        f->leafCapacity = (int)(leaves + 1);
+    }
+    return 1;
+}
+
+// Multipole of a child box, z0 from the parent's centre to the child's,
+// added to the parent's
+static void shiftMultipole(double complex *parent, const double complex *child, double complex z0, int order,
+                           double binomial[][FMM_MAX_ORDER + 1]) {
+    double complex powers[FMM_MAX_ORDER + 1];
+    powers[0] = 1.0;
+    for (int t = 1; t <= order; t++) {
+        powers[t] = powers[t - 1] * z0;
+    }
+    parent[0] += child[0];
+    for (int t = 1; t <= order; t++) {
+        double complex sum = -child[0] * powers[t] / t;
+        for (int k = 1; k <= t; k++) {
+            sum += child[k] * powers[t - k] * binomial[t - 1][k - 1];
+        }
+        parent[t] += sum;
+    }
+}
+
+// Multipole of a well-separated box, z0 from the target's centre to the
+// source's, added to the target's local expansion. The constant term only
+// shifts the potential, so it is left out.
+static void multipoleToLocal(double complex *local, const double complex *source, double complex z0, int order,
+                             double binomial[][FMM_MAX_ORDER + 1]) {
+    double complex inverse = 1.0 / z0, scaled[FMM_MAX_ORDER + 1];
+    double complex power = inverse;
+    for (int k = 1; k <= order; k++) {
+        scaled[k] = (k % 2 ? -source[k] : source[k]) * power;
+        power *= inverse;
+    }
+    power = inverse;
+    for (int l = 1; l <= order; l++) {
+        double complex sum = -source[0] / l;
+        for (int k = 1; k <= order; k++) {
+            sum += scaled[k] * binomial[l + k - 1][k - 1];
+        }
+        local[l] += power * sum;
+        power *= inverse;
+    }
+}
+
+// Re-centres a Taylor expansion on a point d away
+static void shiftLocal(double complex *local, double complex d, int order) {
+    for (int j = 0; j < order; j++) {
+        for (int k = order - 1; k >= j; k--) {
+            local[k] += d * local[k + 1];
+        }
+    }
+}
+
+int evaluateFmm(fmmWorkspace *f, const mortonSet *m, int order, int boxSize, double strength, double softening,
+                vector2 *out) {
+    int n = m->count;
+    if (n == 0) {
+        return 0;
+    }
+    order = order < 1 ? 1 : order > FMM_MAX_ORDER ? FMM_MAX_ORDER : order;
+    boxSize = boxSize > 0 ? boxSize : 1;
+    int levels = 0;
+    while (m->scale > 0.0 && levels < FMM_MAX_LEVELS && ((long long)boxSize << (2 * levels)) < n) {
+        levels++;
+    }
+    long long leaves = 1LL << (2 * levels), boxes = levelOffset(levels + 1);
+    if (!reserveFmm(f, boxes, order, leaves)) {
+        return -1;
+    }
+    f->levels = levels;
+    int terms = order + 1;
+    double binomial[2 * FMM_MAX_ORDER + 1][FMM_MAX_ORDER + 1];
+    for (int a = 0; a <= 2 * order; a++) {
+        for (int b = 0; b <= order; b++) {
+            binomial[a][b] = b == 0 ? 1.0 : b > a ? 0.0 : binomial[a - 1][b - 1] + binomial[a - 1][b];
+        }
+    }
+
+    int *leafStart = f->leafStart;
+    int shift = 2 * (16 - levels);
+    #pragma omp parallel for schedule(static)
+    for (long long b = 0; b < leaves; b++) {
+        leafStart[b] = levels > 0 ? lowerBound(m->codes, n, (unsigned int)b << shift) : 0;
+    }
+    leafStart[leaves] = n;
+
+    // Upward: leaf multipoles, then each level from its children
+    if (levels >= 2) {
+        double complex *leafMultipoles = f->multipoles + levelOffset(levels) * terms;
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (long long b = 0; b < leaves; b++) {
+            double complex *a = leafMultipoles + b * terms;
+            memset(a, 0, terms * sizeof(double complex));
+            a[0] = leafStart[b + 1] - leafStart[b];
+            double complex c = boxCentre(m, levels, (unsigned int)b);
+            for (int k = leafStart[b]; k < leafStart[b + 1]; k++) {
+                double complex w = (m->x[k] + m->y[k] * I) - c, power = w;
+                for (int t = 1; t <= order; t++) {
+                    a[t] -= power / t;
+                    power *= w;
+                }
+            }
+        }
+    }
+    for (int level = levels - 1; level >= 2; level--) {
+        double complex *parents = f->multipoles + levelOffset(level) * terms;
+        const double complex *children = f->multipoles + levelOffset(level + 1) * terms;
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (long long b = 0; b < (1LL << (2 * level)); b++) {
+            double complex *a = parents + b * terms;
+            memset(a, 0, terms * sizeof(double complex));
+            double complex c = boxCentre(m, level, (unsigned int)b);
+            for (int q = 0; q < 4; q++) {
+                unsigned int child = (unsigned int)b * 4 + q;
+                if (creal(children[child * terms]) > 0.0) {
+                    shiftMultipole(a, children + child * terms, boxCentre(m, level + 1, child) - c, order, binomial);
+                }
+            }
+        }
+    }
+
+    // Downward: each box takes its parent's local expansion and the
+    // multipoles of its interaction list, the children of the parent's
+    // neighbours that are not its own neighbours
+    for (int level = 2; level <= levels; level++) {
+        double complex *locals = f->locals + levelOffset(level) * terms;
+        const double complex *parents = f->locals + levelOffset(level - 1) * terms;
+        const double complex *multipoles = f->multipoles + levelOffset(level) * terms;
+        int side = 1 << level;
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (long long b = 0; b < (1LL << (2 * level)); b++) {
+            if (creal(multipoles[b * terms]) == 0.0) {
+                continue;
+            }
+            double complex *local = locals + b * terms;
+            double complex c = boxCentre(m, level, (unsigned int)b);
+            if (level > 2) {
+                memcpy(local, parents + (b / 4) * terms, terms * sizeof(double complex));
+                shiftLocal(local, c - boxCentre(m, level - 1, (unsigned int)(b / 4)), order);
+            } else {
+                memset(local, 0, terms * sizeof(double complex));
+            }
+            int ix = (int)compactBits((unsigned int)b), iy = (int)compactBits((unsigned int)b >> 1);
+            for (int cy = (iy / 2 - 1) * 2; cy < (iy / 2 + 2) * 2; cy++) {
+                for (int cx = (ix / 2 - 1) * 2; cx < (ix / 2 + 2) * 2; cx++) {
+                    if (cx < 0 || cy < 0 || cx >= side || cy >= side || (abs(cx - ix) <= 1 && abs(cy - iy) <= 1)) {
+                        continue;
+                    }
+                    unsigned int source = spreadBits(cx) | (spreadBits(cy) << 1);
+                    if (creal(multipoles[source * terms]) > 0.0) {
+                        multipoleToLocal(local, multipoles + source * terms, boxCentre(m, level, source) - c, order,
+                                         binomial);
+                    }
+                }
+            }
+        }
+    }
+
+    // Leaves: the local expansion's derivative plus the neighbours summed
+    const double complex *leafLocals = f->locals + levelOffset(levels) * terms;
+    double softening2 = softening * softening;
+    int side = 1 << levels;
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (long long b = 0; b < leaves; b++) {
+        if (leafStart[b] == leafStart[b + 1]) {
+            continue;
+        }
+        int ix = (int)compactBits((unsigned int)b), iy = (int)compactBits((unsigned int)b >> 1);
+        double complex c = levels >= 2 ? boxCentre(m, levels, (unsigned int)b) : 0.0;
+        const double complex *local = leafLocals + b * terms;
+        for (int k = leafStart[b]; k < leafStart[b + 1]; k++) {
+            double x = m->x[k], y = m->y[k];
+            double complex far = 0.0;
+            if (levels >= 2) {
+                double complex w = (x + y * I) - c;
+                far = order * local[order];
+                for (int t = order - 1; t >= 1; t--) {
+                    far = far * w + t * local[t];
+                }
+            }
+            double ax = creal(far), ay = -cimag(far);
+            for (int ny = iy - 1; ny <= iy + 1; ny++) {
+                for (int nx = ix - 1; nx <= ix + 1; nx++) {
+                    if (nx < 0 || ny < 0 || nx >= side || ny >= side) {
+                        continue;
+                    }
+                    unsigned int near = spreadBits(nx) | (spreadBits(ny) << 1);
+                    for (int j = leafStart[near]; j < leafStart[near + 1]; j++) {
+                        double dx = x - m->x[j], dy = y - m->y[j];
+                        double d2 = dx * dx + dy * dy + softening2;
+                        if (d2 > 0.0) {
+                            ax += dx / d2;
+                            ay += dy / d2;
+                        }
+                    }
+                }
+            }
+            out[m->order[k]] = (vector2){-strength * ax, -strength * ay};
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/grid.h"
+
+static void allocateCells(spatialGrid *g, int cols, int rows, int layers) {
+    g->cols = cols;
+    g->rows = rows;
+    g->layers = layers;
+    g->cellStart = (int *)calloc((size_t)cols * rows * layers + 1, sizeof(int));
+    g->cellPoints = NULL;
+    g->pointCell = NULL;
+    g->pointCapacity = 0;
+    g->revision = 0;
+    g->built = 0;
+    g->pointGroup = NULL;
+    g->groupCount = 0;
+    g->periodic = 0;
+}
+
+void initGrid(spatialGrid *g, double minX, double minY, double maxX, double maxY, double cellSize) {
+    g->minX = minX;
+    g->minY = minY;
+    g->minZ = 0.0;
+    g->cellSize = cellSize;
+    allocateCells(g, (int)((maxX - minX) / cellSize) + 1, (int)((maxY - minY) / cellSize) + 1, 1);
+}
+
+int initPeriodicGrid(spatialGrid *g, double minX, double minY, double maxX, double maxY, double cellSize) {
+    // Cells are square, so the height is rounded to whole cells of the
+    // width's spacing
+    int cols = (int)((maxX - minX) / cellSize);
+    double size = cols > 0 ? (maxX - minX) / cols : cellSize;
+    int rows = (int)((maxY - minY) / size + 0.5);
+    if (cols < 3 || rows < 3) {
+        fprintf(stderr, "Periodic grid: %d x %d cells, need at least 3 x 3\n", cols, rows);
+        return -1;
+    }
+    initGrid(g, minX, minY, maxX, minY + rows * size, size);
+    g->cols = cols;
+    g->rows = rows;
+    g->periodic = 1;
+    return 0;
+}
+
+void initGrid3d(spatialGrid *g, double min, double max, double cellSize) {
+    int side = (int)((max - min) / cellSize) + 1;
+    g->minX = min;
+    g->minY = min;
+    g->minZ = min;
+    g->cellSize = cellSize;
+    allocateCells(g, side, side, side);
+}
+
+void freeGrid(spatialGrid *g) {
+    free(g->cellStart);
+    free(g->cellPoints);
+    free(g->pointCell);
+    g->cellStart = NULL;
+    g->cellPoints = NULL;
+    g->pointCell = NULL;
+    g->pointCapacity = 0;
+    g->built = 0;
+}
+
+int reserveGridPoints(spatialGrid *g, int count) {
+    if (count <= g->pointCapacity) {
+        return 1;
+    }
+    int capacity = g->pointCapacity > 0 ? g->pointCapacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int *cellPoints = (int *)realloc(g->cellPoints, capacity * sizeof(int));
+    if (cellPoints != NULL) {
+        g->cellPoints = cellPoints;
+    }
+    int *pointCell = (int *)realloc(g->pointCell, capacity * sizeof(int));
+    if (pointCell != NULL) {
+        g->pointCell = pointCell;
+    }
+    if (cellPoints == NULL || pointCell == NULL) {
+        fprintf(stderr, "Grid realloc failure\n");
+        g->built = 0;
+        return 0;
+    }
+    g->pointCapacity = capacity;
+    return 1;
+}
+
+void sortGridPoints(spatialGrid *g, int count) {
+    int numCells = g->cols * g->rows * g->layers;
+
+    // Counting sort: histogram, prefix sum, scatter. The scatter walks points in
+    // index order, so indices stay ascending inside each cell.
+    memset(g->cellStart, 0, (numCells + 1) * sizeof(int));
+    for (int i = 0; i < count; i++) {
+        g->cellStart[g->pointCell[i] + 1]++;
+    }
+    for (int c = 0; c < numCells; c++) {
+        g->cellStart[c + 1] += g->cellStart[c];
+    }
+    for (int i = 0; i < count; i++) {
+        g->cellPoints[g->cellStart[g->pointCell[i]]++] = i;
+    }
+    // The scatter advanced every start to the start of the next cell; shift back.
+    for (int c = numCells - 1; c > 0; c--) {
+        g->cellStart[c] = g->cellStart[c - 1];
+    }
+    g->cellStart[0] = 0;
+}
+
+void buildGrid(spatialGrid *g, const pointArray *a) {
+    if (!reserveGridPoints(g, a->size)) {
+        return;
+    }
+    for (int i = 0; i < a->size; i++) {
+        g->pointCell[i] = gridClampRow(g, a->points[i].position.y) * g->cols + gridClampCol(g, a->points[i].position.x);
+    }
+    sortGridPoints(g, a->size);
+    g->revision = a->revision;
+    g->built = 1;
+}
+
+void ensureGrid(spatialGrid *g, const pointArray *a) {
+    if (!g->built || g->revision != a->revision) {
+        buildGrid(g, a);
+    }
+}
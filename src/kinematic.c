@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/kinematic.h"
+#include "common/fixed.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void initKinematicSet(kinematicSet *k) {
+    memset(k, 0, sizeof(*k));
+}
+
+void freeKinematicSet(kinematicSet *k) {
+    free(k->bodies);
+    free(k->worldA);
+    free(k->worldB);
+    free(k->ballStart);
+    free(k->pairBodies);
+    free(k->pairBalls);
+    free(k->bodyStart);
+    free(k->activeBalls);
+    initKinematicSet(k);
+}
+
+int addKinematicBody(kinematicSet *k, vector2 a, vector2 b, double thickness, vector2 position, double angle) {
+    if (fixedPointRefuses("Kinematic bodies")) {
+        return -1;
+    }
+    if (k->count == k->capacity) {
+        int capacity = k->capacity > 0 ? k->capacity * 2 : 16;
+        kinematicBody *bodies = (kinematicBody *)realloc(k->bodies, capacity * sizeof(kinematicBody));
+        if (bodies != NULL) {
+            k->bodies = bodies;
+        }
+        vector2 *worldA = (vector2 *)realloc(k->worldA, capacity * sizeof(vector2));
+        if (worldA != NULL) {
+            k->worldA = worldA;
+        }
+        vector2 *worldB = (vector2 *)realloc(k->worldB, capacity * sizeof(vector2));
+        if (worldB != NULL) {
+            k->worldB = worldB;
+        }
+        int *bodyStart = (int *)realloc(k->bodyStart, (capacity + 1) * sizeof(int));
+        if (bodyStart != NULL) {
+            k->bodyStart = bodyStart;
+        }
+        if (bodies == NULL || worldA == NULL || worldB == NULL || bodyStart == NULL) {
+            fprintf(stderr, "Kinematic set realloc failure\n");
+            return -1;
+        }
+        k->capacity = capacity;
+    }
+    kinematicBody *body = &k->bodies[k->count];
+    memset(body, 0, sizeof(*body));
+    body->a = a;
+    body->b = b;
+    body->thickness = thickness;
+    body->script = KINEMATIC_MANUAL;
+    body->origin = position;
+    body->position = body->target = position;
+    body->angle = body->targetAngle = angle;
+    return k->count++;
+}
+
+void setKinematicTarget(kinematicSet *k, int body, vector2 position, double angle) {
+    k->bodies[body].target = position;
+    k->bodies[body].targetAngle = angle;
+}
+
+static vector2 toWorld(vector2 local, vector2 position, double c, double s) {
+    return (vector2){position.x + c * local.x - s * local.y, position.y + s * local.x + c * local.y};
+}
+
+// Bounds of everything the capsule covers during the step, grown by reach
+static void sweptBounds(const kinematicBody *body, double reach, vector2 *lo, vector2 *hi) {
+    double c0 = cos(body->angle), s0 = sin(body->angle);
+    double c1 = cos(body->targetAngle), s1 = sin(body->targetAngle);
+    vector2 p[4] = {toWorld(body->a, body->position, c0, s0), toWorld(body->b, body->position, c0, s0),
+                    toWorld(body->a, body->target, c1, s1), toWorld(body->b, body->target, c1, s1)};
+    *lo = *hi = p[0];
+    for (int i = 1; i < 4; i++) {
+        lo->x = fmin(lo->x, p[i].x);
+        lo->y = fmin(lo->y, p[i].y);
+        hi->x = fmax(hi->x, p[i].x);
+        hi->y = fmax(hi->y, p[i].y);
+    }
+    // A turning end bulges out of the box of its two poses by at most
+    // rho (1 - cos(turn / 2)) for a turn under half a revolution
+    double rho = fmax(hypot(body->a.x, body->a.y), hypot(body->b.x, body->b.y));
+    double turn = fabs(body->targetAngle - body->angle);
+    double bulge = turn < M_PI ? rho * (1.0 - cos(0.5 * turn)) : 2.0 * rho;
+    double grow = body->thickness + reach + bulge;
+    lo->x -= grow;
+    lo->y -= grow;
+    hi->x += grow;
+    hi->y += grow;
+}
+
+static int reservePairs(kinematicSet *k, int numPoints, int pairs) {
+    if (numPoints + 1 > k->pointCapacity) {
+        int capacity = (numPoints + 1) * 2;
+        int *ballStart = (int *)realloc(k->ballStart, capacity * sizeof(int));
+        if (ballStart != NULL) {
+            k->ballStart = ballStart;
+        }
+        int *activeBalls = (int *)realloc(k->activeBalls, capacity * sizeof(int));
+        if (activeBalls != NULL) {
+            k->activeBalls = activeBalls;
+        }
+        if (ballStart == NULL || activeBalls == NULL) {
+            fprintf(stderr, "Kinematic set realloc failure\n");
+            return 0;
+        }
+        k->pointCapacity = capacity;
+    }
+    if (pairs > k->pairCapacity) {
+        int capacity = pairs * 2;
+        int *pairBodies = (int *)realloc(k->pairBodies, capacity * sizeof(int));
+        if (pairBodies != NULL) {
+            k->pairBodies = pairBodies;
+        }
+        int *pairBalls = (int *)realloc(k->pairBalls, capacity * sizeof(int));
+        if (pairBalls != NULL) {
+            k->pairBalls = pairBalls;
+        }
+        if (pairBodies == NULL || pairBalls == NULL) {
+            fprintf(stderr, "Kinematic set realloc failure\n");
+            return 0;
+        }
+        k->pairCapacity = capacity;
+    }
+    return 1;
+}
+
+// Balls whose centre is inside the bounds; counts only when out is NULL
+static int gatherBalls(const spatialGrid *grid, const pointArray *a, vector2 lo, vector2 hi, int *out) {
+    int x0 = gridClampCol(grid, lo.x), x1 = gridClampCol(grid, hi.x);
+    int y0 = gridClampRow(grid, lo.y), y1 = gridClampRow(grid, hi.y);
+    int found = 0;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            int cell = y * grid->cols + x;
+            for (int m = grid->cellStart[cell]; m < grid->cellStart[cell + 1]; m++) {
+                int i = grid->cellPoints[m];
+                vector2 p = a->points[i].position;
+                if (p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y) {
+                    if (out != NULL) {
+                        out[found] = i;
+                    }
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void beginKinematicStep(kinematicSet *k, spatialGrid *grid, const pointArray *a, double dt, double reach) {
+    k->time += dt;
+    k->stepLength = dt;
+    k->activeCount = 0;
+    k->pairCount = 0;
+    k->numPoints = 0;
+    if (k->count == 0) {
+        return;
+    }
+    for (int b = 0; b < k->count; b++) {
+        kinematicBody *body = &k->bodies[b];
+        if (body->script == KINEMATIC_SPIN) {
+            body->target = body->origin;
+            body->targetAngle = body->angle + body->spin * dt;
+        } else if (body->script == KINEMATIC_OSCILLATE) {
+            double s = sin(2.0 * M_PI * body->frequency * k->time + body->phase);
+            body->target = (vector2){body->origin.x + body->amplitude.x * s, body->origin.y + body->amplitude.y * s};
+            body->targetAngle = body->angle;
+        }
+        body->velocity = (vector2){(body->target.x - body->position.x) / dt, (body->target.y - body->position.y) / dt};
+        body->angularVelocity = (body->targetAngle - body->angle) / dt;
+    }
+    ensureGrid(grid, a);
+
+    // Count, prefix, fill, body by body; each body writes its own range
+    int *bodyStart = k->bodyStart;
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int b = 0; b < k->count; b++) {
+        vector2 lo, hi;
+        sweptBounds(&k->bodies[b], reach, &lo, &hi);
+        bodyStart[b + 1] = gatherBalls(grid, a, lo, hi, NULL);
+    }
+    bodyStart[0] = 0;
+    for (int b = 0; b < k->count; b++) {
+        bodyStart[b + 1] += bodyStart[b];
+    }
+    int pairs = bodyStart[k->count];
+    if (!reservePairs(k, a->size, pairs)) {
+        return;
+    }
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int b = 0; b < k->count; b++) {
+        vector2 lo, hi;
+        sweptBounds(&k->bodies[b], reach, &lo, &hi);
+        gatherBalls(grid, a, lo, hi, k->pairBalls + bodyStart[b]);
+    }
+
+    // Regroup by ball; walking pairs body by body keeps body order per ball
+    int *ballStart = k->ballStart;
+    memset(ballStart, 0, (a->size + 1) * sizeof(int));
+    for (int p = 0; p < pairs; p++) {
+        ballStart[k->pairBalls[p] + 1]++;
+    }
+    for (int i = 0; i < a->size; i++) {
+        if (ballStart[i + 1] > 0) {
+            k->activeBalls[k->activeCount++] = i;
+        }
+        ballStart[i + 1] += ballStart[i];
+    }
+    for (int b = 0; b < k->count; b++) {
+        for (int p = bodyStart[b]; p < bodyStart[b + 1]; p++) {
+            k->pairBodies[ballStart[k->pairBalls[p]]++] = b;
+        }
+    }
+    for (int i = a->size; i > 0; i--) {
+        ballStart[i] = ballStart[i - 1];
+    }
+    ballStart[0] = 0;
+    k->pairCount = pairs;
+    k->numPoints = a->size;
+}
+
+int collideKinematic(kinematicSet *k, pointArray *a, const int *balls, int count, double t, float radius, double restitution) {
+    if (k->pairCount == 0) {
+        return 0;
+    }
+    for (int b = 0; b < k->count; b++) {
+        const kinematicBody *body = &k->bodies[b];
+        vector2 position = {body->position.x + (body->target.x - body->position.x) * t,
+                            body->position.y + (body->target.y - body->position.y) * t};
+        double angle = body->angle + (body->targetAngle - body->angle) * t;
+        double c = cos(angle), s = sin(angle);
+        k->worldA[b] = toWorld(body->a, position, c, s);
+        k->worldB[b] = toWorld(body->b, position, c, s);
+    }
+    if (balls == NULL) {
+        balls = k->activeBalls;
+        count = k->activeCount;
+    }
+
+    int pushed = 0;
+    #pragma omp parallel for schedule(static) reduction(+:pushed)
+    for (int n = 0; n < count; n++) {
+        int i = balls[n];
+        if (i >= k->numPoints) {
+            continue;
+        }
+        centerPoint *p = &a->points[i];
+        for (int m = k->ballStart[i]; m < k->ballStart[i + 1]; m++) {
+            int b = k->pairBodies[m];
+            const kinematicBody *body = &k->bodies[b];
+            vector2 ea = k->worldA[b], eb = k->worldB[b];
+            double ex = eb.x - ea.x, ey = eb.y - ea.y;
+            double length2 = ex * ex + ey * ey;
+            double u = length2 > 0.0 ? ((p->position.x - ea.x) * ex + (p->position.y - ea.y) * ey) / length2 : 0.0;
+            u = u < 0.0 ? 0.0 : (u > 1.0 ? 1.0 : u);
+            vector2 q = {ea.x + ex * u, ea.y + ey * u};
+            double dx = p->position.x - q.x, dy = p->position.y - q.y;
+            double reach = radius + body->thickness;
+            double d2 = dx * dx + dy * dy;
+            if (d2 >= reach * reach || d2 == 0.0) {
+                continue;
+            }
+            double d = sqrt(d2);
+            double nx = dx / d, ny = dy / d;
+            p->position.x = q.x + nx * reach;
+            p->position.y = q.y + ny * reach;
+
+            // Surface velocity at the contact: the body's translation plus
+            // its turn about its own position
+            vector2 pivot = {body->position.x + body->velocity.x * k->stepLength * t,
+                             body->position.y + body->velocity.y * k->stepLength * t};
+            double sx = body->velocity.x - body->angularVelocity * (q.y - pivot.y);
+            double sy = body->velocity.y + body->angularVelocity * (q.x - pivot.x);
+            double vn = (p->velocity.x - sx) * nx + (p->velocity.y - sy) * ny;
+            if (vn < 0.0) {
+                p->velocity.x -= (1.0 + restitution) * vn * nx;
+                p->velocity.y -= (1.0 + restitution) * vn * ny;
+            }
+            pushed++;
+        }
+    }
+    return pushed;
+}
+
+void endKinematicStep(kinematicSet *k) {
+    for (int b = 0; b < k->count; b++) {
+        k->bodies[b].position = k->bodies[b].target;
+        k->bodies[b].angle = k->bodies[b].targetAngle;
+    }
+}
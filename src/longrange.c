@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "common/longrange.h"
+
+#define MORTON_LEVELS 16    // bits per axis
+#define TREE_STACK 256
+
+void defaultLongRangeSettings(longRangeSettings *s) {
+    s->mode = LONG_RANGE_NONE;
+    s->strength = 1e-4;
+    s->softening = 0.01;
+    s->theta = 0.5;
+    s->leafSize = 8;
+    s->order = 12;
+    s->boxSize = 32;
+    s->uniformGravity = 1;
+}
+
+void initLongRangeWorkspace(longRangeWorkspace *w) {
+    memset(w, 0, sizeof(*w));
+    initFmmWorkspace(&w->fmm);
+}
+
+void freeLongRangeWorkspace(longRangeWorkspace *w) {
+    free(w->acceleration);
+    free(w->codes);
+    free(w->order);
+    free(w->codeScratch);
+    free(w->orderScratch);
+    free(w->sortedX);
+    free(w->sortedY);
+    free(w->nodes);
+    freeFmmWorkspace(&w->fmm);
+    initLongRangeWorkspace(w);
+}
+
+static int reserveLongRange(longRangeWorkspace *w, int n) {
+    if (n <= w->capacity) {
+        return 1;
+    }
+    int capacity = w->capacity > 0 ? w->capacity : 1024;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    vector2 *acceleration = (vector2 *)realloc(w->acceleration, capacity * sizeof(vector2));
+    if (acceleration != NULL) {
+        w->acceleration = acceleration;
+    }
+    unsigned int **codes[2] = {&w->codes, &w->codeScratch};
+    int **orders[2] = {&w->order, &w->orderScratch};
+    double **coordinates[2] = {&w->sortedX, &w->sortedY};
+    int ok = acceleration != NULL;
+    for (int k = 0; k < 2; k++) {
+        unsigned int *code = (unsigned int *)realloc(*codes[k], capacity * sizeof(unsigned int));
+        if (code != NULL) {
+            *codes[k] = code;
+        }
+        int *order = (int *)realloc(*orders[k], capacity * sizeof(int));
+        if (order != NULL) {
+            *orders[k] = order;
+        }
+        double *coordinate = (double *)realloc(*coordinates[k], capacity * sizeof(double));
+        if (coordinate != NULL) {
+            *coordinates[k] = coordinate;
+        }
+        ok = ok && code != NULL && order != NULL && coordinate != NULL;
+    }
+    // Every inner node has at least two children, so 2n nodes always fit
+    quadNode *nodes = (quadNode *)realloc(w->nodes, 2 * capacity * sizeof(quadNode));
+    if (nodes != NULL) {
+        w->nodes = nodes;
+        w->nodeCapacity = 2 * capacity;
+    }
+    if (!ok || nodes == NULL) {
+        fprintf(stderr, "Long-range workspace realloc failure\n");
+        return 0;
+    }
+    w->capacity = capacity;
+    return 1;
+}
+
+// Softened Laplace pull of a mass at (sx, sy) on (x, y), added to (ax, ay)
+static inline void accumulate(double x, double y, double sx, double sy, double mass, double softening2, double *ax, double *ay) {
+    double dx = x - sx, dy = y - sy;
+    double d2 = dx * dx + dy * dy + softening2;
+    if (d2 > 0.0) {
+        double f = mass / d2;
+        *ax += dx * f;
+        *ay += dy * f;
+    }
+}
+
+vector2 directForce(const longRangeSettings *s, const pointArray *a, int i) {
+    double x = a->points[i].position.x, y = a->points[i].position.y;
+    double softening2 = s->softening * s->softening, ax = 0.0, ay = 0.0;
+    for (int j = 0; j < a->size; j++) {
+        if (j != i) {
+            accumulate(x, y, a->points[j].position.x, a->points[j].position.y, 1.0, softening2, &ax, &ay);
+        }
+    }
+    return (vector2){-s->strength * ax, -s->strength * ay};
+}
+
+static unsigned int spreadBits(unsigned int v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Stable LSD radix sort of codes (carrying order) a byte at a time. Each
+// thread counts and scatters one static range, so the result does not
+// depend on the thread count.
+static int sortCodes(longRangeWorkspace *w, int n) {
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+    int *counts = (int *)malloc(threads * 256 * sizeof(int));
+    if (counts == NULL) {
+        fprintf(stderr, "Long-range sort malloc failure\n");
+        return 0;
+    }
+    unsigned int *keys = w->codes, *keyScratch = w->codeScratch;
+    int *values = w->order, *valueScratch = w->orderScratch;
+    for (int shift = 0; shift < 32; shift += 8) {
+        #pragma omp parallel num_threads(threads)
+        {
+#ifdef _OPENMP
+            int t = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+            int t = 0, nt = 1;
+#endif
+            int first = (int)((long long)n * t / nt), last = (int)((long long)n * (t + 1) / nt);
+            int *count = counts + t * 256;
+            memset(count, 0, 256 * sizeof(int));
+            for (int k = first; k < last; k++) {
+                count[(keys[k] >> shift) & 255]++;
+            }
+            #pragma omp barrier
+            #pragma omp single
+            {
+                int offset = 0;
+                for (int digit = 0; digit < 256; digit++) {
+                    for (int u = 0; u < nt; u++) {
+                        int c = counts[u * 256 + digit];
+                        counts[u * 256 + digit] = offset;
+                        offset += c;
+                    }
+                }
+            }
+            for (int k = first; k < last; k++) {
+                int slot = count[(keys[k] >> shift) & 255]++;
+                keyScratch[slot] = keys[k];
+                valueScratch[slot] = values[k];
+            }
+        }
+        unsigned int *keySwap = keys;
+        keys = keyScratch;
+        keyScratch = keySwap;
+        int *valueSwap = values;
+        values = valueScratch;
+        valueScratch = valueSwap;
+    }
+    // Four passes: the sorted data is back in w->codes and w->order
+    free(counts);
+    return 1;
+}
+
+static int newNode(longRangeWorkspace *w) {
+    int node;
+    #pragma omp atomic capture
+    node = w->nodeCount++;
+    return node;
+}
+
+// First index in [first, last) whose quadrant digit at level is above quad
+static int quadrantEnd(const unsigned int *codes, int first, int last, int level, unsigned int quad) {
+    while (first < last) {
+        int mid = first + (last - first) / 2;
+        if (((codes[mid] >> (2 * level)) & 3) <= quad) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+static void buildNode(longRangeWorkspace *w, int node, int first, int count, int level, int leafSize) {
+    quadNode *q = &w->nodes[node];
+    const unsigned int *codes = w->codes;
+    q->first = first;
+    q->count = count;
+    for (int c = 0; c < 4; c++) {
+        q->child[c] = -1;
+    }
+    // Levels where the whole range sits in one quadrant add nothing
+    while (level >= 0 && count > leafSize
+           && ((codes[first] >> (2 * level)) & 3) == ((codes[first + count - 1] >> (2 * level)) & 3)) {
+        level--;
+    }
+
+    double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    double sumX = 0.0, sumY = 0.0, mass = 0.0;
+    if (count <= leafSize || level < 0) {
+        for (int k = first; k < first + count; k++) {
+            double x = w->sortedX[k], y = w->sortedY[k];
+            sumX += x;
+            sumY += y;
+            minX = x < minX ? x : minX;
+            maxX = x > maxX ? x : maxX;
+            minY = y < minY ? y : minY;
+            maxY = y > maxY ? y : maxY;
+        }
+        mass = count;
+    } else {
+        int start = first;
+        for (unsigned int quad = 0; quad < 4; quad++) {
+            int end = quadrantEnd(codes, start, first + count, level, quad);
+            if (end > start) {
+                int child = newNode(w);
+                q->child[quad] = child;
+                int childFirst = start, childCount = end - start;
+                // Big subtrees are built by whichever thread is free
+                #pragma omp task if (childCount > 4096) firstprivate(child, childFirst, childCount)
+                buildNode(w, child, childFirst, childCount, level - 1, leafSize);
+            }
+            start = end;
+        }
+        #pragma omp taskwait
+        for (int c = 0; c < 4; c++) {
+            if (q->child[c] < 0) {
+                continue;
+            }
+            const quadNode *child = &w->nodes[q->child[c]];
+            sumX += child->comX * child->mass;
+            sumY += child->comY * child->mass;
+            mass += child->mass;
+            minX = child->minX < minX ? child->minX : minX;
+            maxX = child->maxX > maxX ? child->maxX : maxX;
+            minY = child->minY < minY ? child->minY : minY;
+            maxY = child->maxY > maxY ? child->maxY : maxY;
+        }
+    }
+    q->mass = mass;
+    q->comX = sumX / mass;
+    q->comY = sumY / mass;
+    q->minX = minX;
+    q->minY = minY;
+    q->maxX = maxX;
+    q->maxY = maxY;
+    q->size = maxX - minX > maxY - minY ? maxX - minX : maxY - minY;
+}
+
+// Codes over the bounding square of the balls, sorted with their positions
+static int sortMorton(longRangeWorkspace *w, const pointArray *a) {
+    int n = a->size;
+    const centerPoint *points = a->points;
+    double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    #pragma omp parallel for schedule(static) reduction(min:minX, minY) reduction(max:maxX, maxY)
+    for (int i = 0; i < n; i++) {
+        double x = points[i].position.x, y = points[i].position.y;
+        minX = x < minX ? x : minX;
+        maxX = x > maxX ? x : maxX;
+        minY = y < minY ? y : minY;
+        maxY = y > maxY ? y : maxY;
+    }
+    double extent = maxX - minX > maxY - minY ? maxX - minX : maxY - minY;
+    double scale = extent > 0.0 ? ((1 << MORTON_LEVELS) - 1) / extent : 0.0;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+        unsigned int qx = (unsigned int)((points[i].position.x - minX) * scale);
+        unsigned int qy = (unsigned int)((points[i].position.y - minY) * scale);
+        w->codes[i] = spreadBits(qx) | (spreadBits(qy) << 1);
+        w->order[i] = i;
+    }
+    if (!sortCodes(w, n)) {
+        return 0;
+    }
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < n; k++) {
+        w->sortedX[k] = points[w->order[k]].position.x;
+        w->sortedY[k] = points[w->order[k]].position.y;
+    }
+    w->minX = minX;
+    w->minY = minY;
+    w->scale = scale;
+    return 1;
+}
+
+int buildBarnesHut(longRangeWorkspace *w, const longRangeSettings *s, const pointArray *a) {
+    int n = a->size;
+    w->nodeCount = 0;
+    if (n == 0) {
+        return 0;
+    }
+    if (!reserveLongRange(w, n) || !sortMorton(w, a)) {
+        return -1;
+    }
+    int leafSize = s->leafSize > 0 ? s->leafSize : 1;
+    #pragma omp parallel
+    #pragma omp single
+    buildNode(w, newNode(w), 0, n, MORTON_LEVELS - 1, leafSize);
+    return 0;
+}
+
+vector2 barnesHutForce(const longRangeWorkspace *w, const longRangeSettings *s, double x, double y) {
+    double softening2 = s->softening * s->softening, theta2 = s->theta * s->theta;
+    double ax = 0.0, ay = 0.0;
+    int stack[TREE_STACK], top = 0;
+    if (w->nodeCount > 0) {
+        stack[top++] = 0;
+    }
+    while (top > 0) {
+        const quadNode *q = &w->nodes[stack[--top]];
+        double dx = x - q->comX, dy = y - q->comY;
+        double d2 = dx * dx + dy * dy;
+        if (q->size * q->size < theta2 * d2) {
+            accumulate(x, y, q->comX, q->comY, q->mass, softening2, &ax, &ay);
+            continue;
+        }
+        int leaf = 1;
+        // Pushed in reverse so quadrants are visited in order
+        for (int c = 3; c >= 0; c--) {
+            if (q->child[c] >= 0) {
+                leaf = 0;
+                if (top < TREE_STACK) {
+                    stack[top++] = q->child[c];
+                }
+            }
+        }
+        if (leaf) {
+            // The ball itself adds nothing: its offset is zero
+            for (int k = q->first; k < q->first + q->count; k++) {
+                accumulate(x, y, w->sortedX[k], w->sortedY[k], 1.0, softening2, &ax, &ay);
+            }
+        }
+    }
+    return (vector2){-s->strength * ax, -s->strength * ay};
+}
+
+int computeLongRangeForces(longRangeWorkspace *w, const longRangeSettings *s, const pointArray *a) {
+    int n = a->size;
+    if (n == 0) {
+        return 0;
+    }
+    if (!reserveLongRange(w, n)) {
+        return -1;
+    }
+    vector2 *out = w->acceleration;
+    switch (s->mode) {
+    case LONG_RANGE_DIRECT:
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int i = 0; i < n; i++) {
+            out[i] = directForce(s, a, i);
+        }
+        return 0;
+    case LONG_RANGE_BARNES_HUT:
+        if (buildBarnesHut(w, s, a) != 0) {
+            memset(out, 0, n * sizeof(vector2));
+            return -1;
+        }
+        // Morton order, so neighbouring iterations walk the same nodes
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (int k = 0; k < n; k++) {
+            out[w->order[k]] = barnesHutForce(w, s, w->sortedX[k], w->sortedY[k]);
+        }
+        return 0;
+    case LONG_RANGE_FMM: {
+        if (!sortMorton(w, a)) {
+            memset(out, 0, n * sizeof(vector2));
+            return -1;
+        }
+        mortonSet m = {w->codes, w->order, w->sortedX, w->sortedY, n, w->minX, w->minY, w->scale};
+        if (evaluateFmm(&w->fmm, &m, s->order, s->boxSize, s->strength, s->softening, out) != 0) {
+            memset(out, 0, n * sizeof(vector2));
+            return -1;
+        }
+        return 0;
+    }
+    default:
+        memset(out, 0, n * sizeof(vector2));
+        return 0;
+    }
+}
@@ -37,7 +37,11 @@ TODO:
 #include <stdlib.h>
 #include <windows.h>
 #include <stdbool.h>
+#include <string.h>
 #include "common/common.h"
+#include "common/world.h"
+#include "common/snapshot.h"
+#include "common/replay.h"
 
 float SLOP = 0.0001;
 float borderRadius = 0.9f;
@@ -52,6 +56,7 @@ int subSteps = 10; // divide the main time step into 5 sub-steps
 #endif
 
 bool spacePressed = false; // prevents spawning multiple balls in one frame
+bool savePressed = false;
 
 const char *vertexShaderSource = "#version 330 core\n"
     "layout (location = 0) in vec2 aPos;\n"
@@ -78,11 +83,49 @@ void getMonitorResolution(int *width, int *height) {
     *height = desktop.bottom;
 }
 
-int main() {
-    pointArray a;
+int main(int argc, char **argv) {
+    physicsWorld world = {0};
+    snapshotMapping snapshot = {0};
     centerPoint boundryCenter;
-    initPointArray(&a, INITIAL_CAPACITY);
-    addPoint(&a, 0.0, 0.0, 1.0, 0.5); // Starting position and velocity
+    inputLog log;
+    const char *snapshotPath = NULL, *recordPath = NULL;
+    // main.exe [scene.snap] [--record run.log] resumes a saved scene and/or
+    // logs the inputs, S saves the current scene as world_<step>.snap.
+    // main.exe --replay run.log re-runs a logged session without a window.
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (loadInputLog(&log, argv[i + 1]) != 0) {
+                return -1;
+            }
+            int result = replayInputLog(&log, &world);
+            if (world.points.points != NULL) {
+                freeWorld(&world);
+            }
+            freeInputLog(&log);
+            return result;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else {
+            snapshotPath = argv[i];
+        }
+    }
+
+    if (snapshotPath != NULL) {
+        if (mapSnapshot(&world, snapshotPath, 1, &snapshot) != 0) {
+            return -1;
+        }
+    } else {
+        initWorld(&world, INITIAL_CAPACITY, radius, borderRadius);
+    }
+    initInputLog(&log, &world, timeStep, subSteps, 60);
+    if (snapshotPath != NULL) {
+        strncpy(log.snapshot, snapshotPath, INPUT_LOG_PATH_MAX - 1);
+    } else {
+        spawnBall(&world, &log, 0.0, 0.0, 1.0, 0.5); // Starting position and velocity
+    }
+    // subSteps is now the most a violent frame gets; quiet frames use fewer
+    double stepLength = timeStep;
+    setParameter(&world, &log, &stepLength, &subSteps, PARAM_ADAPTIVE_SUB_STEPS, 1);
 
     int width, height;
     getMonitorResolution(&width, &height);
@@ -158,7 +201,7 @@ int main() {
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, (NUM_SEGMENTS + 2) * 2 * sizeof(float) * a.capacity, NULL, GL_STREAM_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, (NUM_SEGMENTS + 2) * 2 * sizeof(float) * world.points.capacity, NULL, GL_STREAM_DRAW);
 
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
@@ -181,20 +224,35 @@ int main() {
         bool spaceCurrentlyPressed = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
         drawHollow(&boundryCenter, radius, NUM_SEGMENTS, VBO );
         if (spaceCurrentlyPressed && !spacePressed) {
-            addPoint(&a, 0.0, 0.0, 1.0, 0.5);
+            spawnBall(&world, &log, 0.0, 0.0, 1.0, 0.5);
             spacePressed = true;
         } else if (!spaceCurrentlyPressed) {
             spacePressed = false;
         }
 
-
-    for (int i = 0; i < a.size; i++) {
-        verlet(&a.points[i], timeStep, subSteps);
-        borderCollision(&a.points[i], radius);
-    }
-
-        collisionDetection(&a, radius);
-        updateVertexData(&a, VBO, radius);
+        bool saveCurrentlyPressed = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        if (saveCurrentlyPressed && !savePressed) {
+            // A fresh name per step: the snapshot this run started from is
+            // still mapped, and a recorded replay needs it as it was
+            char savePath[64];
+            snprintf(savePath, sizeof(savePath), "world_%llu.snap", world.step);
+            if (snapshotPath != NULL && strcmp(savePath, snapshotPath) == 0) {
+                fprintf(stderr, "Not overwriting %s, this run started from it\n", savePath);
+            } else if (saveSnapshot(&world, savePath) == 0) {
+                printf("Saved %s\n", savePath);
+            }
+        }
+        savePressed = saveCurrentlyPressed;
+
+        stepWorld(&world, timeStep, subSteps);
+        recordStep(&log, &world);
+        if (world.step % 30 == 0) {
+            char title[128];
+            snprintf(title, sizeof(title), "Render Circle - %d balls, %d substeps, %d contacts",
+                     world.points.size, world.stats.subSteps, world.stats.contacts);
+            glfwSetWindowTitle(window, title);
+        }
+        updateVertexData(&world.points, VBO, radius);
 
         glUseProgram(shaderProgram);
         glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection);
@@ -211,6 +269,11 @@ int main() {
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    freePointArray(&a);
+    if (recordPath != NULL) {
+        saveInputLog(&log, recordPath);
+    }
+    freeInputLog(&log);
+    freeWorld(&world);
+    unmapSnapshot(&snapshot);
     return 0;
 }
\ No newline at end of file
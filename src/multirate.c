@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common/multirate.h"
+
+void initMultiRateWorkspace(multiRateWorkspace *m) {
+    m->level = NULL;
+    m->previousLevel = NULL;
+    m->parent = NULL;
+    m->ballOrder = NULL;
+    for (int l = 0; l < MAX_RATE_LEVELS; l++) {
+        m->levelContacts[l] = (contactList){NULL, 0, 0};
+        m->levelStart[l] = 0;
+    }
+    m->levelStart[MAX_RATE_LEVELS] = 0;
+    m->numLevels = 0;
+    m->numPoints = 0;
+    m->capacity = 0;
+    m->ballSubSteps = 0;
+}
+
+void freeMultiRateWorkspace(multiRateWorkspace *m) {
+    free(m->level);
+    free(m->previousLevel);
+    free(m->parent);
+    free(m->ballOrder);
+    for (int l = 0; l < MAX_RATE_LEVELS; l++) {
+        freeContactList(&m->levelContacts[l]);
+    }
+    initMultiRateWorkspace(m);
+}
+
+static int reserveRates(multiRateWorkspace *m, int numPoints) {
+    if (numPoints <= m->capacity) {
+        return 1;
+    }
+    int capacity = m->capacity > 0 ? m->capacity : 64;
+    while (capacity < numPoints) {
+        capacity *= 2;
+    }
+    int **columns[4] = {&m->level, &m->previousLevel, &m->parent, &m->ballOrder};
+    for (int c = 0; c < 4; c++) {
+        int *column = (int *)realloc(*columns[c], capacity * sizeof(int));
+        if (column == NULL) {
+            fprintf(stderr, "Multi-rate workspace realloc failure\n");
+            return 0;
+        }
+        *columns[c] = column;
+    }
+    m->capacity = capacity;
+    return 1;
+}
+
+static int findRoot(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Smallest L with 2^L >= n
+static int levelFor(double n) {
+    int level = 0;
+    while (level < MAX_RATE_LEVELS - 1 && (double)(1 << level) < n) {
+        level++;
+    }
+    return level;
+}
+
+int assignRateLevels(multiRateWorkspace *m, const pointArray *a, const contactList *contacts, double dt, double maxTravel, int minSubSteps, int maxSubSteps) {
+    if (!reserveRates(m, a->size)) {
+        m->numLevels = 0;
+        return maxSubSteps;
+    }
+    int lower = levelFor(minSubSteps > 1 ? minSubSteps : 1);
+    int upper = levelFor(maxSubSteps > 1 ? maxSubSteps : 1);
+    // maxSubSteps is a bound, so round it down when it is not a power of two
+    if (upper > 0 && (1 << upper) > maxSubSteps) {
+        upper--;
+    }
+    lower = lower > upper ? upper : lower;
+
+    int *level = m->level;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a->size; i++) {
+        double vx = a->points[i].velocity.x, vy = a->points[i].velocity.y;
+        double travel = (sqrt(vx * vx + vy * vy) + GRAVITY * dt) * dt;
+        int l = levelFor(travel / maxTravel);
+        level[i] = l < lower ? lower : (l > upper ? upper : l);
+    }
+
+    // A contact's balls must step together, so every connected group runs at
+    // the level of its fastest member. The root keeps the group's maximum.
+    int *parent = m->parent;
+    for (int i = 0; i < a->size; i++) {
+        parent[i] = i;
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        const contact *c = &contacts->items[k];
+        if (c->b == BORDER_CONTACT) {
+            continue;
+        }
+        int ra = findRoot(parent, c->a), rb = findRoot(parent, c->b);
+        if (ra != rb) {
+            int l = level[ra] > level[rb] ? level[ra] : level[rb];
+            parent[rb] = ra;
+            level[ra] = l;
+        }
+    }
+    for (int i = 0; i < a->size; i++) {
+        level[i] = level[findRoot(parent, i)];
+    }
+
+    // Counting sort of the balls by level, index order within each
+    int *start = m->levelStart;
+    for (int l = 0; l <= MAX_RATE_LEVELS; l++) {
+        start[l] = 0;
+    }
+    int finest = 0;
+    for (int i = 0; i < a->size; i++) {
+        start[level[i] + 1]++;
+        finest = level[i] > finest ? level[i] : finest;
+    }
+    for (int l = 0; l < MAX_RATE_LEVELS; l++) {
+        start[l + 1] += start[l];
+    }
+    int fill[MAX_RATE_LEVELS];
+    for (int l = 0; l < MAX_RATE_LEVELS; l++) {
+        fill[l] = start[l];
+    }
+    for (int i = 0; i < a->size; i++) {
+        m->ballOrder[fill[level[i]]++] = i;
+    }
+    m->numLevels = a->size > 0 ? finest + 1 : lower + 1;
+    return 1 << (m->numLevels - 1);
+}
+
+static int reserveLevelContacts(contactList *c, int count) {
+    if (count <= c->capacity) {
+        return 1;
+    }
+    contact *items = (contact *)realloc(c->items, count * sizeof(contact));
+    if (items == NULL) {
+        fprintf(stderr, "Contact list realloc failure\n");
+        return 0;
+    }
+    c->items = items;
+    c->capacity = count;
+    return 1;
+}
+
+void solveMultiRate(multiRateWorkspace *m, pointArray *a, contactList *contacts, const solverSettings *s, float radius, float borderRadius, double dt,
+                    rateBallCallback moved, void *userData) {
+    if (m->numLevels == 0) {
+        return;
+    }
+    const int *level = m->level;
+
+    // Split the contacts by level, keeping the sorted order. A warm-start
+    // impulse was accumulated over last step's substep length; scale it to
+    // this step's so a ball changing level does not get kicked.
+    for (int l = 0; l < m->numLevels; l++) {
+        clearContactList(&m->levelContacts[l]);
+        if (!reserveLevelContacts(&m->levelContacts[l], contacts->count)) {
+            return;
+        }
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        contact c = contacts->items[k];
+        int l = level[c.a];
+        int previous = c.a < m->numPoints ? m->previousLevel[c.a] : l;
+        if (previous != l) {
+            double scale = ldexp(1.0, previous - l);
+            c.impulse *= scale;
+            c.tangentImpulse *= scale;
+        }
+        contactList *list = &m->levelContacts[l];
+        list->items[list->count++] = c;
+    }
+
+    // Fine substep s ends a substep of level l every 2^(finest - l) fine
+    // substeps, so all levels reach the end of the step together. Levels
+    // share no contacts, so the order they run in does not matter.
+    int finest = m->numLevels - 1;
+    int fineSteps = 1 << finest;
+    m->ballSubSteps = 0;
+    for (int step = 0; step < fineSteps; step++) {
+        for (int l = 0; l <= finest; l++) {
+            int stride = 1 << (finest - l);
+            int first = m->levelStart[l], last = m->levelStart[l + 1];
+            if ((step + 1) % stride != 0 || first == last) {
+                continue;
+            }
+            double h = dt / (1 << l);
+            const int *balls = m->ballOrder;
+            #pragma omp parallel for schedule(static)
+            for (int k = first; k < last; k++) {
+                integrateVelocity(&a->points[balls[k]], h);
+            }
+            solveContacts(a, &m->levelContacts[l], s, radius, borderRadius, h);
+            #pragma omp parallel for schedule(static)
+            for (int k = first; k < last; k++) {
+                integratePosition(&a->points[balls[k]], h);
+                clampToBorder(&a->points[balls[k]], radius, borderRadius);
+            }
+            if (moved != NULL) {
+                moved(a, balls + first, last - first, (double)(step + 1) / fineSteps, userData);
+            }
+            m->ballSubSteps += last - first;
+        }
+    }
+    a->revision++;
+
+    // Back into the caller's list: each level's contacts are a subsequence of it
+    int cursor[MAX_RATE_LEVELS] = {0};
+    for (int k = 0; k < contacts->count; k++) {
+        int l = level[contacts->items[k].a];
+        contacts->items[k] = m->levelContacts[l].items[cursor[l]++];
+    }
+    for (int i = 0; i < a->size; i++) {
+        m->previousLevel[i] = level[i];
+    }
+    m->numPoints = a->size;
+}
@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "common/query.h"
+
+// The unlocked versions below assume the grid is current, which lets the
+// batched queries share one ensureGrid and then run read-only in parallel.
+
+static int radiusUnlocked(const spatialGrid *g, const pointArray *a, vector2 center, double r, int *out, int maxOut) {
+    int x0 = gridClampCol(g, center.x - r), x1 = gridClampCol(g, center.x + r);
+    int y0 = gridClampRow(g, center.y - r), y1 = gridClampRow(g, center.y + r);
+    double r2 = r * r;
+    int found = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            int cell = y * g->cols + x;
+            for (int k = g->cellStart[cell]; k < g->cellStart[cell + 1]; k++) {
+                int j = g->cellPoints[k];
+                double dx = a->points[j].position.x - center.x;
+                double dy = a->points[j].position.y - center.y;
+                if (dx * dx + dy * dy <= r2) {
+                    if (found < maxOut) {
+                        out[found] = j;
+                    }
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+static int nearestUnlocked(const spatialGrid *g, const pointArray *a, vector2 p, int k, int *outIndices, double *outDistSq) {
+    if (k <= 0) {
+        return 0;
+    }
+    int cx = gridClampCol(g, p.x);
+    int cy = gridClampRow(g, p.y);
+    int maxRing = g->cols > g->rows ? g->cols : g->rows;
+    int found = 0;
+
+    // Walk square rings of cells outwards. Every cell on ring R + 1 is at least
+    // R cells away from p, so once the k-th best beats that we are done.
+    for (int ring = 0; ring <= maxRing; ring++) {
+        for (int y = cy - ring; y <= cy + ring; y++) {
+            if (y < 0 || y >= g->rows) {
+                continue;
+            }
+            int onEdge = (y == cy - ring || y == cy + ring);
+            int step = onEdge ? 1 : 2 * ring;
+            for (int x = cx - ring; x <= cx + ring; x += step > 0 ? step : 1) {
+                if (x < 0 || x >= g->cols) {
+                    continue;
+                }
+                int cell = y * g->cols + x;
+                for (int s = g->cellStart[cell]; s < g->cellStart[cell + 1]; s++) {
+                    int j = g->cellPoints[s];
+                    double dx = a->points[j].position.x - p.x;
+                    double dy = a->points[j].position.y - p.y;
+                    double d2 = dx * dx + dy * dy;
+                    if (found == k && d2 >= outDistSq[k - 1]) {
+                        continue;
+                    }
+                    // Insertion into the sorted result list
+                    int pos = found < k ? found++ : k - 1;
+                    while (pos > 0 && outDistSq[pos - 1] > d2) {
+                        outDistSq[pos] = outDistSq[pos - 1];
+                        outIndices[pos] = outIndices[pos - 1];
+                        pos--;
+                    }
+                    outDistSq[pos] = d2;
+                    outIndices[pos] = j;
+                }
+            }
+        }
+        double reach = ring * g->cellSize;
+        if (found == k && outDistSq[k - 1] <= reach * reach) {
+            break;
+        }
+    }
+    return found;
+}
+
+static int raycastUnlocked(const spatialGrid *g, const pointArray *a, vector2 origin, vector2 dir, double maxDist, float radius, double *outT) {
+    double len = sqrt(dir.x * dir.x + dir.y * dir.y);
+    if (len == 0.0) {
+        return -1;
+    }
+    double dx = dir.x / len, dy = dir.y / len;
+
+    // A ball touching the ray at distance t has its centre within radius of
+    // that ray point, so within reach cells of the cell holding it. The walk
+    // runs over the grid padded by reach cells on every side, which also
+    // catches balls at the edge hit from a ray starting outside the grid.
+    int reach = (int)ceil(radius / g->cellSize);
+    reach = reach > 1 ? reach : 1;
+    double pad = reach * g->cellSize;
+
+    // Clip the ray to the padded rectangle
+    double maxX = g->minX + g->cols * g->cellSize + pad;
+    double maxY = g->minY + g->rows * g->cellSize + pad;
+    double tEnter = 0.0, tExit = maxDist;
+    double lo[2] = {g->minX - pad, g->minY - pad}, hi[2] = {maxX, maxY};
+    double o[2] = {origin.x, origin.y}, d[2] = {dx, dy};
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0.0) {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) {
+                return -1;
+            }
+            continue;
+        }
+        double t0 = (lo[axis] - o[axis]) / d[axis];
+        double t1 = (hi[axis] - o[axis]) / d[axis];
+        if (t0 > t1) {
+            double tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        tEnter = t0 > tEnter ? t0 : tEnter;
+        tExit = t1 < tExit ? t1 : tExit;
+    }
+    if (tEnter > tExit) {
+        return -1;
+    }
+
+    // Amanatides-Woo traversal; testing the block of reach cells around each
+    // visited cell finds every hit in order.
+    int x = (int)floor((origin.x + dx * tEnter - g->minX) / g->cellSize);
+    int y = (int)floor((origin.y + dy * tEnter - g->minY) / g->cellSize);
+    x = x < -reach ? -reach : (x >= g->cols + reach ? g->cols + reach - 1 : x);
+    y = y < -reach ? -reach : (y >= g->rows + reach ? g->rows + reach - 1 : y);
+    int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+    double tDeltaX = dx != 0.0 ? g->cellSize / fabs(dx) : DBL_MAX;
+    double tDeltaY = dy != 0.0 ? g->cellSize / fabs(dy) : DBL_MAX;
+    double tMaxX = dx != 0.0 ? (g->minX + (x + (dx > 0)) * g->cellSize - origin.x) / dx : DBL_MAX;
+    double tMaxY = dy != 0.0 ? (g->minY + (y + (dy > 0)) * g->cellSize - origin.y) / dy : DBL_MAX;
+    double tCell = tEnter;
+    double bestT = maxDist;
+    double r2 = (double)radius * radius;
+    int best = -1;
+
+    while (tCell <= bestT && tCell <= tExit) {
+        for (int ny = y - reach; ny <= y + reach; ny++) {
+            for (int nx = x - reach; nx <= x + reach; nx++) {
+                if (nx < 0 || ny < 0 || nx >= g->cols || ny >= g->rows) {
+                    continue;
+                }
+                int cell = ny * g->cols + nx;
+                for (int s = g->cellStart[cell]; s < g->cellStart[cell + 1]; s++) {
+                    int j = g->cellPoints[s];
+                    double mx = origin.x - a->points[j].position.x;
+                    double my = origin.y - a->points[j].position.y;
+                    double b = mx * dx + my * dy;
+                    double c = mx * mx + my * my - r2;
+                    if (c > 0.0 && b > 0.0) {
+                        continue;
+                    }
+                    double disc = b * b - c;
+                    if (disc < 0.0) {
+                        continue;
+                    }
+                    double t = -b - sqrt(disc);
+                    if (t < 0.0) {
+                        t = 0.0; // origin starts inside this ball
+                    }
+                    if (t < bestT || (t == bestT && best >= 0 && j < best)) {
+                        bestT = t;
+                        best = j;
+                    }
+                }
+            }
+        }
+        if (tMaxX < tMaxY) {
+            tCell = tMaxX;
+            tMaxX += tDeltaX;
+            x += stepX;
+        } else {
+            tCell = tMaxY;
+            tMaxY += tDeltaY;
+            y += stepY;
+        }
+        if (x < -reach || y < -reach || x >= g->cols + reach || y >= g->rows + reach) {
+            break;
+        }
+    }
+    if (best >= 0 && outT != NULL) {
+        *outT = bestT;
+    }
+    return best;
+}
+
+int queryRadius(spatialGrid *g, const pointArray *a, vector2 center, double r, int *out, int maxOut) {
+    ensureGrid(g, a);
+    return radiusUnlocked(g, a, center, r, out, maxOut);
+}
+
+int queryNearest(spatialGrid *g, const pointArray *a, vector2 p, int k, int *outIndices, double *outDistSq) {
+    ensureGrid(g, a);
+    return nearestUnlocked(g, a, p, k, outIndices, outDistSq);
+}
+
+int queryRaycast(spatialGrid *g, const pointArray *a, vector2 origin, vector2 dir, double maxDist, float radius, double *outT) {
+    ensureGrid(g, a);
+    return raycastUnlocked(g, a, origin, dir, maxDist, radius, outT);
+}
+
+int queryAABB(spatialGrid *g, const pointArray *a, vector2 lo, vector2 hi, float radius, int *out, int maxOut) {
+    ensureGrid(g, a);
+    int x0 = gridClampCol(g, lo.x - radius), x1 = gridClampCol(g, hi.x + radius);
+    int y0 = gridClampRow(g, lo.y - radius), y1 = gridClampRow(g, hi.y + radius);
+    double r2 = (double)radius * radius;
+    int found = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            int cell = y * g->cols + x;
+            for (int k = g->cellStart[cell]; k < g->cellStart[cell + 1]; k++) {
+                int j = g->cellPoints[k];
+                vector2 c = a->points[j].position;
+                // Distance from the centre to the closest point of the box
+                double qx = c.x < lo.x ? lo.x : (c.x > hi.x ? hi.x : c.x);
+                double qy = c.y < lo.y ? lo.y : (c.y > hi.y ? hi.y : c.y);
+                double dx = c.x - qx, dy = c.y - qy;
+                if (dx * dx + dy * dy <= r2) {
+                    if (found < maxOut) {
+                        out[found] = j;
+                    }
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void queryRadiusBatch(spatialGrid *g, const pointArray *a, const radiusQuery *queries, int count, int maxPerQuery, int *out, int *outCounts) {
+    ensureGrid(g, a);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int q = 0; q < count; q++) {
+        outCounts[q] = radiusUnlocked(g, a, queries[q].center, queries[q].radius, out + (size_t)q * maxPerQuery, maxPerQuery);
+    }
+}
+
+void queryNearestBatch(spatialGrid *g, const pointArray *a, const vector2 *points, int count, int k, int *outIndices, double *outDistSq, int *outCounts) {
+    ensureGrid(g, a);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int q = 0; q < count; q++) {
+        outCounts[q] = nearestUnlocked(g, a, points[q], k, outIndices + (size_t)q * k, outDistSq + (size_t)q * k);
+    }
+}
+
+void queryRaycastBatch(spatialGrid *g, const pointArray *a, const rayQuery *rays, int count, float radius, int *outHits, double *outT) {
+    ensureGrid(g, a);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int q = 0; q < count; q++) {
+        outHits[q] = raycastUnlocked(g, a, rays[q].origin, rays[q].dir, rays[q].maxDist, radius, outT + q);
+    }
+}
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common/replay.h"
+#include "common/snapshot.h"
+
+static const char *parameterNames[PARAM_COUNT] = {
+    "timeStep", "subSteps", "solverMode", "iterations", "restitution", "friction", "adaptiveSubSteps"
+};
+
+static unsigned long long mixWord(unsigned long long h, unsigned long long word) {
+    h = (h ^ word) * 0x100000001b3ULL;
+    return h ^ (h >> 29);
+}
+
+static unsigned long long doubleBits(double v) {
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+unsigned long long hashWorld(const physicsWorld *w) {
+    const pointArray *a = &w->points;
+    unsigned long long h = snapshotChecksum(a->points, (unsigned long long)a->size * sizeof(centerPoint), w->step);
+    // Field by field: contact padding is not initialized
+    for (int k = 0; k < w->contacts.count; k++) {
+        const contact *c = &w->contacts.items[k];
+        h = mixWord(h, ((unsigned long long)(unsigned int)c->a << 32) | (unsigned int)c->b);
+        h = mixWord(h, doubleBits(c->impulse));
+        h = mixWord(h, doubleBits(c->tangentImpulse));
+        h = mixWord(h, (unsigned long long)(unsigned int)c->color);
+    }
+    return mixWord(h, (unsigned long long)w->contacts.count);
+}
+
+void initInputLog(inputLog *log, const physicsWorld *w, double timeStep, int subSteps, int hashInterval) {
+    memset(log, 0, sizeof(*log));
+    log->capacity = w->points.capacity;
+    log->radius = w->radius;
+    log->borderRadius = w->borderRadius;
+    log->mode = w->solver.mode;
+    log->timeStep = timeStep;
+    log->subSteps = subSteps;
+    log->hashInterval = hashInterval > 0 ? hashInterval : 1;
+    log->steps = w->step;
+}
+
+void freeInputLog(inputLog *log) {
+    free(log->events);
+    free(log->hashes);
+    memset(log, 0, sizeof(*log));
+}
+
+static void addEvent(inputLog *log, const inputEvent *e) {
+    if (log->eventCount == log->eventCapacity) {
+        int capacity = log->eventCapacity > 0 ? log->eventCapacity * 2 : 64;
+        inputEvent *events = (inputEvent *)realloc(log->events, capacity * sizeof(inputEvent));
+        if (events == NULL) {
+            fprintf(stderr, "Input log realloc failure\n");
+            return;
+        }
+        log->events = events;
+        log->eventCapacity = capacity;
+    }
+    log->events[log->eventCount++] = *e;
+}
+
+static void addHash(inputLog *log, unsigned long long step, unsigned long long hash) {
+    if (log->hashCount == log->hashCapacity) {
+        int capacity = log->hashCapacity > 0 ? log->hashCapacity * 2 : 64;
+        stateHash *hashes = (stateHash *)realloc(log->hashes, capacity * sizeof(stateHash));
+        if (hashes == NULL) {
+            fprintf(stderr, "Input log realloc failure\n");
+            return;
+        }
+        log->hashes = hashes;
+        log->hashCapacity = capacity;
+    }
+    log->hashes[log->hashCount++] = (stateHash){step, hash};
+}
+
+static void applyEvent(physicsWorld *w, const inputEvent *e, double *timeStep, int *subSteps) {
+    if (e->type == INPUT_SPAWN) {
+        addPoint(&w->points, e->values[0], e->values[1], e->values[2], e->values[3]);
+        return;
+    }
+    double value = e->values[0];
+    switch (e->parameter) {
+    case PARAM_TIME_STEP:
+        *timeStep = value;
+        break;
+    case PARAM_SUB_STEPS:
+        *subSteps = (int)value;
+        break;
+    case PARAM_SOLVER_MODE:
+        w->solver.mode = (solverMode)(int)value;
+        break;
+    case PARAM_ITERATIONS:
+        w->solver.iterations = (int)value;
+        break;
+    case PARAM_RESTITUTION:
+        w->solver.restitution = value;
+        break;
+    case PARAM_FRICTION:
+        w->solver.friction = value;
+        break;
+    case PARAM_ADAPTIVE_SUB_STEPS:
+        w->substeps.adaptive = (int)value;
+        break;
+    default:
+        break;
+    }
+}
+
+void spawnBall(physicsWorld *w, inputLog *log, double x, double y, double vx, double vy) {
+    inputEvent e = {w->step, INPUT_SPAWN, PARAM_COUNT, {x, y, vx, vy}};
+    applyEvent(w, &e, NULL, NULL);
+    if (log != NULL) {
+        addEvent(log, &e);
+    }
+}
+
+int setParameter(physicsWorld *w, inputLog *log, double *timeStep, int *subSteps, inputParameter p, double value) {
+    // The integer backend has its own fixed collision response
+    int solverSetting = p == PARAM_SOLVER_MODE || p == PARAM_ITERATIONS || p == PARAM_RESTITUTION || p == PARAM_FRICTION;
+    if (solverSetting && fixedPointRefuses(parameterNames[p])) {
+        return -1;
+    }
+    inputEvent e = {w->step, INPUT_PARAMETER, p, {value, 0.0, 0.0, 0.0}};
+    applyEvent(w, &e, timeStep, subSteps);
+    if (log != NULL) {
+        addEvent(log, &e);
+    }
+    return 0;
+}
+
+void recordStep(inputLog *log, const physicsWorld *w) {
+    log->steps = w->step;
+    if (w->step % (unsigned long long)log->hashInterval == 0) {
+        addHash(log, w->step, hashWorld(w));
+    }
+}
+
+int saveInputLog(const inputLog *log, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Input log: cannot create %s\n", path);
+        return -1;
+    }
+    fprintf(f, "physics-input %d\n", INPUT_LOG_VERSION);
+    fprintf(f, "world %d %.9g %.9g %d\n", log->capacity, log->radius, log->borderRadius, (int)log->mode);
+    fprintf(f, "run %.17g %d %d\n", log->timeStep, log->subSteps, log->hashInterval);
+    if (log->snapshot[0] != '\0') {
+        fprintf(f, "snapshot %s\n", log->snapshot);
+    }
+
+    // Interleaved by step; the hash of step s comes before the inputs applied
+    // after it, which is the order they happened in
+    int h = 0;
+    for (int k = 0; k <= log->eventCount; k++) {
+        unsigned long long step = k < log->eventCount ? log->events[k].step : ~0ULL;
+        for (; h < log->hashCount && log->hashes[h].step <= step; h++) {
+            fprintf(f, "%llu hash %016llx\n", log->hashes[h].step, log->hashes[h].hash);
+        }
+        if (k == log->eventCount) {
+            break;
+        }
+        const inputEvent *e = &log->events[k];
+        if (e->type == INPUT_SPAWN) {
+            fprintf(f, "%llu spawn %.17g %.17g %.17g %.17g\n", e->step, e->values[0], e->values[1], e->values[2], e->values[3]);
+        } else {
+            fprintf(f, "%llu param %s %.17g\n", e->step, parameterNames[e->parameter], e->values[0]);
+        }
+    }
+    fprintf(f, "end %llu\n", log->steps);
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Input log: write to %s failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int loadInputLog(inputLog *log, const char *path) {
+    memset(log, 0, sizeof(*log));
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Input log: cannot open %s\n", path);
+        return -1;
+    }
+
+    int version = 0, mode = 0, ended = 0;
+    if (fscanf(f, " physics-input %d", &version) != 1 || version > INPUT_LOG_VERSION
+        || fscanf(f, " world %d %f %f %d", &log->capacity, &log->radius, &log->borderRadius, &mode) != 4
+        || fscanf(f, " run %lf %d %d", &log->timeStep, &log->subSteps, &log->hashInterval) != 3) {
+        fprintf(stderr, "Input log: %s has no valid header\n", path);
+        fclose(f);
+        return -1;
+    }
+    log->mode = (solverMode)mode;
+
+    char line[INPUT_LOG_PATH_MAX + 64];
+    int lineNumber = 3;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineNumber++;
+        unsigned long long step, hash;
+        char name[32];
+        inputEvent e;
+        memset(&e, 0, sizeof(e));
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            lineNumber--;
+            continue;
+        }
+        if (sscanf(line, "snapshot %259s", log->snapshot) == 1) {
+            continue;
+        }
+        if (sscanf(line, "end %llu", &log->steps) == 1) {
+            ended = 1;
+            break;
+        }
+        if (sscanf(line, "%llu hash %llx", &step, &hash) == 2) {
+            addHash(log, step, hash);
+            continue;
+        }
+        if (sscanf(line, "%llu spawn %lf %lf %lf %lf", &e.step, &e.values[0], &e.values[1], &e.values[2], &e.values[3]) == 5) {
+            e.type = INPUT_SPAWN;
+            e.parameter = PARAM_COUNT;
+            addEvent(log, &e);
+            continue;
+        }
+        if (sscanf(line, "%llu param %31s %lf", &e.step, name, &e.values[0]) == 3) {
+            e.type = INPUT_PARAMETER;
+            e.parameter = PARAM_COUNT;
+            for (int p = 0; p < PARAM_COUNT; p++) {
+                if (strcmp(name, parameterNames[p]) == 0) {
+                    e.parameter = (inputParameter)p;
+                }
+            }
+            if (e.parameter != PARAM_COUNT) {
+                addEvent(log, &e);
+                continue;
+            }
+        }
+        fprintf(stderr, "Input log: cannot parse line %d of %s\n", lineNumber, path);
+        fclose(f);
+        freeInputLog(log);
+        return -1;
+    }
+    fclose(f);
+
+    if (!ended) {
+        // A run that crashed before saving the end still replays up to its last input or hash
+        fprintf(stderr, "Input log: %s has no end line\n", path);
+        if (log->eventCount > 0) {
+            log->steps = log->events[log->eventCount - 1].step;
+        }
+        if (log->hashCount > 0 && log->hashes[log->hashCount - 1].step > log->steps) {
+            log->steps = log->hashes[log->hashCount - 1].step;
+        }
+    }
+    return 0;
+}
+
+int replayInputLog(const inputLog *log, physicsWorld *w) {
+    if (log->snapshot[0] != '\0') {
+        if (loadSnapshot(w, log->snapshot) != 0) {
+            return -1;
+        }
+    } else {
+        initWorld(w, log->capacity, log->radius, log->borderRadius);
+        w->solver.mode = log->mode;
+    }
+    double timeStep = log->timeStep;
+    int subSteps = log->subSteps;
+
+    int e = 0, h = 0, checked = 0;
+    // Hashes taken before the first replayed step (a snapshot start)
+    while (h < log->hashCount && log->hashes[h].step < w->step) {
+        h++;
+    }
+    clock_t start = clock();
+    for (;;) {
+        if (h < log->hashCount && log->hashes[h].step == w->step) {
+            unsigned long long hash = hashWorld(w);
+            if (hash != log->hashes[h].hash) {
+                unsigned long long good = checked > 0 ? log->hashes[h - 1].step : 0;
+                fprintf(stderr, "Replay diverged after step %llu: hash %016llx, recorded %016llx (last match at step %llu)\n",
+                        w->step, hash, log->hashes[h].hash, good);
+                return -1;
+            }
+            checked++;
+            h++;
+        }
+        if (w->step >= log->steps) {
+            break;
+        }
+        for (; e < log->eventCount && log->events[e].step <= w->step; e++) {
+            applyEvent(w, &log->events[e], &timeStep, &subSteps);
+        }
+        stepWorld(w, timeStep, subSteps);
+    }
+
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("Replayed %llu steps in %.3f s (%.0f steps/s), %d of %d hashes matched\n",
+           log->steps, elapsed, elapsed > 0.0 ? log->steps / elapsed : 0.0, checked, log->hashCount);
+    return 0;
+}
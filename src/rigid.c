@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common/rigid.h"
+#include "common/fixed.h"
+
+void initRigidSet(rigidSet *r) {
+    r->bodies = NULL;
+    r->pushes = NULL;
+    r->count = 0;
+    r->capacity = 0;
+    r->members = NULL;
+    r->offsets = NULL;
+    r->memberCount = 0;
+    r->memberCapacity = 0;
+    r->ballBody = NULL;
+    r->ballSlot = NULL;
+    r->numBalls = 0;
+    r->ballCapacity = 0;
+    r->contacts = (contactList){NULL, 0, 0};
+    r->scratch = (contactList){NULL, 0, 0};
+    r->points = NULL;
+    r->pointCapacity = 0;
+}
+
+void freeRigidSet(rigidSet *r) {
+    free(r->bodies);
+    free(r->pushes);
+    free(r->members);
+    free(r->offsets);
+    free(r->ballBody);
+    free(r->ballSlot);
+    freeContactList(&r->contacts);
+    freeContactList(&r->scratch);
+    free(r->points);
+    initRigidSet(r);
+}
+
+static int reserveRigid(rigidSet *r, int bodies, int members, int balls) {
+    if (bodies > r->capacity) {
+        int capacity = r->capacity > 0 ? r->capacity * 2 : 64;
+        capacity = capacity < bodies ? bodies : capacity;
+        rigidBody *grown = (rigidBody *)realloc(r->bodies, capacity * sizeof(rigidBody));
+        if (grown != NULL) {
+            r->bodies = grown;
+        }
+        rigidPush *pushes = (rigidPush *)realloc(r->pushes, capacity * sizeof(rigidPush));
+        if (pushes != NULL) {
+            r->pushes = pushes;
+        }
+        if (grown == NULL || pushes == NULL) {
+            fprintf(stderr, "Rigid body realloc failure\n");
+            return 0;
+        }
+        r->capacity = capacity;
+    }
+    if (members > r->memberCapacity) {
+        int capacity = r->memberCapacity > 0 ? r->memberCapacity * 2 : 256;
+        capacity = capacity < members ? members : capacity;
+        int *indices = (int *)realloc(r->members, capacity * sizeof(int));
+        if (indices != NULL) {
+            r->members = indices;
+        }
+        vector2 *offsets = (vector2 *)realloc(r->offsets, capacity * sizeof(vector2));
+        if (offsets != NULL) {
+            r->offsets = offsets;
+        }
+        if (indices == NULL || offsets == NULL) {
+            fprintf(stderr, "Rigid member realloc failure\n");
+            return 0;
+        }
+        r->memberCapacity = capacity;
+    }
+    if (balls > r->ballCapacity) {
+        int capacity = r->ballCapacity > 0 ? r->ballCapacity * 2 : 256;
+        capacity = capacity < balls ? balls : capacity;
+        int *ballBody = (int *)realloc(r->ballBody, capacity * sizeof(int));
+        if (ballBody != NULL) {
+            r->ballBody = ballBody;
+        }
+        int *ballSlot = (int *)realloc(r->ballSlot, capacity * sizeof(int));
+        if (ballSlot != NULL) {
+            r->ballSlot = ballSlot;
+        }
+        if (ballBody == NULL || ballSlot == NULL) {
+            fprintf(stderr, "Rigid ball map realloc failure\n");
+            return 0;
+        }
+        r->ballCapacity = capacity;
+    }
+    for (int i = r->numBalls; i < balls; i++) {
+        r->ballBody[i] = -1;
+        r->ballSlot[i] = -1;
+    }
+    r->numBalls = balls > r->numBalls ? balls : r->numBalls;
+    return 1;
+}
+
+int addRigidBody(rigidSet *r, const pointArray *a, const int *balls, int count) {
+    if (count <= 0 || fixedPointRefuses("Rigid bodies") || !reserveRigid(r, r->count + 1, r->memberCount + count, a->size)) {
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        int i = balls[k];
+        if (i < 0 || i >= a->size || r->ballBody[i] >= 0) {
+            fprintf(stderr, "Rigid body member %d does not exist or already has a body\n", i);
+            return -1;
+        }
+    }
+
+    rigidBody *b = &r->bodies[r->count];
+    b->position = (vector2){0.0, 0.0};
+    b->velocity = (vector2){0.0, 0.0};
+    for (int k = 0; k < count; k++) {
+        const centerPoint *p = &a->points[balls[k]];
+        b->position.x += p->position.x / count;
+        b->position.y += p->position.y / count;
+        b->velocity.x += p->velocity.x / count;
+        b->velocity.y += p->velocity.y / count;
+    }
+    b->angle = 0.0;
+    b->inertia = 0.0;
+    double momentum = 0.0;
+    b->first = r->memberCount;
+    b->count = count;
+    for (int k = 0; k < count; k++) {
+        const centerPoint *p = &a->points[balls[k]];
+        vector2 offset = {p->position.x - b->position.x, p->position.y - b->position.y};
+        b->inertia += offset.x * offset.x + offset.y * offset.y;
+        momentum += offset.x * (p->velocity.y - b->velocity.y) - offset.y * (p->velocity.x - b->velocity.x);
+        r->members[r->memberCount] = balls[k];
+        r->offsets[r->memberCount] = offset;
+        r->ballBody[balls[k]] = r->count;
+        r->ballSlot[balls[k]] = r->memberCount;
+        r->memberCount++;
+    }
+    b->inverseMass = 1.0 / count;
+    b->inverseInertia = b->inertia > 0.0 ? 1.0 / b->inertia : 0.0;
+    b->angularVelocity = momentum * b->inverseInertia;
+    return r->count++;
+}
+
+static inline vector2 rotate(vector2 v, double c, double s) {
+    return (vector2){c * v.x - s * v.y, s * v.x + c * v.y};
+}
+
+// Linear and angular momentum of the members, as the body's velocity and spin
+static void gatherMomentum(rigidBody *b, const int *members, const vector2 *offsets, const centerPoint *points) {
+    double vx = 0.0, vy = 0.0;
+    for (int k = 0; k < b->count; k++) {
+        vx += points[members[k]].velocity.x;
+        vy += points[members[k]].velocity.y;
+    }
+    vx /= b->count;
+    vy /= b->count;
+    double c = cos(b->angle), s = sin(b->angle), momentum = 0.0;
+    for (int k = 0; k < b->count; k++) {
+        vector2 arm = rotate(offsets[k], c, s);
+        momentum += arm.x * (points[members[k]].velocity.y - vy) - arm.y * (points[members[k]].velocity.x - vx);
+    }
+    b->velocity = (vector2){vx, vy};
+    b->angularVelocity = momentum * b->inverseInertia;
+}
+
+static void placeMembers(const rigidBody *b, const int *members, const vector2 *offsets, centerPoint *points) {
+    double c = cos(b->angle), s = sin(b->angle);
+    for (int k = 0; k < b->count; k++) {
+        vector2 arm = rotate(offsets[k], c, s);
+        centerPoint *p = &points[members[k]];
+        p->position = (vector2){b->position.x + arm.x, b->position.y + arm.y};
+        p->velocity = (vector2){b->velocity.x - b->angularVelocity * arm.y, b->velocity.y + b->angularVelocity * arm.x};
+    }
+}
+
+static int isMember(const rigidSet *r, int i) {
+    return i >= 0 && i < r->numBalls && r->ballBody[i] >= 0;
+}
+
+static int reserveContacts(contactList *c, int count) {
+    if (count <= c->capacity) {
+        return 1;
+    }
+    int capacity = c->capacity > 0 ? c->capacity * 2 : 64;
+    capacity = capacity < count ? count : capacity;
+    contact *items = (contact *)realloc(c->items, capacity * sizeof(contact));
+    if (items == NULL) {
+        fprintf(stderr, "Contact list realloc failure\n");
+        return 0;
+    }
+    c->items = items;
+    c->capacity = capacity;
+    return 1;
+}
+
+void splitRigidContacts(rigidSet *r, contactList *contacts) {
+    clearContactList(&r->contacts);
+    if (r->count == 0) {
+        return;
+    }
+    int kept = 0;
+    for (int k = 0; k < contacts->count; k++) {
+        contact c = contacts->items[k];
+        if (isMember(r, c.a) || isMember(r, c.b)) {
+            if (!reserveContacts(&r->contacts, r->contacts.count + 1)) {
+                return;
+            }
+            r->contacts.items[r->contacts.count++] = c;
+        } else {
+            contacts->items[kept++] = c;
+        }
+    }
+    contacts->count = kept;
+}
+
+void mergeRigidContacts(rigidSet *r, contactList *contacts) {
+    if (r->contacts.count == 0) {
+        return;
+    }
+    // Both halves are sorted by pair, so one merge walk restores the order
+    contactList *merged = &r->scratch;
+    if (!reserveContacts(merged, contacts->count + r->contacts.count)) {
+        return;
+    }
+    int i = 0, j = 0, n = 0;
+    while (i < contacts->count || j < r->contacts.count) {
+        int takeRigid = i == contacts->count
+            || (j < r->contacts.count && contactKey(r->contacts.items[j].a, r->contacts.items[j].b)
+                                         < contactKey(contacts->items[i].a, contacts->items[i].b));
+        merged->items[n++] = takeRigid ? r->contacts.items[j++] : contacts->items[i++];
+    }
+    merged->count = n;
+    contactList swap = *contacts;
+    *contacts = *merged;
+    *merged = swap;
+    clearContactList(&r->contacts);
+}
+
+// One side of a split contact: a member's body, a free ball, or the border
+typedef struct {
+    rigidBody *body;
+    rigidPush *push;
+    centerPoint *ball;
+    vector2 arm;
+} contactSide;
+
+static contactSide sideOf(rigidSet *r, pointArray *a, int i, vector2 arm) {
+    if (i == BORDER_CONTACT) {
+        return (contactSide){NULL, NULL, NULL, arm};
+    }
+    if (isMember(r, i)) {
+        int body = r->ballBody[i];
+        return (contactSide){&r->bodies[body], &r->pushes[body], NULL, arm};
+    }
+    return (contactSide){NULL, NULL, &a->points[i], arm};
+}
+
+static vector2 sideVelocity(const contactSide *side) {
+    if (side->body != NULL) {
+        const rigidBody *b = side->body;
+        return (vector2){b->velocity.x - b->angularVelocity * side->arm.y, b->velocity.y + b->angularVelocity * side->arm.x};
+    }
+    return side->ball != NULL ? side->ball->velocity : (vector2){0.0, 0.0};
+}
+
+// Inverse mass seen by a push along d: unit mass per member
+static double sideInverseMass(const contactSide *side, vector2 d) {
+    if (side->body != NULL) {
+        double armCross = side->arm.x * d.y - side->arm.y * d.x;
+        return side->body->inverseMass + armCross * armCross * side->body->inverseInertia;
+    }
+    return side->ball != NULL ? 1.0 : 0.0;
+}
+
+static void sideImpulse(contactSide *side, vector2 p) {
+    if (side->body != NULL) {
+        rigidBody *b = side->body;
+        b->velocity.x += p.x * b->inverseMass;
+        b->velocity.y += p.y * b->inverseMass;
+        b->angularVelocity += (side->arm.x * p.y - side->arm.y * p.x) * b->inverseInertia;
+    } else if (side->ball != NULL) {
+        side->ball->velocity.x += p.x;
+        side->ball->velocity.y += p.y;
+    }
+}
+
+// Position corrections to bodies collect in their push until the pass ends
+static void sidePush(contactSide *side, vector2 p) {
+    if (side->body != NULL) {
+        rigidPush *push = side->push;
+        push->shift.x += p.x * side->body->inverseMass;
+        push->shift.y += p.y * side->body->inverseMass;
+        push->turn += (side->arm.x * p.y - side->arm.y * p.x) * side->body->inverseInertia;
+    } else if (side->ball != NULL) {
+        side->ball->position.x += p.x;
+        side->ball->position.y += p.y;
+    }
+}
+
+// Where a side's ball is now. Members are still where the substep placed
+// them, moved by their body's push so far (rotation to first order).
+static vector2 sidePosition(const pointArray *a, int i, contactSide *side) {
+    vector2 p = a->points[i].position;
+    if (side->body != NULL) {
+        const rigidPush *push = side->push;
+        vector2 arm = {p.x - side->body->position.x, p.y - side->body->position.y};
+        side->arm = (vector2){arm.x - push->turn * arm.y, arm.y + push->turn * arm.x};
+        return (vector2){side->body->position.x + push->shift.x + side->arm.x, side->body->position.y + push->shift.y + side->arm.y};
+    }
+    side->arm = (vector2){0.0, 0.0};
+    return p;
+}
+
+// Normal (from b towards a) and depth from the current positions
+static void contactGeometry(const pointArray *a, contact *c, float radius, float borderRadius, contactSide *sa, contactSide *sb) {
+    vector2 p = sidePosition(a, c->a, sa);
+    if (c->b == BORDER_CONTACT) {
+        double distance = sqrt(p.x * p.x + p.y * p.y);
+        if (distance > 0.0) {
+            c->normal = (vector2){-p.x / distance, -p.y / distance};
+        }
+        c->depth = distance - (borderRadius - radius);
+        return;
+    }
+    vector2 q = sidePosition(a, c->b, sb);
+    double dx = p.x - (q.x + c->shift.x), dy = p.y - (q.y + c->shift.y);
+    double distance = sqrt(dx * dx + dy * dy);
+    if (distance > 0.0) {
+        c->normal = (vector2){dx / distance, dy / distance};
+    }
+    c->depth = 2.0 * radius - distance;
+}
+
+void solveRigidContacts(rigidSet *r, pointArray *a, const solverSettings *s, float radius, float borderRadius, double h) {
+    if (r->count == 0) {
+        return;
+    }
+    #pragma omp parallel for schedule(static)
+    for (int n = 0; n < r->count; n++) {
+        rigidBody *b = &r->bodies[n];
+        gatherMomentum(b, r->members + b->first, r->offsets + b->first, a->points);
+        r->pushes[n] = (rigidPush){{0.0, 0.0}, 0.0};
+    }
+
+    int count = r->contacts.count;
+    if (count > r->pointCapacity) {
+        rigidContactPoint *points = (rigidContactPoint *)realloc(r->points, count * sizeof(rigidContactPoint));
+        if (points == NULL) {
+            fprintf(stderr, "Rigid contact realloc failure\n");
+            return;
+        }
+        r->points = points;
+        r->pointCapacity = count;
+    }
+
+    // Geometry, effective masses and last substep's impulses
+    for (int k = 0; k < count; k++) {
+        contact *c = &r->contacts.items[k];
+        rigidContactPoint *cp = &r->points[k];
+        contactSide sa = sideOf(r, a, c->a, (vector2){0.0, 0.0}), sb = sideOf(r, a, c->b, (vector2){0.0, 0.0});
+        contactGeometry(a, c, radius, borderRadius, &sa, &sb);
+        vector2 n = c->normal, t = {-c->normal.y, c->normal.x};
+        cp->armA = sa.arm;
+        cp->armB = sb.arm;
+        double wn = sideInverseMass(&sa, n) + sideInverseMass(&sb, n);
+        double wt = sideInverseMass(&sa, t) + sideInverseMass(&sb, t);
+        cp->normalMass = wn > 0.0 ? 1.0 / wn : 0.0;
+        cp->tangentMass = wt > 0.0 ? 1.0 / wt : 0.0;
+        vector2 p = {n.x * c->impulse + t.x * c->tangentImpulse, n.y * c->impulse + t.y * c->tangentImpulse};
+        sideImpulse(&sa, p);
+        sideImpulse(&sb, (vector2){-p.x, -p.y});
+    }
+
+    // The ball solver's sequential impulses, with a body's whole mass behind
+    // each member
+    for (int it = 0; it < s->iterations; it++) {
+        for (int k = 0; k < count; k++) {
+            contact *c = &r->contacts.items[k];
+            const rigidContactPoint *cp = &r->points[k];
+            contactSide sa = sideOf(r, a, c->a, cp->armA), sb = sideOf(r, a, c->b, cp->armB);
+            vector2 va = sideVelocity(&sa), vb = sideVelocity(&sb);
+            vector2 v = {va.x - vb.x, va.y - vb.y};
+
+            double target = c->depth < 0.0 ? c->depth / h : c->bounce;
+            double vn = v.x * c->normal.x + v.y * c->normal.y;
+            double jn = c->impulse - (vn - target) * cp->normalMass;
+            jn = jn > 0.0 ? jn : 0.0;
+            double dn = jn - c->impulse;
+            c->impulse = jn;
+            c->touched |= jn > 0.0;
+
+            double vt = -v.x * c->normal.y + v.y * c->normal.x;
+            double limit = s->friction * c->impulse;
+            double jt = c->tangentImpulse - vt * cp->tangentMass;
+            jt = jt > limit ? limit : (jt < -limit ? -limit : jt);
+            double dt = jt - c->tangentImpulse;
+            c->tangentImpulse = jt;
+
+            vector2 p = {c->normal.x * dn - c->normal.y * dt, c->normal.y * dn + c->normal.x * dt};
+            sideImpulse(&sa, p);
+            sideImpulse(&sb, (vector2){-p.x, -p.y});
+        }
+    }
+
+    // Overlap projection, split by the inverse masses along the normal
+    for (int it = 0; it < s->positionIterations; it++) {
+        for (int k = 0; k < count; k++) {
+            contact *c = &r->contacts.items[k];
+            contactSide sa = sideOf(r, a, c->a, (vector2){0.0, 0.0}), sb = sideOf(r, a, c->b, (vector2){0.0, 0.0});
+            contactGeometry(a, c, radius, borderRadius, &sa, &sb);
+            if (c->depth <= s->slop) {
+                continue;
+            }
+            double w = sideInverseMass(&sa, c->normal) + sideInverseMass(&sb, c->normal);
+            if (w <= 0.0) {
+                continue;
+            }
+            double push = s->positionCorrection * (c->depth - s->slop) / w;
+            sidePush(&sa, (vector2){c->normal.x * push, c->normal.y * push});
+            sidePush(&sb, (vector2){-c->normal.x * push, -c->normal.y * push});
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int n = 0; n < r->count; n++) {
+        rigidBody *b = &r->bodies[n];
+        b->position.x += r->pushes[n].shift.x;
+        b->position.y += r->pushes[n].shift.y;
+        b->angle += r->pushes[n].turn;
+        placeMembers(b, r->members + b->first, r->offsets + b->first, a->points);
+    }
+    a->revision++;
+}
+
+void stepRigidBodies(rigidSet *r, pointArray *a, double h) {
+    centerPoint *points = a->points;
+    // Bodies share no balls, so each one is independent
+    #pragma omp parallel for schedule(static)
+    for (int n = 0; n < r->count; n++) {
+        rigidBody *b = &r->bodies[n];
+        const int *members = r->members + b->first;
+        const vector2 *offsets = r->offsets + b->first;
+        gatherMomentum(b, members, offsets, points);
+
+        // The pose best matching where the members went (shape matching), so
+        // corrections made to single members move the body too
+        double px = 0.0, py = 0.0;
+        for (int k = 0; k < b->count; k++) {
+            px += points[members[k]].position.x;
+            py += points[members[k]].position.y;
+        }
+        px /= b->count;
+        py /= b->count;
+        double dot = 0.0, cross = 0.0;
+        for (int k = 0; k < b->count; k++) {
+            double qx = points[members[k]].position.x - px, qy = points[members[k]].position.y - py;
+            dot += offsets[k].x * qx + offsets[k].y * qy;
+            cross += offsets[k].x * qy - offsets[k].y * qx;
+        }
+        b->position = (vector2){px, py};
+        b->angle = b->count > 1 ? atan2(cross, dot) : b->angle + b->angularVelocity * h;
+        placeMembers(b, members, offsets, points);
+    }
+    if (r->count > 0) {
+        a->revision++;
+    }
+}
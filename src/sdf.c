@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common/sdf.h"
+#include "common/fixed.h"
+
+void initSdfProgram(sdfProgram *p) {
+    p->code = NULL;
+    p->count = 0;
+    p->capacity = 0;
+    p->vertices = NULL;
+    p->vertexCount = 0;
+    p->vertexCapacity = 0;
+    p->depth = 0;
+}
+
+void freeSdfProgram(sdfProgram *p) {
+    free(p->code);
+    free(p->vertices);
+    initSdfProgram(p);
+}
+
+static int emit(sdfProgram *p, sdfInstruction in, int pops, int pushes) {
+    if (fixedPointRefuses("SDF boundaries")) {
+        return -1;
+    }
+    if (p->depth < pops || p->depth - pops + pushes > SDF_MAX_STACK) {
+        fprintf(stderr, "SDF program: stack %s\n", p->depth < pops ? "underflow" : "overflow");
+        return -1;
+    }
+    if (p->count == p->capacity) {
+        int capacity = p->capacity > 0 ? p->capacity * 2 : 16;
+        sdfInstruction *code = (sdfInstruction *)realloc(p->code, capacity * sizeof(sdfInstruction));
+        if (code == NULL) {
+            fprintf(stderr, "SDF program realloc failure\n");
+            return -1;
+        }
+        p->code = code;
+        p->capacity = capacity;
+    }
+    p->code[p->count++] = in;
+    p->depth += pushes - pops;
+    return 0;
+}
+
+int sdfCircle(sdfProgram *p, double cx, double cy, double r) {
+    return emit(p, (sdfInstruction){SDF_CIRCLE, {cx, cy, r, 0.0, 0.0}, 0, 0}, 0, 1);
+}
+
+int sdfBox(sdfProgram *p, double cx, double cy, double halfWidth, double halfHeight) {
+    return emit(p, (sdfInstruction){SDF_BOX, {cx, cy, halfWidth, halfHeight, 0.0}, 0, 0}, 0, 1);
+}
+
+int sdfCapsule(sdfProgram *p, double ax, double ay, double bx, double by, double r) {
+    return emit(p, (sdfInstruction){SDF_CAPSULE, {ax, ay, bx, by, r}, 0, 0}, 0, 1);
+}
+
+int sdfPolygon(sdfProgram *p, const vector2 *vertices, int count) {
+    if (count < 3) {
+        fprintf(stderr, "SDF program: polygon needs 3 vertices, got %d\n", count);
+        return -1;
+    }
+    if (p->vertexCount + count > p->vertexCapacity) {
+        int capacity = p->vertexCapacity > 0 ? p->vertexCapacity : 64;
+        while (capacity < p->vertexCount + count) {
+            capacity *= 2;
+        }
+        vector2 *v = (vector2 *)realloc(p->vertices, capacity * sizeof(vector2));
+        if (v == NULL) {
+            fprintf(stderr, "SDF program realloc failure\n");
+            return -1;
+        }
+        p->vertices = v;
+        p->vertexCapacity = capacity;
+    }
+    int first = p->vertexCount;
+    if (emit(p, (sdfInstruction){SDF_POLYGON, {0.0, 0.0, 0.0, 0.0, 0.0}, first, count}, 0, 1) != 0) {
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        p->vertices[first + k] = vertices[k];
+    }
+    p->vertexCount += count;
+    return 0;
+}
+
+int sdfCombine(sdfProgram *p, sdfOp op) {
+    if (op < SDF_UNION) {
+        fprintf(stderr, "SDF program: %d is not an operator\n", (int)op);
+        return -1;
+    }
+    int pops = op == SDF_INVERT ? 1 : 2;
+    return emit(p, (sdfInstruction){op, {0.0, 0.0, 0.0, 0.0, 0.0}, 0, 0}, pops, 1);
+}
+
+static inline double circleDistance(double x, double y, const double *q) {
+    double dx = x - q[0], dy = y - q[1];
+    return sqrt(dx * dx + dy * dy) - q[2];
+}
+
+static inline double boxDistance(double x, double y, const double *q) {
+    double dx = fabs(x - q[0]) - q[2], dy = fabs(y - q[1]) - q[3];
+    double ox = dx > 0.0 ? dx : 0.0, oy = dy > 0.0 ? dy : 0.0;
+    double inside = dx > dy ? dx : dy;
+    return sqrt(ox * ox + oy * oy) + (inside < 0.0 ? inside : 0.0);
+}
+
+static inline double capsuleDistance(double x, double y, const double *q) {
+    double px = x - q[0], py = y - q[1];
+    double bx = q[2] - q[0], by = q[3] - q[1];
+    double length2 = bx * bx + by * by;
+    double t = length2 > 0.0 ? (px * bx + py * by) / length2 : 0.0;
+    t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+    double dx = px - bx * t, dy = py - by * t;
+    return sqrt(dx * dx + dy * dy) - q[4];
+}
+
+// Distance to the nearest edge, negated inside by counting edge crossings
+static double polygonDistance(double x, double y, const vector2 *v, int n) {
+    double best = (x - v[0].x) * (x - v[0].x) + (y - v[0].y) * (y - v[0].y);
+    double sign = 1.0;
+    for (int i = 0, j = n - 1; i < n; j = i, i++) {
+        double ex = v[j].x - v[i].x, ey = v[j].y - v[i].y;
+        double wx = x - v[i].x, wy = y - v[i].y;
+        double t = (wx * ex + wy * ey) / (ex * ex + ey * ey);
+        t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+        double bx = wx - ex * t, by = wy - ey * t;
+        double d2 = bx * bx + by * by;
+        best = d2 < best ? d2 : best;
+        int c0 = y >= v[i].y, c1 = y < v[j].y, c2 = ex * wy > ey * wx;
+        if ((c0 && c1 && c2) || (!c0 && !c1 && !c2)) {
+            sign = -sign;
+        }
+    }
+    return sign * sqrt(best);
+}
+
+// One block of up to SDF_BLOCK points, an instruction at a time so every
+// inner loop runs across points
+static void evaluateBlock(const sdfProgram *p, const double *x, const double *y, int n, double *out) {
+    if (p->depth != 1) {
+        for (int i = 0; i < n; i++) {
+            out[i] = HUGE_VAL;
+        }
+        return;
+    }
+    double stack[SDF_MAX_STACK][SDF_BLOCK];
+    int top = 0;
+    for (int k = 0; k < p->count; k++) {
+        const sdfInstruction *in = &p->code[k];
+        const double *q = in->params;
+        double *d = stack[top], *a = top > 1 ? stack[top - 2] : NULL, *b = top > 0 ? stack[top - 1] : NULL;
+        switch (in->op) {
+        case SDF_CIRCLE:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                d[i] = circleDistance(x[i], y[i], q);
+            }
+            top++;
+            break;
+        case SDF_BOX:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                d[i] = boxDistance(x[i], y[i], q);
+            }
+            top++;
+            break;
+        case SDF_CAPSULE:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                d[i] = capsuleDistance(x[i], y[i], q);
+            }
+            top++;
+            break;
+        case SDF_POLYGON:
+            for (int i = 0; i < n; i++) {
+                d[i] = polygonDistance(x[i], y[i], p->vertices + in->first, in->count);
+            }
+            top++;
+            break;
+        case SDF_UNION:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                a[i] = a[i] < b[i] ? a[i] : b[i];
+            }
+            top--;
+            break;
+        case SDF_INTERSECT:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                a[i] = a[i] > b[i] ? a[i] : b[i];
+            }
+            top--;
+            break;
+        case SDF_SUBTRACT:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                a[i] = a[i] > -b[i] ? a[i] : -b[i];
+            }
+            top--;
+            break;
+        case SDF_INVERT:
+            #pragma omp simd
+            for (int i = 0; i < n; i++) {
+                b[i] = -b[i];
+            }
+            break;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = stack[0][i];
+    }
+}
+
+// Same program one point at a time, for the few normals collideSdf needs;
+// a block of one costs several times more
+double evaluateSdf(const sdfProgram *p, vector2 point) {
+    if (p->depth != 1) {
+        return HUGE_VAL;
+    }
+    double stack[SDF_MAX_STACK];
+    int top = 0;
+    for (int k = 0; k < p->count; k++) {
+        const sdfInstruction *in = &p->code[k];
+        switch (in->op) {
+        case SDF_CIRCLE:
+            stack[top++] = circleDistance(point.x, point.y, in->params);
+            break;
+        case SDF_BOX:
+            stack[top++] = boxDistance(point.x, point.y, in->params);
+            break;
+        case SDF_CAPSULE:
+            stack[top++] = capsuleDistance(point.x, point.y, in->params);
+            break;
+        case SDF_POLYGON:
+            stack[top++] = polygonDistance(point.x, point.y, p->vertices + in->first, in->count);
+            break;
+        case SDF_UNION:
+            top--;
+            stack[top - 1] = stack[top - 1] < stack[top] ? stack[top - 1] : stack[top];
+            break;
+        case SDF_INTERSECT:
+            top--;
+            stack[top - 1] = stack[top - 1] > stack[top] ? stack[top - 1] : stack[top];
+            break;
+        case SDF_SUBTRACT:
+            top--;
+            stack[top - 1] = stack[top - 1] > -stack[top] ? stack[top - 1] : -stack[top];
+            break;
+        case SDF_INVERT:
+            stack[top - 1] = -stack[top - 1];
+            break;
+        }
+    }
+    return stack[0];
+}
+
+void evaluateSdfBatch(const sdfProgram *p, const double *x, const double *y, int count, double *out) {
+    int blocks = (count + SDF_BLOCK - 1) / SDF_BLOCK;
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < blocks; k++) {
+        int first = k * SDF_BLOCK;
+        int n = count - first < SDF_BLOCK ? count - first : SDF_BLOCK;
+        evaluateBlock(p, x + first, y + first, n, out + first);
+    }
+}
+
+void initSdfGrid(sdfGrid *g) {
+    g->minX = 0.0;
+    g->minY = 0.0;
+    g->cellSize = 0.0;
+    g->cols = 0;
+    g->rows = 0;
+    g->values = NULL;
+}
+
+void freeSdfGrid(sdfGrid *g) {
+    free(g->values);
+    initSdfGrid(g);
+}
+
+int bakeSdf(sdfGrid *g, const sdfProgram *p, double minX, double minY, double maxX, double maxY, double cellSize) {
+    if (p->depth != 1 || cellSize <= 0.0 || maxX <= minX || maxY <= minY) {
+        fprintf(stderr, "SDF bake: incomplete program or empty area\n");
+        return -1;
+    }
+    int cols = (int)ceil((maxX - minX) / cellSize) + 1;
+    int rows = (int)ceil((maxY - minY) / cellSize) + 1;
+    float *values = (float *)realloc(g->values, (size_t)cols * rows * sizeof(float));
+    if (values == NULL) {
+        fprintf(stderr, "SDF bake: cannot allocate %d x %d samples\n", cols, rows);
+        return -1;
+    }
+    g->values = values;
+    g->minX = minX;
+    g->minY = minY;
+    g->cellSize = cellSize;
+    g->cols = cols;
+    g->rows = rows;
+
+    #pragma omp parallel for schedule(static)
+    for (int row = 0; row < rows; row++) {
+        double x[SDF_BLOCK], y[SDF_BLOCK], d[SDF_BLOCK];
+        for (int first = 0; first < cols; first += SDF_BLOCK) {
+            int n = cols - first < SDF_BLOCK ? cols - first : SDF_BLOCK;
+            for (int i = 0; i < n; i++) {
+                x[i] = minX + (first + i) * cellSize;
+                y[i] = minY + row * cellSize;
+            }
+            evaluateBlock(p, x, y, n, d);
+            for (int i = 0; i < n; i++) {
+                values[(size_t)row * cols + first + i] = (float)d[i];
+            }
+        }
+    }
+    return 0;
+}
+
+double sampleSdfGrid(const sdfGrid *g, vector2 point, vector2 *normal) {
+    double fx = (point.x - g->minX) / g->cellSize;
+    double fy = (point.y - g->minY) / g->cellSize;
+    fx = fx < 0.0 ? 0.0 : (fx > g->cols - 1 ? g->cols - 1 : fx);
+    fy = fy < 0.0 ? 0.0 : (fy > g->rows - 1 ? g->rows - 1 : fy);
+    int col = (int)fx < g->cols - 1 ? (int)fx : g->cols - 2;
+    int row = (int)fy < g->rows - 1 ? (int)fy : g->rows - 2;
+    double tx = fx - col, ty = fy - row;
+
+    const float *v = g->values + (size_t)row * g->cols + col;
+    double v00 = v[0], v10 = v[1], v01 = v[g->cols], v11 = v[g->cols + 1];
+    if (normal != NULL) {
+        // Derivative of the bilinear patch itself, so normals are continuous
+        // inside a cell and agree with the distances being sampled
+        double gx = (v10 - v00) * (1.0 - ty) + (v11 - v01) * ty;
+        double gy = (v01 - v00) * (1.0 - tx) + (v11 - v10) * tx;
+        double length = sqrt(gx * gx + gy * gy);
+        *normal = length > 0.0 ? (vector2){gx / length, gy / length} : (vector2){0.0, 1.0};
+    }
+    return (v00 * (1.0 - tx) + v10 * tx) * (1.0 - ty) + (v01 * (1.0 - tx) + v11 * tx) * ty;
+}
+
+// Central differences of the program, for balls that touch
+static vector2 programNormal(const sdfProgram *p, vector2 point, double h) {
+    double gx = evaluateSdf(p, (vector2){point.x + h, point.y}) - evaluateSdf(p, (vector2){point.x - h, point.y});
+    double gy = evaluateSdf(p, (vector2){point.x, point.y + h}) - evaluateSdf(p, (vector2){point.x, point.y - h});
+    double length = sqrt(gx * gx + gy * gy);
+    return length > 0.0 ? (vector2){gx / length, gy / length} : (vector2){0.0, 1.0};
+}
+
+static int pushOut(centerPoint *b, double d, vector2 n, float radius, double restitution) {
+    if (d >= radius) {
+        return 0;
+    }
+    b->position.x += n.x * (radius - d);
+    b->position.y += n.y * (radius - d);
+    double vn = b->velocity.x * n.x + b->velocity.y * n.y;
+    if (vn < 0.0) {
+        b->velocity.x -= (1.0 + restitution) * vn * n.x;
+        b->velocity.y -= (1.0 + restitution) * vn * n.y;
+    }
+    return 1;
+}
+
+int collideSdf(pointArray *a, const int *balls, int count, const sdfProgram *p, const sdfGrid *g, float radius, double restitution) {
+    int pushed = 0;
+    if (g != NULL && g->values != NULL) {
+        // Almost every ball is clear of the geometry, so test with the
+        // distance alone and only work out normals for the few that touch
+        #pragma omp parallel for schedule(static) reduction(+:pushed)
+        for (int k = 0; k < count; k++) {
+            centerPoint *b = &a->points[balls != NULL ? balls[k] : k];
+            if (sampleSdfGrid(g, b->position, NULL) < radius) {
+                vector2 n;
+                double d = sampleSdfGrid(g, b->position, &n);
+                pushed += pushOut(b, d, n, radius, restitution);
+            }
+        }
+        return pushed;
+    }
+    if (p == NULL || p->depth != 1) {
+        return 0;
+    }
+
+    int blocks = (count + SDF_BLOCK - 1) / SDF_BLOCK;
+    double h = 1e-3 * radius;
+    #pragma omp parallel for schedule(static) reduction(+:pushed)
+    for (int block = 0; block < blocks; block++) {
+        double x[SDF_BLOCK], y[SDF_BLOCK], d[SDF_BLOCK];
+        int first = block * SDF_BLOCK;
+        int n = count - first < SDF_BLOCK ? count - first : SDF_BLOCK;
+        for (int i = 0; i < n; i++) {
+            const centerPoint *b = &a->points[balls != NULL ? balls[first + i] : first + i];
+            x[i] = b->position.x;
+            y[i] = b->position.y;
+        }
+        evaluateBlock(p, x, y, n, d);
+        for (int i = 0; i < n; i++) {
+            if (d[i] < radius) {
+                centerPoint *b = &a->points[balls != NULL ? balls[first + i] : first + i];
+                pushed += pushOut(b, d[i], programNormal(p, b->position, h), radius, restitution);
+            }
+        }
+    }
+    return pushed;
+}
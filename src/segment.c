@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/segment.h"
+#include "common/fixed.h"
+
+void initSegmentSet(segmentSet *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void freeSegmentSet(segmentSet *s) {
+    free(s->segments);
+    free(s->cellStart);
+    free(s->cellSegments);
+    initSegmentSet(s);
+}
+
+int addSegment(segmentSet *s, vector2 a, vector2 b) {
+    if (fixedPointRefuses("Segments")) {
+        return -1;
+    }
+    if (s->count == s->capacity) {
+        int capacity = s->capacity > 0 ? s->capacity * 2 : 64;
+        segment *segments = (segment *)realloc(s->segments, capacity * sizeof(segment));
+        if (segments == NULL) {
+            fprintf(stderr, "Segment set realloc failure\n");
+            return -1;
+        }
+        s->segments = segments;
+        s->capacity = capacity;
+    }
+    s->segments[s->count++] = (segment){a, b};
+    s->built = 0;
+    return 0;
+}
+
+int addPolyline(segmentSet *s, const vector2 *points, int count, int closed) {
+    for (int k = 0; k + 1 < count; k++) {
+        if (addSegment(s, points[k], points[k + 1]) != 0) {
+            return -1;
+        }
+    }
+    if (closed && count > 2) {
+        return addSegment(s, points[count - 1], points[0]);
+    }
+    return 0;
+}
+
+// Closest point of the segment to p
+static vector2 closestPoint(const segment *g, vector2 p) {
+    double ex = g->b.x - g->a.x, ey = g->b.y - g->a.y;
+    double length2 = ex * ex + ey * ey;
+    double t = length2 > 0.0 ? ((p.x - g->a.x) * ex + (p.y - g->a.y) * ey) / length2 : 0.0;
+    t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+    return (vector2){g->a.x + ex * t, g->a.y + ey * t};
+}
+
+// Conservative: the segment is within reach of the cell's centre, where
+// reach covers the half diagonal plus the pad
+static int segmentNearCell(const segmentSet *s, const segment *g, int col, int row) {
+    double half = 0.5 * s->cellSize;
+    vector2 c = {s->minX + (col + 0.5) * s->cellSize, s->minY + (row + 0.5) * s->cellSize};
+    vector2 q = closestPoint(g, c);
+    double reach = half * 1.41421356237309505 + s->pad;
+    return (q.x - c.x) * (q.x - c.x) + (q.y - c.y) * (q.y - c.y) <= reach * reach;
+}
+
+static void cellRange(const segmentSet *s, const segment *g, int *x0, int *x1, int *y0, int *y1) {
+    double lox = fmin(g->a.x, g->b.x) - s->pad, hix = fmax(g->a.x, g->b.x) + s->pad;
+    double loy = fmin(g->a.y, g->b.y) - s->pad, hiy = fmax(g->a.y, g->b.y) + s->pad;
+    *x0 = (int)floor((lox - s->minX) / s->cellSize);
+    *x1 = (int)floor((hix - s->minX) / s->cellSize);
+    *y0 = (int)floor((loy - s->minY) / s->cellSize);
+    *y1 = (int)floor((hiy - s->minY) / s->cellSize);
+    *x0 = *x0 < 0 ? 0 : *x0;
+    *y0 = *y0 < 0 ? 0 : *y0;
+    *x1 = *x1 >= s->cols ? s->cols - 1 : *x1;
+    *y1 = *y1 >= s->rows ? s->rows - 1 : *y1;
+}
+
+int buildSegmentGrid(segmentSet *s, double minX, double minY, double maxX, double maxY, double cellSize, double pad) {
+    s->minX = minX;
+    s->minY = minY;
+    s->cellSize = cellSize;
+    s->pad = pad;
+    s->cols = (int)((maxX - minX) / cellSize) + 1;
+    s->rows = (int)((maxY - minY) / cellSize) + 1;
+    int numCells = s->cols * s->rows;
+    int *cellStart = (int *)realloc(s->cellStart, (numCells + 1) * sizeof(int));
+    if (cellStart == NULL) {
+        fprintf(stderr, "Segment grid realloc failure\n");
+        s->built = 0;
+        return -1;
+    }
+    s->cellStart = cellStart;
+
+    // Counting sort as in buildGrid, except a segment lands in every cell it
+    // comes near. Segments stay in index order within a cell.
+    memset(cellStart, 0, (numCells + 1) * sizeof(int));
+    for (int k = 0; k < s->count; k++) {
+        int x0, x1, y0, y1;
+        cellRange(s, &s->segments[k], &x0, &x1, &y0, &y1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                if (segmentNearCell(s, &s->segments[k], x, y)) {
+                    cellStart[y * s->cols + x + 1]++;
+                }
+            }
+        }
+    }
+    for (int c = 0; c < numCells; c++) {
+        cellStart[c + 1] += cellStart[c];
+    }
+    int total = cellStart[numCells];
+    int *cellSegments = (int *)realloc(s->cellSegments, (total > 0 ? total : 1) * sizeof(int));
+    if (cellSegments == NULL) {
+        fprintf(stderr, "Segment grid realloc failure\n");
+        s->built = 0;
+        return -1;
+    }
+    s->cellSegments = cellSegments;
+    s->cellSegmentCount = total;
+    for (int k = 0; k < s->count; k++) {
+        int x0, x1, y0, y1;
+        cellRange(s, &s->segments[k], &x0, &x1, &y0, &y1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                if (segmentNearCell(s, &s->segments[k], x, y)) {
+                    cellSegments[cellStart[y * s->cols + x]++] = k;
+                }
+            }
+        }
+    }
+    for (int c = numCells - 1; c > 0; c--) {
+        cellStart[c] = cellStart[c - 1];
+    }
+    cellStart[0] = 0;
+    s->built = 1;
+    return 0;
+}
+
+int collideSegments(pointArray *a, const int *balls, int count, const segmentSet *s, float radius, double restitution) {
+    if (!s->built || s->count == 0) {
+        return 0;
+    }
+    int pushed = 0;
+    #pragma omp parallel for schedule(static) reduction(+:pushed)
+    for (int k = 0; k < count; k++) {
+        centerPoint *b = &a->points[balls != NULL ? balls[k] : k];
+        int col = (int)((b->position.x - s->minX) / s->cellSize);
+        int row = (int)((b->position.y - s->minY) / s->cellSize);
+        col = col < 0 ? 0 : (col >= s->cols ? s->cols - 1 : col);
+        row = row < 0 ? 0 : (row >= s->rows ? s->rows - 1 : row);
+        int cell = row * s->cols + col;
+
+        // In index order, each push seeing the previous ones, so a ball in a
+        // corner settles against both walls
+        for (int m = s->cellStart[cell]; m < s->cellStart[cell + 1]; m++) {
+            vector2 q = closestPoint(&s->segments[s->cellSegments[m]], b->position);
+            double dx = b->position.x - q.x, dy = b->position.y - q.y;
+            double d2 = dx * dx + dy * dy;
+            if (d2 >= (double)radius * radius) {
+                continue;
+            }
+            double d = sqrt(d2);
+            if (d == 0.0) {
+                continue;
+            }
+            double nx = dx / d, ny = dy / d;
+            b->position.x += nx * (radius - d);
+            b->position.y += ny * (radius - d);
+            double vn = b->velocity.x * nx + b->velocity.y * ny;
+            if (vn < 0.0) {
+                b->velocity.x -= (1.0 + restitution) * vn * nx;
+                b->velocity.y -= (1.0 + restitution) * vn * ny;
+            }
+            pushed++;
+        }
+    }
+    return pushed;
+}
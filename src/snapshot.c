@@ -0,0 +1,419 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "common/snapshot.h"
+
+#define HEADER_CHECKSUM_OFFSET offsetof(snapshotHeader, headerChecksum)
+
+unsigned long long snapshotChecksum(const void *data, unsigned long long size, unsigned long long seed) {
+    // FNV-style, 8 bytes at a time on four independent lanes so a 500 MB
+    // column hashes at memory speed. An extra shift mixes high bits down.
+    const unsigned long long prime = 0x100000001b3ULL;
+    const unsigned char *p = (const unsigned char *)data;
+    unsigned long long h[4];
+    for (int lane = 0; lane < 4; lane++) {
+        h[lane] = (0xcbf29ce484222325ULL ^ seed) + lane;
+    }
+
+    unsigned long long i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            unsigned long long word;
+            memcpy(&word, p + i + 8 * lane, 8);
+            h[lane] = (h[lane] ^ word) * prime;
+            h[lane] ^= h[lane] >> 29;
+        }
+    }
+    for (; i < size; i++) {
+        h[0] = (h[0] ^ p[i]) * prime;
+    }
+
+    unsigned long long result = size;
+    for (int lane = 0; lane < 4; lane++) {
+        result = (result ^ h[lane]) * prime;
+        result ^= result >> 32;
+    }
+    return result;
+}
+
+static unsigned long long alignUp(unsigned long long offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+static unsigned long long headerChecksum(const void *header, unsigned long long size) {
+    unsigned char copy[SNAPSHOT_ALIGN];
+    if (size > sizeof(copy)) {
+        size = sizeof(copy);
+    }
+    memcpy(copy, header, size);
+    memset(copy + HEADER_CHECKSUM_OFFSET, 0, sizeof(unsigned long long));
+    return snapshotChecksum(copy, size, 1);
+}
+
+static int writePadding(FILE *f, unsigned long long from, unsigned long long to) {
+    static const char zeros[SNAPSHOT_ALIGN];
+    while (from < to) {
+        unsigned long long chunk = to - from < sizeof(zeros) ? to - from : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, f) != chunk) {
+            return -1;
+        }
+        from += chunk;
+    }
+    return 0;
+}
+
+static int skipBytes(FILE *f, unsigned long long count) {
+    char scratch[SNAPSHOT_ALIGN];
+    while (count > 0) {
+        unsigned long long chunk = count < sizeof(scratch) ? count : sizeof(scratch);
+        if (fread(scratch, 1, chunk, f) != chunk) {
+            return -1;
+        }
+        count -= chunk;
+    }
+    return 0;
+}
+
+// What w holds that a snapshot has no section for, or NULL
+static const char *unsavedState(const physicsWorld *w) {
+    if (w->rigid.count > 0) {
+        return "rigid bodies";
+    }
+    if (constraintCount(&w->constraints) > 0) {
+        return "constraints";
+    }
+    if (w->fluid.count > 0) {
+        return "fluid";
+    }
+    if (w->fields.count > 0) {
+        return "force fields";
+    }
+    if (w->emitters.count > 0) {
+        return "emitters";
+    }
+    if (w->segments.count > 0) {
+        return "segments";
+    }
+    if (w->kinematics.count > 0) {
+        return "kinematic bodies";
+    }
+    if (w->boundary.count > 0 || w->bakedBoundary.values != NULL) {
+        return "an SDF boundary";
+    }
+    if (w->longRange.mode != LONG_RANGE_NONE) {
+        return "long-range forces";
+    }
+    // Per-ball levels rescale the next step's warm start
+    if (w->substeps.multiRate) {
+        return "multi-rate substeps";
+    }
+    return NULL;
+}
+
+int saveSnapshot(const physicsWorld *w, const char *path) {
+    const char *unsaved = unsavedState(w);
+    if (unsaved != NULL) {
+        fprintf(stderr, "Snapshot: cannot save %s, snapshots do not store %s\n", path, unsaved);
+        return -1;
+    }
+    const pointArray *a = &w->points;
+    const contactList *c = &w->contacts;
+    snapshotHeader h;
+    memset(&h, 0, sizeof(h));
+
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h.version = SNAPSHOT_VERSION;
+    h.headerSize = sizeof(snapshotHeader);
+    h.pointSize = sizeof(centerPoint);
+    h.contactSize = sizeof(contact);
+    h.step = w->step;
+    h.radius = w->radius;
+    h.borderRadius = w->borderRadius;
+    h.solverMode = w->solver.mode;
+    h.iterations = w->solver.iterations;
+    h.positionIterations = w->solver.positionIterations;
+    h.warmStart = w->solver.warmStart;
+    h.restitution = w->solver.restitution;
+    h.friction = w->solver.friction;
+    h.restitutionThreshold = w->solver.restitutionThreshold;
+    h.positionCorrection = w->solver.positionCorrection;
+    h.slop = w->solver.slop;
+    h.contactMargin = w->solver.contactMargin;
+    h.warmStartFactor = w->solver.warmStartFactor;
+    h.relaxation = w->solver.relaxation;
+    h.periodic = w->periodic;
+    h.adaptive = w->substeps.adaptive;
+    h.minSubSteps = w->substeps.minSubSteps;
+    h.maxTravel = w->substeps.maxTravel;
+    h.maxOverlap = w->substeps.maxOverlap;
+    h.ccd = w->substeps.ccd;
+    h.ccdThreshold = w->substeps.ccdThreshold;
+    h.overlapSubSteps = w->stats.overlapSubSteps;
+    h.overlap = w->stats.overlap;
+    h.pointCount = a->size;
+    h.pointOffset = alignUp(sizeof(snapshotHeader));
+    h.contactCount = c->count;
+    h.contactOffset = alignUp(h.pointOffset + h.pointCount * sizeof(centerPoint));
+
+    unsigned long long pointBytes = h.pointCount * sizeof(centerPoint);
+    unsigned long long contactBytes = h.contactCount * sizeof(contact);
+    h.payloadChecksum = snapshotChecksum(c->items, contactBytes, snapshotChecksum(a->points, pointBytes, 0));
+    h.headerChecksum = headerChecksum(&h, sizeof(h));
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Snapshot: cannot create %s\n", path);
+        return -1;
+    }
+    int failed = fwrite(&h, sizeof(h), 1, f) != 1
+        || writePadding(f, sizeof(h), h.pointOffset) != 0
+        || (pointBytes > 0 && fwrite(a->points, pointBytes, 1, f) != 1)
+        || writePadding(f, h.pointOffset + pointBytes, h.contactOffset) != 0
+        || (contactBytes > 0 && fwrite(c->items, contactBytes, 1, f) != 1);
+    if (fclose(f) != 0 || failed) {
+        fprintf(stderr, "Snapshot: write to %s failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Checks everything that can be checked without the payload and copies a
+// header of any version into the current struct (unknown fields zeroed).
+static int readHeader(const void *data, unsigned long long available, snapshotHeader *h, const char *path) {
+    const snapshotHeader *raw = (const snapshotHeader *)data;
+    if (available < HEADER_CHECKSUM_OFFSET + sizeof(unsigned long long) || memcmp(raw->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        fprintf(stderr, "Snapshot: %s is not a snapshot\n", path);
+        return -1;
+    }
+    if (raw->version > SNAPSHOT_VERSION) {
+        fprintf(stderr, "Snapshot: %s has version %u, this build reads up to %d\n", path, raw->version, SNAPSHOT_VERSION);
+        return -1;
+    }
+    if (raw->headerSize > available || raw->headerSize > SNAPSHOT_ALIGN) {
+        fprintf(stderr, "Snapshot: %s has a truncated header\n", path);
+        return -1;
+    }
+    if (headerChecksum(raw, raw->headerSize) != raw->headerChecksum) {
+        fprintf(stderr, "Snapshot: header checksum mismatch in %s\n", path);
+        return -1;
+    }
+    memset(h, 0, sizeof(*h));
+    memcpy(h, raw, raw->headerSize < sizeof(*h) ? raw->headerSize : sizeof(*h));
+
+    if (h->pointSize != sizeof(centerPoint)) {
+        fprintf(stderr, "Snapshot: %s was written with %u byte points, this build uses %u\n", path, h->pointSize, (unsigned)sizeof(centerPoint));
+        return -1;
+    }
+    if (h->pointOffset < h->headerSize) {
+        fprintf(stderr, "Snapshot: %s has overlapping sections\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int restoreSettings(physicsWorld *w, const snapshotHeader *h) {
+    w->step = h->step;
+    w->solver.mode = (solverMode)h->solverMode;
+    w->solver.iterations = h->iterations;
+    w->solver.positionIterations = h->positionIterations;
+    w->solver.warmStart = h->warmStart;
+    w->solver.restitution = h->restitution;
+    w->solver.friction = h->friction;
+    w->solver.restitutionThreshold = h->restitutionThreshold;
+    w->solver.positionCorrection = h->positionCorrection;
+    w->solver.slop = h->slop;
+    w->solver.contactMargin = h->contactMargin;
+    w->solver.warmStartFactor = h->warmStartFactor;
+    w->solver.relaxation = h->relaxation;
+    if (h->version >= 3) {
+        w->substeps.adaptive = h->adaptive;
+        w->substeps.minSubSteps = h->minSubSteps;
+        w->substeps.maxTravel = h->maxTravel;
+        w->substeps.maxOverlap = h->maxOverlap;
+        w->substeps.ccd = h->ccd;
+        w->substeps.ccdThreshold = h->ccdThreshold;
+        w->stats.overlapSubSteps = h->overlapSubSteps;
+        w->stats.overlap = h->overlap;
+    }
+    return h->periodic ? setPeriodic(w, 1) : 0;
+}
+
+// Contacts only matter for warm starting, so a layout change drops them
+// instead of failing the restore
+static void restoreContacts(physicsWorld *w, const snapshotHeader *h, const void *data) {
+    if (h->contactSize != sizeof(contact) || data == NULL) {
+        return;
+    }
+    contactList *c = &w->contacts;
+    if ((unsigned long long)c->capacity < h->contactCount) {
+        freeContactList(c);
+        initContactList(c, (int)h->contactCount);
+    }
+    memcpy(c->items, data, h->contactCount * sizeof(contact));
+    c->count = (int)h->contactCount;
+}
+
+int loadSnapshot(physicsWorld *w, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Snapshot: cannot open %s\n", path);
+        return -1;
+    }
+
+    unsigned char raw[SNAPSHOT_ALIGN];
+    size_t got = fread(raw, 1, sizeof(snapshotHeader), f);
+    // A newer, longer header: pull in the rest before checking it
+    const snapshotHeader *peek = (const snapshotHeader *)raw;
+    if (got == sizeof(snapshotHeader) && peek->headerSize > got && peek->headerSize <= sizeof(raw)) {
+        got += fread(raw + got, 1, peek->headerSize - got, f);
+    }
+    snapshotHeader h;
+    if (readHeader(raw, got, &h, path) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    unsigned long long pointBytes = h.pointCount * sizeof(centerPoint);
+    unsigned long long contactBytes = h.contactCount * (unsigned long long)h.contactSize;
+    void *contacts = contactBytes > 0 ? malloc(contactBytes) : NULL;
+    initWorld(w, h.pointCount > 0 ? (int)h.pointCount : 1, (float)h.radius, (float)h.borderRadius);
+    if (restoreSettings(w, &h) != 0) {
+        fclose(f);
+        free(contacts);
+        freeWorld(w);
+        return -1;
+    }
+
+    int failed = skipBytes(f, h.pointOffset - got) != 0
+        || (pointBytes > 0 && fread(w->points.points, pointBytes, 1, f) != 1)
+        || skipBytes(f, h.contactOffset - h.pointOffset - pointBytes) != 0
+        || (contactBytes > 0 && (contacts == NULL || fread(contacts, contactBytes, 1, f) != 1));
+    fclose(f);
+    if (failed) {
+        fprintf(stderr, "Snapshot: %s is truncated\n", path);
+        free(contacts);
+        freeWorld(w);
+        return -1;
+    }
+    if (snapshotChecksum(contacts, contactBytes, snapshotChecksum(w->points.points, pointBytes, 0)) != h.payloadChecksum) {
+        fprintf(stderr, "Snapshot: payload checksum mismatch in %s\n", path);
+        free(contacts);
+        freeWorld(w);
+        return -1;
+    }
+
+    w->points.size = (int)h.pointCount;
+    w->points.revision++;
+    restoreContacts(w, &h, contacts);
+    free(contacts);
+    return 0;
+}
+
+int mapSnapshot(physicsWorld *w, const char *path, int verify, snapshotMapping *m) {
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Snapshot: cannot open %s\n", path);
+        return -1;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    // Copy-on-write: the simulation writes to its points, never to the file
+    HANDLE map = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    void *base = map != NULL ? MapViewOfFile(map, FILE_MAP_COPY, 0, 0, 0) : NULL;
+    if (base == NULL) {
+        fprintf(stderr, "Snapshot: cannot map %s\n", path);
+        if (map != NULL) {
+            CloseHandle(map);
+        }
+        CloseHandle(file);
+        return -1;
+    }
+    m->fileHandle = file;
+    m->mapHandle = map;
+    m->size = (unsigned long long)fileSize.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Snapshot: cannot open %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Snapshot: cannot stat %s\n", path);
+        close(fd);
+        return -1;
+    }
+    // Copy-on-write: the simulation writes to its points, never to the file
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Snapshot: cannot map %s\n", path);
+        return -1;
+    }
+    m->size = (unsigned long long)st.st_size;
+#endif
+    m->base = base;
+
+    snapshotHeader h;
+    if (readHeader(base, m->size, &h, path) != 0) {
+        unmapSnapshot(m);
+        return -1;
+    }
+    unsigned long long pointBytes = h.pointCount * sizeof(centerPoint);
+    unsigned long long contactBytes = h.contactCount * (unsigned long long)h.contactSize;
+    if (h.pointOffset + pointBytes > m->size || h.contactOffset + contactBytes > m->size) {
+        fprintf(stderr, "Snapshot: %s is truncated\n", path);
+        unmapSnapshot(m);
+        return -1;
+    }
+    const unsigned char *bytes = (const unsigned char *)base;
+    if (verify && snapshotChecksum(bytes + h.contactOffset, contactBytes, snapshotChecksum(bytes + h.pointOffset, pointBytes, 0)) != h.payloadChecksum) {
+        fprintf(stderr, "Snapshot: payload checksum mismatch in %s\n", path);
+        unmapSnapshot(m);
+        return -1;
+    }
+
+    initWorld(w, 1, (float)h.radius, (float)h.borderRadius);
+    if (restoreSettings(w, &h) != 0) {
+        freeWorld(w);
+        unmapSnapshot(m);
+        return -1;
+    }
+    free(w->points.points);
+    w->points.points = (centerPoint *)(bytes + h.pointOffset);
+    w->points.size = (int)h.pointCount;
+    w->points.capacity = (int)h.pointCount;
+    w->points.borrowed = 1;
+    w->points.revision++;
+    restoreContacts(w, &h, bytes + h.contactOffset);
+    return 0;
+}
+
+void unmapSnapshot(snapshotMapping *m) {
+    if (m->base == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m->base);
+    CloseHandle((HANDLE)m->mapHandle);
+    CloseHandle((HANDLE)m->fileHandle);
+#else
+    munmap(m->base, (size_t)m->size);
+#endif
+    memset(m, 0, sizeof(*m));
+}
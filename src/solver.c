@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "common/solver.h"
+
+void defaultSolverSettings(solverSettings *s) {
+    s->mode = SOLVER_LEGACY;
+    s->iterations = 4;
+    s->positionIterations = 1;
+    s->restitution = 0.3;
+    s->friction = 0.2;
+    s->restitutionThreshold = 0.5;
+    s->positionCorrection = 0.2;
+    s->slop = 0.0001;
+    s->contactMargin = 0.25;
+    s->warmStart = 1;
+    s->warmStartFactor = 1.0;
+    s->relaxation = 0.35;
+    s->deterministic = 1;
+}
+
+void warmStartContacts(contactList *current, const contactList *previous, double factor) {
+    int i = 0, j = 0;
+    while (nextCommonContact(previous->items, previous->count, current->items, current->count, sizeof(contact), &i, &j)) {
+        current->items[j].impulse = previous->items[i].impulse * factor;
+        current->items[j].tangentImpulse = previous->items[i].tangentImpulse * factor;
+        current->items[j].color = previous->items[i].color;
+        i++;
+        j++;
+    }
+}
+
+static void applyImpulse(pointArray *a, const contact *c, double jn, double jt) {
+    // Tangent is the normal rotated a quarter turn
+    double px = c->normal.x * jn - c->normal.y * jt;
+    double py = c->normal.y * jn + c->normal.x * jt;
+    a->points[c->a].velocity.x += px;
+    a->points[c->a].velocity.y += py;
+    if (c->b != BORDER_CONTACT) {
+        a->points[c->b].velocity.x -= px;
+        a->points[c->b].velocity.y -= py;
+    }
+}
+
+static vector2 relativeVelocity(const pointArray *a, const contact *c) {
+    vector2 v = a->points[c->a].velocity;
+    if (c->b != BORDER_CONTACT) {
+        v.x -= a->points[c->b].velocity.x;
+        v.y -= a->points[c->b].velocity.y;
+    }
+    return v;
+}
+
+// Refreshes normal and depth from the current positions
+static void updateContactGeometry(const pointArray *a, contact *c, float radius, float borderRadius) {
+    vector2 p = a->points[c->a].position;
+    if (c->b == BORDER_CONTACT) {
+        double distance = sqrt(p.x * p.x + p.y * p.y);
+        if (distance > 0.0) {
+            c->normal = (vector2){-p.x / distance, -p.y / distance};
+        }
+        c->depth = distance - (borderRadius - radius);
+        return;
+    }
+    vector2 q = a->points[c->b].position;
+    double dx = p.x - (q.x + c->shift.x), dy = p.y - (q.y + c->shift.y);
+    double distance = sqrt(dx * dx + dy * dy);
+    if (distance > 0.0) {
+        c->normal = (vector2){dx / distance, dy / distance};
+    }
+    c->depth = 2.0 * radius - distance;
+}
+
+void prepareContacts(pointArray *a, contactList *contacts, const solverSettings *s) {
+    for (int k = 0; k < contacts->count; k++) {
+        contact *c = &contacts->items[k];
+        vector2 v = relativeVelocity(a, c);
+        c->bounce = bounceSpeed(s, v.x * c->normal.x + v.y * c->normal.y);
+        if (!s->warmStart) {
+            c->impulse = 0.0;
+            c->tangentImpulse = 0.0;
+        }
+    }
+}
+
+// One Gauss-Seidel update of a single contact's velocity constraint
+static void solveContactVelocity(pointArray *a, contact *c, const solverSettings *s, double h) {
+    vector2 v = relativeVelocity(a, c);
+    double effectiveMass = contactMass(c->b);
+
+    double vn = v.x * c->normal.x + v.y * c->normal.y;
+    double jn = solveNormalImpulse(c->impulse, vn, contactTarget(c->depth, c->bounce, h), effectiveMass);
+    double dn = jn - c->impulse;
+    c->impulse = jn;
+    c->touched |= jn > 0.0;
+
+    double vt = -v.x * c->normal.y + v.y * c->normal.x;
+    double limit = frictionLimit(s, c->impulse);
+    double jt = c->tangentImpulse - vt * effectiveMass;
+    jt = jt > limit ? limit : (jt < -limit ? -limit : jt);
+    double dt = jt - c->tangentImpulse;
+    c->tangentImpulse = jt;
+
+    applyImpulse(a, c, dn, dt);
+}
+
+// Removes part of what is left of the overlap by moving positions directly
+static void solveContactPosition(pointArray *a, contact *c, const solverSettings *s, float radius, float borderRadius) {
+    updateContactGeometry(a, c, radius, borderRadius);
+    if (c->depth <= s->slop) {
+        return;
+    }
+    double push = positionPush(s, c->depth) * contactMass(c->b);
+    a->points[c->a].position.x += c->normal.x * push;
+    a->points[c->a].position.y += c->normal.y * push;
+    if (c->b == BORDER_CONTACT) {
+        return;
+    }
+    a->points[c->b].position.x -= c->normal.x * push;
+    a->points[c->b].position.y -= c->normal.y * push;
+}
+
+void solveContacts(pointArray *a, contactList *contacts, const solverSettings *s, float radius, float borderRadius, double h) {
+    for (int k = 0; k < contacts->count; k++) {
+        contact *c = &contacts->items[k];
+        updateContactGeometry(a, c, radius, borderRadius);
+        applyImpulse(a, c, c->impulse, c->tangentImpulse);
+    }
+    for (int it = 0; it < s->iterations; it++) {
+        for (int k = 0; k < contacts->count; k++) {
+            solveContactVelocity(a, &contacts->items[k], s, h);
+        }
+    }
+    for (int it = 0; it < s->positionIterations; it++) {
+        for (int k = 0; k < contacts->count; k++) {
+            solveContactPosition(a, &contacts->items[k], s, radius, borderRadius);
+        }
+    }
+    a->revision++;
+}
+
+void initSolverWorkspace(solverWorkspace *w) {
+    w->adjStart = NULL;
+    w->adjContacts = NULL;
+    w->delta = NULL;
+    w->usedColors = NULL;
+    w->colorOrder = NULL;
+    w->numColors = 0;
+    w->numPoints = 0;
+    w->pointCapacity = 0;
+    w->contactCapacity = 0;
+}
+
+void freeSolverWorkspace(solverWorkspace *w) {
+    free(w->adjStart);
+    free(w->adjContacts);
+    free(w->delta);
+    free(w->usedColors);
+    free(w->colorOrder);
+    initSolverWorkspace(w);
+}
+
+static int reserveWorkspace(solverWorkspace *w, int numPoints, int numContacts) {
+    if (numPoints + 1 > w->pointCapacity) {
+        int capacity = (numPoints + 1) * 2;
+        int *adjStart = (int *)realloc(w->adjStart, capacity * sizeof(int));
+        if (adjStart != NULL) {
+            w->adjStart = adjStart;
+        }
+        unsigned long long *usedColors = (unsigned long long *)realloc(w->usedColors, capacity * sizeof(unsigned long long));
+        if (usedColors != NULL) {
+            w->usedColors = usedColors;
+        }
+        if (adjStart == NULL || usedColors == NULL) {
+            fprintf(stderr, "Solver workspace realloc failure\n");
+            return 0;
+        }
+        w->pointCapacity = capacity;
+    }
+    if (numContacts > w->contactCapacity) {
+        int capacity = numContacts * 2;
+        int *adjContacts = (int *)realloc(w->adjContacts, capacity * 2 * sizeof(int));
+        if (adjContacts != NULL) {
+            w->adjContacts = adjContacts;
+        }
+        vector2 *delta = (vector2 *)realloc(w->delta, capacity * sizeof(vector2));
+        if (delta != NULL) {
+            w->delta = delta;
+        }
+        int *colorOrder = (int *)realloc(w->colorOrder, capacity * sizeof(int));
+        if (colorOrder != NULL) {
+            w->colorOrder = colorOrder;
+        }
+        if (adjContacts == NULL || delta == NULL || colorOrder == NULL) {
+            fprintf(stderr, "Solver workspace realloc failure\n");
+            return 0;
+        }
+        w->contactCapacity = capacity;
+    }
+    return 1;
+}
+
+void buildContactAdjacency(solverWorkspace *w, const contactList *contacts, int numPoints) {
+    if (!reserveWorkspace(w, numPoints, contacts->count)) {
+        return;
+    }
+
+    // Counting sort of contact endpoints by ball, same scheme as buildGrid
+    int *start = w->adjStart;
+    for (int i = 0; i <= numPoints; i++) {
+        start[i] = 0;
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        start[contacts->items[k].a + 1]++;
+        if (contacts->items[k].b != BORDER_CONTACT) {
+            start[contacts->items[k].b + 1]++;
+        }
+    }
+    for (int i = 0; i < numPoints; i++) {
+        start[i + 1] += start[i];
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        w->adjContacts[start[contacts->items[k].a]++] = k;
+        if (contacts->items[k].b != BORDER_CONTACT) {
+            w->adjContacts[start[contacts->items[k].b]++] = k;
+        }
+    }
+    for (int i = numPoints; i > 0; i--) {
+        start[i] = start[i - 1];
+    }
+    start[0] = 0;
+    w->numPoints = numPoints;
+}
+
+// Second half of every Jacobi pass: each ball sums the corrections of its
+// contacts, positive on the a side and negative on the b side.
+static void gatherDeltas(const solverWorkspace *w, const contactList *contacts, pointArray *a, int toPosition) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < w->numPoints; i++) {
+        double sx = 0.0, sy = 0.0;
+        for (int s = w->adjStart[i]; s < w->adjStart[i + 1]; s++) {
+            int k = w->adjContacts[s];
+            double sign = contacts->items[k].a == i ? 1.0 : -1.0;
+            sx += sign * w->delta[k].x;
+            sy += sign * w->delta[k].y;
+        }
+        if (toPosition) {
+            a->points[i].position.x += sx;
+            a->points[i].position.y += sy;
+        } else {
+            a->points[i].velocity.x += sx;
+            a->points[i].velocity.y += sy;
+        }
+    }
+}
+
+// Order-free alternative to gatherDeltas: the additions race, so each is
+// atomic and the rounding depends on which thread got there first
+static void scatterDeltas(const solverWorkspace *w, const contactList *contacts, pointArray *a, int toPosition) {
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < contacts->count; k++) {
+        const contact *c = &contacts->items[k];
+        vector2 *pa = toPosition ? &a->points[c->a].position : &a->points[c->a].velocity;
+        #pragma omp atomic
+        pa->x += w->delta[k].x;
+        #pragma omp atomic
+        pa->y += w->delta[k].y;
+        if (c->b != BORDER_CONTACT) {
+            vector2 *pb = toPosition ? &a->points[c->b].position : &a->points[c->b].velocity;
+            #pragma omp atomic
+            pb->x -= w->delta[k].x;
+            #pragma omp atomic
+            pb->y -= w->delta[k].y;
+        }
+    }
+}
+
+static void applyDeltas(const solverWorkspace *w, const contactList *contacts, pointArray *a, int toPosition, int deterministic) {
+    if (deterministic) {
+        gatherDeltas(w, contacts, a, toPosition);
+    } else {
+        scatterDeltas(w, contacts, a, toPosition);
+    }
+}
+
+void solveContactsJacobi(pointArray *a, contactList *contacts, const solverSettings *s, solverWorkspace *work, float radius, float borderRadius, double h) {
+    contact *items = contacts->items;
+    int count = contacts->count;
+    double omega = s->relaxation;
+    if (!s->deterministic && !reserveWorkspace(work, a->size, count)) {
+        return;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < count; k++) {
+        contact *c = &items[k];
+        updateContactGeometry(a, c, radius, borderRadius);
+        work->delta[k].x = c->normal.x * c->impulse - c->normal.y * c->tangentImpulse;
+        work->delta[k].y = c->normal.y * c->impulse + c->normal.x * c->tangentImpulse;
+    }
+    applyDeltas(work, contacts, a, 0, s->deterministic);
+
+    for (int it = 0; it < s->iterations; it++) {
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < count; k++) {
+            contact *c = &items[k];
+            vector2 v = relativeVelocity(a, c);
+            double effectiveMass = contactMass(c->b);
+
+            double vn = v.x * c->normal.x + v.y * c->normal.y;
+            double jn = solveNormalImpulse(c->impulse, vn, contactTarget(c->depth, c->bounce, h), effectiveMass);
+            double dn = omega * (jn - c->impulse);
+            c->impulse += dn;
+            c->touched |= c->impulse > 0.0;
+
+            double vt = -v.x * c->normal.y + v.y * c->normal.x;
+            double limit = frictionLimit(s, c->impulse);
+            double jt = c->tangentImpulse - vt * effectiveMass;
+            jt = jt > limit ? limit : (jt < -limit ? -limit : jt);
+            double dt = omega * (jt - c->tangentImpulse);
+            c->tangentImpulse += dt;
+
+            work->delta[k].x = c->normal.x * dn - c->normal.y * dt;
+            work->delta[k].y = c->normal.y * dn + c->normal.x * dt;
+        }
+        applyDeltas(work, contacts, a, 0, s->deterministic);
+    }
+
+    for (int it = 0; it < s->positionIterations; it++) {
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < count; k++) {
+            contact *c = &items[k];
+            updateContactGeometry(a, c, radius, borderRadius);
+            double push = omega * positionPush(s, c->depth) * contactMass(c->b);
+            work->delta[k].x = c->normal.x * push;
+            work->delta[k].y = c->normal.y * push;
+        }
+        applyDeltas(work, contacts, a, 1, s->deterministic);
+    }
+    a->revision++;
+}
+
+void colorContacts(solverWorkspace *w, contactList *contacts, int numPoints) {
+    if (!reserveWorkspace(w, numPoints, contacts->count)) {
+        return;
+    }
+    unsigned long long *used = w->usedColors;
+    for (int i = 0; i < numPoints; i++) {
+        used[i] = 0;
+    }
+
+    // Contacts that persisted keep their color whenever neither ball has
+    // already claimed it, so the batches barely change between steps
+    for (int k = 0; k < contacts->count; k++) {
+        contact *c = &contacts->items[k];
+        if (c->color < 0 || c->color >= MAX_CONTACT_COLORS) {
+            continue;
+        }
+        unsigned long long bit = 1ULL << c->color;
+        unsigned long long taken = used[c->a] | (c->b != BORDER_CONTACT ? used[c->b] : 0);
+        if (taken & bit) {
+            c->color = -1;
+            continue;
+        }
+        used[c->a] |= bit;
+        if (c->b != BORDER_CONTACT) {
+            used[c->b] |= bit;
+        }
+    }
+
+    // Greedy lowest free color for the new ones. A ball with more than
+    // MAX_CONTACT_COLORS contacts spills into a last batch solved serially.
+    for (int k = 0; k < contacts->count; k++) {
+        contact *c = &contacts->items[k];
+        if (c->color >= 0) {
+            continue;
+        }
+        unsigned long long taken = used[c->a] | (c->b != BORDER_CONTACT ? used[c->b] : 0);
+        if (taken == ~0ULL) {
+            c->color = MAX_CONTACT_COLORS;
+            continue;
+        }
+        int color = 0;
+        while (taken & (1ULL << color)) {
+            color++;
+        }
+        c->color = color;
+        used[c->a] |= 1ULL << color;
+        if (c->b != BORDER_CONTACT) {
+            used[c->b] |= 1ULL << color;
+        }
+    }
+
+    // Bucket contact indices by color, ascending inside each batch
+    int *start = w->colorStart;
+    for (int color = 0; color <= MAX_CONTACT_COLORS + 1; color++) {
+        start[color] = 0;
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        start[contacts->items[k].color + 1]++;
+    }
+    w->numColors = 0;
+    for (int color = 0; color <= MAX_CONTACT_COLORS; color++) {
+        if (start[color + 1] > 0) {
+            w->numColors = color + 1;
+        }
+        start[color + 1] += start[color];
+    }
+    for (int k = 0; k < contacts->count; k++) {
+        w->colorOrder[start[contacts->items[k].color]++] = k;
+    }
+    for (int color = MAX_CONTACT_COLORS + 1; color > 0; color--) {
+        start[color] = start[color - 1];
+    }
+    start[0] = 0;
+}
+
+void solveContactsColored(pointArray *a, contactList *contacts, const solverSettings *s, solverWorkspace *work, float radius, float borderRadius, double h) {
+    contact *items = contacts->items;
+    const int *order = work->colorOrder;
+    const int *start = work->colorStart;
+
+    // Contacts of one color share no ball, so each batch is a parallel loop.
+    // The spill batch (color MAX_CONTACT_COLORS) may not be, and runs serially.
+    for (int color = 0; color < work->numColors; color++) {
+        #pragma omp parallel for schedule(static) if (color < MAX_CONTACT_COLORS)
+        for (int slot = start[color]; slot < start[color + 1]; slot++) {
+            contact *c = &items[order[slot]];
+            updateContactGeometry(a, c, radius, borderRadius);
+            applyImpulse(a, c, c->impulse, c->tangentImpulse);
+        }
+    }
+    for (int it = 0; it < s->iterations; it++) {
+        for (int color = 0; color < work->numColors; color++) {
+            #pragma omp parallel for schedule(static) if (color < MAX_CONTACT_COLORS)
+            for (int slot = start[color]; slot < start[color + 1]; slot++) {
+                solveContactVelocity(a, &items[order[slot]], s, h);
+            }
+        }
+    }
+    for (int it = 0; it < s->positionIterations; it++) {
+        for (int color = 0; color < work->numColors; color++) {
+            #pragma omp parallel for schedule(static) if (color < MAX_CONTACT_COLORS)
+            for (int slot = start[color]; slot < start[color + 1]; slot++) {
+                solveContactPosition(a, &items[order[slot]], s, radius, borderRadius);
+            }
+        }
+    }
+    a->revision++;
+}
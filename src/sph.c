@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common/sph.h"
+#include "common/fixed.h"
+
+#define SPH_PI 3.14159265358979323846
+
+void defaultSphSettings(sphSettings *s) {
+    s->support = 4.0;
+    s->restDensity = 0.0;
+    s->stiffness = 20.0;
+    s->viscosity = 1e-3;
+    s->skin = 1.0;
+}
+
+void initSphSet(sphSet *f) {
+    memset(f, 0, sizeof(*f));
+}
+
+void freeSphSet(sphSet *f) {
+    free(f->fluid);
+    free(f->particles);
+    free(f->density);
+    free(f->pressure);
+    free(f->thrust);
+    free(f->inverseDensity);
+    free(f->acceleration);
+    free(f->reference);
+    free(f->neighbourCount);
+    free(f->neighbours);
+    free(f->dx);
+    free(f->dy);
+    free(f->r2);
+    free(f->groups);
+    initSphSet(f);
+}
+
+static int reserveBalls(sphSet *f, int n) {
+    if (n <= f->ballCapacity) {
+        return 1;
+    }
+    int capacity = f->ballCapacity > 0 ? f->ballCapacity : 1024;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    unsigned char *fluid = (unsigned char *)realloc(f->fluid, capacity);
+    if (fluid != NULL) {
+        memset(fluid + f->ballCapacity, 0, capacity - f->ballCapacity);
+        f->fluid = fluid;
+    }
+    double *density = (double *)realloc(f->density, capacity * sizeof(double));
+    if (density != NULL) {
+        f->density = density;
+    }
+    double *pressure = (double *)realloc(f->pressure, capacity * sizeof(double));
+    if (pressure != NULL) {
+        f->pressure = pressure;
+    }
+    double *thrust = (double *)realloc(f->thrust, capacity * sizeof(double));
+    if (thrust != NULL) {
+        f->thrust = thrust;
+    }
+    double *inverseDensity = (double *)realloc(f->inverseDensity, capacity * sizeof(double));
+    if (inverseDensity != NULL) {
+        f->inverseDensity = inverseDensity;
+    }
+    vector2 *acceleration = (vector2 *)realloc(f->acceleration, capacity * sizeof(vector2));
+    if (acceleration != NULL) {
+        f->acceleration = acceleration;
+    }
+    if (fluid == NULL || density == NULL || pressure == NULL || thrust == NULL || inverseDensity == NULL
+        || acceleration == NULL) {
+        fprintf(stderr, "Fluid realloc failure\n");
+        return 0;
+    }
+    f->ballCapacity = capacity;
+    return 1;
+}
+
+int setFluid(sphSet *f, int ball, int fluid) {
+    if (ball < 0 || (fluid && fixedPointRefuses("Fluid"))) {
+        return -1;
+    }
+    if (ball >= f->numBalls) {
+        if (!fluid) {
+            return 0;
+        }
+        if (!reserveBalls(f, ball + 1)) {
+            return -1;
+        }
+        f->numBalls = ball + 1;
+    }
+    fluid = fluid != 0;
+    if (f->fluid[ball] != fluid) {
+        f->fluid[ball] = (unsigned char)fluid;
+        f->count += fluid ? 1 : -1;
+    }
+    return 0;
+}
+
+const int *fluidGroups(sphSet *f, const int *ballBody, int numBodyBalls, int bodies, int n) {
+    if (f->count == 0) {
+        return ballBody;
+    }
+    if (n > f->groupCapacity) {
+        int *groups = (int *)realloc(f->groups, n * sizeof(int));
+        if (groups == NULL) {
+            fprintf(stderr, "Fluid group realloc failure\n");
+            return ballBody;
+        }
+        f->groups = groups;
+        f->groupCapacity = n;
+    }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+        int group = ballBody != NULL && i < numBodyBalls ? ballBody[i] : -1;
+        // Every fluid ball shares one group past the bodies'
+        f->groups[i] = group < 0 && isFluid(f, i) ? bodies : group;
+    }
+    return f->groups;
+}
+
+// Fluid balls within reach of ball i, the first limit of them written to
+// out; returns how many there are
+static int gatherNeighbours(const sphSet *f, const pointArray *a, const spatialGrid *g, int i, double reach, int limit,
+                            int *out) {
+    double x = a->points[i].position.x, y = a->points[i].position.y;
+    int c0 = gridClampCol(g, x - reach), c1 = gridClampCol(g, x + reach);
+    int r0 = gridClampRow(g, y - reach), r1 = gridClampRow(g, y + reach);
+    int count = 0;
+    for (int row = r0; row <= r1; row++) {
+        // The cells of one row are one run of cellPoints
+        int first = g->cellStart[row * g->cols + c0], last = g->cellStart[row * g->cols + c1 + 1];
+        for (int k = first; k < last; k++) {
+            int j = g->cellPoints[k];
+            if (j >= a->size || !isFluid(f, j)) {
+                continue;
+            }
+            double dx = x - a->points[j].position.x, dy = y - a->points[j].position.y;
+            if (dx * dx + dy * dy <= reach * reach) {
+                if (count < limit) {
+                    out[count] = j;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Density a ball sees among touching balls packed hexagonally, itself included
+static double latticeDensity(double h, double spacing) {
+    double h2 = h * h, sum = 0.0, norm = 4.0 / (SPH_PI * pow(h, 8));
+    int reach = (int)(h / spacing) + 2;
+    for (int row = -reach; row <= reach; row++) {
+        for (int col = -reach; col <= reach; col++) {
+            double x = (col + 0.5 * row) * spacing, y = row * spacing * sqrt(3.0) / 2.0;
+            double q = h2 - x * x - y * y;
+            if (q > 0.0) {
+                sum += q * q * q;
+            }
+        }
+    }
+    return norm * sum;
+}
+
+static int reserveNeighbours(sphSet *f, long long total) {
+    if (total <= f->neighbourCapacity) {
+        return 1;
+    }
+    long long capacity = f->neighbourCapacity > 0 ? f->neighbourCapacity : 4096;
+    while (capacity < total) {
+        capacity *= 2;
+    }
+    int *neighbours = (int *)realloc(f->neighbours, capacity * sizeof(int));
+    if (neighbours != NULL) {
+        f->neighbours = neighbours;
+    }
+    double **offsets[3] = {&f->dx, &f->dy, &f->r2};
+    int ok = neighbours != NULL;
+    for (int k = 0; k < 3; k++) {
+        double *offset = (double *)realloc(*offsets[k], capacity * sizeof(double));
+        if (offset != NULL) {
+            *offsets[k] = offset;
+        }
+        ok = ok && offset != NULL;
+    }
+    if (!ok || capacity > 0x7fffffff) {
+        fprintf(stderr, "Fluid neighbour realloc failure\n");
+        return 0;
+    }
+    f->neighbourCapacity = (int)capacity;
+    return 1;
+}
+
+int buildFluidNeighbours(sphSet *f, const sphSettings *s, const pointArray *a, const spatialGrid *g, float radius) {
+    f->restDensity = s->restDensity > 0.0 ? s->restDensity : latticeDensity(s->support * radius, 2.0 * radius);
+    f->listed = 0;
+    if (f->count > f->particleCapacity) {
+        int capacity = f->count;
+        int *particles = (int *)realloc(f->particles, capacity * sizeof(int));
+        if (particles != NULL) {
+            f->particles = particles;
+        }
+        int *counts = (int *)realloc(f->neighbourCount, capacity * sizeof(int));
+        if (counts != NULL) {
+            f->neighbourCount = counts;
+        }
+        vector2 *reference = (vector2 *)realloc(f->reference, capacity * sizeof(vector2));
+        if (reference != NULL) {
+            f->reference = reference;
+        }
+        if (particles == NULL || counts == NULL || reference == NULL) {
+            fprintf(stderr, "Fluid particle realloc failure\n");
+            return -1;
+        }
+        f->particleCapacity = capacity;
+    }
+    // In grid order, so consecutive balls mostly share their neighbours
+    int count = 0;
+    for (int k = 0; k < g->cellStart[g->cols * g->rows]; k++) {
+        int i = g->cellPoints[k];
+        if (i < a->size && isFluid(f, i)) {
+            f->reference[count] = a->points[i].position;
+            f->particles[count++] = i;
+        }
+    }
+
+    // Every ball gets stride slots; one pass over the grid unless some ball
+    // has more neighbours than that, and the same lists whatever the thread count
+    double reach = (s->support + s->skin) * radius;
+    int stride = f->stride > 0 ? f->stride : 32;
+    for (;;) {
+        if (!reserveNeighbours(f, (long long)count * stride)) {
+            return -1;
+        }
+        int longest = 0;
+        #pragma omp parallel for schedule(dynamic, 64) reduction(max:longest)
+        for (int p = 0; p < count; p++) {
+            int n = gatherNeighbours(f, a, g, f->particles[p], reach, stride, f->neighbours + (long long)p * stride);
+            f->neighbourCount[p] = n;
+            longest = n > longest ? n : longest;
+        }
+        if (longest <= stride) {
+            break;
+        }
+        stride = longest + longest / 4;
+    }
+    f->stride = stride;
+    f->listed = count;
+    f->listedCount = f->count;
+    f->listedSize = a->size;
+    return 0;
+}
+
+// The lists hold every pair within the kernel until some ball has moved half
+// the skin since they were gathered
+static int listsStale(const sphSet *f, const sphSettings *s, const pointArray *a, float radius) {
+    if (f->listedCount != f->count || f->listedSize != a->size) {
+        return 1;
+    }
+    double limit = 0.5 * s->skin * radius, moved = 0.0;
+    #pragma omp parallel for schedule(static) reduction(max:moved)
+    for (int p = 0; p < f->listed; p++) {
+        vector2 q = a->points[f->particles[p]].position, r = f->reference[p];
+        double d2 = (q.x - r.x) * (q.x - r.x) + (q.y - r.y) * (q.y - r.y);
+        moved = d2 > moved ? d2 : moved;
+    }
+    return moved > limit * limit;
+}
+
+void computeFluidForces(sphSet *f, const sphSettings *s, const pointArray *a, spatialGrid *g, float radius) {
+    if (f->count > 0 && listsStale(f, s, a, radius)) {
+        ensureGrid(g, a);
+        buildFluidNeighbours(f, s, a, g, radius);
+    }
+    int count = f->listed;
+    const centerPoint *points = a->points;
+    const int *neighbours = f->neighbours;
+    double *dxs = f->dx, *dys = f->dy, *r2s = f->r2;
+    double *density = f->density, *pressure = f->pressure;
+    double *thrust = f->thrust, *inverseDensity = f->inverseDensity;
+    double h = s->support * radius, h2 = h * h;
+    double poly6 = 4.0 / (SPH_PI * pow(h, 8));
+    double spiky = 30.0 / (SPH_PI * pow(h, 5));
+    double laplacian = 40.0 / (SPH_PI * pow(h, 5));
+    double rest = f->restDensity, stiffness = s->stiffness, viscosity = s->viscosity;
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < count; p++) {
+        int i = f->particles[p];
+        double x = points[i].position.x, y = points[i].position.y, sum = 0.0;
+        int first = p * f->stride, last = first + f->neighbourCount[p];
+        #pragma omp simd reduction(+:sum)
+        for (int k = first; k < last; k++) {
+            int j = neighbours[k];
+            double dx = x - points[j].position.x, dy = y - points[j].position.y;
+            double r2 = dx * dx + dy * dy, q = h2 - r2 > 0.0 ? h2 - r2 : 0.0;
+            dxs[k] = dx;
+            dys[k] = dy;
+            r2s[k] = r2;
+            sum += q * q * q;
+        }
+        density[i] = poly6 * sum;
+        // No tension: stretched fluid does not pull back together
+        pressure[i] = density[i] > rest ? stiffness * (density[i] - rest) : 0.0;
+        thrust[i] = pressure[i] / (density[i] * density[i]);
+        inverseDensity[i] = 1.0 / density[i];
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < count; p++) {
+        int i = f->particles[p];
+        double vx = points[i].velocity.x, vy = points[i].velocity.y;
+        double ti = thrust[i], ax = 0.0, ay = 0.0;
+        int first = p * f->stride, last = first + f->neighbourCount[p];
+        #pragma omp simd reduction(+:ax, ay)
+        for (int k = first; k < last; k++) {
+            int j = neighbours[k];
+            double r = sqrt(r2s[k]);
+            double hr = h - r > 0.0 ? h - r : 0.0;
+            double push = r > 0.0 ? (ti + thrust[j]) * spiky * hr * hr / r : 0.0;
+            double drag = viscosity * laplacian * hr * inverseDensity[j];
+            ax += push * dxs[k] + drag * (points[j].velocity.x - vx);
+            ay += push * dys[k] + drag * (points[j].velocity.y - vy);
+        }
+        f->acceleration[i] = (vector2){ax, ay};
+    }
+}
@@ -0,0 +1,686 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "common/trajectory.h"
+
+#define MAX_DECIMATION 1024
+
+typedef struct {
+    unsigned char *data;
+    unsigned long long size;
+    unsigned long long capacity;
+} byteBuffer;
+
+typedef struct {
+    vector2 *positions;
+    int count;
+    int capacity;
+    unsigned long long step;
+} frameSlot;
+
+struct trajectoryWriter {
+    FILE *file;
+    trajectorySettings settings;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+
+    // Single producer, single consumer ring: the simulation only advances
+    // head, the writer thread only advances tail
+    frameSlot *slots;
+    int slotCount;
+    atomic_ullong head;
+    atomic_ullong tail;
+    atomic_int stopping;
+
+    // Simulation thread only
+    unsigned long long framesOffered;
+    unsigned long long framesDropped;
+    unsigned long long framesDecimated;
+    int stride;
+
+    // Writer thread only
+    long long *previous;
+    int previousCount;
+    int previousCapacity;
+    byteBuffer chunk;
+    byteBuffer packed;
+    int framesInChunk;
+    unsigned long long chunkFirstStep;
+    trajectoryIndexEntry *index;
+    unsigned long long indexCount;
+    unsigned long long indexCapacity;
+    unsigned long long offset;
+    int failed;
+
+    atomic_ullong framesRecorded;
+    atomic_ullong bytesRaw;
+    atomic_ullong bytesWritten;
+};
+
+static int seekFile(FILE *f, unsigned long long offset) {
+#ifdef _WIN32
+    return _fseeki64(f, (long long)offset, SEEK_SET);
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static unsigned long long fileSize(FILE *f) {
+#ifdef _WIN32
+    _fseeki64(f, 0, SEEK_END);
+    return (unsigned long long)_ftelli64(f);
+#else
+    fseeko(f, 0, SEEK_END);
+    return (unsigned long long)ftello(f);
+#endif
+}
+
+static void idleWait(void) {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec pause = {0, 500000};
+    nanosleep(&pause, NULL);
+#endif
+}
+
+static int reserveBytes(byteBuffer *b, unsigned long long extra) {
+    if (b->size + extra <= b->capacity) {
+        return 0;
+    }
+    unsigned long long capacity = b->capacity > 0 ? b->capacity : 4096;
+    while (capacity < b->size + extra) {
+        capacity *= 2;
+    }
+    unsigned char *data = (unsigned char *)realloc(b->data, capacity);
+    if (data == NULL) {
+        fprintf(stderr, "Trajectory buffer realloc failure\n");
+        return -1;
+    }
+    b->data = data;
+    b->capacity = capacity;
+    return 0;
+}
+
+static void putVarint(byteBuffer *b, unsigned long long v) {
+    while (v >= 0x80) {
+        b->data[b->size++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    b->data[b->size++] = (unsigned char)v;
+}
+
+static unsigned long long zigzag(long long v) {
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static long long unzigzag(unsigned long long v) {
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+void defaultTrajectorySettings(trajectorySettings *s) {
+    s->precision = 1e-6;
+    s->keyframeInterval = 64;
+    s->bufferFrames = 16;
+    s->policy = TRAJECTORY_DROP;
+    s->codec = TRAJECTORY_CODEC_BUILTIN;
+}
+
+// Compresses the finished chunk with the configured codec, keeping the
+// varint bytes when that does not make it smaller, and appends it to the file.
+static void flushChunk(trajectoryWriter *t) {
+    trajectoryChunkHeader h = {t->chunkFirstStep, (unsigned int)t->framesInChunk, TRAJECTORY_CODEC_BUILTIN, t->chunk.size, t->chunk.size};
+    const unsigned char *stored = t->chunk.data;
+
+#ifdef HAVE_LZ4
+    if (t->settings.codec == TRAJECTORY_CODEC_LZ4 && t->chunk.size < 0x7e000000ULL) {
+        t->packed.size = 0;
+        if (reserveBytes(&t->packed, (unsigned long long)LZ4_compressBound((int)t->chunk.size)) == 0) {
+            int size = LZ4_compress_default((const char *)t->chunk.data, (char *)t->packed.data, (int)t->chunk.size, (int)t->packed.capacity);
+            if (size > 0 && (unsigned long long)size < t->chunk.size) {
+                h.codec = TRAJECTORY_CODEC_LZ4;
+                h.storedSize = (unsigned long long)size;
+                stored = t->packed.data;
+            }
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (t->settings.codec == TRAJECTORY_CODEC_ZSTD) {
+        t->packed.size = 0;
+        if (reserveBytes(&t->packed, ZSTD_compressBound(t->chunk.size)) == 0) {
+            size_t size = ZSTD_compress(t->packed.data, t->packed.capacity, t->chunk.data, t->chunk.size, 3);
+            if (!ZSTD_isError(size) && size < t->chunk.size) {
+                h.codec = TRAJECTORY_CODEC_ZSTD;
+                h.storedSize = size;
+                stored = t->packed.data;
+            }
+        }
+    }
+#endif
+
+    if (t->indexCount == t->indexCapacity) {
+        unsigned long long capacity = t->indexCapacity > 0 ? t->indexCapacity * 2 : 64;
+        trajectoryIndexEntry *index = (trajectoryIndexEntry *)realloc(t->index, capacity * sizeof(trajectoryIndexEntry));
+        if (index == NULL) {
+            fprintf(stderr, "Trajectory index realloc failure\n");
+            t->failed = 1;
+            return;
+        }
+        t->index = index;
+        t->indexCapacity = capacity;
+    }
+    unsigned long long firstFrame = atomic_load(&t->framesRecorded) - (unsigned long long)t->framesInChunk;
+    t->index[t->indexCount++] = (trajectoryIndexEntry){t->chunkFirstStep, firstFrame, t->offset};
+
+    if (fwrite(&h, sizeof(h), 1, t->file) != 1 || (h.storedSize > 0 && fwrite(stored, h.storedSize, 1, t->file) != 1)) {
+        t->failed = 1;
+    }
+    t->offset += sizeof(h) + h.storedSize;
+    atomic_fetch_add(&t->bytesWritten, sizeof(h) + h.storedSize);
+    t->chunk.size = 0;
+    t->framesInChunk = 0;
+}
+
+static void encodeFrame(trajectoryWriter *t, const frameSlot *slot) {
+    int keyframe = t->framesInChunk == 0;
+    int values = 2 * slot->count;
+    if (keyframe) {
+        t->chunkFirstStep = slot->step;
+    }
+    if (values > t->previousCapacity) {
+        long long *previous = (long long *)realloc(t->previous, values * sizeof(long long));
+        if (previous == NULL) {
+            fprintf(stderr, "Trajectory realloc failure\n");
+            t->failed = 1;
+            return;
+        }
+        t->previous = previous;
+        t->previousCapacity = values;
+    }
+    // Worst case is a full ten byte varint per value
+    if (reserveBytes(&t->chunk, 20 + 10ULL * values) != 0) {
+        t->failed = 1;
+        return;
+    }
+
+    putVarint(&t->chunk, slot->step);
+    putVarint(&t->chunk, (unsigned long long)slot->count);
+    double scale = 1.0 / t->settings.precision;
+    int known = keyframe ? 0 : 2 * t->previousCount;
+    unsigned long long run = 0;
+    for (int k = 0; k < values; k++) {
+        const vector2 *p = &slot->positions[k >> 1];
+        long long q = llround(((k & 1) ? p->y : p->x) * scale);
+        long long delta = q - (k < known ? t->previous[k] : 0);
+        t->previous[k] = q;
+        if (delta == 0) {
+            run++;
+            continue;
+        }
+        // A zero byte can only start a run: nonzero varints never begin with one
+        if (run > 0) {
+            t->chunk.data[t->chunk.size++] = 0;
+            putVarint(&t->chunk, run - 1);
+            run = 0;
+        }
+        putVarint(&t->chunk, zigzag(delta));
+    }
+    if (run > 0) {
+        t->chunk.data[t->chunk.size++] = 0;
+        putVarint(&t->chunk, run - 1);
+    }
+    t->previousCount = slot->count;
+
+    atomic_fetch_add(&t->framesRecorded, 1);
+    atomic_fetch_add(&t->bytesRaw, (unsigned long long)values * sizeof(double));
+    if (++t->framesInChunk == t->settings.keyframeInterval) {
+        flushChunk(t);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writerThread(LPVOID arg) {
+#else
+static void *writerThread(void *arg) {
+#endif
+    trajectoryWriter *t = (trajectoryWriter *)arg;
+    unsigned long long tail = atomic_load(&t->tail);
+    for (;;) {
+        // Read stopping first: once set, head already holds the last frame
+        int stopping = atomic_load(&t->stopping);
+        if (tail != atomic_load(&t->head)) {
+            if (!t->failed) {
+                encodeFrame(t, &t->slots[tail % t->slotCount]);
+            }
+            atomic_store(&t->tail, ++tail);
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        idleWait();
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+trajectoryWriter *openTrajectoryWriter(const char *path, const trajectorySettings *s) {
+    trajectoryWriter *t = (trajectoryWriter *)calloc(1, sizeof(trajectoryWriter));
+    if (t == NULL) {
+        fprintf(stderr, "Trajectory malloc failure\n");
+        return NULL;
+    }
+    t->settings = *s;
+    if (t->settings.keyframeInterval < 1) {
+        t->settings.keyframeInterval = 1;
+    }
+    if (t->settings.bufferFrames < 1) {
+        t->settings.bufferFrames = 1;
+    }
+#ifndef HAVE_LZ4
+    if (t->settings.codec == TRAJECTORY_CODEC_LZ4) {
+        fprintf(stderr, "Trajectory: built without LZ4, using the built-in codec\n");
+        t->settings.codec = TRAJECTORY_CODEC_BUILTIN;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (t->settings.codec == TRAJECTORY_CODEC_ZSTD) {
+        fprintf(stderr, "Trajectory: built without zstd, using the built-in codec\n");
+        t->settings.codec = TRAJECTORY_CODEC_BUILTIN;
+    }
+#endif
+
+    t->file = fopen(path, "wb");
+    if (t->file == NULL) {
+        fprintf(stderr, "Trajectory: cannot create %s\n", path);
+        free(t);
+        return NULL;
+    }
+    trajectoryFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    h.version = TRAJECTORY_VERSION;
+    h.keyframeInterval = (unsigned int)t->settings.keyframeInterval;
+    h.precision = t->settings.precision;
+    fwrite(&h, sizeof(h), 1, t->file);
+    t->offset = sizeof(h);
+
+    t->slotCount = t->settings.bufferFrames;
+    t->slots = (frameSlot *)calloc(t->slotCount, sizeof(frameSlot));
+    t->stride = 1;
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->stopping, 0);
+    atomic_init(&t->framesRecorded, 0);
+    atomic_init(&t->bytesRaw, 0);
+    atomic_init(&t->bytesWritten, sizeof(h));
+
+#ifdef _WIN32
+    t->thread = CreateThread(NULL, 0, writerThread, t, 0, NULL);
+    int started = t->thread != NULL;
+#else
+    int started = pthread_create(&t->thread, NULL, writerThread, t) == 0;
+#endif
+    if (t->slots == NULL || !started) {
+        fprintf(stderr, "Trajectory: cannot start the writer thread\n");
+        fclose(t->file);
+        free(t->slots);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void recordFrame(trajectoryWriter *t, const pointArray *a, unsigned long long step) {
+    unsigned long long offered = t->framesOffered++;
+    if (offered % (unsigned long long)t->stride != 0) {
+        t->framesDecimated++;
+        return;
+    }
+
+    unsigned long long head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    unsigned long long queued = head - atomic_load(&t->tail);
+    if (queued >= (unsigned long long)t->slotCount) {
+        t->framesDropped++;
+        if (t->settings.policy == TRAJECTORY_DECIMATE && t->stride < MAX_DECIMATION) {
+            t->stride *= 2;
+        }
+        return;
+    }
+    if (t->stride > 1 && queued <= (unsigned long long)t->slotCount / 4) {
+        t->stride /= 2;
+    }
+
+    // The slot is free, so the writer thread is not looking at it
+    frameSlot *slot = &t->slots[head % t->slotCount];
+    if (slot->capacity < a->size) {
+        vector2 *positions = (vector2 *)realloc(slot->positions, a->size * sizeof(vector2));
+        if (positions == NULL) {
+            fprintf(stderr, "Trajectory slot realloc failure\n");
+            t->framesDropped++;
+            return;
+        }
+        slot->positions = positions;
+        slot->capacity = a->size;
+    }
+    for (int i = 0; i < a->size; i++) {
+        slot->positions[i] = a->points[i].position;
+    }
+    slot->count = a->size;
+    slot->step = step;
+    atomic_store(&t->head, head + 1);
+}
+
+void getTrajectoryStats(trajectoryWriter *t, trajectoryStats *stats) {
+    stats->framesOffered = t->framesOffered;
+    stats->framesRecorded = atomic_load(&t->framesRecorded);
+    stats->framesDropped = t->framesDropped;
+    stats->framesDecimated = t->framesDecimated;
+    stats->bytesRaw = atomic_load(&t->bytesRaw);
+    stats->bytesWritten = atomic_load(&t->bytesWritten);
+}
+
+int closeTrajectoryWriter(trajectoryWriter *t, trajectoryStats *stats) {
+    atomic_store(&t->stopping, 1);
+#ifdef _WIN32
+    WaitForSingleObject(t->thread, INFINITE);
+    CloseHandle(t->thread);
+#else
+    pthread_join(t->thread, NULL);
+#endif
+
+    if (t->framesInChunk > 0 && !t->failed) {
+        flushChunk(t);
+    }
+    trajectoryTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.indexOffset = t->offset;
+    trailer.chunkCount = t->indexCount;
+    trailer.frameCount = atomic_load(&t->framesRecorded);
+    memcpy(trailer.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    if ((t->indexCount > 0 && fwrite(t->index, t->indexCount * sizeof(trajectoryIndexEntry), 1, t->file) != 1)
+        || fwrite(&trailer, sizeof(trailer), 1, t->file) != 1) {
+        t->failed = 1;
+    }
+    atomic_fetch_add(&t->bytesWritten, t->indexCount * sizeof(trajectoryIndexEntry) + sizeof(trailer));
+    if (fclose(t->file) != 0) {
+        t->failed = 1;
+    }
+    if (stats != NULL) {
+        getTrajectoryStats(t, stats);
+    }
+
+    int result = t->failed ? -1 : 0;
+    if (t->failed) {
+        fprintf(stderr, "Trajectory: write failed, the file is incomplete\n");
+    }
+    for (int i = 0; i < t->slotCount; i++) {
+        free(t->slots[i].positions);
+    }
+    free(t->slots);
+    free(t->previous);
+    free(t->chunk.data);
+    free(t->packed.data);
+    free(t->index);
+    free(t);
+    return result;
+}
+
+// Rebuilds the index of a file whose writer never got to the trailer
+static int scanChunks(trajectoryReader *r, unsigned long long size) {
+    unsigned long long offset = sizeof(trajectoryFileHeader), capacity = 0;
+    trajectoryChunkHeader h;
+    while (offset + sizeof(h) <= size && seekFile(r->file, offset) == 0 && fread(&h, sizeof(h), 1, r->file) == 1) {
+        if (offset + sizeof(h) + h.storedSize > size) {
+            break;
+        }
+        if (r->chunkCount == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            trajectoryIndexEntry *index = (trajectoryIndexEntry *)realloc(r->index, capacity * sizeof(trajectoryIndexEntry));
+            if (index == NULL) {
+                return -1;
+            }
+            r->index = index;
+        }
+        r->index[r->chunkCount++] = (trajectoryIndexEntry){h.firstStep, r->frameCount, offset};
+        r->frameCount += h.frameCount;
+        offset += sizeof(h) + h.storedSize;
+    }
+    return 0;
+}
+
+int openTrajectory(trajectoryReader *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->chunk = -1;
+    r->frame = -1;
+    r->file = fopen(path, "rb");
+    if (r->file == NULL) {
+        fprintf(stderr, "Trajectory: cannot open %s\n", path);
+        return -1;
+    }
+    if (fread(&r->header, sizeof(r->header), 1, r->file) != 1 || memcmp(r->header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0) {
+        fprintf(stderr, "Trajectory: %s is not a trajectory\n", path);
+        closeTrajectory(r);
+        return -1;
+    }
+    if (r->header.version > TRAJECTORY_VERSION) {
+        fprintf(stderr, "Trajectory: %s has version %u, this build reads up to %d\n", path, r->header.version, TRAJECTORY_VERSION);
+        closeTrajectory(r);
+        return -1;
+    }
+
+    unsigned long long size = fileSize(r->file);
+    trajectoryTrailer trailer;
+    int complete = size >= sizeof(r->header) + sizeof(trailer)
+        && seekFile(r->file, size - sizeof(trailer)) == 0
+        && fread(&trailer, sizeof(trailer), 1, r->file) == 1
+        && memcmp(trailer.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) == 0
+        && trailer.indexOffset + trailer.chunkCount * sizeof(trajectoryIndexEntry) + sizeof(trailer) == size;
+    if (complete) {
+        r->chunkCount = trailer.chunkCount;
+        r->frameCount = trailer.frameCount;
+        r->index = (trajectoryIndexEntry *)malloc((r->chunkCount > 0 ? r->chunkCount : 1) * sizeof(trajectoryIndexEntry));
+        if (r->index == NULL || seekFile(r->file, trailer.indexOffset) != 0
+            || (r->chunkCount > 0 && fread(r->index, r->chunkCount * sizeof(trajectoryIndexEntry), 1, r->file) != 1)) {
+            fprintf(stderr, "Trajectory: cannot read the index of %s\n", path);
+            closeTrajectory(r);
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "Trajectory: %s was not closed, recovering complete chunks\n", path);
+        if (scanChunks(r, size) != 0) {
+            closeTrajectory(r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int loadChunk(trajectoryReader *r, unsigned long long c) {
+    trajectoryChunkHeader h;
+    if (seekFile(r->file, r->index[c].offset) != 0 || fread(&h, sizeof(h), 1, r->file) != 1) {
+        return -1;
+    }
+    if (h.rawSize > r->rawCapacity) {
+        unsigned char *raw = (unsigned char *)realloc(r->raw, h.rawSize);
+        if (raw == NULL) {
+            return -1;
+        }
+        r->raw = raw;
+        r->rawCapacity = h.rawSize;
+    }
+
+    if (h.codec == TRAJECTORY_CODEC_BUILTIN) {
+        if (h.storedSize != h.rawSize || (h.rawSize > 0 && fread(r->raw, h.rawSize, 1, r->file) != 1)) {
+            return -1;
+        }
+    } else {
+        unsigned char *stored = (unsigned char *)malloc(h.storedSize > 0 ? h.storedSize : 1);
+        if (stored == NULL || fread(stored, h.storedSize, 1, r->file) != 1) {
+            free(stored);
+            return -1;
+        }
+        int ok = 0;
+#ifdef HAVE_LZ4
+        if (h.codec == TRAJECTORY_CODEC_LZ4) {
+            ok = LZ4_decompress_safe((const char *)stored, (char *)r->raw, (int)h.storedSize, (int)h.rawSize) == (int)h.rawSize;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (h.codec == TRAJECTORY_CODEC_ZSTD) {
+            ok = ZSTD_decompress(r->raw, h.rawSize, stored, h.storedSize) == h.rawSize;
+        }
+#endif
+        free(stored);
+        if (!ok) {
+            fprintf(stderr, "Trajectory: chunk %llu needs codec %u, which this build lacks\n", c, h.codec);
+            return -1;
+        }
+    }
+
+    r->rawSize = h.rawSize;
+    r->cursor = 0;
+    r->chunk = (long long)c;
+    r->frame = (long long)r->index[c].firstFrame - 1;
+    return 0;
+}
+
+static int getVarint(trajectoryReader *r, unsigned long long *v) {
+    unsigned long long result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->cursor >= r->rawSize) {
+            return -1;
+        }
+        unsigned char byte = r->raw[r->cursor++];
+        result |= (unsigned long long)(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            *v = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int decodeFrame(trajectoryReader *r) {
+    int keyframe = r->cursor == 0;
+    unsigned long long step, count;
+    if (getVarint(r, &step) != 0 || getVarint(r, &count) != 0 || count > 0x3fffffffULL) {
+        return -1;
+    }
+    int values = 2 * (int)count;
+    if (values > r->quantizedCapacity) {
+        long long *quantized = (long long *)realloc(r->quantized, values * sizeof(long long));
+        vector2 *positions = (vector2 *)realloc(r->positions, count * sizeof(vector2));
+        if (quantized != NULL) {
+            r->quantized = quantized;
+        }
+        if (positions != NULL) {
+            r->positions = positions;
+        }
+        if (quantized == NULL || positions == NULL) {
+            return -1;
+        }
+        r->quantizedCapacity = values;
+    }
+
+    int known = keyframe ? 0 : 2 * r->count;
+    unsigned long long run = 0;
+    for (int k = 0; k < values; k++) {
+        long long delta = 0;
+        if (run > 0) {
+            run--;
+        } else {
+            unsigned long long v;
+            if (getVarint(r, &v) != 0) {
+                return -1;
+            }
+            if (v == 0) {
+                if (getVarint(r, &run) != 0) {
+                    return -1;
+                }
+            } else {
+                delta = unzigzag(v);
+            }
+        }
+        r->quantized[k] = (k < known ? r->quantized[k] : 0) + delta;
+    }
+    for (int i = 0; i < (int)count; i++) {
+        r->positions[i] = (vector2){r->quantized[2 * i] * r->header.precision, r->quantized[2 * i + 1] * r->header.precision};
+    }
+    r->count = (int)count;
+    r->step = step;
+    r->frame++;
+    return 0;
+}
+
+int readTrajectoryFrame(trajectoryReader *r, unsigned long long index) {
+    if (index >= r->frameCount) {
+        return -1;
+    }
+    if ((long long)index == r->frame) {
+        return 0;
+    }
+
+    unsigned long long lo = 0, hi = r->chunkCount;
+    while (hi - lo > 1) {
+        unsigned long long mid = (lo + hi) / 2;
+        if (r->index[mid].firstFrame <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((long long)lo != r->chunk || (long long)index < r->frame) {
+        if (loadChunk(r, lo) != 0) {
+            fprintf(stderr, "Trajectory: cannot read chunk %llu\n", lo);
+            r->chunk = -1;
+            return -1;
+        }
+    }
+    while (r->frame < (long long)index) {
+        if (decodeFrame(r) != 0) {
+            fprintf(stderr, "Trajectory: chunk %llu is corrupt\n", lo);
+            r->chunk = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void closeTrajectory(trajectoryReader *r) {
+    if (r->file != NULL) {
+        fclose(r->file);
+    }
+    free(r->index);
+    free(r->raw);
+    free(r->quantized);
+    free(r->positions);
+    memset(r, 0, sizeof(*r));
+    r->chunk = -1;
+    r->frame = -1;
+}
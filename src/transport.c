@@ -0,0 +1,399 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+typedef SOCKET socketHandle;
+#define NO_SOCKET INVALID_SOCKET
+#define closeSocket closesocket
+#define SEND_FLAGS 0
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int socketHandle;
+#define NO_SOCKET -1
+#define closeSocket close
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+#endif
+#include "common/transport.h"
+
+// Bytes each direction of a memory channel holds before the sender waits
+#define CHANNEL_BYTES (1 << 20)
+// Largest piece handed to one send or recv call
+#define SOCKET_CHUNK (1 << 20)
+
+static void idleWait(void) {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec pause = {0, 500000};
+    nanosleep(&pause, NULL);
+#endif
+}
+
+void closeTransport(transport *t) {
+    if (t->close != NULL) {
+        t->close(t);
+    }
+    t->close = NULL;
+    t->state = NULL;
+}
+
+int sendMessage(transport *t, int to, const void *data, unsigned long long bytes) {
+    if (t->send(t, to, &bytes, sizeof(bytes)) != 0) {
+        return -1;
+    }
+    return bytes > 0 ? t->send(t, to, data, bytes) : 0;
+}
+
+int receiveMessage(transport *t, int from, void **data, unsigned long long *capacity, unsigned long long *bytes) {
+    if (t->receive(t, from, bytes, sizeof(*bytes)) != 0) {
+        return -1;
+    }
+    if (*bytes > *capacity) {
+        void *grown = realloc(*data, *bytes);
+        if (grown == NULL) {
+            fprintf(stderr, "Transport: cannot hold a %llu byte message\n", *bytes);
+            return -1;
+        }
+        *data = grown;
+        *capacity = *bytes;
+    }
+    return *bytes > 0 ? t->receive(t, from, *data, *bytes) : 0;
+}
+
+// Memory transport: one single-producer single-consumer ring per ordered
+// pair of ranks, channels[from * size + to]
+typedef struct {
+    unsigned char *data;
+    atomic_ullong head;     // bytes written
+    atomic_ullong tail;     // bytes read
+} channel;
+
+typedef struct {
+    channel *channels;
+    int size;
+    atomic_int users;       // ranks not yet closed; the last frees the hub
+} memoryHub;
+
+static int memorySend(transport *t, int to, const void *data, unsigned long long bytes) {
+    memoryHub *hub = (memoryHub *)t->state;
+    channel *c = &hub->channels[t->rank * hub->size + to];
+    const unsigned char *from = (const unsigned char *)data;
+    unsigned long long head = atomic_load(&c->head);
+    while (bytes > 0) {
+        unsigned long long space = CHANNEL_BYTES - (head - atomic_load(&c->tail));
+        if (space == 0) {
+            idleWait();
+            continue;
+        }
+        unsigned long long offset = head % CHANNEL_BYTES;
+        unsigned long long n = bytes < space ? bytes : space;
+        n = n < CHANNEL_BYTES - offset ? n : CHANNEL_BYTES - offset;
+        memcpy(c->data + offset, from, n);
+        from += n;
+        bytes -= n;
+        head += n;
+        atomic_store(&c->head, head);
+    }
+    return 0;
+}
+
+static int memoryReceive(transport *t, int from, void *data, unsigned long long bytes) {
+    memoryHub *hub = (memoryHub *)t->state;
+    channel *c = &hub->channels[from * hub->size + t->rank];
+    unsigned char *to = (unsigned char *)data;
+    unsigned long long tail = atomic_load(&c->tail);
+    while (bytes > 0) {
+        unsigned long long available = atomic_load(&c->head) - tail;
+        if (available == 0) {
+            idleWait();
+            continue;
+        }
+        unsigned long long offset = tail % CHANNEL_BYTES;
+        unsigned long long n = bytes < available ? bytes : available;
+        n = n < CHANNEL_BYTES - offset ? n : CHANNEL_BYTES - offset;
+        memcpy(to, c->data + offset, n);
+        to += n;
+        bytes -= n;
+        tail += n;
+        atomic_store(&c->tail, tail);
+    }
+    return 0;
+}
+
+static void freeHub(memoryHub *hub) {
+    for (int k = 0; k < hub->size * hub->size; k++) {
+        free(hub->channels[k].data);
+    }
+    free(hub->channels);
+    free(hub);
+}
+
+static void memoryClose(transport *t) {
+    memoryHub *hub = (memoryHub *)t->state;
+    if (atomic_fetch_sub(&hub->users, 1) == 1) {
+        freeHub(hub);
+    }
+}
+
+int openMemoryTransports(transport *ranks, int size) {
+    memoryHub *hub = (memoryHub *)malloc(sizeof(memoryHub));
+    if (hub == NULL) {
+        fprintf(stderr, "Memory transport malloc failure\n");
+        return -1;
+    }
+    hub->size = size;
+    hub->channels = (channel *)calloc((size_t)size * size, sizeof(channel));
+    int failed = hub->channels == NULL;
+    for (int k = 0; !failed && k < size * size; k++) {
+        // Nothing flows from a rank to itself
+        if (k / size != k % size) {
+            hub->channels[k].data = (unsigned char *)malloc(CHANNEL_BYTES);
+            failed = hub->channels[k].data == NULL;
+        }
+        atomic_init(&hub->channels[k].head, 0);
+        atomic_init(&hub->channels[k].tail, 0);
+    }
+    if (failed) {
+        fprintf(stderr, "Memory transport malloc failure\n");
+        if (hub->channels != NULL) {
+            freeHub(hub);
+        } else {
+            free(hub);
+        }
+        return -1;
+    }
+    atomic_init(&hub->users, size);
+    for (int r = 0; r < size; r++) {
+        ranks[r] = (transport){r, size, memorySend, memoryReceive, memoryClose, hub};
+    }
+    return 0;
+}
+
+// Socket transport: a connected stream per peer, none to itself
+typedef struct {
+    socketHandle *peers;
+} socketState;
+
+static int socketSend(transport *t, int to, const void *data, unsigned long long bytes) {
+    socketHandle s = ((socketState *)t->state)->peers[to];
+    const char *from = (const char *)data;
+    while (bytes > 0) {
+        int n = (int)(bytes < SOCKET_CHUNK ? bytes : SOCKET_CHUNK);
+        n = (int)send(s, from, n, SEND_FLAGS);
+        if (n <= 0) {
+            fprintf(stderr, "Socket transport: send to rank %d failed\n", to);
+            return -1;
+        }
+        from += n;
+        bytes -= n;
+    }
+    return 0;
+}
+
+static int socketReceive(transport *t, int from, void *data, unsigned long long bytes) {
+    socketHandle s = ((socketState *)t->state)->peers[from];
+    char *to = (char *)data;
+    while (bytes > 0) {
+        int n = (int)(bytes < SOCKET_CHUNK ? bytes : SOCKET_CHUNK);
+        n = (int)recv(s, to, n, 0);
+        if (n <= 0) {
+            fprintf(stderr, "Socket transport: receive from rank %d failed\n", from);
+            return -1;
+        }
+        to += n;
+        bytes -= n;
+    }
+    return 0;
+}
+
+static void socketClose(transport *t) {
+    socketState *state = (socketState *)t->state;
+    for (int r = 0; r < t->size; r++) {
+        if (state->peers[r] != NO_SOCKET) {
+            closeSocket(state->peers[r]);
+        }
+    }
+    free(state->peers);
+    free(state);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// Fills the address rank listens on; returns its length, or 0 if the
+// address cannot be used here
+static int rankAddress(const char *address, int port, int rank, struct sockaddr_storage *out) {
+    memset(out, 0, sizeof(*out));
+    if (strncmp(address, "unix:", 5) == 0) {
+#ifdef _WIN32
+        fprintf(stderr, "Socket transport: no Unix domain sockets on Windows\n");
+        return 0;
+#else
+        struct sockaddr_un *un = (struct sockaddr_un *)out;
+        un->sun_family = AF_UNIX;
+        int n = snprintf(un->sun_path, sizeof(un->sun_path), "%s.%d", address + 5, rank);
+        if (n < 0 || n >= (int)sizeof(un->sun_path)) {
+            fprintf(stderr, "Socket transport: path %s too long\n", address + 5);
+            return 0;
+        }
+        return (int)sizeof(struct sockaddr_un);
+#endif
+    }
+    struct sockaddr_in *in = (struct sockaddr_in *)out;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((unsigned short)(port + rank));
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return (int)sizeof(struct sockaddr_in);
+}
+
+static void tuneSocket(socketHandle s, int family) {
+    if (family == AF_INET) {
+        int on = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+    }
+}
+
+// Whether a connection is waiting on the listener before the deadline
+static int waitForPeer(socketHandle listener, time_t deadline) {
+    while (1) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(listener, &ready);
+        struct timeval wait = {0, 100000};
+        int n = select((int)listener + 1, &ready, NULL, NULL, &wait);
+        if (n > 0) {
+            return 1;
+        }
+        if (n < 0 || time(NULL) > deadline) {
+            return 0;
+        }
+    }
+}
+
+int openSocketTransport(transport *t, const char *address, int port, int rank, int size, double timeout) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        fprintf(stderr, "Socket transport: WSAStartup failed\n");
+        return -1;
+    }
+#endif
+    socketState *state = (socketState *)malloc(sizeof(socketState));
+    socketHandle *peers = (socketHandle *)malloc(size * sizeof(socketHandle));
+    if (state == NULL || peers == NULL) {
+        fprintf(stderr, "Socket transport malloc failure\n");
+        free(state);
+        free(peers);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return -1;
+    }
+    for (int r = 0; r < size; r++) {
+        peers[r] = NO_SOCKET;
+    }
+    state->peers = peers;
+    *t = (transport){rank, size, socketSend, socketReceive, socketClose, state};
+
+    struct sockaddr_storage own;
+    int ownLength = rankAddress(address, port, rank, &own);
+    int family = own.ss_family;
+    socketHandle listener = ownLength > 0 ? socket(family, SOCK_STREAM, 0) : NO_SOCKET;
+    if (listener == NO_SOCKET) {
+        closeTransport(t);
+        return -1;
+    }
+#ifndef _WIN32
+    if (family == AF_UNIX) {
+        unlink(((struct sockaddr_un *)&own)->sun_path);
+    }
+#endif
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+    if (bind(listener, (struct sockaddr *)&own, ownLength) != 0 || listen(listener, size) != 0) {
+        fprintf(stderr, "Socket transport: rank %d cannot listen\n", rank);
+        closeSocket(listener);
+        closeTransport(t);
+        return -1;
+    }
+
+    // Lower ranks are dialled (retrying until they listen), higher ranks
+    // dial in and name themselves
+    time_t deadline = time(NULL) + (time_t)(timeout + 1.0);
+    int failed = 0;
+    for (int r = 0; r < rank && !failed; r++) {
+        struct sockaddr_storage peer;
+        int length = rankAddress(address, port, r, &peer);
+        while (1) {
+            socketHandle s = socket(family, SOCK_STREAM, 0);
+            if (s != NO_SOCKET && connect(s, (struct sockaddr *)&peer, length) == 0) {
+                peers[r] = s;
+                break;
+            }
+            if (s != NO_SOCKET) {
+                closeSocket(s);
+            }
+            if (time(NULL) > deadline) {
+                fprintf(stderr, "Socket transport: rank %d cannot reach rank %d\n", rank, r);
+                failed = 1;
+                break;
+            }
+            idleWait();
+        }
+        if (!failed) {
+            tuneSocket(peers[r], family);
+            int name = rank;
+            failed = socketSend(t, r, &name, sizeof(name)) != 0;
+        }
+    }
+    for (int k = rank + 1; k < size && !failed; k++) {
+        if (!waitForPeer(listener, deadline)) {
+            fprintf(stderr, "Socket transport: rank %d waited too long for its peers\n", rank);
+            failed = 1;
+            break;
+        }
+        socketHandle s = accept(listener, NULL, NULL);
+        int name = -1;
+        if (s != NO_SOCKET && recv(s, (char *)&name, sizeof(name), MSG_WAITALL) == (int)sizeof(name)
+            && name > rank && name < size && peers[name] == NO_SOCKET) {
+            peers[name] = s;
+            tuneSocket(s, family);
+        } else {
+            fprintf(stderr, "Socket transport: rank %d got a bad greeting\n", rank);
+            if (s != NO_SOCKET) {
+                closeSocket(s);
+            }
+            failed = 1;
+        }
+    }
+    closeSocket(listener);
+#ifndef _WIN32
+    if (family == AF_UNIX) {
+        unlink(((struct sockaddr_un *)&own)->sun_path);
+    }
+#endif
+    if (failed) {
+        closeTransport(t);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include <stddef.h>
+#include <math.h>
+#include "common/world.h"
+
+void initWorld(physicsWorld *w, int capacity, float radius, float borderRadius) {
+    initPointArray(&w->points, capacity);
+    // Cells a little over one ball diameter wide, so overlaps (and the solver's
+    // contact margin) only span neighbouring cells
+    initGrid(&w->grid, -borderRadius, -borderRadius, borderRadius, borderRadius, 2.5 * radius);
+    initContactList(&w->contacts, capacity * 4);
+    initContactList(&w->previousContacts, capacity * 4);
+    w->events = (contactEvents){0};
+    defaultSolverSettings(&w->solver);
+    w->substeps = (substepSettings){0, 1, 0.25, 0.05, 0, 0, 0.5};
+    w->stats = (stepStats){0, 0.0, 0, 0, 0, 0.0, 0.0};
+    initSolverWorkspace(&w->solverWork);
+    initMultiRateWorkspace(&w->rates);
+    initCcdWorkspace(&w->ccd);
+    initSdfProgram(&w->boundary);
+    initSdfGrid(&w->bakedBoundary);
+    initSegmentSet(&w->segments);
+    initKinematicSet(&w->kinematics);
+    initConstraintSet(&w->constraints);
+    initRigidSet(&w->rigid);
+    defaultLongRangeSettings(&w->longRange);
+    initLongRangeWorkspace(&w->longRangeWork);
+    defaultSphSettings(&w->sph);
+    initSphSet(&w->fluid);
+    initForceFieldSet(&w->fields);
+    initEmitterSet(&w->emitters);
+    initFixedState(&w->fixed, radius, borderRadius);
+    w->radius = radius;
+    w->borderRadius = borderRadius;
+    w->periodic = 0;
+    w->step = 0;
+}
+
+void freeWorld(physicsWorld *w) {
+    freeFixedState(&w->fixed);
+    freeEmitterSet(&w->emitters);
+    freeForceFieldSet(&w->fields);
+    freeSphSet(&w->fluid);
+    freeLongRangeWorkspace(&w->longRangeWork);
+    freeRigidSet(&w->rigid);
+    freeConstraintSet(&w->constraints);
+    freeKinematicSet(&w->kinematics);
+    freeSegmentSet(&w->segments);
+    freeSdfGrid(&w->bakedBoundary);
+    freeSdfProgram(&w->boundary);
+    freeCcdWorkspace(&w->ccd);
+    freeMultiRateWorkspace(&w->rates);
+    freeSolverWorkspace(&w->solverWork);
+    freeContactEvents(&w->events);
+    freeContactList(&w->previousContacts);
+    freeContactList(&w->contacts);
+    freeGrid(&w->grid);
+    freePointArray(&w->points);
+}
+
+int bakeBoundary(physicsWorld *w, double cellSize) {
+    double r = w->borderRadius;
+    return bakeSdf(&w->bakedBoundary, &w->boundary, -r, -r, r, r, cellSize);
+}
+
+int setPeriodic(physicsWorld *w, int periodic) {
+    if (periodic && fixedPointRefuses("Periodic boxes")) {
+        return -1;
+    }
+    double r = w->borderRadius;
+    spatialGrid grid;
+    if (periodic) {
+        if (initPeriodicGrid(&grid, -r, -r, r, r, 2.5 * w->radius) != 0) {
+            return -1;
+        }
+    } else {
+        initGrid(&grid, -r, -r, r, r, 2.5 * w->radius);
+    }
+    grid.pointGroup = w->grid.pointGroup;
+    grid.groupCount = w->grid.groupCount;
+    freeGrid(&w->grid);
+    w->grid = grid;
+    w->periodic = periodic;
+    return 0;
+}
+
+// Only the substepped modes treat fluid balls as fluid
+static int fluidActive(const physicsWorld *w) {
+#ifdef PHYSICS_FIXED_POINT
+    (void)w;
+    return 0;
+#else
+    return w->fluid.count > 0 && w->solver.mode != SOLVER_LEGACY;
+#endif
+}
+
+// The float pipeline's helpers; the fixed-point build steps in integers
+#ifndef PHYSICS_FIXED_POINT
+// Brings balls that left the periodic box back in on the far side, and
+// bodies as a whole once their centre left. Once per step before the
+// broadphase, so each contact's image shift holds for the whole step.
+static void wrapPeriodic(physicsWorld *w) {
+    const spatialGrid *g = &w->grid;
+    double width = g->cols * g->cellSize, height = g->rows * g->cellSize;
+    pointArray *a = &w->points;
+    const rigidSet *r = &w->rigid;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a->size; i++) {
+        if (i < r->numBalls && r->ballBody[i] >= 0) {
+            continue;
+        }
+        vector2 *p = &a->points[i].position;
+        p->x -= width * floor((p->x - g->minX) / width);
+        p->y -= height * floor((p->y - g->minY) / height);
+    }
+    for (int b = 0; b < r->count; b++) {
+        rigidBody *body = &r->bodies[b];
+        double sx = -width * floor((body->position.x - g->minX) / width);
+        double sy = -height * floor((body->position.y - g->minY) / height);
+        if (sx == 0.0 && sy == 0.0) {
+            continue;
+        }
+        body->position.x += sx;
+        body->position.y += sy;
+        for (int k = body->first; k < body->first + body->count; k++) {
+            a->points[r->members[k]].position.x += sx;
+            a->points[r->members[k]].position.y += sy;
+        }
+    }
+    a->revision++;
+}
+
+// Velocity half of a substep: gravity() unless long-range forces replace it,
+// plus their pull, computed once at the start of the step, the fluid's
+// forces at the substep's positions and the force fields
+static void accelerate(physicsWorld *w, pointArray *a, double h) {
+    const vector2 *pull = w->longRange.mode != LONG_RANGE_NONE ? w->longRangeWork.acceleration : NULL;
+    int uniform = pull == NULL || w->longRange.uniformGravity;
+    const sphSet *fluid = fluidActive(w) ? &w->fluid : NULL;
+    if (fluid != NULL) {
+        computeFluidForces(&w->fluid, &w->sph, a, &w->grid, w->radius);
+    }
+    // Per ball and independent, so any thread count gives the same result
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a->size; i++) {
+        if (uniform) {
+            integrateVelocity(&a->points[i], h);
+        }
+        if (pull != NULL) {
+            a->points[i].velocity.x += pull[i].x * h;
+            a->points[i].velocity.y += pull[i].y * h;
+        }
+        if (fluid != NULL && isFluid(fluid, i)) {
+            a->points[i].velocity.x += fluid->acceleration[i].x * h;
+            a->points[i].velocity.y += fluid->acceleration[i].y * h;
+        }
+    }
+    applyForceFields(&w->fields, a, h);
+}
+
+// Static and kinematic geometry after the balls moved to fraction t of the
+// step; balls NULL means all of them
+static void collideStatic(pointArray *a, const int *balls, int count, double t, void *userData) {
+    physicsWorld *w = (physicsWorld *)userData;
+    if (w->boundary.count > 0) {
+        collideSdf(a, balls, count, &w->boundary, &w->bakedBoundary, w->radius, w->solver.restitution);
+    }
+    if (w->segments.count > 0) {
+        if (!w->segments.built) {
+            double r = w->borderRadius;
+            buildSegmentGrid(&w->segments, -r, -r, r, r, w->grid.cellSize, w->radius);
+        }
+        collideSegments(a, balls, count, &w->segments, w->radius, w->solver.restitution);
+    }
+    if (w->kinematics.count > 0) {
+        // With balls NULL it only visits balls that have candidate pairs
+        collideKinematic(&w->kinematics, a, balls, count, t, w->radius, w->solver.restitution);
+    }
+}
+
+static void integrate(physicsWorld *w, double dt, int subSteps) {
+    pointArray *a = &w->points;
+    // verlet() only knows gravity, so the fields act as one kick up front
+    applyForceFields(&w->fields, a, dt);
+    for (int i = 0; i < a->size; i++) {
+        verlet(&a->points[i], dt, subSteps);
+        borderCollision(&a->points[i], w->radius);
+    }
+    collideStatic(a, NULL, a->size, 1.0, w);
+    a->revision++;
+}
+#endif // PHYSICS_FIXED_POINT
+
+// Deepest ball-to-ball overlap the last step left, in diameters: measured at
+// the final positions, since the detection-time depth of a resting pile is
+// mostly what the solver goes on to remove
+static double deepestOverlap(const physicsWorld *w) {
+    const pointArray *a = &w->points;
+    double deepest = 0.0;
+    for (int k = 0; k < w->contacts.count; k++) {
+        const contact *c = &w->contacts.items[k];
+        if (c->b == BORDER_CONTACT || c->a >= a->size || c->b >= a->size) {
+            continue;
+        }
+        vector2 p = a->points[c->a].position, q = a->points[c->b].position;
+        double dx = p.x - q.x - c->shift.x, dy = p.y - q.y - c->shift.y;
+        double depth = 2.0 * w->radius - sqrt(dx * dx + dy * dy);
+        deepest = depth > deepest ? depth : deepest;
+    }
+    return deepest / (2.0 * w->radius);
+}
+
+#define OVERLAP_RISE 1.0 // most substeps the overlap feedback adds in one step
+#define OVERLAP_FALL 0.25 // least it takes off, per substep it keeps
+#define OVERLAP_LAG 8.0  // steps a pile takes to show a change of count
+
+// CFL-style choice: enough substeps that the fastest ball, including what
+// gravity adds during the step, moves at most maxTravel radii per substep,
+// raised to what the overlap feedback asks for
+static int chooseSubSteps(physicsWorld *w, double dt, int maxSubSteps) {
+    const pointArray *a = &w->points;
+    double maxSpeed2 = 0.0;
+    #pragma omp parallel for schedule(static) reduction(max:maxSpeed2)
+    for (int i = 0; i < a->size; i++) {
+        double vx = a->points[i].velocity.x, vy = a->points[i].velocity.y;
+        double speed2 = vx * vx + vy * vy;
+        maxSpeed2 = speed2 > maxSpeed2 ? speed2 : maxSpeed2;
+    }
+    w->stats.maxSpeed = sqrt(maxSpeed2);
+    if (!w->substeps.adaptive) {
+        return maxSubSteps;
+    }
+
+    double travel = (w->stats.maxSpeed + GRAVITY * dt) * dt;
+    double n = ceil(travel / (w->substeps.maxTravel * w->radius));
+    if (w->substeps.maxOverlap > 0.0) {
+        // Nothing to go by before the first step, so that starts at the bound.
+        // A pile answers a lower count only several steps later, and once
+        // crushed stays deep long after the count is back up, so the rising
+        // overlap is projected OVERLAP_LAG steps ahead and the count moves a
+        // fraction at a time, holding still just under the target: sawing
+        // around it costs more substeps for the same overlap than one count.
+        double *need = &w->stats.overlapSubSteps;
+        if (*need <= 0.0) {
+            *need = maxSubSteps;
+            w->stats.overlap = deepestOverlap(w);
+        } else {
+            double overlap = deepestOverlap(w), rise = overlap - w->stats.overlap;
+            w->stats.overlap = overlap;
+            double ratio = (overlap + OVERLAP_LAG * fmax(rise, 0.0)) / w->substeps.maxOverlap;
+            if (ratio > 1.0) {
+                *need += fmin(ratio - 1.0, OVERLAP_RISE);
+            } else if (ratio < 0.75) {
+                *need -= fmax(OVERLAP_FALL, OVERLAP_FALL * *need * (1.0 - ratio / 0.75));
+            }
+            *need = fmax(1.0, fmin(*need, maxSubSteps));
+        }
+        double byOverlap = ceil(*need);
+        n = byOverlap > n ? byOverlap : n;
+    }
+    int lower = w->substeps.minSubSteps > 1 ? w->substeps.minSubSteps : 1;
+    n = n < lower ? lower : n;
+    // The caller's bound wins over minSubSteps
+    return n > maxSubSteps ? maxSubSteps : (int)n;
+}
+
+void stepWorld(physicsWorld *w, double dt, int subSteps) {
+    pointArray *a = &w->points;
+    if (w->emitters.count > 0) {
+        runEmitters(&w->emitters, a, &w->fluid, dt);
+    }
+#ifndef PHYSICS_FIXED_POINT
+    if (w->periodic && w->solver.mode != SOLVER_LEGACY) {
+        wrapPeriodic(w);
+    }
+    // Multi-rate levels may reach the caller's count, not just the adaptive one
+    int maxSubSteps = subSteps;
+#endif
+    subSteps = chooseSubSteps(w, dt, subSteps);
+    w->stats.ballSubSteps = (long long)subSteps * a->size;
+    w->stats.swept = 0;
+
+    // Last step's contacts become the reference for persistence
+    contactList previous = w->previousContacts;
+    w->previousContacts = w->contacts;
+    w->contacts = previous;
+    clearContactList(&w->contacts);
+    // Members of one body never collide with each other, nor do fluid balls
+    int fluid = fluidActive(w);
+    w->grid.pointGroup = w->rigid.ballBody;
+    w->grid.groupCount = w->rigid.numBalls;
+    if (fluid) {
+        w->grid.pointGroup = fluidGroups(&w->fluid, w->rigid.ballBody, w->rigid.numBalls, w->rigid.count, a->size);
+        w->grid.groupCount = w->grid.pointGroup == w->fluid.groups ? a->size : w->rigid.numBalls;
+    }
+
+#ifndef PHYSICS_FIXED_POINT
+    if (w->kinematics.count > 0) {
+        // Balls that can reach a body before the step ends: contact distance
+        // plus how far the fastest ball travels
+        double reach = w->radius + (w->stats.maxSpeed + GRAVITY * dt) * dt;
+        beginKinematicStep(&w->kinematics, &w->grid, a, dt, reach);
+    }
+#endif
+
+#ifdef PHYSICS_FIXED_POINT
+    // One integer pipeline, and nothing but balls in it (see fixedPointRefuses);
+    // the doubles only mirror it
+    importFixedPoints(&w->fixed, a);
+    stepFixed(&w->fixed, &w->grid, &w->contacts, dt, subSteps);
+    exportFixedPoints(&w->fixed, a);
+#else
+    switch (w->solver.mode) {
+    case SOLVER_ITERATIVE:
+    case SOLVER_JACOBI:
+    case SOLVER_COLORED:
+        // Contacts are found once per step with a margin and then solved after
+        // every substep, so the solver sees the pile at substep resolution
+        findContacts(a, &w->grid, &w->contacts, w->radius, w->borderRadius, w->solver.contactMargin * w->radius);
+        warmStartContacts(&w->contacts, &w->previousContacts, w->solver.warmStartFactor);
+        prepareContacts(a, &w->contacts, &w->solver);
+        // Contacts with a member are solved against its body, see rigid.h
+        splitRigidContacts(&w->rigid, &w->contacts);
+        if (w->longRange.mode != LONG_RANGE_NONE) {
+            computeLongRangeForces(&w->longRangeWork, &w->longRange, a);
+        }
+        if (w->substeps.multiRate && w->solver.mode == SOLVER_ITERATIVE && constraintCount(&w->constraints) == 0
+            && w->rigid.count == 0 && w->longRange.mode == LONG_RANGE_NONE && !fluid && !w->periodic) {
+            subSteps = assignRateLevels(&w->rates, a, &w->contacts, dt, w->substeps.maxTravel * w->radius,
+                                        w->substeps.minSubSteps, maxSubSteps);
+            solveMultiRate(&w->rates, a, &w->contacts, &w->solver, w->radius, w->borderRadius, dt, collideStatic, w);
+            w->stats.ballSubSteps = w->rates.ballSubSteps;
+            break;
+        }
+        // Uniform substeps leave impulses for their own length; forget the levels
+        w->rates.numPoints = 0;
+        if (w->solver.mode == SOLVER_JACOBI && w->solver.deterministic) {
+            buildContactAdjacency(&w->solverWork, &w->contacts, a->size);
+        } else if (w->solver.mode == SOLVER_COLORED) {
+            colorContacts(&w->solverWork, &w->contacts, a->size);
+        }
+        beginSweptStep(&w->ccd);
+        for (int s = 0; s < subSteps; s++) {
+            double h = dt / subSteps;
+            accelerate(w, a, h);
+            if (w->solver.mode == SOLVER_JACOBI) {
+                solveContactsJacobi(a, &w->contacts, &w->solver, &w->solverWork, w->radius, w->borderRadius, h);
+            } else if (w->solver.mode == SOLVER_COLORED) {
+                solveContactsColored(a, &w->contacts, &w->solver, &w->solverWork, w->radius, w->borderRadius, h);
+            } else {
+                solveContacts(a, &w->contacts, &w->solver, w->radius, w->borderRadius, h);
+            }
+            solveRigidContacts(&w->rigid, a, &w->solver, w->radius, w->borderRadius, h);
+            if (w->substeps.ccd && !w->periodic) {
+                w->stats.swept += integrateSwept(a, &w->grid, &w->ccd, w->radius, w->borderRadius,
+                                                 w->solver.restitution, w->substeps.ccdThreshold * w->radius / dt, h);
+            } else if (w->periodic) {
+                #pragma omp parallel for schedule(static)
+                for (int i = 0; i < a->size; i++) {
+                    integratePosition(&a->points[i], h);
+                }
+            } else {
+                #pragma omp parallel for schedule(static)
+                for (int i = 0; i < a->size; i++) {
+                    integratePosition(&a->points[i], h);
+                    clampToBorder(&a->points[i], w->radius, w->borderRadius);
+                }
+            }
+            solveConstraints(&w->constraints, a, h);
+            stepRigidBodies(&w->rigid, a, h);
+            collideStatic(a, NULL, a->size, (double)(s + 1) / subSteps, w);
+            a->revision++;
+        }
+        mergeRigidContacts(&w->rigid, &w->contacts);
+        break;
+    default:
+        integrate(w, dt, subSteps);
+        collisionDetection(a, &w->grid, &w->contacts, w->radius);
+        stepRigidBodies(&w->rigid, a, dt);
+        break;
+    }
+#endif
+    endKinematicStep(&w->kinematics);
+    emitContactEvents(&w->events, &w->previousContacts, &w->contacts);
+    w->stats.subSteps = subSteps;
+    w->stats.contacts = w->contacts.count;
+    w->step++;
+}
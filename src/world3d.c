@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "common/world3d.h"
+
+// Below this many spheres the threads cost more than they save
+#define PARALLEL_CONTACT3D_MIN 2048
+
+static void initContactList3d(contactList3d *c, int capacity) {
+    c->items = (contact3d *)malloc(capacity * sizeof(contact3d));
+    c->count = 0;
+    c->capacity = c->items != NULL ? capacity : 0;
+}
+
+static void freeContactList3d(contactList3d *c) {
+    free(c->items);
+    c->items = NULL;
+    c->count = 0;
+    c->capacity = 0;
+}
+
+void initWorld3d(world3d *w, int capacity, float radius, float borderRadius) {
+    w->spheres.spheres = (sphere *)malloc(capacity * sizeof(sphere));
+    w->spheres.size = 0;
+    w->spheres.capacity = w->spheres.spheres != NULL ? capacity : 0;
+    w->spheres.revision = 0;
+    initGrid3d(&w->grid, -borderRadius, borderRadius, 2.5 * radius);
+    initContactList3d(&w->contacts, capacity * 6);
+    initContactList3d(&w->previousContacts, capacity * 6);
+    defaultSolverSettings(&w->solver);
+    w->solver.mode = SOLVER_ITERATIVE;
+    w->contactsFound = 0;
+    w->radius = radius;
+    w->borderRadius = borderRadius;
+    w->step = 0;
+}
+
+void freeWorld3d(world3d *w) {
+    freeContactList3d(&w->previousContacts);
+    freeContactList3d(&w->contacts);
+    freeGrid(&w->grid);
+    free(w->spheres.spheres);
+    w->spheres.spheres = NULL;
+    w->spheres.size = 0;
+    w->spheres.capacity = 0;
+}
+
+int addSpheres(world3d *w, const sphere *spheres, int count) {
+    sphereArray *a = &w->spheres;
+    if (a->size + count > a->capacity) {
+        int capacity = a->capacity > 8 ? a->capacity : 16;
+        while (capacity < a->size + count) {
+            capacity *= 2;
+        }
+        sphere *grown = (sphere *)realloc(a->spheres, capacity * sizeof(sphere));
+        if (grown == NULL) {
+            fprintf(stderr, "Sphere realloc failure\n");
+            return -1;
+        }
+        a->spheres = grown;
+        a->capacity = capacity;
+    }
+    int first = a->size;
+    memcpy(a->spheres + first, spheres, count * sizeof(sphere));
+    a->size += count;
+    a->revision++;
+    return first;
+}
+
+int clampToBorder3d(sphere *s, float radius, float borderRadius) {
+    vector3 p = s->position;
+    double distance = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+    double reach = borderRadius - radius;
+    if (distance <= reach) {
+        return 0;
+    }
+    double nx = p.x / distance, ny = p.y / distance, nz = p.z / distance;
+    double outward = s->velocity.x * nx + s->velocity.y * ny + s->velocity.z * nz;
+    if (outward > 0.0) {
+        s->velocity.x -= outward * nx;
+        s->velocity.y -= outward * ny;
+        s->velocity.z -= outward * nz;
+    }
+    s->position = (vector3){reach * nx, reach * ny, reach * nz};
+    return 1;
+}
+
+static void buildGrid3d(spatialGrid *g, const sphereArray *a) {
+    if (!reserveGridPoints(g, a->size)) {
+        return;
+    }
+    for (int i = 0; i < a->size; i++) {
+        vector3 p = a->spheres[i].position;
+        g->pointCell[i] = (gridClampLayer(g, p.z) * g->rows + gridClampRow(g, p.y)) * g->cols + gridClampCol(g, p.x);
+    }
+    sortGridPoints(g, a->size);
+    g->revision = a->revision;
+    g->built = 1;
+}
+
+static void addContact3d(contactList3d *c, int a, int b, vector3 normal, double depth) {
+    if (c->count >= c->capacity) {
+        contact3d *items = (contact3d *)growContactItems(c->items, &c->capacity, c->count + 1, sizeof(contact3d));
+        if (items == NULL) {
+            return;
+        }
+        c->items = items;
+    }
+    contact3d item = {a, b, normal, depth, 0.0, {0.0, 0.0, 0.0}, 0.0};
+    insertSortedContact(c->items, c->count++, &item, sizeof(contact3d));
+}
+
+static void findContactsRange3d(const world3d *w, contactList3d *contacts, int first, int last, double margin) {
+    const sphereArray *a = &w->spheres;
+    const spatialGrid *g = &w->grid;
+    double radius = w->radius;
+    double reach = 2.0 * radius + margin;
+    reach = reach < g->cellSize ? reach : g->cellSize;
+    double wall = w->borderRadius - radius - margin;
+    int cols = g->cols, rows = g->rows, layers = g->layers;
+
+    for (int i = first; i < last; i++) {
+        vector3 p = a->spheres[i].position;
+        double r2 = p.x * p.x + p.y * p.y + p.z * p.z;
+        if (r2 > wall * wall) {
+            double distance = sqrt(r2);
+            addContact3d(contacts, i, BORDER_CONTACT, (vector3){-p.x / distance, -p.y / distance, -p.z / distance},
+                         distance - (w->borderRadius - radius));
+        }
+
+        int cell = g->pointCell[i];
+        int cx = cell % cols, cy = cell / cols % rows, cz = cell / (cols * rows);
+        int x0 = cx > 0 ? cx - 1 : 0, x1 = cx < cols - 1 ? cx + 1 : cx;
+        int y0 = cy > 0 ? cy - 1 : 0, y1 = cy < rows - 1 ? cy + 1 : cy;
+        int z0 = cz > 0 ? cz - 1 : 0, z1 = cz < layers - 1 ? cz + 1 : cz;
+        for (int z = z0; z <= z1; z++) {
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    int other = (z * rows + y) * cols + x;
+                    for (int k = g->cellStart[other]; k < g->cellStart[other + 1]; k++) {
+                        int j = g->cellPoints[k];
+                        if (j <= i) {
+                            continue;
+                        }
+                        vector3 q = a->spheres[j].position;
+                        double dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+                        double d2 = dx * dx + dy * dy + dz * dz;
+                        if (d2 >= reach * reach) {
+                            continue;
+                        }
+                        double distance = sqrt(d2);
+                        vector3 normal = distance > 0.0 ? (vector3){dx / distance, dy / distance, dz / distance}
+                                                        : (vector3){0.0, 1.0, 0.0};
+                        addContact3d(contacts, i, j, normal, 2.0 * radius - distance);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void findContacts3d(world3d *w, double margin) {
+    sphereArray *a = &w->spheres;
+    contactList3d *contacts = &w->contacts;
+    if (!w->grid.built || w->grid.revision != a->revision) {
+        buildGrid3d(&w->grid, a);
+    }
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+    if (threads == 1 || a->size < PARALLEL_CONTACT3D_MIN) {
+        findContactsRange3d(w, contacts, 0, a->size, margin);
+        return;
+    }
+
+    // Ranges joined in order, so the list is the serial one, as findContacts
+    contactList3d *parts = (contactList3d *)malloc(threads * sizeof(contactList3d));
+    if (parts == NULL) {
+        fprintf(stderr, "Contact list malloc failure\n");
+        return;
+    }
+    int base = contacts->count, total = 0;
+    #pragma omp parallel num_threads(threads)
+    {
+#ifdef _OPENMP
+        int t = omp_get_thread_num(), n = omp_get_num_threads();
+#else
+        int t = 0, n = 1;
+#endif
+        int first = (int)((long long)a->size * t / n);
+        int last = (int)((long long)a->size * (t + 1) / n);
+        initContactList3d(&parts[t], contacts->capacity / n + 64);
+        findContactsRange3d(w, &parts[t], first, last, margin);
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            for (int k = 0; k < n; k++) {
+                total += parts[k].count;
+            }
+            if (base + total > contacts->capacity) {
+                contact3d *items = (contact3d *)growContactItems(contacts->items, &contacts->capacity, base + total, sizeof(contact3d));
+                if (items != NULL) {
+                    contacts->items = items;
+                } else {
+                    total = 0;
+                }
+            }
+        }
+
+        if (total > 0) {
+            int offset = base;
+            for (int k = 0; k < t; k++) {
+                offset += parts[k].count;
+            }
+            memcpy(contacts->items + offset, parts[t].items, parts[t].count * sizeof(contact3d));
+        }
+        #pragma omp barrier
+        freeContactList3d(&parts[t]);
+    }
+    contacts->count = base + total;
+    free(parts);
+}
+
+static void warmStartContacts3d(contactList3d *current, const contactList3d *previous, double factor) {
+    int i = 0, j = 0;
+    while (nextCommonContact(previous->items, previous->count, current->items, current->count, sizeof(contact3d), &i, &j)) {
+        vector3 t = previous->items[i].tangentImpulse;
+        current->items[j].impulse = previous->items[i].impulse * factor;
+        current->items[j].tangentImpulse = (vector3){t.x * factor, t.y * factor, t.z * factor};
+        i++;
+        j++;
+    }
+}
+
+static vector3 relativeVelocity3d(const sphereArray *a, const contact3d *c) {
+    vector3 v = a->spheres[c->a].velocity;
+    if (c->b != BORDER_CONTACT) {
+        v.x -= a->spheres[c->b].velocity.x;
+        v.y -= a->spheres[c->b].velocity.y;
+        v.z -= a->spheres[c->b].velocity.z;
+    }
+    return v;
+}
+
+static void applyImpulse3d(sphereArray *a, const contact3d *c, vector3 p) {
+    a->spheres[c->a].velocity.x += p.x;
+    a->spheres[c->a].velocity.y += p.y;
+    a->spheres[c->a].velocity.z += p.z;
+    if (c->b != BORDER_CONTACT) {
+        a->spheres[c->b].velocity.x -= p.x;
+        a->spheres[c->b].velocity.y -= p.y;
+        a->spheres[c->b].velocity.z -= p.z;
+    }
+}
+
+static void updateContactGeometry3d(const world3d *w, contact3d *c) {
+    vector3 p = w->spheres.spheres[c->a].position;
+    if (c->b == BORDER_CONTACT) {
+        double distance = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (distance > 0.0) {
+            c->normal = (vector3){-p.x / distance, -p.y / distance, -p.z / distance};
+        }
+        c->depth = distance - (w->borderRadius - w->radius);
+        return;
+    }
+    vector3 q = w->spheres.spheres[c->b].position;
+    double dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+    double distance = sqrt(dx * dx + dy * dy + dz * dz);
+    if (distance > 0.0) {
+        c->normal = (vector3){dx / distance, dy / distance, dz / distance};
+    }
+    c->depth = 2.0 * w->radius - distance;
+}
+
+static void prepareContacts3d(world3d *w) {
+    const solverSettings *s = &w->solver;
+    for (int k = 0; k < w->contacts.count; k++) {
+        contact3d *c = &w->contacts.items[k];
+        vector3 v = relativeVelocity3d(&w->spheres, c);
+        c->bounce = bounceSpeed(s, v.x * c->normal.x + v.y * c->normal.y + v.z * c->normal.z);
+        if (!s->warmStart) {
+            c->impulse = 0.0;
+            c->tangentImpulse = (vector3){0.0, 0.0, 0.0};
+        }
+    }
+}
+
+// solveContactVelocity with the friction impulse a vector in the contact
+// plane, bounded by the cone's circle instead of an interval
+static void solveContactVelocity3d(sphereArray *a, contact3d *c, const solverSettings *s, double h) {
+    vector3 v = relativeVelocity3d(a, c);
+    vector3 n = c->normal;
+    double effectiveMass = contactMass(c->b);
+
+    double vn = v.x * n.x + v.y * n.y + v.z * n.z;
+    double jn = solveNormalImpulse(c->impulse, vn, contactTarget(c->depth, c->bounce, h), effectiveMass);
+    double dn = jn - c->impulse;
+    c->impulse = jn;
+
+    vector3 vt = {v.x - vn * n.x, v.y - vn * n.y, v.z - vn * n.z};
+    vector3 old = c->tangentImpulse;
+    vector3 jt = {old.x - vt.x * effectiveMass, old.y - vt.y * effectiveMass, old.z - vt.z * effectiveMass};
+    double limit = frictionLimit(s, c->impulse);
+    double length2 = jt.x * jt.x + jt.y * jt.y + jt.z * jt.z;
+    if (length2 > limit * limit) {
+        double scale = limit / sqrt(length2);
+        jt = (vector3){jt.x * scale, jt.y * scale, jt.z * scale};
+    }
+    c->tangentImpulse = jt;
+
+    applyImpulse3d(a, c, (vector3){n.x * dn + jt.x - old.x, n.y * dn + jt.y - old.y, n.z * dn + jt.z - old.z});
+}
+
+static void solveContactPosition3d(world3d *w, contact3d *c) {
+    const solverSettings *s = &w->solver;
+    updateContactGeometry3d(w, c);
+    if (c->depth <= s->slop) {
+        return;
+    }
+    double push = positionPush(s, c->depth) * contactMass(c->b);
+    vector3 *p = &w->spheres.spheres[c->a].position;
+    p->x += c->normal.x * push;
+    p->y += c->normal.y * push;
+    p->z += c->normal.z * push;
+    if (c->b == BORDER_CONTACT) {
+        return;
+    }
+    vector3 *q = &w->spheres.spheres[c->b].position;
+    q->x -= c->normal.x * push;
+    q->y -= c->normal.y * push;
+    q->z -= c->normal.z * push;
+}
+
+static void solveContacts3d(world3d *w, double h) {
+    sphereArray *a = &w->spheres;
+    const solverSettings *s = &w->solver;
+    contactList3d *contacts = &w->contacts;
+    for (int k = 0; k < contacts->count; k++) {
+        contact3d *c = &contacts->items[k];
+        updateContactGeometry3d(w, c);
+        // Warm-started friction may lie partly along the refreshed normal
+        vector3 n = c->normal, t = c->tangentImpulse;
+        double along = t.x * n.x + t.y * n.y + t.z * n.z;
+        c->tangentImpulse = (vector3){t.x - along * n.x, t.y - along * n.y, t.z - along * n.z};
+        t = c->tangentImpulse;
+        applyImpulse3d(a, c, (vector3){n.x * c->impulse + t.x, n.y * c->impulse + t.y, n.z * c->impulse + t.z});
+    }
+    for (int it = 0; it < s->iterations; it++) {
+        for (int k = 0; k < contacts->count; k++) {
+            solveContactVelocity3d(a, &contacts->items[k], s, h);
+        }
+    }
+    for (int it = 0; it < s->positionIterations; it++) {
+        for (int k = 0; k < contacts->count; k++) {
+            solveContactPosition3d(w, &contacts->items[k]);
+        }
+    }
+    a->revision++;
+}
+
+int stepWorld3d(world3d *w, double dt, int subSteps) {
+    sphereArray *a = &w->spheres;
+    if (w->solver.mode != SOLVER_ITERATIVE) {
+        fprintf(stderr, "world3d only supports SOLVER_ITERATIVE\n");
+        return -1;
+    }
+
+    contactList3d previous = w->previousContacts;
+    w->previousContacts = w->contacts;
+    w->contacts = previous;
+    w->contacts.count = 0;
+    findContacts3d(w, w->solver.contactMargin * w->radius);
+    if (w->solver.warmStart) {
+        warmStartContacts3d(&w->contacts, &w->previousContacts, w->solver.warmStartFactor);
+    }
+    prepareContacts3d(w);
+
+    for (int s = 0; s < subSteps; s++) {
+        double h = dt / subSteps;
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < a->size; i++) {
+            a->spheres[i].velocity.y -= GRAVITY * h;
+        }
+        solveContacts3d(w, h);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < a->size; i++) {
+            sphere *p = &a->spheres[i];
+            p->position.x += p->velocity.x * h;
+            p->position.y += p->velocity.y * h;
+            p->position.z += p->velocity.z * h;
+            clampToBorder3d(p, w->radius, w->borderRadius);
+        }
+        a->revision++;
+    }
+    w->contactsFound = w->contacts.count;
+    w->step++;
+    return 0;
+}